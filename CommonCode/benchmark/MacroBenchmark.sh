@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# End-to-end timing of the HistogramFiller and MatchEEC event loops on a fixed sample
+#    Each program is run Repeat times on the same input and fraction; the wall time, CPU time and
+#    peak memory of every run go to the JSON file.  Build both programs first (make in their folders);
+#    the reduced sample is the output of "make TestRun" in MainAnalysis/20240312_ReducedFormat.
+#    A run that fails, or whose timing cannot be read, is recorded as FAILED with the tail of its log
+#    printed, and the script exits with status 1.
+#
+#    ./MacroBenchmark.sh [Output.json] [Repeat]
+#    Sample, ReducedSample and Fraction can be overridden from the environment.
+
+Output=${1:-MacroBenchmark.json}
+Repeat=${2:-3}
+Sample=${Sample:-$ProjectBase/Samples/ALEPHMC/LEP1MC1994_recons_aftercut-014.root}
+ReducedSample=${ReducedSample:-$ProjectBase/MainAnalysis/20240312_ReducedFormat/Output/TestLEP1MC_1994_014_Reco.root}
+Fraction=${Fraction:-0.1}
+
+Work=$(mktemp -d)
+trap "rm -rf $Work" EXIT
+
+Results=()
+Failures=0
+
+# Name, directory, then the arguments
+Measure()
+{
+   Name=$1
+   Directory=$2
+   shift 2
+
+   if [ ! -x "$Directory/Execute" ]
+   then
+      echo "Skipping $Name, $Directory/Execute is not built" >&2
+      return
+   fi
+
+   for i in $(seq 1 $Repeat)
+   do
+      echo "$Name, run $i of $Repeat"
+      rm -f $Work/Time
+      if [ -x /usr/bin/time ]
+      then
+         (cd $Work && /usr/bin/time -f "%e %U %M" -o $Work/Time "$Directory/Execute" "$@" > $Work/Log 2>&1)
+         Status=$?
+         # on failure time writes "Command exited with non-zero status" before the numbers
+         read Wall CPU RSS < <(tail -n 1 $Work/Time 2> /dev/null)
+      else
+         Start=$(date +%s.%N)
+         (cd $Work && "$Directory/Execute" "$@" > $Work/Log 2>&1)
+         Status=$?
+         Wall=$(awk "BEGIN {print $(date +%s.%N) - $Start}")
+         CPU=-1
+         RSS=-1
+      fi
+
+      Number='^-?[0-9]+([.][0-9]+)?$'
+      if [ $Status -ne 0 ] || ! [[ "$Wall" =~ $Number && "$CPU" =~ $Number && "$RSS" =~ $Number ]]
+      then
+         echo "$Name, run $i FAILED (exit status $Status, timing \"$Wall $CPU $RSS\"), last lines of the log:" >&2
+         tail -n 20 $Work/Log >&2
+         Results+=("{\"name\": \"$Name\", \"run\": $i, \"fraction\": $Fraction, \"status\": \"FAILED\", \"exit_code\": $Status}")
+         Failures=$((Failures + 1))
+         continue
+      fi
+      Results+=("{\"name\": \"$Name\", \"run\": $i, \"fraction\": $Fraction, \"status\": \"OK\", \"wall_s\": $Wall, \"cpu_s\": $CPU, \"max_rss_kb\": $RSS}")
+   done
+}
+
+Measure HistogramFiller $ProjectBase/MainAnalysis/20240313_SimpleHistogramFiller \
+   --Input "$ReducedSample" --Output $Work/HistogramFiller.root --Fraction $Fraction
+Measure MatchEEC $ProjectBase/Unfolding/20240328_Unfolding \
+   --Input "$Sample" --Output $Work/MatchEEC.root --Gen tgen --Reco t --Fraction $Fraction
+
+{
+   echo "{"
+   echo "   \"suite\": \"macro\","
+   echo "   \"host\": \"$(hostname)\","
+   echo "   \"time\": \"$(date +%Y-%m-%dT%H:%M:%S)\","
+   echo "   \"sample\": \"$Sample\","
+   echo "   \"reduced_sample\": \"$ReducedSample\","
+   echo "   \"results\":"
+   echo "   ["
+   for i in "${!Results[@]}"
+   do
+      Separator=","
+      [ $((i + 1)) -eq ${#Results[@]} ] && Separator=""
+      echo "      ${Results[$i]}$Separator"
+   done
+   echo "   ]"
+   echo "}"
+} > $Output
+
+echo "Wrote ${#Results[@]} results to $Output"
+if [ $Failures -gt 0 ]
+then
+   echo "$Failures runs FAILED" >&2
+   exit 1
+fi
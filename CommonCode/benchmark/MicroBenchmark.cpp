@@ -0,0 +1,326 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+using namespace std;
+
+#include <unistd.h>
+
+#include "CommandLine.h"
+#include "TauHelperFunctions3.h"
+#include "DrawRandom.h"
+#include "CATree.h"
+#include "Matching.h"
+#include "JetCorrector.h"
+#include "alephTrkEfficiency.h"
+#include "EECKernels.h"
+
+// Micro-benchmarks of the CommonCode hot paths at the sizes the analyses run at
+//    Every benchmark times one call on a pre-generated, fixed set of inputs (seeded, so two runs see the
+//    same events).  A measurement repeats the calls until --MinTime seconds have passed, and --Repeat
+//    measurements are taken; the JSON keeps the best, the median and the spread in ns per call.
+//
+//    ./MicroBenchmark --Output MicroBenchmark.json --Filter Hungarian --Sizes 10,50,150
+
+struct BenchmarkResult
+{
+   string Name;
+   int Size;
+   long long Calls;
+   double Best;     // ns per call
+   double Median;
+   double Spread;   // (max - min) / median
+};
+
+struct BenchmarkEvent
+{
+   vector<FourVector> Particles;
+   vector<FourVector> Smeared;   // the same particles with a small smearing, as the "reco" side
+};
+
+class BenchmarkRunner
+{
+public:
+   double MinTime;
+   int Repeat;
+   string Filter;
+   vector<BenchmarkResult> Results;
+   double Sink;   // everything a benchmark computes ends up here, so nothing is optimized away
+public:
+   BenchmarkRunner(double mintime, int repeat, string filter)
+      : MinTime(mintime), Repeat(repeat), Filter(filter), Sink(0) {}
+   bool Wanted(string Name) {return Filter == "" || Name.find(Filter) != string::npos;}
+   void Run(string Name, int Size, int InputCount, function<double(int)> Call);
+};
+
+vector<BenchmarkEvent> GenerateEvents(int Count, int Multiplicity);
+string GetTimeStamp();
+void WriteJSON(string FileName, CommandLine &CL, BenchmarkRunner &Runner);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   string OutputFileName  = CL.Get("Output", "MicroBenchmark.json");
+   double MinTime         = CL.GetDouble("MinTime", 0.2);
+   int Repeat             = CL.GetInt("Repeat", 5);
+   string Filter          = CL.Get("Filter", "");
+   vector<string> Sizes   = CL.GetStringVector("Sizes", vector<string>{"10", "50", "150"});
+   int EventCount         = CL.GetInt("Events", 100);
+   string ProjectBase     = (getenv("ProjectBase") != nullptr) ? getenv("ProjectBase") : "";
+   string JECFileName     = CL.Get("JEC", ProjectBase + "/JetCalibration/26221_MCCalibration/JECR4.txt");
+
+   srand(31415);
+
+   BenchmarkRunner Runner(MinTime, Repeat, Filter);
+
+   // theta and z axes as in the analyses: 2 x 100 bins, double log
+   const int BinCount = 100;
+   double Bins[2*BinCount+1];
+   double zBins[2*BinCount+1];
+   double BinMin = 0.002, BinMax = M_PI / 2;
+   double zBinMin = (1 - cos(0.002)) / 2, zBinMax = 0.5;
+   for(int i = 0; i <= BinCount; i++)
+   {
+      Bins[i] = exp(log(BinMin) + (log(BinMax) - log(BinMin)) / BinCount * i);
+      Bins[2*BinCount-i] = BinMax * 2 - exp(log(BinMin) + (log(BinMax) - log(BinMin)) / BinCount * i);
+      zBins[i] = exp(log(zBinMin) + (log(zBinMax) - log(zBinMin)) / BinCount * i);
+      zBins[2*BinCount-i] = zBinMax * 2 - exp(log(zBinMin) + (log(zBinMax) - log(zBinMin)) / BinCount * i);
+   }
+
+   // angles spread over the whole axis, log-uniform towards both ends like the EEC pairs
+   vector<double> Angles(4096), Zs(4096);
+   for(int i = 0; i < (int)Angles.size(); i++)
+   {
+      double X = exp(DrawRandom(log(BinMin / 2), log(BinMax)));
+      Angles[i] = (DrawRandom() < 0.5) ? X : M_PI - X;
+      Zs[i] = (1 - cos(Angles[i])) / 2;
+   }
+
+   // the legacy linear search and the binary search of EECKernels.h that replaces it with --FastKernels
+   if(Runner.Wanted("FindBinTheta"))
+   {
+      Runner.Run("FindBinThetaLinear", 2 * BinCount, Angles.size(),
+         [&](int i) {return FindBinLinear(Angles[i], 2 * BinCount, Bins);});
+      Runner.Run("FindBinThetaSorted", 2 * BinCount, Angles.size(),
+         [&](int i) {return FindBinSorted(Angles[i], 2 * BinCount, Bins);});
+   }
+   if(Runner.Wanted("FindBinZ"))
+   {
+      Runner.Run("FindBinZLinear", 2 * BinCount, Zs.size(),
+         [&](int i) {return FindBinLinear(Zs[i], 2 * BinCount, zBins);});
+      Runner.Run("FindBinZSorted", 2 * BinCount, Zs.size(),
+         [&](int i) {return FindBinSorted(Zs[i], 2 * BinCount, zBins);});
+   }
+
+   for(string SizeString : Sizes)
+   {
+      int Size = atoi(SizeString.c_str());
+      if(Size < 2 || Size > HungarianMAX)
+      {
+         cerr << "Skipping size " << SizeString << ", it should be between 2 and " << HungarianMAX << endl;
+         continue;
+      }
+
+      vector<BenchmarkEvent> Events = GenerateEvents(EventCount, Size);
+
+      // all pairs of one event, the inner loop of every EEC filler
+      if(Runner.Wanted("GetAngle"))
+         Runner.Run("GetAnglePairs", Size, Events.size(), [&](int i)
+         {
+            const vector<FourVector> &P = Events[i].Particles;
+            double Sum = 0;
+            for(int i1 = 0; i1 < Size; i1++)
+               for(int i2 = i1 + 1; i2 < Size; i2++)
+                  Sum = Sum + GetAngle(P[i1], P[i2]);
+            return Sum;
+         });
+
+      if(Runner.Wanted("MatchJetsHungarian"))
+         Runner.Run("MatchJetsHungarian", Size, Events.size(), [&](int i)
+         {
+            auto Metric = [](const FourVector &A, const FourVector &B) {return GetAngle(A, B);};
+            map<int, int> Matching = MatchJetsHungarian(Metric, Events[i].Particles, Events[i].Smeared);
+            return (double)Matching.size();
+         });
+
+      if(Runner.Wanted("BuildCATree2"))
+         Runner.Run("BuildCATree2", Size, Events.size(), [&](int i)
+         {
+            vector<Node *> Nodes;
+            for(FourVector &P : Events[i].Particles)
+               Nodes.push_back(new Node(P));
+            BuildCATree2(Nodes);
+            double Result = (Nodes.size() > 0) ? Nodes[0]->N : 0;
+            for(Node *N : Nodes)
+               delete N;
+            return Result;
+         });
+   }
+
+   // per-jet and per-track corrections: one call each, on the particles of the largest events
+   vector<BenchmarkEvent> Events = GenerateEvents(EventCount, 50);
+   vector<FourVector> Objects;
+   for(BenchmarkEvent &E : Events)
+      Objects.insert(Objects.end(), E.Particles.begin(), E.Particles.end());
+
+   if(Runner.Wanted("JetCorrector"))
+   {
+      if(ifstream(JECFileName.c_str()).good() == false)
+         cerr << "Skipping JetCorrector, cannot read " << JECFileName << " (set --JEC)" << endl;
+      else
+      {
+         JetCorrector JEC(JECFileName);
+         Runner.Run("JetCorrectorGetCorrection", 1, Objects.size(), [&](int i)
+         {
+            FourVector &P = Objects[i];
+            JEC.SetJetE(P[0] * 10);
+            JEC.SetJetP(P.GetP() * 10);
+            JEC.SetJetPT(P.GetPT() * 10);
+            JEC.SetJetTheta(P.GetTheta());
+            JEC.SetJetPhi(P.GetPhi());
+            JEC.SetJetEta(P.GetEta());
+            return JEC.GetCorrection();
+         });
+      }
+   }
+
+   if(Runner.Wanted("alephTrkEfficiency"))
+   {
+      if(ProjectBase == "")
+         cerr << "Skipping alephTrkEfficiency, ProjectBase is not set" << endl;
+      else
+      {
+         alephTrkEfficiency Efficiency;
+         Runner.Run("alephTrkEfficiency", 1, Objects.size(), [&](int i)
+         {
+            FourVector &P = Objects[i];
+            return (double)Efficiency.efficiency(P.GetTheta(), P.GetPhi(), P.GetPT(), 20 + i % 30);
+         });
+
+         // the flattened copy MatchEEC uses with --FastKernels
+         EfficiencyTable FastEfficiency(Efficiency._heff);
+         if(FastEfficiency.IsValid() == true)
+            Runner.Run("EfficiencyTable", 1, Objects.size(), [&](int i)
+            {
+               FourVector &P = Objects[i];
+               return (double)FastEfficiency.Efficiency(P.GetTheta(), P.GetPhi(), P.GetPT(), 20 + i % 30);
+            });
+      }
+   }
+
+   WriteJSON(OutputFileName, CL, Runner);
+
+   return 0;
+}
+
+void BenchmarkRunner::Run(string Name, int Size, int InputCount, function<double(int)> Call)
+{
+   if(InputCount <= 0)
+      return;
+
+   // warm up and find how many calls fill MinTime
+   long long Calls = 1;
+   while(true)
+   {
+      auto Start = chrono::steady_clock::now();
+      for(long long i = 0; i < Calls; i++)
+         Sink = Sink + Call(i % InputCount);
+      double Elapsed = chrono::duration<double>(chrono::steady_clock::now() - Start).count();
+      if(Elapsed >= MinTime || Calls > (1LL << 40))
+         break;
+      Calls = (Elapsed > MinTime / 100) ? (long long)(Calls * MinTime / Elapsed * 1.1) + 1 : Calls * 10;
+   }
+
+   vector<double> PerCall;
+   for(int iR = 0; iR < max(Repeat, 1); iR++)
+   {
+      auto Start = chrono::steady_clock::now();
+      for(long long i = 0; i < Calls; i++)
+         Sink = Sink + Call(i % InputCount);
+      double Elapsed = chrono::duration<double>(chrono::steady_clock::now() - Start).count();
+      PerCall.push_back(Elapsed / Calls * 1e9);
+   }
+   sort(PerCall.begin(), PerCall.end());
+
+   BenchmarkResult Result;
+   Result.Name = Name;
+   Result.Size = Size;
+   Result.Calls = Calls;
+   Result.Best = PerCall[0];
+   Result.Median = PerCall[PerCall.size() / 2];
+   Result.Spread = (Result.Median > 0) ? (PerCall.back() - PerCall[0]) / Result.Median : 0;
+   Results.push_back(Result);
+
+   cout << setw(28) << left << Name << " size " << setw(5) << Size << right
+      << " best " << setw(12) << fixed << setprecision(1) << Result.Best << " ns"
+      << "  median " << setw(12) << Result.Median << " ns"
+      << "  spread " << setprecision(3) << Result.Spread << defaultfloat << endl;
+}
+
+// isotropic-ish events with a falling momentum spectrum; the smeared copy is shuffled by a small amount
+vector<BenchmarkEvent> GenerateEvents(int Count, int Multiplicity)
+{
+   vector<BenchmarkEvent> Events(Count);
+   for(BenchmarkEvent &E : Events)
+   {
+      for(int i = 0; i < Multiplicity; i++)
+      {
+         FourVector P, S;
+         double Size = DrawExponential(-0.2, 0.2, 45);
+         double Theta = DrawSine(0.35, M_PI - 0.35);
+         double Phi = DrawRandom(-M_PI, M_PI);
+         P.SetSizeThetaPhi(Size, Theta, Phi);
+         S.SetSizeThetaPhi(Size * DrawGaussian(1, 0.05), Theta + DrawGaussian(0.005), Phi + DrawGaussian(0.005));
+         E.Particles.push_back(P);
+         E.Smeared.push_back(S);
+      }
+   }
+   return Events;
+}
+
+string GetTimeStamp()
+{
+   char Buffer[64] = "";
+   time_t Now = time(nullptr);
+   strftime(Buffer, 64, "%Y-%m-%dT%H:%M:%S", localtime(&Now));
+   return Buffer;
+}
+
+void WriteJSON(string FileName, CommandLine &CL, BenchmarkRunner &Runner)
+{
+   char HostName[256] = "";
+   gethostname(HostName, 255);
+
+   ofstream out(FileName.c_str());
+   out << "{" << endl;
+   out << "   \"suite\": \"micro\"," << endl;
+   out << "   \"host\": \"" << HostName << "\"," << endl;
+   out << "   \"time\": \"" << GetTimeStamp() << "\"," << endl;
+   out << "   \"min_time\": " << Runner.MinTime << "," << endl;
+   out << "   \"repeat\": " << Runner.Repeat << "," << endl;
+   out << "   \"results\":" << endl;
+   out << "   [" << endl;
+   for(int i = 0; i < (int)Runner.Results.size(); i++)
+   {
+      BenchmarkResult &R = Runner.Results[i];
+      out << "      {\"name\": \"" << R.Name << "\", \"size\": " << R.Size << ", \"calls\": " << R.Calls
+         << ", \"best_ns\": " << R.Best << ", \"median_ns\": " << R.Median << ", \"spread\": " << R.Spread << "}"
+         << ((i + 1 < (int)Runner.Results.size()) ? "," : "") << endl;
+   }
+   out << "   ]" << endl;
+   out << "}" << endl;
+   out.close();
+
+   cout << "Wrote " << Runner.Results.size() << " results to " << FileName
+      << " (checksum " << Runner.Sink << ")" << endl;
+}
@@ -0,0 +1,599 @@
+#ifndef ASYNCTREEWRITER_H_11235
+#define ASYNCTREEWRITER_H_11235
+
+// Asynchronous tree writer
+//    The event loop registers its branch buffers once and calls Fill() as it would on a TTree.
+//    Fill() only snapshots the buffers into a bounded queue; a background thread copies each
+//    snapshot into its own tree and does the real TTree::Fill, so basket compression runs off
+//    the event-loop thread.  Several writers (one per tree) feed the same AsyncOutputFile.
+//
+//    Each branch holds a single leaf, described by the usual leaf list ("X/D", "X[N]/D", "X[N][6]/F").
+//    Variable-size branches must have their counter registered before them.  Float16_t ("/f[...]")
+//    and Double32_t ("/d[...]") leaves are filled from float and double buffers (see Quantization.h).
+//
+//    The output file is either a classic TTree file, filled through a ROOT::TBufferMerger, or an
+//    RNTuple file (--Format RNTuple, ROOT 6.36 or newer, link with -lROOTNTuple).  In an RNTuple every
+//    branch becomes a field of the same name: scalars stay scalars, arrays become std::vector fields
+//    (multi-dimensional leaves are flattened), and the counters are kept as ordinary int fields.
+//    Float16_t and Double32_t leaves are stored there as float and double at full precision.
+//    Include CommandLine.h before this file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include "RVersion.h"
+#include "ROOT/TBufferMerger.hxx"
+
+#include "Timeline.h"
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+#define ASYNC_TREE_WRITER_RNTUPLE
+#include "ROOT/RNTupleModel.hxx"
+#include "ROOT/RNTupleWriter.hxx"
+#include "ROOT/RNTupleWriteOptions.hxx"
+#include "ROOT/REntry.hxx"
+#include "ROOT/RField.hxx"
+#endif
+
+struct AsyncTreeWriterOptions
+{
+   int Compression;          // ROOT compression setting (100 * algorithm + level), negative = file default
+   int BasketSize;           // bytes per branch basket, non-positive = ROOT default
+   int QueueDepth;           // number of entries allowed to wait for the writer thread
+   long long FlushEntries;   // entries between hand-overs to the merger, non-positive = only at the end
+};
+
+int ParseCompressionSetting(std::string Setting);
+AsyncTreeWriterOptions GetAsyncTreeWriterOptions(CommandLine &CL, std::string Name);
+std::string GetNTupleTypeName(char Type);
+
+// The file shared by the writers of one output: a TBufferMerger for TTrees, or a plain TFile for
+//    RNTuples, which the writer threads take turns on through Mutex
+class AsyncOutputFile
+{
+public:
+   std::string FileName;
+   std::string Format;   // "TTree" or "RNTuple"
+   ROOT::TBufferMerger *Merger;
+   TFile *File;
+   std::mutex Mutex;
+public:
+   AsyncOutputFile(std::string filename, std::string mode = "RECREATE", std::string format = "TTree");
+   ~AsyncOutputFile();
+   bool IsRNTuple() {return Format == "RNTuple";}
+   void Close();
+};
+
+class AsyncTreeWriter
+{
+private:
+   struct BranchRecord
+   {
+      std::string Name;
+      std::string LeafList;
+      char *Source;              // the caller's buffer
+      char Type;                 // leaf type code
+      int TypeSize;
+      int FixedCount;            // product of the numeric dimensions
+      int Counter;               // index of the counter branch, -1 if the size is fixed
+      std::vector<char> Buffer;  // writer-thread copy, the tree reads from here
+   };
+private:
+   std::string Name;
+   std::string Title;
+   AsyncOutputFile *Output;
+   AsyncTreeWriterOptions Options;
+   std::vector<BranchRecord> Branches;
+   std::deque<std::vector<char>> Queue;
+   std::mutex Mutex;
+   std::condition_variable NotEmpty;
+   std::condition_variable NotFull;
+   std::thread Worker;
+   bool Started;
+   bool Done;
+public:
+   long long EntriesFilled;   // entries written by the worker
+   long long BytesIn;         // uncompressed bytes handed to the worker
+   long long BytesZip;        // compressed bytes produced by the worker
+   double FillTime;           // worker time in TTree::Fill and hand-over to the merger, in seconds
+   double WaitTime;           // event-loop time spent waiting on a full queue, in seconds
+private:
+   int GetCount(const BranchRecord &B, bool WriterSide);
+   bool Pop(std::vector<char> &Entry);
+   bool Unpack(const std::vector<char> &Entry);
+   TTree *MakeTree();
+   void SetNTupleValue(BranchRecord &B, void *Value);
+   void Run();
+   void RunTree();
+   void RunNTuple();
+public:
+   AsyncTreeWriter(AsyncOutputFile &output, std::string name, std::string title, AsyncTreeWriterOptions options);
+   ~AsyncTreeWriter();
+   void Branch(std::string name, void *address, std::string leaflist);
+   void Fill();
+   void Finish();
+   void PrintStatistics(std::ostream &out);
+};
+
+int ParseCompressionSetting(std::string Setting)
+{
+   if(Setting == "" || Setting == "Default")
+      return -1;
+
+   std::string Algorithm = Setting;
+   int Level = -1;
+   std::size_t Colon = Setting.find(':');
+   if(Colon != std::string::npos)
+   {
+      Algorithm = Setting.substr(0, Colon);
+      Level = atoi(Setting.substr(Colon + 1).c_str());
+   }
+
+   if(Algorithm.find_first_not_of("0123456789") == std::string::npos)
+      return atoi(Algorithm.c_str());
+
+   int Code = -1;
+   if(Algorithm == "ZLIB")   Code = 1;
+   if(Algorithm == "LZMA")   Code = 2;
+   if(Algorithm == "LZ4")    Code = 4;
+   if(Algorithm == "ZSTD")   Code = 5;
+   if(Code < 0)
+   {
+      std::cerr << "Unknown compression algorithm " << Algorithm << ", using file default" << std::endl;
+      return -1;
+   }
+
+   if(Level < 0)
+      Level = (Code == 2) ? 8 : ((Code == 4) ? 4 : 5);
+   return Code * 100 + Level;
+}
+
+// --<Name>Compression / --<Name>BasketSize override the global --Compression / --BasketSize
+AsyncTreeWriterOptions GetAsyncTreeWriterOptions(CommandLine &CL, std::string Name)
+{
+   AsyncTreeWriterOptions Options;
+   Options.Compression  = ParseCompressionSetting(CL.Get(Name + "Compression", CL.Get("Compression", "Default")));
+   Options.BasketSize   = CL.GetInt(Name + "BasketSize", CL.GetInt("BasketSize", -1));
+   Options.QueueDepth   = CL.GetInt("WriterQueue", 256);
+   Options.FlushEntries = CL.GetInt("WriterFlush", 50000);
+   if(Options.QueueDepth < 1)
+      Options.QueueDepth = 1;
+   return Options;
+}
+
+std::string GetNTupleTypeName(char Type)
+{
+   switch(Type)
+   {
+      case 'B':   return "std::int8_t";
+      case 'b':   return "std::uint8_t";
+      case 'O':   return "bool";
+      case 'S':   return "std::int16_t";
+      case 's':   return "std::uint16_t";
+      case 'I':   return "std::int32_t";
+      case 'i':   return "std::uint32_t";
+      case 'F':   return "float";
+      case 'f':   return "float";
+      case 'D':   return "double";
+      case 'd':   return "double";
+      case 'L':   return "std::int64_t";
+      case 'l':   return "std::uint64_t";
+   }
+   return "";
+}
+
+template <class T>
+void SetNTupleValue(void *Value, const char *Data, int Count, bool Collection)
+{
+   if(Collection == false)
+      *(T *)Value = *(const T *)Data;
+   else
+      ((std::vector<T> *)Value)->assign((const T *)Data, (const T *)Data + Count);
+}
+
+AsyncOutputFile::AsyncOutputFile(std::string filename, std::string mode, std::string format)
+   : FileName(filename), Format(format), Merger(nullptr), File(nullptr)
+{
+   ROOT::EnableThreadSafety();
+
+   if(Format == "TTree")
+      Merger = new ROOT::TBufferMerger(FileName.c_str(), mode.c_str());
+   else if(Format == "RNTuple")
+   {
+#ifndef ASYNC_TREE_WRITER_RNTUPLE
+      std::cerr << "AsyncOutputFile: RNTuple output needs ROOT 6.36 or newer" << std::endl;
+      exit(1);
+#endif
+      File = TFile::Open(FileName.c_str(), mode.c_str());
+      if(File == nullptr || File->IsZombie() == true)
+      {
+         std::cerr << "AsyncOutputFile: cannot open " << FileName << std::endl;
+         exit(1);
+      }
+   }
+   else
+   {
+      std::cerr << "AsyncOutputFile: unknown format " << Format << " (use TTree or RNTuple)" << std::endl;
+      exit(1);
+   }
+}
+
+AsyncOutputFile::~AsyncOutputFile()
+{
+   Close();
+}
+
+// all writers have to be finished before the file is closed
+void AsyncOutputFile::Close()
+{
+   if(Merger != nullptr)
+      delete Merger;
+   Merger = nullptr;
+
+   if(File != nullptr)
+   {
+      File->Close();
+      delete File;
+   }
+   File = nullptr;
+}
+
+AsyncTreeWriter::AsyncTreeWriter(AsyncOutputFile &output, std::string name, std::string title,
+   AsyncTreeWriterOptions options)
+   : Name(name), Title(title), Output(&output), Options(options)
+{
+   Started = false;
+   Done = false;
+   EntriesFilled = 0;
+   BytesIn = 0;
+   BytesZip = 0;
+   FillTime = 0;
+   WaitTime = 0;
+
+   ROOT::EnableThreadSafety();
+}
+
+AsyncTreeWriter::~AsyncTreeWriter()
+{
+   Finish();
+}
+
+void AsyncTreeWriter::Branch(std::string name, void *address, std::string leaflist)
+{
+   if(Started == true)
+   {
+      std::cerr << "AsyncTreeWriter " << Name << ": branch " << name << " added after the first Fill" << std::endl;
+      exit(1);
+   }
+
+   BranchRecord B;
+   B.Name = name;
+   B.LeafList = leaflist;
+   B.Source = (char *)address;
+   B.FixedCount = 1;
+   B.Counter = -1;
+
+   std::size_t Slash = leaflist.rfind('/');
+   char Type = (Slash == std::string::npos) ? 'F' : leaflist[Slash+1];
+   B.Type = Type;
+   switch(Type)
+   {
+      case 'B': case 'b': case 'O':            B.TypeSize = 1;   break;
+      case 'S': case 's':                      B.TypeSize = 2;   break;
+      case 'I': case 'i': case 'F': case 'f':  B.TypeSize = 4;   break;
+      case 'D': case 'd': case 'L': case 'l':  B.TypeSize = 8;   break;
+      default:
+         std::cerr << "AsyncTreeWriter " << Name << ": unsupported leaf type in " << leaflist << std::endl;
+         exit(1);
+   }
+   if(leaflist.find(':') != std::string::npos)
+   {
+      std::cerr << "AsyncTreeWriter " << Name << ": only one leaf per branch is supported (" << leaflist << ")" << std::endl;
+      exit(1);
+   }
+
+   // dimensions: numbers multiply the fixed size, a name refers to a counter registered earlier
+   std::size_t Start = leaflist.find('[');
+   while(Start != std::string::npos && Start < Slash)
+   {
+      std::size_t End = leaflist.find(']', Start);
+      std::string Dimension = leaflist.substr(Start + 1, End - Start - 1);
+      if(Dimension.find_first_not_of("0123456789") == std::string::npos)
+         B.FixedCount = B.FixedCount * atoi(Dimension.c_str());
+      else
+      {
+         for(int i = 0; i < (int)Branches.size(); i++)
+            if(Branches[i].Name == Dimension || Branches[i].LeafList.substr(0, Branches[i].LeafList.find('/')) == Dimension)
+               B.Counter = i;
+         if(B.Counter < 0 || Branches[B.Counter].TypeSize != 4 || Branches[B.Counter].FixedCount != 1)
+         {
+            std::cerr << "AsyncTreeWriter " << Name << ": counter " << Dimension << " of " << name
+               << " has to be an int branch registered before it" << std::endl;
+            exit(1);
+         }
+      }
+      Start = leaflist.find('[', End);
+   }
+
+   B.Buffer.resize((B.Counter < 0) ? B.TypeSize * B.FixedCount : B.TypeSize * B.FixedCount * 16);
+   Branches.push_back(B);
+}
+
+int AsyncTreeWriter::GetCount(const BranchRecord &B, bool WriterSide)
+{
+   if(B.Counter < 0)
+      return B.FixedCount;
+
+   int N;
+   if(WriterSide == true)
+      memcpy(&N, Branches[B.Counter].Buffer.data(), sizeof(int));
+   else
+      memcpy(&N, Branches[B.Counter].Source, sizeof(int));
+   return (N > 0) ? N * B.FixedCount : 0;
+}
+
+void AsyncTreeWriter::Fill()
+{
+   TIMELINE_SCOPE("AsyncTreeWriter::Fill", "output");
+
+   std::size_t Size = 0;
+   for(BranchRecord &B : Branches)
+      Size = Size + (std::size_t)GetCount(B, false) * B.TypeSize;
+
+   std::vector<char> Entry(Size);
+   std::size_t Offset = 0;
+   for(BranchRecord &B : Branches)
+   {
+      std::size_t Bytes = (std::size_t)GetCount(B, false) * B.TypeSize;
+      memcpy(Entry.data() + Offset, B.Source, Bytes);
+      Offset = Offset + Bytes;
+   }
+
+   if(Started == false)
+   {
+      Started = true;
+      Worker = std::thread(&AsyncTreeWriter::Run, this);
+   }
+
+   std::unique_lock<std::mutex> Lock(Mutex);
+   if((int)Queue.size() >= Options.QueueDepth)
+   {
+      auto WaitStart = std::chrono::steady_clock::now();
+      NotFull.wait(Lock, [this]{return (int)Queue.size() < Options.QueueDepth;});
+      WaitTime = WaitTime + std::chrono::duration<double>(std::chrono::steady_clock::now() - WaitStart).count();
+   }
+   Queue.push_back(std::move(Entry));
+   BytesIn = BytesIn + Size;
+   Lock.unlock();
+   NotEmpty.notify_one();
+}
+
+void AsyncTreeWriter::Finish()
+{
+   if(Started == false)   // nothing filled: still write an empty tree
+   {
+      Started = true;
+      Worker = std::thread(&AsyncTreeWriter::Run, this);
+   }
+
+   {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Done = true;
+   }
+   NotEmpty.notify_one();
+
+   if(Worker.joinable() == true)
+      Worker.join();
+}
+
+bool AsyncTreeWriter::Pop(std::vector<char> &Entry)
+{
+   std::unique_lock<std::mutex> Lock(Mutex);
+   NotEmpty.wait(Lock, [this]{return Queue.size() > 0 || Done == true;});
+   if(Queue.size() == 0 && Done == true)
+      return false;
+   Entry = std::move(Queue.front());
+   Queue.pop_front();
+   Lock.unlock();
+   NotFull.notify_one();
+   return true;
+}
+
+// copies one queued entry into the writer-side buffers, returns true if a buffer had to grow
+bool AsyncTreeWriter::Unpack(const std::vector<char> &Entry)
+{
+   bool Grown = false;
+   std::size_t Offset = 0;
+   for(BranchRecord &B : Branches)
+   {
+      std::size_t Bytes = (std::size_t)GetCount(B, true) * B.TypeSize;
+      if(Bytes > B.Buffer.size())
+      {
+         B.Buffer.resize(Bytes * 2);
+         Grown = true;
+      }
+      memcpy(B.Buffer.data(), Entry.data() + Offset, Bytes);
+      Offset = Offset + Bytes;
+   }
+   return Grown;
+}
+
+TTree *AsyncTreeWriter::MakeTree()
+{
+   TTree *Tree = new TTree(Name.c_str(), Title.c_str());
+   for(BranchRecord &B : Branches)
+   {
+      TBranch *Branch = Tree->Branch(B.Name.c_str(), B.Buffer.data(), B.LeafList.c_str());
+      if(Options.Compression >= 0)
+         Branch->SetCompressionSettings(Options.Compression);
+   }
+   if(Options.BasketSize > 0)
+      Tree->SetBasketSize("*", Options.BasketSize);
+   return Tree;
+}
+
+void AsyncTreeWriter::SetNTupleValue(BranchRecord &B, void *Value)
+{
+   int Count = GetCount(B, true);
+   bool Collection = (B.Counter >= 0 || B.FixedCount > 1);
+   const char *Data = B.Buffer.data();
+
+   switch(B.Type)
+   {
+      case 'B':   ::SetNTupleValue<std::int8_t>(Value, Data, Count, Collection);     break;
+      case 'b':   ::SetNTupleValue<std::uint8_t>(Value, Data, Count, Collection);    break;
+      case 'O':   ::SetNTupleValue<bool>(Value, Data, Count, Collection);            break;
+      case 'S':   ::SetNTupleValue<std::int16_t>(Value, Data, Count, Collection);    break;
+      case 's':   ::SetNTupleValue<std::uint16_t>(Value, Data, Count, Collection);   break;
+      case 'I':   ::SetNTupleValue<std::int32_t>(Value, Data, Count, Collection);    break;
+      case 'i':   ::SetNTupleValue<std::uint32_t>(Value, Data, Count, Collection);   break;
+      case 'F':   ::SetNTupleValue<float>(Value, Data, Count, Collection);           break;
+      case 'f':   ::SetNTupleValue<float>(Value, Data, Count, Collection);           break;
+      case 'D':   ::SetNTupleValue<double>(Value, Data, Count, Collection);          break;
+      case 'd':   ::SetNTupleValue<double>(Value, Data, Count, Collection);          break;
+      case 'L':   ::SetNTupleValue<std::int64_t>(Value, Data, Count, Collection);    break;
+      case 'l':   ::SetNTupleValue<std::uint64_t>(Value, Data, Count, Collection);   break;
+   }
+}
+
+void AsyncTreeWriter::Run()
+{
+   if(Timeline::Enabled == true)
+      Timeline::SetThreadName("writer " + Name);
+
+   if(Output->IsRNTuple() == true)
+      RunNTuple();
+   else
+      RunTree();
+}
+
+void AsyncTreeWriter::RunTree()
+{
+   std::shared_ptr<ROOT::TBufferMergerFile> File = Output->Merger->GetFile();
+   if(Options.Compression >= 0)
+      File->SetCompressionSettings(Options.Compression);
+   File->cd();
+   TTree *Tree = MakeTree();
+
+   long long PendingEntries = 0;
+   long long ZipBaseline = 0;
+
+   std::vector<char> Entry;
+   while(Pop(Entry) == true)
+   {
+      TIMELINE_SCOPE("TTree::Fill", "output");
+      auto Start = std::chrono::steady_clock::now();
+
+      if(Unpack(Entry) == true)   // re-point the branches at the grown buffers
+         for(BranchRecord &B : Branches)
+            Tree->SetBranchAddress(B.Name.c_str(), B.Buffer.data());
+
+      Tree->Fill();
+      EntriesFilled = EntriesFilled + 1;
+      PendingEntries = PendingEntries + 1;
+
+      if(Options.FlushEntries > 0 && PendingEntries >= Options.FlushEntries)
+      {
+         Tree->FlushBaskets();
+         BytesZip = BytesZip + (Tree->GetZipBytes() - ZipBaseline);
+         File->Write();
+         ZipBaseline = Tree->GetZipBytes();
+         PendingEntries = 0;
+      }
+
+      FillTime = FillTime + std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+   }
+
+   TIMELINE_SCOPE("TTree::Write", "output");
+   auto Start = std::chrono::steady_clock::now();
+   Tree->FlushBaskets();
+   BytesZip = BytesZip + (Tree->GetZipBytes() - ZipBaseline);
+   File->Write();
+   File.reset();   // the tree belongs to the file
+   FillTime = FillTime + std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+// RNTuple pages are compressed inside Fill; the writers of one file take turns on it, so
+//    compression is not concurrent across trees here, but it still runs off the event loop
+void AsyncTreeWriter::RunNTuple()
+{
+#ifdef ASYNC_TREE_WRITER_RNTUPLE
+   std::unique_ptr<ROOT::RNTupleModel> Model = ROOT::RNTupleModel::CreateBare();
+   for(BranchRecord &B : Branches)
+   {
+      std::string TypeName = GetNTupleTypeName(B.Type);
+      if(B.Counter >= 0 || B.FixedCount > 1)
+         TypeName = "std::vector<" + TypeName + ">";
+      Model->AddField(ROOT::RFieldBase::Create(B.Name, TypeName).Unwrap());
+   }
+
+   ROOT::RNTupleWriteOptions WriteOptions;
+   if(Options.Compression >= 0)
+      WriteOptions.SetCompression(Options.Compression);
+
+   std::unique_ptr<ROOT::RNTupleWriter> Writer;
+   {
+      std::lock_guard<std::mutex> Lock(Output->Mutex);
+      Writer = ROOT::RNTupleWriter::Append(std::move(Model), Name, *Output->File, WriteOptions);
+   }
+
+   std::unique_ptr<ROOT::REntry> NTupleEntry = Writer->CreateEntry();
+   std::vector<std::shared_ptr<void>> Values;
+   for(BranchRecord &B : Branches)
+      Values.push_back(NTupleEntry->GetPtr<void>(B.Name));
+
+   std::vector<char> Entry;
+   while(Pop(Entry) == true)
+   {
+      TIMELINE_SCOPE("RNTuple::Fill", "output");
+      auto Start = std::chrono::steady_clock::now();
+
+      Unpack(Entry);
+      for(int i = 0; i < (int)Branches.size(); i++)
+         SetNTupleValue(Branches[i], Values[i].get());
+
+      {
+         std::lock_guard<std::mutex> Lock(Output->Mutex);
+         Writer->Fill(*NTupleEntry);
+      }
+      EntriesFilled = EntriesFilled + 1;
+
+      FillTime = FillTime + std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+   }
+
+   auto Start = std::chrono::steady_clock::now();
+   {
+      std::lock_guard<std::mutex> Lock(Output->Mutex);
+      Writer.reset();   // commits the last cluster and the footer
+   }
+   FillTime = FillTime + std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+#endif
+}
+
+void AsyncTreeWriter::PrintStatistics(std::ostream &out)
+{
+   out << "[" << Name << "] " << EntriesFilled << " entries, " << BytesIn / 1048576.0 << " MB";
+   if(Output->IsRNTuple() == false)
+      out << " -> " << BytesZip / 1048576.0 << " MB";
+   if(BytesZip > 0)
+      out << " (ratio " << (double)BytesIn / BytesZip << ")";
+   if(FillTime > 0)
+      out << ", " << BytesIn / 1048576.0 / FillTime << " MB/s on the writer thread";
+   out << ", event loop waited " << WaitTime << " s" << std::endl;
+}
+
+#endif
@@ -0,0 +1,222 @@
+// Poisson bootstrap replicas of the EEC histograms, filled in the same pass as the nominal histograms
+//    --Bootstrap K               number of replicas (default 0, off)
+//    --BootstrapSeed s           seed of the replica weights (default 1)
+//
+//    Every event gets K weights drawn from Poisson(1).  The weights come from a counter-based generator:
+//    the weight of replica k is a hash of (seed, run, event, k), so an event carries the same weights in
+//    every job, shard, resumed run and configuration, and the replicas of split jobs can simply be added.
+//    Inputs without run and event numbers are keyed on the input file name and the entry number instead.
+//
+//    The pairs of an event all share the event weight, so they are first summed into a per-event
+//    histogram, and only the bins the event touched are added to the replicas at the end of the event:
+//    the cost per pair is the same as for the nominal histogram, and the replica update is one pass over
+//    K contiguous values per touched bin.  Next() starts an event and Flush() ends it.
+//
+//    The replicas of a histogram H are kept in a TH2D "<H>Bootstrap" with the replica index on x and the
+//    binning of H on y, so that they can be registered with Checkpoint and added by the mergers like any
+//    other histogram.  The spread of the replicas in every y bin (and their correlations between y bins)
+//    gives the statistical covariance of H.
+//    Include CommandLine.h before this file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TDirectory.h"
+
+class BootstrapHistogram;
+
+class BootstrapReplicas
+{
+public:
+   int K;
+   std::uint64_t Seed;
+   std::vector<double> W;           // weights of the current event, one per replica
+private:
+   std::uint64_t FileKey;           // stands in for the run number when the input has none
+   std::vector<double> Cumulative;  // cumulative Poisson(1) probabilities
+   std::vector<BootstrapHistogram *> Histograms;
+public:
+   BootstrapReplicas(CommandLine &CL, std::string InputFileName);
+   bool IsEnabled() const;
+   void Add(BootstrapHistogram *H);
+   void Next(long long Run, long long Event, long long Entry);
+   void Flush();
+   static std::uint64_t Mix(std::uint64_t X);
+private:
+   int Poisson(std::uint64_t Key) const;
+};
+
+class BootstrapHistogram
+{
+public:
+   TH2D *Replicas;
+private:
+   BootstrapReplicas *Bootstrap;
+   std::vector<double> Event;       // contribution of the current event, per y cell
+   std::vector<int> Touched;        // y cells with a nonzero contribution in the current event
+public:
+   BootstrapHistogram(BootstrapReplicas &B, TH1D &Nominal);
+   ~BootstrapHistogram();
+   void Fill(double X, double Value = 1);
+   void Flush();
+   void DivideByBin(const double Edges[]);
+   void Write(TDirectory *Directory = nullptr);
+};
+
+BootstrapReplicas::BootstrapReplicas(CommandLine &CL, std::string InputFileName)
+{
+   K = CL.GetInt("Bootstrap", 0);
+   Seed = CL.GetInt("BootstrapSeed", 1);
+   if(K < 0)
+      K = 0;
+   W.assign(K, 1);
+
+   // FNV-1a of the file name without its directory, so that the key does not depend on where the file is
+   std::string Base = InputFileName.substr(InputFileName.find_last_of('/') + 1);
+   FileKey = 14695981039346656037ULL;
+   for(char C : Base)
+      FileKey = (FileKey ^ (unsigned char)C) * 1099511628211ULL;
+
+   // beyond k = 20 the probability is below the resolution of the 53-bit uniform numbers
+   double P = std::exp(-1.0), Sum = 0;
+   for(int k = 0; k <= 20; k++)
+   {
+      Sum = Sum + P;
+      Cumulative.push_back(Sum);
+      P = P / (k + 1);
+   }
+
+   if(K > 0)
+      std::cout << "[Bootstrap] " << K << " Poisson replicas, seed " << Seed << std::endl;
+}
+
+bool BootstrapReplicas::IsEnabled() const
+{
+   return K > 0;
+}
+
+void BootstrapReplicas::Add(BootstrapHistogram *H)
+{
+   if(H != nullptr)
+      Histograms.push_back(H);
+}
+
+// Finishes the previous event and draws the weights of the next one; Run and Event below 0 mean unknown
+void BootstrapReplicas::Next(long long Run, long long Event, long long Entry)
+{
+   Flush();
+   if(K == 0)
+      return;
+
+   std::uint64_t Key;
+   if(Run >= 0 && Event >= 0)
+      Key = Mix(Mix(Seed) ^ (std::uint64_t)Run) ^ (std::uint64_t)Event;
+   else
+      Key = Mix(Mix(Seed) ^ FileKey) ^ ((std::uint64_t)Entry + 0x8000000000000000ULL);
+   Key = Mix(Key);
+
+   for(int k = 0; k < K; k++)
+      W[k] = Poisson(Key + (std::uint64_t)k * 0x9E3779B97F4A7C15ULL);
+}
+
+void BootstrapReplicas::Flush()
+{
+   for(BootstrapHistogram *H : Histograms)
+      H->Flush();
+}
+
+// splitmix64 finalizer: a bijective mix of the 64 bits, so distinct counters give independent-looking outputs
+std::uint64_t BootstrapReplicas::Mix(std::uint64_t X)
+{
+   X = X + 0x9E3779B97F4A7C15ULL;
+   X = (X ^ (X >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   X = (X ^ (X >> 27)) * 0x94D049BB133111EBULL;
+   return X ^ (X >> 31);
+}
+
+int BootstrapReplicas::Poisson(std::uint64_t Key) const
+{
+   double U = (Mix(Key) >> 11) * 0x1.0p-53;
+   int k = 0;
+   while(k + 1 < (int)Cumulative.size() && U >= Cumulative[k])
+      k = k + 1;
+   return k;
+}
+
+BootstrapHistogram::BootstrapHistogram(BootstrapReplicas &B, TH1D &Nominal)
+   : Bootstrap(&B)
+{
+   std::string Name = std::string(Nominal.GetName()) + "Bootstrap";
+   std::string Title = std::string(";Replica;") + Nominal.GetXaxis()->GetTitle();
+   TAxis *Axis = Nominal.GetXaxis();
+   if(Axis->GetXbins()->GetSize() > 0)
+      Replicas = new TH2D(Name.c_str(), Title.c_str(), B.K, 0, B.K, Axis->GetNbins(), Axis->GetXbins()->GetArray());
+   else
+      Replicas = new TH2D(Name.c_str(), Title.c_str(), B.K, 0, B.K, Axis->GetNbins(), Axis->GetXmin(), Axis->GetXmax());
+   Replicas->SetDirectory(nullptr);
+
+   Event.assign(Axis->GetNbins() + 2, 0);
+   B.Add(this);
+}
+
+BootstrapHistogram::~BootstrapHistogram()
+{
+   delete Replicas;
+}
+
+// Same arguments as the Fill of the nominal histogram
+void BootstrapHistogram::Fill(double X, double Value)
+{
+   int Cell = Replicas->GetYaxis()->FindFixBin(X);
+   if(Event[Cell] == 0)
+      Touched.push_back(Cell);
+   Event[Cell] = Event[Cell] + Value;
+}
+
+// In the TH2D array the replicas of one y cell are the x cells 1..K of row Cell, which are contiguous.
+//    The entries count the events that contributed, so the mergers do not skip the histogram as empty
+void BootstrapHistogram::Flush()
+{
+   if(Touched.size() == 0)
+      return;
+   Replicas->SetEntries(Replicas->GetEntries() + 1);
+
+   int K = Bootstrap->K;
+   const double *W = Bootstrap->W.data();
+   double *Array = Replicas->GetArray();
+   for(int Cell : Touched)
+   {
+      double V = Event[Cell];
+      double *Row = Array + (long long)Cell * (K + 2) + 1;
+      for(int k = 0; k < K; k++)
+         Row[k] = Row[k] + V * W[k];
+      Event[Cell] = 0;
+   }
+   Touched.clear();
+}
+
+// The same bin-width division as the nominal histogram, applied along y
+void BootstrapHistogram::DivideByBin(const double Edges[])
+{
+   Flush();
+   int K = Bootstrap->K;
+   for(int j = 1; j <= Replicas->GetNbinsY(); j++)
+   {
+      double Width = Edges[j] - Edges[j-1];
+      for(int k = 1; k <= K; k++)
+         Replicas->SetBinContent(k, j, Replicas->GetBinContent(k, j) / Width);
+   }
+}
+
+void BootstrapHistogram::Write(TDirectory *Directory)
+{
+   Flush();
+   if(Directory != nullptr)
+      Directory->cd();
+   Replicas->Write();
+}
@@ -0,0 +1,365 @@
+// Checkpoint and resume for long event loops
+//    The event loop registers its accumulators (histograms and counters) once.  Every --CheckpointInterval
+//    entries, or every --CheckpointMinutes of wall time, Save() writes them together with the next entry
+//    to process to a side file (--CheckpointFile, default "<output>.checkpoint").  The side file is a
+//    normal ROOT file with the histograms under their own names, so partial results can be inspected
+//    while the job is still running.
+//
+//    When a job is restarted with the same input and entry range, Resume() loads the snapshot and returns
+//    the entry to continue from.  Histogram contents and counters are restored exactly, so the final
+//    output is the same as for an uninterrupted run.  Finish() removes the snapshot once the real output
+//    has been written.  --Resume false ignores an existing snapshot.
+//
+//    The saved position is a position in the loop, which maps to an entry through the sampled clusters of
+//    the range and whatever order the loop reads them in.  The snapshot therefore also keeps the sampling
+//    of the range (--SampleFraction, --SampleSeed) and the settings registered with AddSetting(); a
+//    snapshot made with different values is not resumed.
+//
+//    Output files that are written during the loop (trees) can be registered with AddFile().  They have
+//    to be closed when Save() is called; a copy is kept with the snapshot and put back by Resume().
+//    Include CommandLine.h and EntryRange.h before this file.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1.h"
+#include "TDirectory.h"
+
+class Checkpoint
+{
+private:
+   struct ValueRecord
+   {
+      std::string Name;
+      double *Double;
+      float *Float;
+      int *Int;
+      long long *Long;
+   };
+private:
+   std::string FileName;
+   long long Interval;    // entries between snapshots, 0 = not by entries
+   double Seconds;        // wall time between snapshots, 0 = not by time
+   bool Enabled;
+   bool AllowResume;
+   std::vector<std::string> HistogramDirectories;
+   std::vector<TH1 *> Histograms;
+   std::vector<ValueRecord> Values;
+   std::vector<std::string> Files;
+   std::vector<std::pair<std::string, std::string>> Settings;
+   int Sequence;
+   long long LastEntry;
+   std::chrono::steady_clock::time_point LastTime;
+   EntryRange Range;
+private:
+   std::string SnapshotFileName(int sequence, int index);
+   void RemoveSnapshotFiles(int sequence);
+   void AddValue(std::string Name, double *D, float *F, int *I, long long *L);
+   std::string SettingString();
+public:
+   Checkpoint(CommandLine &CL, std::string OutputFileName);
+   bool IsEnabled() {return Enabled;}
+   void Add(TH1 *H, std::string Directory = "");
+   void Add(std::string Name, double &X) {AddValue(Name, &X, nullptr, nullptr, nullptr);}
+   void Add(std::string Name, float &X) {AddValue(Name, nullptr, &X, nullptr, nullptr);}
+   void Add(std::string Name, int &X) {AddValue(Name, nullptr, nullptr, &X, nullptr);}
+   void Add(std::string Name, long long &X) {AddValue(Name, nullptr, nullptr, nullptr, &X);}
+   void AddFile(std::string Name);
+   void AddSetting(std::string Name, std::string Value);
+   long long Resume(const EntryRange &range);
+   bool Due(long long Entry);
+   void Save(long long Entry);
+   void Finish();
+};
+
+bool CopyCheckpointFile(std::string From, std::string To);
+
+Checkpoint::Checkpoint(CommandLine &CL, std::string OutputFileName)
+{
+   FileName    = CL.Get("CheckpointFile", OutputFileName + ".checkpoint");
+   Interval    = CL.GetInt("CheckpointInterval", 0);
+   Seconds     = CL.GetDouble("CheckpointMinutes", 0) * 60;
+   AllowResume = CL.GetBool("Resume", true);
+   Enabled     = (Interval > 0 || Seconds > 0);
+
+   Sequence = 0;
+   LastEntry = 0;
+   LastTime = std::chrono::steady_clock::now();
+   Range.Begin = 0;
+   Range.End = 0;
+}
+
+void Checkpoint::Add(TH1 *H, std::string Directory)
+{
+   if(H == nullptr)
+      return;
+   Histograms.push_back(H);
+   HistogramDirectories.push_back(Directory);
+}
+
+void Checkpoint::AddValue(std::string Name, double *D, float *F, int *I, long long *L)
+{
+   ValueRecord Record;
+   Record.Name = Name;
+   Record.Double = D;
+   Record.Float = F;
+   Record.Int = I;
+   Record.Long = L;
+   Values.push_back(Record);
+}
+
+void Checkpoint::AddFile(std::string Name)
+{
+   Files.push_back(Name);
+}
+
+// Anything that changes which entry a loop position stands for
+void Checkpoint::AddSetting(std::string Name, std::string Value)
+{
+   Settings.push_back(std::pair<std::string, std::string>(Name, Value));
+}
+
+std::string Checkpoint::SettingString()
+{
+   char Fraction[64];
+   snprintf(Fraction, 64, "%.17g", Range.SampleFraction);
+   std::string Result = std::string("SampleFraction=") + Fraction + ";SampleSeed=" + std::to_string(Range.SampleSeed);
+   for(auto &Setting : Settings)
+      Result = Result + ";" + Setting.first + "=" + Setting.second;
+   return Result;
+}
+
+std::string Checkpoint::SnapshotFileName(int sequence, int index)
+{
+   return FileName + "." + std::to_string(sequence) + "." + std::to_string(index);
+}
+
+void Checkpoint::RemoveSnapshotFiles(int sequence)
+{
+   for(int i = 0; i < (int)Files.size(); i++)
+      remove(SnapshotFileName(sequence, i).c_str());
+}
+
+long long Checkpoint::Resume(const EntryRange &range)
+{
+   Range = range;
+   LastEntry = Range.Begin;
+   LastTime = std::chrono::steady_clock::now();
+
+   if(Enabled == false || AllowResume == false)
+      return Range.Begin;
+
+   std::ifstream Test(FileName.c_str());
+   if(Test.good() == false)
+      return Range.Begin;
+   Test.close();
+
+   TDirectory::TContext Context;   // leaves gDirectory where the caller had it
+
+   TFile File(FileName.c_str());
+   TTree *State = (TTree *)File.Get("CheckpointState");
+   if(File.IsZombie() == true || State == nullptr || State->GetEntries() != 1)
+   {
+      std::cerr << "Checkpoint: " << FileName << " is not readable, starting from the beginning" << std::endl;
+      return Range.Begin;
+   }
+
+   char InputFileName[1024] = "", TreeName[256] = "", SavedSettings[4096] = "";
+   long long NextEntry = -1, Begin = -1, End = -1;
+   int SavedSequence = 0;
+   if(State->GetBranch("Settings") == nullptr)
+   {
+      std::cerr << "Checkpoint: " << FileName << " does not record the loop settings, starting from the beginning" << std::endl;
+      return Range.Begin;
+   }
+   State->SetBranchAddress("InputFile", InputFileName);
+   State->SetBranchAddress("TreeName", TreeName);
+   State->SetBranchAddress("Settings", SavedSettings);
+   State->SetBranchAddress("Begin", &Begin);
+   State->SetBranchAddress("End", &End);
+   State->SetBranchAddress("NextEntry", &NextEntry);
+   State->SetBranchAddress("Sequence", &SavedSequence);
+
+   // every value is stored as a double, which is exact for float, int and counts below 2^53
+   std::vector<double> Buffer(Values.size(), 0);
+   for(int i = 0; i < (int)Values.size(); i++)
+   {
+      if(State->GetBranch(Values[i].Name.c_str()) == nullptr)
+      {
+         std::cerr << "Checkpoint: " << FileName << " has no value " << Values[i].Name << ", starting from the beginning" << std::endl;
+         return Range.Begin;
+      }
+      State->SetBranchAddress(Values[i].Name.c_str(), &Buffer[i]);
+   }
+   State->GetEntry(0);
+
+   if(Range.FileName != InputFileName || Range.TreeName != TreeName || Range.Begin != Begin || Range.End != End)
+   {
+      std::cerr << "Checkpoint: " << FileName << " was made for " << InputFileName << ":" << TreeName
+         << " [" << Begin << ", " << End << "), starting from the beginning" << std::endl;
+      return Range.Begin;
+   }
+   if(SettingString() != SavedSettings)
+   {
+      std::cerr << "Checkpoint: " << FileName << " was made with " << SavedSettings << ", now "
+         << SettingString() << ", starting from the beginning" << std::endl;
+      return Range.Begin;
+   }
+   if(NextEntry < Range.Begin || NextEntry > Range.End)
+      return Range.Begin;
+
+   // check everything before touching the accumulators, so a bad snapshot leaves them empty
+   std::vector<TH1 *> Saved(Histograms.size(), nullptr);
+   for(int i = 0; i < (int)Histograms.size(); i++)
+   {
+      std::string Path = Histograms[i]->GetName();
+      if(HistogramDirectories[i] != "")
+         Path = HistogramDirectories[i] + "/" + Path;
+      Saved[i] = (TH1 *)File.Get(Path.c_str());
+      if(Saved[i] == nullptr || Saved[i]->GetNcells() != Histograms[i]->GetNcells())
+      {
+         std::cerr << "Checkpoint: histogram " << Path << " missing or different in " << FileName
+            << ", starting from the beginning" << std::endl;
+         return Range.Begin;
+      }
+   }
+   for(int i = 0; i < (int)Files.size(); i++)
+   {
+      std::ifstream Snapshot(SnapshotFileName(SavedSequence, i).c_str());
+      if(Snapshot.good() == false)
+      {
+         std::cerr << "Checkpoint: copy of " << Files[i] << " missing, starting from the beginning" << std::endl;
+         return Range.Begin;
+      }
+   }
+
+   for(int i = 0; i < (int)Histograms.size(); i++)
+   {
+      Histograms[i]->Reset();
+      Histograms[i]->Add(Saved[i]);
+   }
+   for(int i = 0; i < (int)Values.size(); i++)
+   {
+      if(Values[i].Double != nullptr)   *Values[i].Double = Buffer[i];
+      if(Values[i].Float != nullptr)    *Values[i].Float  = (float)Buffer[i];
+      if(Values[i].Int != nullptr)      *Values[i].Int    = (int)Buffer[i];
+      if(Values[i].Long != nullptr)     *Values[i].Long   = (long long)Buffer[i];
+   }
+   for(int i = 0; i < (int)Files.size(); i++)
+      CopyCheckpointFile(SnapshotFileName(SavedSequence, i), Files[i]);
+
+   File.Close();
+
+   Sequence = SavedSequence;
+   LastEntry = NextEntry;
+   std::cout << "Checkpoint: resuming from entry " << NextEntry << " (" << NextEntry - Range.Begin << " of "
+      << Range.Size() << " entries already done)" << std::endl;
+
+   return NextEntry;
+}
+
+bool Checkpoint::Due(long long Entry)
+{
+   if(Enabled == false)
+      return false;
+   if(Interval > 0 && Entry - LastEntry >= Interval)
+      return true;
+   if(Seconds > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - LastTime).count() >= Seconds)
+      return true;
+   return false;
+}
+
+void Checkpoint::Save(long long Entry)
+{
+   if(Enabled == false)
+      return;
+
+   TDirectory::TContext Context;
+
+   // the copies of the output files go under a new sequence number; the state file is renamed last,
+   //    so a crash at any point leaves the previous snapshot complete
+   int NewSequence = Sequence + 1;
+   for(int i = 0; i < (int)Files.size(); i++)
+      CopyCheckpointFile(Files[i], SnapshotFileName(NewSequence, i));
+
+   std::string TemporaryName = FileName + ".tmp";
+   TFile File(TemporaryName.c_str(), "RECREATE");
+
+   for(int i = 0; i < (int)Histograms.size(); i++)
+   {
+      TDirectory *Directory = &File;
+      if(HistogramDirectories[i] != "")
+         Directory = File.mkdir(HistogramDirectories[i].c_str(), "", true);
+      Directory->WriteTObject(Histograms[i], Histograms[i]->GetName());
+   }
+
+   File.cd();
+   TTree State("CheckpointState", "Event loop position and counters");
+
+   char InputFileName[1024] = "", TreeName[256] = "", CurrentSettings[4096] = "";
+   strncpy(InputFileName, Range.FileName.c_str(), 1023);
+   strncpy(TreeName, Range.TreeName.c_str(), 255);
+   strncpy(CurrentSettings, SettingString().c_str(), 4095);
+   long long NextEntry = Entry, Begin = Range.Begin, End = Range.End;
+   State.Branch("InputFile", InputFileName, "InputFile/C");
+   State.Branch("TreeName", TreeName, "TreeName/C");
+   State.Branch("Settings", CurrentSettings, "Settings/C");
+   State.Branch("Begin", &Begin, "Begin/L");
+   State.Branch("End", &End, "End/L");
+   State.Branch("NextEntry", &NextEntry, "NextEntry/L");
+   State.Branch("Sequence", &NewSequence, "Sequence/I");
+
+   std::vector<double> Buffer(Values.size(), 0);
+   for(int i = 0; i < (int)Values.size(); i++)
+   {
+      if(Values[i].Double != nullptr)   Buffer[i] = *Values[i].Double;
+      if(Values[i].Float != nullptr)    Buffer[i] = *Values[i].Float;
+      if(Values[i].Int != nullptr)      Buffer[i] = *Values[i].Int;
+      if(Values[i].Long != nullptr)     Buffer[i] = (double)*Values[i].Long;
+      State.Branch(Values[i].Name.c_str(), &Buffer[i], (Values[i].Name + "/D").c_str());
+   }
+
+   State.Fill();
+   State.Write();
+   File.Close();
+
+   if(rename(TemporaryName.c_str(), FileName.c_str()) != 0)
+   {
+      std::cerr << "Checkpoint: cannot rename " << TemporaryName << " to " << FileName << std::endl;
+      RemoveSnapshotFiles(NewSequence);
+      return;
+   }
+   RemoveSnapshotFiles(Sequence);
+
+   Sequence = NewSequence;
+   LastEntry = Entry;
+   LastTime = std::chrono::steady_clock::now();
+}
+
+void Checkpoint::Finish()
+{
+   if(Enabled == false)
+      return;
+   RemoveSnapshotFiles(Sequence);
+   remove(FileName.c_str());
+}
+
+bool CopyCheckpointFile(std::string From, std::string To)
+{
+   std::ifstream in(From.c_str(), std::ios::binary);
+   std::ofstream out(To.c_str(), std::ios::binary | std::ios::trunc);
+   if(in.good() == false || out.good() == false)
+   {
+      std::cerr << "Checkpoint: cannot copy " << From << " to " << To << std::endl;
+      return false;
+   }
+   out << in.rdbuf();
+   return out.good();
+}
@@ -10,6 +10,7 @@ private:
    std::string Self;
    std::map<std::string, std::string> Arguments;
    std::vector<std::string> ExtraArguments;
+   std::vector<std::string> Raw;
 public:
    CommandLine(int argc, char *argv[]);
    ~CommandLine();
@@ -74,6 +75,7 @@ public:
    std::vector<bool> GetBoolVector(int Index, std::vector<bool> Default, char Delimiter = ',');
    std::vector<bool> GetBoolVector(std::string Key, std::vector<bool> Default, char Delimiter = ',');
    std::string GetSelf();
+   std::string GetCommandLine();
    static std::vector<std::string> Parse(std::string Input, char Delimiter = ',');
    static std::vector<int> ParseInt(std::string Input, char Delimiter = ',');
    static std::vector<double> ParseDouble(std::string Input, char Delimiter = ',');
@@ -94,10 +96,14 @@ void CommandLine::Initialize(int argc, char *argv[])
    Self = "";
    Arguments.clear();
    ExtraArguments.clear();
+   Raw.clear();
 
    if(argc < 1)
       return;
 
+   for(int i = 0; i < argc; i++)
+      Raw.push_back(argv[i]);
+
    Self = argv[0];
 
    for(int i = 1; i < argc; i++)
@@ -447,6 +453,27 @@ std::string CommandLine::GetSelf()
    return Self;
 }
 
+// the full command line as typed, arguments with spaces or quotes are quoted again
+std::string CommandLine::GetCommandLine()
+{
+   std::string Result = "";
+   for(int i = 0; i < (int)Raw.size(); i++)
+   {
+      if(i > 0)
+         Result = Result + " ";
+      if(Raw[i].find_first_of(" \t\"'") == std::string::npos && Raw[i].size() > 0)
+         Result = Result + Raw[i];
+      else
+      {
+         std::string Quoted = "'";
+         for(char c : Raw[i])
+            Quoted = Quoted + ((c == '\'') ? std::string("'\\''") : std::string(1, c));
+         Result = Result + Quoted + "'";
+      }
+   }
+   return Result;
+}
+
 std::vector<std::string> CommandLine::Parse(std::string  Input, char Delimiter)
 {
    std::vector<std::string> Result;
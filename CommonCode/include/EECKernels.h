@@ -0,0 +1,471 @@
+// Legacy and fast versions of the hot kernels, and the validator that checks one against the other
+//    Each fast kernel is written to give bit-identical results to the legacy code it replaces:
+//       FindBinSorted     binary search with the legacy FindBin conventions (-1 below, NBins above and NaN)
+//       EECPairLoopFast   upper-triangle angle matrix from cached |p|, no per-triplet vector allocation
+//       EfficiencyTable   flattened copy of the efficiency TH3 with the TAxis bin lookup done inline
+//       MatchingTrack     cached |p| and phi, so that matching metrics skip the FourVector copies
+//    The pair loops hand every pair (triplet) to Fill2(i1, i2, Max2, Bin2) (Fill3(i1, i2, i3, Max3, Bin3)),
+//    so the callers keep their own weights and histograms.  EECPairLoopShared serves several particle
+//    subsets of one event (the selections of a multi-configuration job) from a single angle matrix.
+//
+//    --FastKernels            use the fast kernels in production (default false, legacy)
+//    --Validate               run both versions on a sample of the events and compare them (default false)
+//    --ValidateFraction f     fraction of the events sampled, chosen by a hash of the entry (default 0.01)
+//    --ValidateTolerance t    largest relative deviation counted as agreement (default 1e-9)
+//    KernelValidator::Report prints, per component, the sampled events, the largest deviation, the events
+//    outside the tolerance and the legacy / fast time ratio.  For matching maps the deviation is the
+//    number of entries that differ.
+//    Include CommandLine.h and TauHelperFunctions3.h before this file.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+
+#include "TH3.h"
+
+#include "Timeline.h"
+
+int FindBinLinear(double Value, int NBins, const double Bins[]);
+int FindBinSorted(double Value, int NBins, const double Bins[]);
+double PairAngle(double Dot, double P1, double P2);
+template <class Sink2, class Sink3>
+void EECPairLoopLegacy(std::vector<FourVector> &P, int NBins, const double Bins[], Sink2 &&Fill2, Sink3 &&Fill3);
+template <class Sink2, class Sink3>
+void EECPairLoopFast(std::vector<FourVector> &P, int NBins, const double Bins[], Sink2 &&Fill2, Sink3 &&Fill3);
+template <class Sink2, class Sink3>
+void EECPairLoop(bool Fast, std::vector<FourVector> &P, int NBins, const double Bins[], Sink2 &&Fill2, Sink3 &&Fill3);
+template <class Sink2, class Sink3>
+void EECPairLoopShared(std::vector<FourVector> &P, const std::vector<uint64_t> &Masks, int NBins, const double Bins[],
+   Sink2 &&Fill2, Sink3 &&Fill3);
+double KernelDeviation(const std::vector<double> &A, const std::vector<double> &B);
+double KernelDeviation(const std::map<int, int> &A, const std::map<int, int> &B);
+
+struct MatchingTrack
+{
+   double E, X, Y, Z;
+   double P, Phi;
+   MatchingTrack(FourVector &V) : E(V[0]), X(V[1]), Y(V[2]), Z(V[3]), P(V.GetP()), Phi(V.GetPhi()) {}
+};
+
+class EfficiencyTable
+{
+private:
+   struct Axis
+   {
+      int N;
+      double Min, Max;
+      std::vector<double> Edges;   // empty for fixed bins
+   };
+   Axis AxisX, AxisY, AxisZ;
+   std::vector<float> Content;
+   int Counter;
+public:
+   EfficiencyTable(TH3 *H);
+   bool IsValid() const;
+   float Efficiency(float Theta, float Phi, float PT, float NTrack);
+private:
+   static Axis CopyAxis(TAxis *A);
+   static int FindAxisBin(const Axis &A, double x);
+};
+
+class KernelValidator
+{
+public:
+   struct Component
+   {
+      std::string Name;
+      long long Events;
+      long long Failures;
+      double MaxDeviation;
+      double LegacyTime;
+      double FastTime;
+   };
+public:
+   bool Enabled;
+   bool Fast;
+   double Fraction;
+   double Tolerance;
+   std::vector<Component> Components;
+public:
+   KernelValidator(CommandLine &CL);
+   bool Sample(long long Entry) const;
+   template <class Legacy, class New>
+   void Compare(std::string Name, Legacy &&RunLegacy, New &&RunFast);
+   Component &Find(std::string Name);
+   bool Passed() const;
+   void Report(std::ostream &out) const;
+};
+
+int FindBinLinear(double Value, int NBins, const double Bins[])
+{
+   for(int i = 0; i < NBins; i++)
+      if(Value < Bins[i])
+         return i - 1;
+   return NBins;
+}
+
+// upper_bound finds the same first edge above the value; a NaN compares false everywhere and ends up in NBins
+int FindBinSorted(double Value, int NBins, const double Bins[])
+{
+   int Index = std::upper_bound(Bins, Bins + NBins, Value) - Bins;
+   if(Index == NBins)
+      return NBins;
+   return Index - 1;
+}
+
+// GetAngle(P1, P2) with the spatial dot product and the sizes already computed
+double PairAngle(double Dot, double P1, double P2)
+{
+   double V = Dot / P1 / P2;
+   if(V > 1 && V - 1 < 1e-5)
+      V = 0.999999;
+   if(V < -1 && (-1) - V > -1e-5)
+      V = -0.999999;
+   return acos(V);
+}
+
+template <class Sink2, class Sink3>
+void EECPairLoopLegacy(std::vector<FourVector> &P, int NBins, const double Bins[], Sink2 &&Fill2, Sink3 &&Fill3)
+{
+   ScopedTimer AngleTimer("AngleMatrix", "pairs");
+   int N = P.size();
+   std::vector<std::vector<double>> D(N);
+   for(int i = 0; i < N; i++)
+   {
+      D[i].resize(N);
+      for(int j = 0; j < N; j++)
+         D[i][j] = GetAngle(P[i], P[j]);
+   }
+   AngleTimer.Stop();
+
+   TIMELINE_SCOPE("FillEEC", "fill");
+   for(int i1 = 0; i1 < N; i1++)
+   {
+      for(int i2 = i1 + 1; i2 < N; i2++)
+      {
+         double Max2 = D[i1][i2];
+         int Bin2 = FindBinLinear(Max2, NBins, Bins);
+         Fill2(i1, i2, Max2, Bin2);
+
+         for(int i3 = i2 + 1; i3 < N; i3++)
+         {
+            std::vector<double> X = {Max2, D[i1][i3], D[i2][i3]};
+            double Max3 = X[0];
+            for(int i = 1; i < (int)X.size(); i++)
+               if(Max3 < X[i])
+                  Max3 = X[i];
+            int Bin3 = FindBinLinear(Max3, NBins, Bins);
+            Fill3(i1, i2, i3, Max3, Bin3);
+         }
+      }
+   }
+}
+
+// Only D[i][j] with i < j is used, always computed in the order GetAngle(P[i], P[j]) would, and
+//    std::max keeps the first argument on ties and NaN like the legacy GetMax
+template <class Sink2, class Sink3>
+void EECPairLoopFast(std::vector<FourVector> &P, int NBins, const double Bins[], Sink2 &&Fill2, Sink3 &&Fill3)
+{
+   ScopedTimer AngleTimer("AngleMatrix", "pairs");
+   int N = P.size();
+   std::vector<double> X(N), Y(N), Z(N), Size(N);
+   for(int i = 0; i < N; i++)
+   {
+      X[i] = P[i][1];
+      Y[i] = P[i][2];
+      Z[i] = P[i][3];
+      Size[i] = P[i].GetP();
+   }
+   std::vector<double> D(N * N);
+   for(int i = 0; i < N; i++)
+      for(int j = i + 1; j < N; j++)
+         D[i*N+j] = PairAngle(X[i] * X[j] + Y[i] * Y[j] + Z[i] * Z[j], Size[i], Size[j]);
+   AngleTimer.Stop();
+
+   TIMELINE_SCOPE("FillEEC", "fill");
+   for(int i1 = 0; i1 < N; i1++)
+   {
+      for(int i2 = i1 + 1; i2 < N; i2++)
+      {
+         double Max2 = D[i1*N+i2];
+         int Bin2 = FindBinSorted(Max2, NBins, Bins);
+         Fill2(i1, i2, Max2, Bin2);
+
+         for(int i3 = i2 + 1; i3 < N; i3++)
+         {
+            double Max3 = std::max(std::max(Max2, D[i1*N+i3]), D[i2*N+i3]);
+            int Bin3 = FindBinSorted(Max3, NBins, Bins);
+            Fill3(i1, i2, i3, Max3, Bin3);
+         }
+      }
+   }
+}
+
+template <class Sink2, class Sink3>
+void EECPairLoop(bool Fast, std::vector<FourVector> &P, int NBins, const double Bins[], Sink2 &&Fill2, Sink3 &&Fill3)
+{
+   if(Fast == true)
+      EECPairLoopFast(P, NBins, Bins, Fill2, Fill3);
+   else
+      EECPairLoopLegacy(P, NBins, Bins, Fill2, Fill3);
+}
+
+// Masks[i] has bit s set if particle i belongs to subset s (at most 64 subsets).  The angle and bin of a
+//    pair (triplet) are computed once and handed to Fill2(s, i1, i2, Max2, Bin2) (Fill3(s, i1, i2, i3, Max3,
+//    Bin3)) for every subset holding all of its particles, with indices into P.  Each subset sees its
+//    pairs in the order EECPairLoopFast on that subset alone would give them, with the same values
+template <class Sink2, class Sink3>
+void EECPairLoopShared(std::vector<FourVector> &P, const std::vector<uint64_t> &Masks, int NBins, const double Bins[],
+   Sink2 &&Fill2, Sink3 &&Fill3)
+{
+   ScopedTimer AngleTimer("AngleMatrix", "pairs");
+   int N = P.size();
+   std::vector<double> X(N), Y(N), Z(N), Size(N);
+   for(int i = 0; i < N; i++)
+   {
+      X[i] = P[i][1];
+      Y[i] = P[i][2];
+      Z[i] = P[i][3];
+      Size[i] = P[i].GetP();
+   }
+   std::vector<double> D(N * N);
+   for(int i = 0; i < N; i++)
+      for(int j = i + 1; j < N; j++)
+         if((Masks[i] & Masks[j]) != 0)
+            D[i*N+j] = PairAngle(X[i] * X[j] + Y[i] * Y[j] + Z[i] * Z[j], Size[i], Size[j]);
+   AngleTimer.Stop();
+
+   TIMELINE_SCOPE("FillEEC", "fill");
+   for(int i1 = 0; i1 < N; i1++)
+   {
+      for(int i2 = i1 + 1; i2 < N; i2++)
+      {
+         uint64_t Mask2 = Masks[i1] & Masks[i2];
+         if(Mask2 == 0)
+            continue;
+
+         double Max2 = D[i1*N+i2];
+         int Bin2 = FindBinSorted(Max2, NBins, Bins);
+         for(uint64_t Left = Mask2; Left != 0; Left = Left & (Left - 1))
+            Fill2(__builtin_ctzll(Left), i1, i2, Max2, Bin2);
+
+         for(int i3 = i2 + 1; i3 < N; i3++)
+         {
+            uint64_t Mask3 = Mask2 & Masks[i3];
+            if(Mask3 == 0)
+               continue;
+            double Max3 = std::max(std::max(Max2, D[i1*N+i3]), D[i2*N+i3]);
+            int Bin3 = FindBinSorted(Max3, NBins, Bins);
+            for(uint64_t Left = Mask3; Left != 0; Left = Left & (Left - 1))
+               Fill3(__builtin_ctzll(Left), i1, i2, i3, Max3, Bin3);
+         }
+      }
+   }
+}
+
+// Largest relative difference; NaN agrees only with NaN
+double KernelDeviation(const std::vector<double> &A, const std::vector<double> &B)
+{
+   if(A.size() != B.size())
+      return std::numeric_limits<double>::infinity();
+
+   double Result = 0;
+   for(int i = 0; i < (int)A.size(); i++)
+   {
+      if(A[i] == B[i] || (std::isnan(A[i]) && std::isnan(B[i])))
+         continue;
+      if(std::isnan(A[i]) || std::isnan(B[i]))
+         return std::numeric_limits<double>::infinity();
+      double Scale = std::max(std::max(fabs(A[i]), fabs(B[i])), 1e-300);
+      Result = std::max(Result, fabs(A[i] - B[i]) / Scale);
+   }
+   return Result;
+}
+
+// Number of entries present in only one map or mapped differently
+double KernelDeviation(const std::map<int, int> &A, const std::map<int, int> &B)
+{
+   double Result = 0;
+   for(auto &Item : A)
+   {
+      auto Other = B.find(Item.first);
+      if(Other == B.end() || Other->second != Item.second)
+         Result = Result + 1;
+   }
+   for(auto &Item : B)
+      if(A.find(Item.first) == A.end())
+         Result = Result + 1;
+   return Result;
+}
+
+EfficiencyTable::EfficiencyTable(TH3 *H)
+   : Counter(0)
+{
+   if(H == nullptr)
+      return;
+
+   AxisX = CopyAxis(H->GetXaxis());
+   AxisY = CopyAxis(H->GetYaxis());
+   AxisZ = CopyAxis(H->GetZaxis());
+
+   int Total = (AxisX.N + 2) * (AxisY.N + 2) * (AxisZ.N + 2);
+   Content.resize(Total);
+   for(int i = 0; i < Total; i++)
+      Content[i] = H->GetBinContent(i);
+}
+
+bool EfficiencyTable::IsValid() const
+{
+   return Content.size() > 0;
+}
+
+// alephTrkEfficiency::efficiency, the histogram is binned in (pt, theta, Ntrk)
+float EfficiencyTable::Efficiency(float Theta, float Phi, float PT, float NTrack)
+{
+   int BinX = FindAxisBin(AxisX, PT);
+   int BinY = FindAxisBin(AxisY, Theta);
+   int BinZ = FindAxisBin(AxisZ, NTrack);
+   float e = Content[BinX + (AxisX.N + 2) * (BinY + (AxisY.N + 2) * BinZ)];
+   if(e < 0.00000000001)
+   {
+      if(Counter < 10)
+      {
+         std::cout << "!!!Error on efficiency correction! Zero efficiency!!! theta=" << Theta << " phi=" << Phi
+            << " pt=" << PT << " Nchg=" << NTrack << std::endl << std::endl;
+         Counter = Counter + 1;
+      }
+      e = 1;
+   }
+   return e;
+}
+
+EfficiencyTable::Axis EfficiencyTable::CopyAxis(TAxis *A)
+{
+   Axis Result;
+   Result.N = A->GetNbins();
+   Result.Min = A->GetXmin();
+   Result.Max = A->GetXmax();
+   if(A->GetXbins()->GetSize() > 0)
+      Result.Edges.assign(A->GetXbins()->GetArray(), A->GetXbins()->GetArray() + A->GetXbins()->GetSize());
+   return Result;
+}
+
+// TAxis::FindFixBin, including the overflow bin for NaN
+int EfficiencyTable::FindAxisBin(const Axis &A, double x)
+{
+   if(x < A.Min)
+      return 0;
+   if(!(x < A.Max))
+      return A.N + 1;
+   if(A.Edges.size() == 0)
+      return 1 + int(A.N * (x - A.Min) / (A.Max - A.Min));
+   return std::upper_bound(A.Edges.begin(), A.Edges.end(), x) - A.Edges.begin();
+}
+
+KernelValidator::KernelValidator(CommandLine &CL)
+{
+   Fast      = CL.GetBool("FastKernels", false);
+   Enabled   = CL.GetBool("Validate", false);
+   Fraction  = CL.GetDouble("ValidateFraction", 0.01);
+   Tolerance = CL.GetDouble("ValidateTolerance", 1e-9);
+}
+
+// The same entries are sampled in every run and every job
+bool KernelValidator::Sample(long long Entry) const
+{
+   if(Enabled == false)
+      return false;
+
+   uint64_t Hash = (uint64_t)Entry + 0x9e3779b97f4a7c15ULL;
+   Hash = (Hash ^ (Hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   Hash = (Hash ^ (Hash >> 27)) * 0x94d049bb133111ebULL;
+   Hash = Hash ^ (Hash >> 31);
+   return (Hash >> 11) * (1.0 / 9007199254740992.0) < Fraction;
+}
+
+// Runs both versions and compares what they return; the order alternates between calls so that
+//    neither one always runs on a warm cache
+template <class Legacy, class New>
+void KernelValidator::Compare(std::string Name, Legacy &&RunLegacy, New &&RunFast)
+{
+   Component &C = Find(Name);
+
+   typedef std::chrono::steady_clock Clock;
+   decltype(RunLegacy()) LegacyResult;
+   decltype(RunFast()) FastResult;
+
+   auto TimeLegacy = [&]()
+   {
+      Clock::time_point Start = Clock::now();
+      LegacyResult = RunLegacy();
+      C.LegacyTime = C.LegacyTime + std::chrono::duration<double>(Clock::now() - Start).count();
+   };
+   auto TimeFast = [&]()
+   {
+      Clock::time_point Start = Clock::now();
+      FastResult = RunFast();
+      C.FastTime = C.FastTime + std::chrono::duration<double>(Clock::now() - Start).count();
+   };
+
+   if(C.Events % 2 == 0)
+   {
+      TimeLegacy();
+      TimeFast();
+   }
+   else
+   {
+      TimeFast();
+      TimeLegacy();
+   }
+
+   double Deviation = KernelDeviation(LegacyResult, FastResult);
+   C.Events = C.Events + 1;
+   C.MaxDeviation = std::max(C.MaxDeviation, Deviation);
+   if(!(Deviation <= Tolerance))
+      C.Failures = C.Failures + 1;
+}
+
+KernelValidator::Component &KernelValidator::Find(std::string Name)
+{
+   for(Component &C : Components)
+      if(C.Name == Name)
+         return C;
+   Components.push_back(Component{Name, 0, 0, 0, 0, 0});
+   return Components.back();
+}
+
+bool KernelValidator::Passed() const
+{
+   for(const Component &C : Components)
+      if(C.Failures > 0)
+         return false;
+   return true;
+}
+
+void KernelValidator::Report(std::ostream &out) const
+{
+   if(Enabled == false)
+      return;
+
+   out << "[Validate] " << Fraction * 100 << "% of the events, tolerance " << Tolerance
+      << ", production kernels: " << (Fast ? "fast" : "legacy") << std::endl;
+   out << "[Validate] " << std::setw(12) << std::left << "component" << std::right << std::setw(10) << "events"
+      << std::setw(14) << "max dev" << std::setw(10) << "failures" << std::setw(12) << "legacy (s)"
+      << std::setw(12) << "fast (s)" << std::setw(10) << "speedup" << std::endl;
+   for(const Component &C : Components)
+   {
+      out << "[Validate] " << std::setw(12) << std::left << C.Name << std::right << std::setw(10) << C.Events
+         << std::setw(14) << std::scientific << std::setprecision(3) << C.MaxDeviation << std::setw(10) << C.Failures
+         << std::setw(12) << std::fixed << std::setprecision(4) << C.LegacyTime << std::setw(12) << C.FastTime
+         << std::setw(10) << std::setprecision(2) << ((C.FastTime > 0) ? C.LegacyTime / C.FastTime : 0) << std::endl;
+   }
+   out << std::defaultfloat << std::setprecision(6);
+   out << "[Validate] " << (Passed() ? "all components agree" : "DEVIATIONS above the tolerance") << std::endl;
+}
@@ -0,0 +1,394 @@
+// Entry ranges for splitting one input tree over several jobs
+//    --ShardIndex i --ShardCount n   process the i-th of n pieces (0-based); the pieces start on
+//                                    TTree cluster boundaries, so no two shards read the same baskets
+//    --EntryBegin b --EntryEnd e     process entries [b, e) exactly as given
+//    --Fraction f                    still works and keeps the leading fraction of the selected range
+//    --SampleFraction f              read only about a fraction f of the TTree clusters, spread evenly over
+//    --SampleSeed s                  the tree with an offset set by the seed (default 1).  The choice is
+//                                    made on the whole tree, so the shards of a sampled job add up to the
+//                                    same sample as one unsharded job; unlike --Fraction it is not biased
+//                                    towards the early runs.
+//
+//    Loops over a range go "for(iE = Range.First(); iE < Range.End; iE = Range.Next(iE))", which skips
+//    the clusters outside the sample; without sampling this is the plain loop from Begin to End.
+//
+//    Every job writes its range into a small "EntryRange" tree in its output file, one row per sampled
+//    piece together with the requested and the effective sampled fraction, which is what the event
+//    counts have to be scaled by.  After merging, CheckEntryRangeCoverage tells whether the shards of
+//    each input cover it exactly once; for sampled inputs it reports the fraction read instead of gaps.
+//    Include CommandLine.h before this file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "TTree.h"
+#include "TDirectory.h"
+
+struct EntryRange
+{
+   std::string FileName;
+   std::string TreeName;
+   long long Begin;
+   long long End;
+   long long Total;
+   int ShardIndex;
+   int ShardCount;
+   double SampleFraction = 1;                             // requested with --SampleFraction
+   int SampleSeed = 1;
+   std::vector<std::pair<long long, long long>> Sample;   // sampled clusters cut to [Begin, End), empty if all
+   long long Size() const {return End - Begin;}
+   bool IsSampled() const {return SampleFraction < 1;}
+   long long SampledSize() const;
+   double EffectiveFraction() const;
+   std::vector<std::pair<long long, long long>> Pieces() const;
+   long long First() const;
+   long long Next(long long Entry) const;
+};
+
+std::vector<long long> GetClusterBoundaries(TTree *Tree);
+std::vector<std::pair<long long, long long>> SampleClusters(const std::vector<long long> &Clusters, double Fraction, int Seed);
+EntryRange GetEntryRange(CommandLine &CL, TTree *Tree, std::string FileName, double Fraction = 1.00);
+EntryRange GetEntryRange(CommandLine &CL, std::vector<long long> Clusters, std::string TreeName,
+   std::string FileName, double Fraction = 1.00);
+void WriteEntryRange(TDirectory *Directory, const EntryRange &Range);
+void WriteEntryRanges(TDirectory *Directory, const std::vector<EntryRange> &Ranges);
+std::vector<EntryRange> ReadEntryRanges(TTree *Tree);
+bool CheckEntryRangeCoverage(std::vector<EntryRange> Ranges, std::ostream &out);
+
+std::vector<long long> GetClusterBoundaries(TTree *Tree)
+{
+   std::vector<long long> Boundaries;
+   if(Tree == nullptr)
+      return Boundaries;
+
+   long long N = Tree->GetEntries();
+   TTree::TClusterIterator Iterator = Tree->GetClusterIterator(0);
+   long long Start = Iterator.Next();
+   while(Start < N)
+   {
+      Boundaries.push_back(Start);
+      Start = Iterator.Next();
+   }
+   Boundaries.push_back(N);
+
+   return Boundaries;
+}
+
+EntryRange GetEntryRange(CommandLine &CL, TTree *Tree, std::string FileName, double Fraction)
+{
+   return GetEntryRange(CL, GetClusterBoundaries(Tree), (Tree != nullptr) ? Tree->GetName() : "", FileName, Fraction);
+}
+
+// Clusters: first entry of every cluster, followed by the total number of entries
+EntryRange GetEntryRange(CommandLine &CL, std::vector<long long> Clusters, std::string TreeName,
+   std::string FileName, double Fraction)
+{
+   if(Clusters.size() == 0)
+      Clusters.push_back(0);
+
+   EntryRange Range;
+   Range.FileName   = FileName;
+   Range.TreeName   = TreeName;
+   Range.Total      = Clusters.back();
+   Range.ShardIndex = CL.GetInt("ShardIndex", 0);
+   Range.ShardCount = CL.GetInt("ShardCount", 1);
+   Range.Begin      = 0;
+   Range.End        = Range.Total;
+
+   long long EntryBegin = CL.GetInt("EntryBegin", -1);
+   long long EntryEnd   = CL.GetInt("EntryEnd", -1);
+
+   if(EntryBegin >= 0 || EntryEnd >= 0)
+   {
+      Range.Begin = std::max(0LL, EntryBegin);
+      Range.End = (EntryEnd >= 0) ? std::min(EntryEnd, Range.Total) : Range.Total;
+      Range.ShardIndex = 0;
+      Range.ShardCount = 1;
+   }
+   else if(Range.ShardCount > 1)
+   {
+      if(Range.ShardIndex < 0 || Range.ShardIndex >= Range.ShardCount)
+      {
+         std::cerr << "Shard index " << Range.ShardIndex << " out of range for " << Range.ShardCount << " shards" << std::endl;
+         exit(1);
+      }
+
+      // boundary k is the first cluster start at or after k/n of the tree, so the shards tile the tree
+      auto Boundary = [&](int k)
+      {
+         if(k >= Range.ShardCount)
+            return Range.Total;
+         long long Target = (long long)((double)Range.Total * k / Range.ShardCount);
+         return *std::lower_bound(Clusters.begin(), Clusters.end(), Target);
+      };
+      Range.Begin = Boundary(Range.ShardIndex);
+      Range.End   = Boundary(Range.ShardIndex + 1);
+   }
+
+   if(Range.End < Range.Begin)
+      Range.End = Range.Begin;
+   if(Fraction < 1)
+      Range.End = Range.Begin + (long long)(Range.Size() * Fraction);
+
+   Range.SampleFraction = CL.GetDouble("SampleFraction", 1);
+   Range.SampleSeed = CL.GetInt("SampleSeed", 1);
+   if(Range.IsSampled() == true)
+   {
+      for(auto &Piece : SampleClusters(Clusters, Range.SampleFraction, Range.SampleSeed))
+      {
+         long long Begin = std::max(Piece.first, Range.Begin);
+         long long End = std::min(Piece.second, Range.End);
+         if(Begin < End)
+            Range.Sample.push_back(std::pair<long long, long long>(Begin, End));
+      }
+   }
+
+   return Range;
+}
+
+// Systematic sampling: cluster k is taken when floor(u + (k + 1) f) > floor(u + k f), with the offset u in
+//    [0, 1) from the seed, so the clusters taken are evenly spaced and about a fraction f of them.  At
+//    least one cluster is always taken.  Neighbouring clusters are merged into one piece.
+std::vector<std::pair<long long, long long>> SampleClusters(const std::vector<long long> &Clusters, double Fraction, int Seed)
+{
+   std::vector<std::pair<long long, long long>> Result;
+   int N = (int)Clusters.size() - 1;
+   if(N <= 0)
+      return Result;
+
+   uint64_t Hash = (uint64_t)Seed * 0x9e3779b97f4a7c15ULL;
+   Hash = (Hash ^ (Hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   Hash = (Hash ^ (Hash >> 27)) * 0x94d049bb133111ebULL;
+   Hash = Hash ^ (Hash >> 31);
+   double Offset = (Hash >> 11) * (1.0 / 9007199254740992.0);
+
+   Fraction = std::max(0.0, std::min(1.0, Fraction));
+   std::vector<bool> Taken(N, false);
+   bool Any = false;
+   for(int k = 0; k < N; k++)
+   {
+      Taken[k] = floor(Offset + (k + 1) * Fraction) > floor(Offset + k * Fraction);
+      Any = Any || Taken[k];
+   }
+   if(Any == false)
+      Taken[std::min(N - 1, (int)(Offset * N))] = true;
+
+   for(int k = 0; k < N; k++)
+   {
+      if(Taken[k] == false)
+         continue;
+      if(Result.size() > 0 && Result.back().second == Clusters[k])
+         Result.back().second = Clusters[k+1];
+      else
+         Result.push_back(std::pair<long long, long long>(Clusters[k], Clusters[k+1]));
+   }
+
+   return Result;
+}
+
+long long EntryRange::SampledSize() const
+{
+   if(IsSampled() == false)
+      return Size();
+   long long Result = 0;
+   for(auto &Piece : Sample)
+      Result = Result + (Piece.second - Piece.first);
+   return Result;
+}
+
+double EntryRange::EffectiveFraction() const
+{
+   return (Size() > 0) ? (double)SampledSize() / Size() : 1;
+}
+
+// The entries to read as [begin, end) pieces in increasing order
+std::vector<std::pair<long long, long long>> EntryRange::Pieces() const
+{
+   if(IsSampled() == true)
+      return Sample;
+   return std::vector<std::pair<long long, long long>>{std::pair<long long, long long>(Begin, End)};
+}
+
+long long EntryRange::First() const
+{
+   return Next(Begin - 1);
+}
+
+// The next entry to read after Entry, End once there is none
+long long EntryRange::Next(long long Entry) const
+{
+   Entry = Entry + 1;
+   if(IsSampled() == false)
+      return Entry;
+
+   auto Piece = std::upper_bound(Sample.begin(), Sample.end(), Entry,
+      [](long long Value, const std::pair<long long, long long> &P) {return Value < P.second;});
+   if(Piece == Sample.end())
+      return End;
+   return std::max(Entry, Piece->first);
+}
+
+// A sampled range is written as one row per piece
+void WriteEntryRange(TDirectory *Directory, const EntryRange &Range)
+{
+   if(Range.IsSampled() == false)
+   {
+      WriteEntryRanges(Directory, std::vector<EntryRange>{Range});
+      return;
+   }
+
+   std::vector<EntryRange> Ranges;
+   for(auto &Piece : Range.Pieces())
+   {
+      EntryRange Part = Range;
+      Part.Begin = Piece.first;
+      Part.End = Piece.second;
+      Ranges.push_back(Part);
+   }
+   if(Ranges.size() == 0)
+   {
+      Ranges.push_back(Range);
+      Ranges.back().End = Range.Begin;
+   }
+   WriteEntryRanges(Directory, Ranges);
+}
+
+void WriteEntryRanges(TDirectory *Directory, const std::vector<EntryRange> &Ranges)
+{
+   if(Directory == nullptr)
+      return;
+   Directory->cd();
+
+   char FileName[1024] = "", TreeName[256] = "";
+   long long Begin, End, Total;
+   int ShardIndex, ShardCount;
+   double SampleFraction;
+   int SampleSeed;
+
+   TTree Tree("EntryRange", "Entry ranges processed");
+   Tree.Branch("FileName", FileName, "FileName/C");
+   Tree.Branch("TreeName", TreeName, "TreeName/C");
+   Tree.Branch("Begin", &Begin, "Begin/L");
+   Tree.Branch("End", &End, "End/L");
+   Tree.Branch("Total", &Total, "Total/L");
+   Tree.Branch("ShardIndex", &ShardIndex, "ShardIndex/I");
+   Tree.Branch("ShardCount", &ShardCount, "ShardCount/I");
+   Tree.Branch("SampleFraction", &SampleFraction, "SampleFraction/D");
+   Tree.Branch("SampleSeed", &SampleSeed, "SampleSeed/I");
+
+   for(const EntryRange &Range : Ranges)
+   {
+      strncpy(FileName, Range.FileName.c_str(), 1023);
+      strncpy(TreeName, Range.TreeName.c_str(), 255);
+      Begin = Range.Begin;
+      End = Range.End;
+      Total = Range.Total;
+      ShardIndex = Range.ShardIndex;
+      ShardCount = Range.ShardCount;
+      SampleFraction = Range.SampleFraction;
+      SampleSeed = Range.SampleSeed;
+      Tree.Fill();
+   }
+
+   Tree.Write();
+}
+
+std::vector<EntryRange> ReadEntryRanges(TTree *Tree)
+{
+   std::vector<EntryRange> Ranges;
+   if(Tree == nullptr)
+      return Ranges;
+
+   char FileName[1024] = "", TreeName[256] = "";
+   long long Begin, End, Total;
+   int ShardIndex, ShardCount;
+   double SampleFraction = 1;
+   int SampleSeed = 1;
+   Tree->SetBranchAddress("FileName", FileName);
+   Tree->SetBranchAddress("TreeName", TreeName);
+   Tree->SetBranchAddress("Begin", &Begin);
+   Tree->SetBranchAddress("End", &End);
+   Tree->SetBranchAddress("Total", &Total);
+   Tree->SetBranchAddress("ShardIndex", &ShardIndex);
+   Tree->SetBranchAddress("ShardCount", &ShardCount);
+   if(Tree->GetBranch("SampleFraction") != nullptr)   // older files have no sampling
+   {
+      Tree->SetBranchAddress("SampleFraction", &SampleFraction);
+      Tree->SetBranchAddress("SampleSeed", &SampleSeed);
+   }
+
+   for(long long iE = 0; iE < Tree->GetEntries(); iE++)
+   {
+      Tree->GetEntry(iE);
+      EntryRange Range;
+      Range.FileName = FileName;
+      Range.TreeName = TreeName;
+      Range.Begin = Begin;
+      Range.End = End;
+      Range.Total = Total;
+      Range.ShardIndex = ShardIndex;
+      Range.ShardCount = ShardCount;
+      Range.SampleFraction = SampleFraction;
+      Range.SampleSeed = SampleSeed;
+      Ranges.push_back(Range);
+   }
+
+   Tree->ResetBranchAddresses();
+   return Ranges;
+}
+
+// True if, for every input file and tree, the ranges cover [0, Total) with no gap and no overlap; gaps
+//    are expected in sampled inputs, which only report the fraction read
+bool CheckEntryRangeCoverage(std::vector<EntryRange> Ranges, std::ostream &out)
+{
+   std::map<std::string, std::vector<EntryRange>> Groups;
+   for(EntryRange &Range : Ranges)
+      Groups[Range.FileName + ":" + Range.TreeName].push_back(Range);
+
+   bool Good = true;
+   for(auto &Group : Groups)
+   {
+      std::vector<EntryRange> &List = Group.second;
+      std::sort(List.begin(), List.end(), [](const EntryRange &A, const EntryRange &B) {return A.Begin < B.Begin;});
+
+      bool Sampled = false;
+      long long Read = 0;
+      for(EntryRange &Range : List)
+      {
+         Sampled = Sampled || Range.IsSampled();
+         Read = Read + Range.Size();
+      }
+
+      long long Position = 0;
+      for(EntryRange &Range : List)
+      {
+         if(Range.Begin > Position && Sampled == false)
+         {
+            out << Group.first << ": entries [" << Position << ", " << Range.Begin << ") not processed" << std::endl;
+            Good = false;
+         }
+         if(Range.Begin < Position)
+         {
+            out << Group.first << ": entries [" << Range.Begin << ", " << std::min(Position, Range.End) << ") processed twice" << std::endl;
+            Good = false;
+         }
+         Position = std::max(Position, Range.End);
+      }
+      if(Sampled == true)
+         out << Group.first << ": sampled, " << Read << " of " << List[0].Total << " entries read (fraction "
+            << ((List[0].Total > 0) ? (double)Read / List[0].Total : 0) << ")" << std::endl;
+      else if(Position < List[0].Total)
+      {
+         out << Group.first << ": entries [" << Position << ", " << List[0].Total << ") not processed" << std::endl;
+         Good = false;
+      }
+   }
+
+   return Good;
+}
@@ -0,0 +1,367 @@
+// Single-read event loop shared by several analyses
+//    Each analysis is a PipelineModule with Begin / Event / End hooks.  In Begin a module asks for the
+//    particle trees it needs (UseTree) and opens its own output; EventPipeline::Run then reads every
+//    requested tree once per entry and hands the entry to all modules in the order they were added.
+//    End writes the module's output, so a fused job gives the same files as the separate programs.
+//
+//    Quantities that several modules need are computed on first use and kept for the rest of the entry:
+//       PipelineEvent::Particles(Tree, Selection)   the particles passing a ParticleSelection, with their
+//                                                   index in the tree, |p|, unit vector and efficiency
+//                                                   weight (1 / efficiency, or 1)
+//       PipelineParticles::Angle(i, j)              pair angle; the matrix is filled once per selection and
+//                                                   for i < j equals GetAngle(P[i], P[j]) bit for bit
+//    A selection is identified by its name, so modules that use the same cuts should use the same name.
+//
+//    --Input                     input file
+//    --Fraction, --Begin, ...    entry range of the first requested tree, as for GetEntryRange
+//    --CacheSize, --Prefetch, --ParallelUnzip    TTreeCache of each tree, as in the fillers
+//    --ProgressJSON, --Timeline  throughput summary and stage timeline, off if empty
+//    All trees of a pipeline must be aligned entry by entry (t and tgen are, tgenBefore is not).  At
+//    the end the wall time spent in each module is printed.
+//    Include CommandLine.h, Messenger.h, EntryRange.h, ProgressBar.h and EECKernels.h before this file.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cmath>
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "Timeline.h"
+#include "alephTrkEfficiency.h"
+
+class EventPipeline;
+class PipelineEvent;
+
+struct ParticleSelection
+{
+   enum ChargeRequirement {AnyCharge, NonzeroCharge, ChargedFlag, EitherCharged};
+   std::string Name;
+   ChargeRequirement Charge;   // charge != 0, isCharged, or either of the two
+   bool HighPurity;
+   double MinE, MinPT, MinTheta;   // theta between MinTheta and pi - MinTheta
+   bool EfficiencyWeight;
+   ParticleSelection(std::string name = "All")
+      : Name(name), Charge(AnyCharge), HighPurity(false), MinE(0), MinPT(0), MinTheta(0), EfficiencyWeight(false) {}
+   bool Pass(ParticleTreeMessenger &M, int i) const;
+};
+
+class PipelineParticles
+{
+public:
+   std::vector<int> Index;          // into the arrays of the tree
+   std::vector<FourVector> P;
+   std::vector<double> Size;        // |p|
+   std::vector<double> UX, UY, UZ;  // unit vectors of the momenta
+   std::vector<double> Weight;      // 1 / efficiency with EfficiencyWeight, 1 otherwise
+private:
+   std::vector<double> D;
+   bool HasAngles;
+public:
+   PipelineParticles() : HasAngles(false) {}
+   int N() const {return P.size();}
+   void Clear();
+   void Add(ParticleTreeMessenger &M, int i, double W);
+   double Angle(int i, int j);
+};
+
+class PipelineModule
+{
+public:
+   virtual ~PipelineModule() {}
+   virtual std::string Name() const = 0;
+   virtual void Begin(EventPipeline &Pipeline) {}
+   virtual void Event(PipelineEvent &Event) = 0;
+   virtual void End() {}
+};
+
+class PipelineEvent
+{
+public:
+   long long Entry;
+   EventPipeline *Pipeline;
+private:
+   std::map<std::string, PipelineParticles> Cache;
+   std::map<std::string, bool> Filled;
+public:
+   PipelineEvent(EventPipeline *pipeline) : Entry(-1), Pipeline(pipeline) {}
+   void Next(long long entry);
+   ParticleTreeMessenger &Tree(std::string Name);
+   PipelineParticles &Particles(std::string TreeName, const ParticleSelection &Selection);
+};
+
+class EventPipeline
+{
+public:
+   std::string InputFileName;
+   TFile *InputFile;
+   EntryRange Range;
+   long long EntriesRead;
+private:
+   CommandLine *CL;
+   std::vector<PipelineModule *> Modules;
+   std::vector<std::string> TreeNames;
+   std::map<std::string, ParticleTreeMessenger *> Trees;
+   alephTrkEfficiency *Efficiency;
+public:
+   EventPipeline(CommandLine &cl);
+   ~EventPipeline();
+   void Add(PipelineModule *Module);
+   void UseTree(std::string Name);
+   ParticleTreeMessenger &Tree(std::string Name);
+   double EfficiencyWeight(ParticleTreeMessenger &M, int i);
+   bool Run();
+};
+
+bool ParticleSelection::Pass(ParticleTreeMessenger &M, int i) const
+{
+   if(Charge == NonzeroCharge && M.charge[i] == 0)
+      return false;
+   if(Charge == ChargedFlag && M.isCharged[i] == false)
+      return false;
+   if(Charge == EitherCharged && M.charge[i] == 0 && M.isCharged[i] == false)
+      return false;
+   if(HighPurity == true && M.highPurity[i] == false)
+      return false;
+   if(M.P[i][0] < MinE)
+      return false;
+   if(M.P[i].GetPT() < MinPT)
+      return false;
+   if(M.P[i].GetTheta() < MinTheta || M.P[i].GetTheta() > M_PI - MinTheta)
+      return false;
+   return true;
+}
+
+void PipelineParticles::Clear()
+{
+   Index.clear();
+   P.clear();
+   Size.clear();
+   UX.clear();
+   UY.clear();
+   UZ.clear();
+   Weight.clear();
+   HasAngles = false;
+}
+
+void PipelineParticles::Add(ParticleTreeMessenger &M, int i, double W)
+{
+   FourVector &Momentum = M.P[i];
+   double S = Momentum.GetP();
+   Index.push_back(i);
+   P.push_back(Momentum);
+   Size.push_back(S);
+   UX.push_back(Momentum[1] / S);
+   UY.push_back(Momentum[2] / S);
+   UZ.push_back(Momentum[3] / S);
+   Weight.push_back(W);
+}
+
+// The upper triangle is filled on the first call, the same way EECPairLoopFast does it
+double PipelineParticles::Angle(int i, int j)
+{
+   int n = P.size();
+   if(HasAngles == false)
+   {
+      TIMELINE_SCOPE("PipelineAngles", "pairs");
+      D.resize(n * n);
+      for(int a = 0; a < n; a++)
+         for(int b = a + 1; b < n; b++)
+            D[a*n+b] = PairAngle(P[a][1] * P[b][1] + P[a][2] * P[b][2] + P[a][3] * P[b][3], Size[a], Size[b]);
+      HasAngles = true;
+   }
+   if(i > j)
+      return D[j*n+i];
+   if(i == j)
+      return 0;
+   return D[i*n+j];
+}
+
+void PipelineEvent::Next(long long entry)
+{
+   Entry = entry;
+   for(auto &Item : Filled)
+      Item.second = false;
+}
+
+ParticleTreeMessenger &PipelineEvent::Tree(std::string Name)
+{
+   return Pipeline->Tree(Name);
+}
+
+PipelineParticles &PipelineEvent::Particles(std::string TreeName, const ParticleSelection &Selection)
+{
+   std::string Key = TreeName + ":" + Selection.Name;
+   PipelineParticles &Result = Cache[Key];
+   if(Filled[Key] == true)
+      return Result;
+
+   TIMELINE_SCOPE("PipelineParticles", "select");
+   ParticleTreeMessenger &M = Tree(TreeName);
+   Result.Clear();
+   for(int i = 0; i < M.nParticle; i++)
+   {
+      if(Selection.Pass(M, i) == false)
+         continue;
+      Result.Add(M, i, (Selection.EfficiencyWeight == true) ? Pipeline->EfficiencyWeight(M, i) : 1);
+   }
+   Filled[Key] = true;
+   return Result;
+}
+
+EventPipeline::EventPipeline(CommandLine &cl)
+   : InputFile(nullptr), EntriesRead(0), CL(&cl), Efficiency(nullptr)
+{
+   InputFileName = CL->Get("Input");
+}
+
+EventPipeline::~EventPipeline()
+{
+   for(auto &Item : Trees)
+      delete Item.second;
+   if(Efficiency != nullptr)
+      delete Efficiency;
+   if(InputFile != nullptr)
+   {
+      InputFile->Close();
+      delete InputFile;
+   }
+}
+
+void EventPipeline::Add(PipelineModule *Module)
+{
+   Modules.push_back(Module);
+}
+
+// Called from the Begin of a module
+void EventPipeline::UseTree(std::string Name)
+{
+   for(std::string &Existing : TreeNames)
+      if(Existing == Name)
+         return;
+   TreeNames.push_back(Name);
+}
+
+ParticleTreeMessenger &EventPipeline::Tree(std::string Name)
+{
+   auto Iterator = Trees.find(Name);
+   if(Iterator == Trees.end())
+   {
+      std::cerr << "EventPipeline: tree " << Name << " was not requested in Begin" << std::endl;
+      exit(1);
+   }
+   return *Iterator->second;
+}
+
+// As in ReduceTree: the efficiency map of the reconstructed tracks, zero efficiency gives a zero weight
+double EventPipeline::EfficiencyWeight(ParticleTreeMessenger &M, int i)
+{
+   if(Efficiency == nullptr)
+      Efficiency = new alephTrkEfficiency;
+   double E = Efficiency->efficiency(M.P[i].GetTheta(), M.P[i].GetPhi(), M.P[i].GetPT(), M.nChargedHadronsHP);
+   return (E > 0) ? (1 / E) : 0;
+}
+
+bool EventPipeline::Run()
+{
+   double Fraction         = CL->GetDouble("Fraction", 1.00);
+   double CacheSize        = CL->GetDouble("CacheSize", -1);   // in MB; negative = sized from active branches, 0 = off
+   bool Prefetch           = CL->GetBool("Prefetch", true);
+   bool ParallelUnzip      = CL->GetBool("ParallelUnzip", false);
+   std::string ProgressJSON     = CL->Get("ProgressJSON", "");
+   std::string TimelineFileName = CL->Get("Timeline", "");
+
+   Timeline::Start(TimelineFileName);
+
+   for(PipelineModule *Module : Modules)
+      Module->Begin(*this);
+   if(TreeNames.size() == 0)
+   {
+      std::cerr << "EventPipeline: no module asked for a tree" << std::endl;
+      return false;
+   }
+
+   InputFile = TFile::Open(InputFileName.c_str());
+   if(InputFile == nullptr || InputFile->IsZombie() == true)
+   {
+      std::cerr << "EventPipeline: cannot open " << InputFileName << std::endl;
+      return false;
+   }
+
+   for(std::string &Name : TreeNames)
+   {
+      ParticleTreeMessenger *M = new ParticleTreeMessenger(InputFile, Name);
+      Trees[Name] = M;
+      if(M->Tree == nullptr)
+      {
+         std::cerr << "EventPipeline: tree " << Name << " not found in " << InputFileName << std::endl;
+         return false;
+      }
+      if(M->GetEntries() != Trees[TreeNames[0]]->GetEntries())
+      {
+         std::cerr << "EventPipeline: tree " << Name << " is not aligned with " << TreeNames[0] << std::endl;
+         return false;
+      }
+      if(CacheSize != 0)
+         M->EnableCache((CacheSize > 0) ? (long long)(CacheSize * 1048576) : -1, 100, Prefetch, ParallelUnzip);
+   }
+
+   ParticleTreeMessenger &First = *Trees[TreeNames[0]];
+   std::vector<long long> Clusters = GetClusterBoundaries(First.Tree);
+   Range = GetEntryRange(*CL, Clusters, TreeNames[0], InputFileName, Fraction);
+
+   // the stage names have to outlive the timeline
+   std::vector<std::string> StageNames;
+   for(PipelineModule *Module : Modules)
+      StageNames.push_back(Module->Name());
+   std::vector<double> ModuleTime(Modules.size(), 0);
+
+   PipelineEvent Event(this);
+   ProgressBar Bar(std::cout, Range.SampledSize());
+   long long Position = 0;
+   for(long long iE = Range.First(); iE < Range.End; iE = Range.Next(iE))
+   {
+      Bar.Update(Position);
+      Bar.PrintIfDue();
+      Position = Position + 1;
+
+      {
+         TIMELINE_SCOPE("PipelineRead", "io");
+         for(auto &Item : Trees)
+            Item.second->GetEntry(iE);
+      }
+      EntriesRead = EntriesRead + 1;
+      Event.Next(iE);
+
+      for(int i = 0; i < (int)Modules.size(); i++)
+      {
+         ScopedTimer Timer(StageNames[i].c_str(), "module");
+         auto Start = std::chrono::steady_clock::now();
+         Modules[i]->Event(Event);
+         ModuleTime[i] = ModuleTime[i] + std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+      }
+   }
+   Bar.Update(Range.SampledSize());
+   Bar.Print();
+   Bar.PrintLine();
+   Bar.PrintSummary();
+   Bar.WriteJSON(ProgressJSON, "EventPipeline");
+
+   for(auto &Item : Trees)
+      Item.second->IO.PrintStatistics(std::cout, Item.first);
+   for(int i = 0; i < (int)Modules.size(); i++)
+      std::cout << "[Pipeline] " << std::setw(24) << std::left << StageNames[i] << std::right
+         << std::setw(12) << std::fixed << std::setprecision(3) << ModuleTime[i] << " s" << std::endl;
+   std::cout << std::defaultfloat << std::setprecision(6);
+
+   for(PipelineModule *Module : Modules)
+      Module->End();
+
+   Timeline::Finish(&std::cout);
+
+   return true;
+}
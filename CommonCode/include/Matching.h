@@ -4,17 +4,21 @@
 #include <deque>
 #include <cmath>
 
+#include "Timeline.h"
+
 #define HungarianMAX 500
 
-template <class O, class o>
-void BruteForceMatchJets(double (*Metric)(O,o), std::vector<O> &A, std::vector<o> &B,
+// The metric can be any callable taking (O, o) and returning the distance: a plain function,
+// a lambda or a policy object.  It is a template parameter so that the compiler can inline it.
+template <class Metric, class O, class o>
+void BruteForceMatchJets(Metric &Distance, const std::vector<O> &A, const std::vector<o> &B,
    std::vector<int> Mapping, std::vector<int> &Best, int l, int r, double &MinDistance);
-template <class O, class o>
-std::map<int, int> MatchJetsGreedy(double (*Metric)(O,o), std::vector<O> GenJets, std::vector<o> RecoJets);
-template <class O, class o>
-std::map<int, int> MatchJetsBruteForce(double (*Metric)(O,o), std::vector<O> GenJets, std::vector<o> RecoJets);
-template <class O, class o>
-std::map<int, int> MatchJetsHungarian(double (*Metric)(O,o), std::vector<O> GenJets, std::vector<o> RecoJets);
+template <class Metric, class O, class o>
+std::map<int, int> MatchJetsGreedy(Metric &&Distance, const std::vector<O> &GenJets, const std::vector<o> &RecoJets);
+template <class Metric, class O, class o>
+std::map<int, int> MatchJetsBruteForce(Metric &&Distance, const std::vector<O> &GenJets, const std::vector<o> &RecoJets);
+template <class Metric, class O, class o>
+std::map<int, int> MatchJetsHungarian(Metric &&Distance, const std::vector<O> &GenJets, const std::vector<o> &RecoJets);
 bool DoHungarianAssignment(int N, double Cost[HungarianMAX][HungarianMAX], int Assignment[HungarianMAX]);
 bool DoHungarianSubtraction(int N, double Cost[HungarianMAX][HungarianMAX], int Assignment[HungarianMAX]);
 template <class O>
@@ -22,8 +26,8 @@ void PrintVector(int N, O V[HungarianMAX]);
 template <class O>
 void PrintMatrix(int N, O Cost[HungarianMAX][HungarianMAX]);
 
-template <class O, class o>
-void BruteForceMatchJets(double (*Metric)(O,o), std::vector<O> &A, std::vector<o> &B,
+template <class Metric, class O, class o>
+void BruteForceMatchJets(Metric &Distance, const std::vector<O> &A, const std::vector<o> &B,
    std::vector<int> Mapping, std::vector<int> &Best, int l, int r, double &MinDistance)
 {
    if(l == r)
@@ -31,7 +35,7 @@ void BruteForceMatchJets(double (*Metric)(O,o), std::vector<O> &A, std::vector<o
       double SumDistance = 0;
       for(int i = 0; i < (int)A.size(); i++)
          if(Mapping[i] < (int)B.size() && Mapping[i] >= 0)
-            SumDistance += (*Metric)(A[i], B[Mapping[i]]);
+            SumDistance += Distance(A[i], B[Mapping[i]]);
 
       if(SumDistance < MinDistance)
       {
@@ -46,20 +50,20 @@ void BruteForceMatchJets(double (*Metric)(O,o), std::vector<O> &A, std::vector<o
       for(int i = 0; i < (int)A.size(); i++)
          if(Mapping[i] < B.size() && Mapping[i] >= 0)
             if(i < l)
-               FixedDistance += (*Metric)(A[i], B[Mapping[i]]);
+               FixedDistance += Distance(A[i], B[Mapping[i]]);
 
       for(int i = l; i <= r; i++)
       {
          swap(Mapping[l], Mapping[i]);
          if(FixedDistance < MinDistance)
-            BruteForceMatchJets<O,o>(Metric, A, B, Mapping, Best, l + 1, r, MinDistance);
+            BruteForceMatchJets(Distance, A, B, Mapping, Best, l + 1, r, MinDistance);
          swap(Mapping[l], Mapping[i]);
       }
    }
 }
 
-template <class O, class o>
-std::map<int, int> MatchJetsGreedy(double (*Metric)(O,o), std::vector<O> GenJets, std::vector<o> RecoJets)
+template <class Metric, class O, class o>
+std::map<int, int> MatchJetsGreedy(Metric &&Distance, const std::vector<O> &GenJets, const std::vector<o> &RecoJets)
 {
    std::map<int, int> GenReco;
 
@@ -70,11 +74,11 @@ std::map<int, int> MatchJetsGreedy(double (*Metric)(O,o), std::vector<O> GenJets
 
       for(int iR = 0; iR < (int)RecoJets.size(); iR++)
       {
-         double Distance = (*Metric)(GenJets[iG], RecoJets[iR]);
-         if(BestDistance < 0 || BestDistance > Distance)
+         double CurrentDistance = Distance(GenJets[iG], RecoJets[iR]);
+         if(BestDistance < 0 || BestDistance > CurrentDistance)
          {
             BestIndex = iR;
-            BestDistance = Distance;
+            BestDistance = CurrentDistance;
          }
       }
 
@@ -84,8 +88,8 @@ std::map<int, int> MatchJetsGreedy(double (*Metric)(O,o), std::vector<O> GenJets
    return GenReco;
 }
 
-template <class O, class o>
-std::map<int, int> MatchJetsBruteForce(double (*Metric)(O,o), std::vector<O> GenJets, std::vector<o> RecoJets)
+template <class Metric, class O, class o>
+std::map<int, int> MatchJetsBruteForce(Metric &&Distance, const std::vector<O> &GenJets, const std::vector<o> &RecoJets)
 {
    std::map<int, int> GenReco;
 
@@ -95,7 +99,7 @@ std::map<int, int> MatchJetsBruteForce(double (*Metric)(O,o), std::vector<O> Gen
 
    for(int i = 0; i < (int)GenJets.size(); i++)
       Mapping.push_back(i);
-   BruteForceMatchJets<O,o>(Metric, GenJets, RecoJets, Mapping, Best, 0, GenJets.size() - 1, MinDistance);
+   BruteForceMatchJets(Distance, GenJets, RecoJets, Mapping, Best, 0, GenJets.size() - 1, MinDistance);
 
    for(int i = 0; i < GenJets.size(); i++)
    {
@@ -108,9 +112,11 @@ std::map<int, int> MatchJetsBruteForce(double (*Metric)(O,o), std::vector<O> Gen
    return GenReco;
 }
 
-template <class O, class o>
-std::map<int, int> MatchJetsHungarian(double (*Metric)(O,o), std::vector<O> JetsA, std::vector<o> JetsB)
+template <class Metric, class O, class o>
+std::map<int, int> MatchJetsHungarian(Metric &&Distance, const std::vector<O> &JetsA, const std::vector<o> &JetsB)
 {
+   TIMELINE_SCOPE("MatchJetsHungarian", "match");
+
    // Step 0 - construct initial cost matrix
    int NA = JetsA.size();
    int NB = JetsB.size();
@@ -124,7 +130,7 @@ std::map<int, int> MatchJetsHungarian(double (*Metric)(O,o), std::vector<O> Jets
          if(iA >= NA || iB >= NB)
             Cost[iA][iB] = 99999;
          else
-            Cost[iA][iB] = (*Metric)(JetsA[iA], JetsB[iB]);
+            Cost[iA][iB] = Distance(JetsA[iA], JetsB[iB]);
       }
    }
 
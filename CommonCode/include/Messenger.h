@@ -10,14 +10,39 @@
 #define MAXPW 6
 #define MAXPARTICLE 1000
 
+class MessengerIO;
 class JetTreeMessenger;
 class ParticleTreeMessenger;
+class ReducedEventSource;
 class ReducedTreeMessenger;
+class SelectionIndexMessenger;
+
+// Shared I/O bookkeeping for the tree messengers: cached entry count, optional TTreeCache
+//    with asynchronous prefetch and parallel unzipping, and read-time / bytes-read counters
+class MessengerIO
+{
+public:
+   TTree     *CachedTree;
+   long long  Entries;       // cached TTree::GetEntries() of CachedTree
+   long long  EntriesRead;   // number of TTree::GetEntry calls
+   long long  BytesRead;     // uncompressed bytes returned by TTree::GetEntry
+   double     ReadTime;      // wall time spent in TTree::GetEntry, in seconds
+public:
+   MessengerIO();
+   void Reset(TTree *tree);
+   long long GetEntries(TTree *tree);
+   bool EnableCache(TTree *tree, long long CacheSize = -1, int LearnEntries = 100,
+      bool Prefetch = true, bool ParallelUnzip = false);
+   int Read(TTree *tree, long long iEntry);
+   long long GetFileBytesRead(TTree *tree);
+   void PrintStatistics(std::ostream &out, std::string Label);
+};
 
 class JetTreeMessenger
 {
 public:
    TTree *Tree;
+   MessengerIO IO;
    int    nref;
    float  jtpt[MAXJET];
    float  jteta[MAXJET];
@@ -42,12 +67,14 @@ public:
    bool Initialize();
    bool GetEntry(int iEntry);
    int GetEntries();
+   bool EnableCache(long long CacheSize = -1, int LearnEntries = 100, bool Prefetch = true, bool ParallelUnzip = false);
 };
 
 class ParticleTreeMessenger
 {
 public:
    TTree *Tree;
+   MessengerIO IO;
    int           EventNo;
    int           RunNo;
    int           year;
@@ -259,13 +286,29 @@ public:
    bool Initialize();
    bool GetEntry(int iEntry);
    int GetEntries();
+   bool EnableCache(long long CacheSize = -1, int LearnEntries = 100, bool Prefetch = true, bool ParallelUnzip = false);
    bool PassBaselineCut();
 };
 
+// Storage other than a TTree behind ReducedTreeMessenger, e.g. an RNTuple (see RNTupleIO.h)
+class ReducedEventSource
+{
+public:
+   virtual ~ReducedEventSource() {}
+   virtual long long GetEntries() = 0;
+   virtual std::vector<long long> GetClusterBoundaries() = 0;
+   virtual bool Read(long long iEntry, ReducedTreeMessenger &M) = 0;
+};
+
+// Reads the reduced format from a TTree, or from an RNTuple when the program includes RNTupleIO.h
 class ReducedTreeMessenger
 {
+public:
+   static ReducedEventSource *(*OpenSource)(TFile *file, std::string name);
 public:
    TTree *Tree;
+   ReducedEventSource *Source;   // used instead of Tree when the input is not a TTree
+   MessengerIO IO;
    int    N;
    float  Momentum[MAXPARTICLE];
    float  Mass[MAXPARTICLE];
@@ -274,6 +317,8 @@ public:
    float  Weight[MAXPARTICLE];
    short  Charge[MAXPARTICLE];
    bool   PassCut;
+   int    RunNo;     // -1 in reduced files written before the event identifiers were kept
+   int    EventNo;
 public:
    std::vector<FourVector> P;
 public:
@@ -281,10 +326,47 @@ public:
    ReducedTreeMessenger(TFile &file, std::string name);
    ReducedTreeMessenger(TFile *file, std::string name);
    ReducedTreeMessenger(TTree *tree);
+   ~ReducedTreeMessenger();
+   bool Open(TFile *file, std::string name);
    bool Initialize(TTree *tree);
    bool Initialize();
    bool GetEntry(int iEntry);
    int GetEntries();
+   std::vector<long long> GetClusterBoundaries();
+   bool EnableCache(long long CacheSize = -1, int LearnEntries = 100, bool Prefetch = true, bool ParallelUnzip = false);
 };
 
+class SelectionIndexMessenger
+{
+public:
+   TTree *Tree;
+   MessengerIO IO;
+   int    RunNo;            // -1 in indices written without the event identifiers
+   int    EventNo;
+   bool   PassBaselineCut;
+   bool   passesLEP1TwoPC;
+   bool   passesSTheta;
+   bool   passesAll;
+   float  STheta;
+   float  TTheta;
+   short  SThetaCategory;   // STheta in units of pi/36, rounded down
+   short  TThetaCategory;   // TTheta in units of pi/36, rounded down
+   int    nParticle;
+   int    nChargedHadronsHP;
+   float  TotalE;
+   float  SumP;
+   int    N5Jet;            // number of jets with E >= 5 GeV, -1 if no jet tree was indexed
+public:
+   SelectionIndexMessenger();
+   SelectionIndexMessenger(TFile &file, std::string name);
+   SelectionIndexMessenger(TFile *file, std::string name);
+   SelectionIndexMessenger(TTree *tree);
+   bool Initialize(TTree *tree);
+   bool Initialize();
+   bool GetEntry(int iEntry);
+   int GetEntries();
+   bool EnableCache(long long CacheSize = -1, int LearnEntries = 100, bool Prefetch = true, bool ParallelUnzip = false);
+   bool Pass(bool CheckCut, bool CheckSphericity, bool Reject3Jet);
+   bool IsAlignedWith(ParticleTreeMessenger &M, std::ostream &out);
+};
 
@@ -0,0 +1,295 @@
+// Stop an EEC filling job once the bins of interest are precise enough
+//    --TargetPrecision p            stop when every bin in the range has a relative error below p
+//                                   (default 0, off)
+//    --PrecisionRange min,max       range of the observable (theta or z, in the units of the bin edges)
+//                                   that is checked, default the whole histogram
+//    --PrecisionInterval n          selected events between two checks (default 10000)
+//    --PrecisionMinEvents n         never stop before this many selected events (default 10000)
+//    --PrecisionSeed s              seed of the cluster order (default 1)
+//
+//    With a target set, the clusters of the entry range are read in a random order (the entries inside a
+//    cluster stay in order, so every basket is still read once), so that stopping early does not keep
+//    only the start of the file.  The loop asks Entry(i) for the i-th of the Range.SampledSize() entries
+//    to read; without a target these are the entries of the range, or of its --SampleFraction clusters,
+//    in order.  The order only depends on the seed, so a checkpointed FirstExploration (26436) resumed
+//    with --Resume continues the same sequence; the other fillers have no checkpoint.
+//
+//    After the loop Finish() records the precision if the target was not met, ProcessedRanges() gives
+//    the entries actually read, to be written in place of the EntryRange, and Write() stores the target,
+//    the precision reached and the effective event count in a "PrecisionTarget" tree.  The normalization
+//    histograms count only the events that were read.  ReadPrecisionTargets() and WritePrecisionTargets()
+//    carry the tree through HistogramMerger with one entry per job.
+//    Include CommandLine.h and EntryRange.h before this file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#include "TTree.h"
+#include "TH1.h"
+#include "TDirectory.h"
+
+struct PrecisionTargetRecord
+{
+   double Target;
+   double Achieved;
+   double RangeMin, RangeMax;
+   long long EntriesRead;
+   long long EntriesAvailable;
+   long long EventsSelected;
+   int Seed;
+   bool Stopped;
+};
+
+class PrecisionTarget
+{
+private:
+   struct Block
+   {
+      long long Position;   // loop position of the first entry of the cluster
+      long long Begin;
+      long long End;
+   };
+public:
+   double Target;
+   double RangeMin, RangeMax;
+   long long Interval;
+   long long MinEvents;
+   int Seed;
+   double Achieved;
+   long long EntriesRead;
+   long long EventsSelected;
+   bool Stopped;
+private:
+   std::vector<Block> Blocks;
+   int Cursor;
+   long long NextCheck;
+public:
+   PrecisionTarget(CommandLine &CL, std::vector<long long> Clusters, const EntryRange &Range);
+   bool IsEnabled() const;
+   long long Entry(long long Position);
+   bool Reached(TH1 &H, const double Edges[], long long Selected, long long Position);
+   void Finish(TH1 &H, const double Edges[], long long Selected);
+   double GetPrecision(TH1 &H, const double Edges[]) const;
+   std::vector<EntryRange> ProcessedRanges(const EntryRange &Range) const;
+   void Write(TDirectory *Directory, long long EntriesAvailable) const;
+};
+
+std::vector<PrecisionTargetRecord> ReadPrecisionTargets(TTree *Tree);
+void WritePrecisionTargets(TDirectory *Directory, const std::vector<PrecisionTargetRecord> &Records);
+
+PrecisionTarget::PrecisionTarget(CommandLine &CL, std::vector<long long> Clusters, const EntryRange &Range)
+   : Achieved(-1), EntriesRead(Range.SampledSize()), EventsSelected(-1), Stopped(false), Cursor(0), NextCheck(0)
+{
+   Target = CL.GetDouble("TargetPrecision", 0);
+   std::vector<double> PrecisionRange = CL.GetDoubleVector("PrecisionRange", std::vector<double>{-1e10, 1e10});
+   RangeMin = (PrecisionRange.size() > 0) ? PrecisionRange[0] : -1e10;
+   RangeMax = (PrecisionRange.size() > 1) ? PrecisionRange[1] : 1e10;
+   Interval = CL.GetInt("PrecisionInterval", 10000);
+   MinEvents = CL.GetInt("PrecisionMinEvents", 10000);
+   Seed = CL.GetInt("PrecisionSeed", 1);
+   NextCheck = std::max(Interval, MinEvents);
+
+   // the clusters cut to the pieces of the entry range; a tree without cluster information is read in order
+   std::vector<Block> Pieces;
+   for(auto &Piece : Range.Pieces())
+   {
+      if(Clusters.size() < 2 || Target <= 0)
+      {
+         Pieces.push_back(Block{0, Piece.first, Piece.second});
+         continue;
+      }
+      for(int i = 0; i + 1 < (int)Clusters.size(); i++)
+      {
+         long long Begin = std::max(Clusters[i], Piece.first);
+         long long End = std::min(Clusters[i+1], Piece.second);
+         if(Begin < End)
+            Pieces.push_back(Block{0, Begin, End});
+      }
+   }
+   if(Clusters.size() >= 2 && Target > 0)
+   {
+      std::mt19937_64 Random(Seed);
+      std::shuffle(Pieces.begin(), Pieces.end(), Random);
+   }
+
+   long long Position = 0;
+   for(Block &B : Pieces)
+   {
+      B.Position = Position;
+      Position = Position + (B.End - B.Begin);
+      Blocks.push_back(B);
+   }
+}
+
+bool PrecisionTarget::IsEnabled() const
+{
+   return Target > 0;
+}
+
+// Positions are asked for in increasing order in the loop, so the block is found from the last one
+long long PrecisionTarget::Entry(long long Position)
+{
+   if(Blocks.size() == 0)
+      return Position;
+   if(Cursor >= (int)Blocks.size() || Blocks[Cursor].Position > Position)
+      Cursor = 0;
+   while(Cursor + 1 < (int)Blocks.size() && Blocks[Cursor+1].Position <= Position)
+      Cursor = Cursor + 1;
+   return Blocks[Cursor].Begin + (Position - Blocks[Cursor].Position);
+}
+
+// Called once per selected event with the loop position of the next entry; true once the target is met
+bool PrecisionTarget::Reached(TH1 &H, const double Edges[], long long Selected, long long Position)
+{
+   if(IsEnabled() == false || Selected < NextCheck)
+      return false;
+   NextCheck = Selected + Interval;
+
+   Achieved = GetPrecision(H, Edges);
+   std::cout << "[Precision] " << Selected << " events: worst relative error " << Achieved
+      << " (target " << Target << ")" << std::endl;
+   if(Achieved < 0 || Achieved > Target)
+      return false;
+
+   Stopped = true;
+   EntriesRead = Position;
+   EventsSelected = Selected;
+   return true;
+}
+
+// The precision at the end of a loop that ran to the end of the range
+void PrecisionTarget::Finish(TH1 &H, const double Edges[], long long Selected)
+{
+   if(IsEnabled() == false || Stopped == true)
+      return;
+   Achieved = GetPrecision(H, Edges);
+   EventsSelected = Selected;
+   std::cout << "[Precision] target " << Target << " not reached, worst relative error " << Achieved
+      << " after all " << Selected << " events" << std::endl;
+}
+
+// Largest relative error of the bins whose edges lie inside the range; an empty bin counts as infinitely
+//    imprecise, and -1 means no bin was inside
+double PrecisionTarget::GetPrecision(TH1 &H, const double Edges[]) const
+{
+   double Worst = -1;
+   for(int i = 1; i <= H.GetNbinsX(); i++)
+   {
+      if(Edges[i-1] < RangeMin || Edges[i] > RangeMax)
+         continue;
+      double Content = H.GetBinContent(i);
+      double Error = H.GetBinError(i);
+      if(Content <= 0)
+         return INFINITY;
+      Worst = std::max(Worst, Error / Content);
+   }
+   return Worst;
+}
+
+// The clusters read, in entry order and merged where they touch
+std::vector<EntryRange> PrecisionTarget::ProcessedRanges(const EntryRange &Range) const
+{
+   std::vector<std::pair<long long, long long>> Read;
+   for(const Block &B : Blocks)
+   {
+      if(B.Position >= EntriesRead)
+         continue;
+      Read.push_back(std::pair<long long, long long>(B.Begin, B.Begin + std::min(B.End - B.Begin, EntriesRead - B.Position)));
+   }
+   std::sort(Read.begin(), Read.end());
+
+   std::vector<EntryRange> Result;
+   for(auto &Item : Read)
+   {
+      if(Result.size() > 0 && Result.back().End == Item.first)
+      {
+         Result.back().End = Item.second;
+         continue;
+      }
+      EntryRange Piece = Range;
+      Piece.Begin = Item.first;
+      Piece.End = Item.second;
+      Result.push_back(Piece);
+   }
+   if(Result.size() == 0)
+   {
+      EntryRange Piece = Range;
+      Piece.End = Piece.Begin;
+      Result.push_back(Piece);
+   }
+   return Result;
+}
+
+void PrecisionTarget::Write(TDirectory *Directory, long long EntriesAvailable) const
+{
+   if(Directory == nullptr || IsEnabled() == false)
+      return;
+
+   PrecisionTargetRecord Record;
+   Record.Target = Target;
+   Record.Achieved = Achieved;
+   Record.RangeMin = RangeMin;
+   Record.RangeMax = RangeMax;
+   Record.EntriesRead = EntriesRead;
+   Record.EntriesAvailable = EntriesAvailable;
+   Record.EventsSelected = EventsSelected;
+   Record.Seed = Seed;
+   Record.Stopped = Stopped;
+   WritePrecisionTargets(Directory, std::vector<PrecisionTargetRecord>{Record});
+}
+
+std::vector<PrecisionTargetRecord> ReadPrecisionTargets(TTree *Tree)
+{
+   std::vector<PrecisionTargetRecord> Result;
+   if(Tree == nullptr)
+      return Result;
+
+   PrecisionTargetRecord R;
+   Tree->SetBranchAddress("Target", &R.Target);
+   Tree->SetBranchAddress("Achieved", &R.Achieved);
+   Tree->SetBranchAddress("RangeMin", &R.RangeMin);
+   Tree->SetBranchAddress("RangeMax", &R.RangeMax);
+   Tree->SetBranchAddress("EntriesRead", &R.EntriesRead);
+   Tree->SetBranchAddress("EntriesAvailable", &R.EntriesAvailable);
+   Tree->SetBranchAddress("EventsSelected", &R.EventsSelected);
+   Tree->SetBranchAddress("Seed", &R.Seed);
+   Tree->SetBranchAddress("Stopped", &R.Stopped);
+
+   for(long long iE = 0; iE < Tree->GetEntries(); iE++)
+   {
+      Tree->GetEntry(iE);
+      Result.push_back(R);
+   }
+
+   Tree->ResetBranchAddresses();
+   return Result;
+}
+
+void WritePrecisionTargets(TDirectory *Directory, const std::vector<PrecisionTargetRecord> &Records)
+{
+   if(Directory == nullptr)
+      return;
+   Directory->cd();
+
+   PrecisionTargetRecord R;
+   TTree Tree("PrecisionTarget", "Precision-targeted early stop");
+   Tree.Branch("Target", &R.Target, "Target/D");
+   Tree.Branch("Achieved", &R.Achieved, "Achieved/D");
+   Tree.Branch("RangeMin", &R.RangeMin, "RangeMin/D");
+   Tree.Branch("RangeMax", &R.RangeMax, "RangeMax/D");
+   Tree.Branch("EntriesRead", &R.EntriesRead, "EntriesRead/L");
+   Tree.Branch("EntriesAvailable", &R.EntriesAvailable, "EntriesAvailable/L");
+   Tree.Branch("EventsSelected", &R.EventsSelected, "EventsSelected/L");
+   Tree.Branch("Seed", &R.Seed, "Seed/I");
+   Tree.Branch("Stopped", &R.Stopped, "Stopped/O");
+   for(const PrecisionTargetRecord &Record : Records)
+   {
+      R = Record;
+      Tree.Fill();
+   }
+   Tree.Write();
+}
@@ -1,11 +1,27 @@
 // Progress bar class
 // Author: Yi Chen
+//
+// With SetTelemetry(true) the bar also reports the event rate, the pair rate, the ETA, the resident memory
+//    and the bytes read; it is off by default, so the bar keeps its plain format.  Events default to the
+//    progress; AddEvents, AddPairs and AddBytes are atomic, so worker threads can feed them and call
+//    Tick(), and PrintIfDue() prints at most once per interval (0.5 s by default) whoever calls it.
+//    PrintSummary() and WriteJSON() report the totals at the end of the job.
+//    Bytes read default to the rchar counter of /proc/self/io when the caller does not feed them.
 
 #include <iostream>
 #include <iomanip>
 #include <ostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <cstdlib>
 
+#include <unistd.h>
+#include <sys/resource.h>
+
 class ProgressBar
 {
 private:
@@ -15,20 +31,37 @@ private:
    int Column;
    double Progress;
    int Style;
+   std::chrono::steady_clock::time_point StartTime;
+   std::atomic<long long> LastPrint;   // nanoseconds since StartTime, -1 before the first print
+   double Interval;                    // seconds between throttled prints
+   bool ShowTelemetry;
+   std::atomic<long long> EventCount;
+   std::atomic<long long> PairCount;
+   std::atomic<long long> ByteCount;
    void SanityCheck();
+   void StartClock();
+   std::string GetTelemetry();
 public:
    ProgressBar(std::ostream &out, double max = 100, double min = 0, int column = 80)
-      : Out(&out), Max(max), Min(min), Column(column), Progress(0), Style(0) {SanityCheck();}
+      : Out(&out), Max(max), Min(min), Column(column), Progress(0), Style(0) {SanityCheck();   StartClock();}
    ProgressBar(std::ostream *out, double max = 100, double min = 0, int column = 80)
-      : Out(out), Max(max), Min(min), Column(column), Progress(0), Style(0) {SanityCheck();}
+      : Out(out), Max(max), Min(min), Column(column), Progress(0), Style(0) {SanityCheck();   StartClock();}
    ~ProgressBar() {}
    void Print();
    void PrintWithMod(int Mod);
    void Print(double progress);
+   bool IsDue();
+   void PrintIfDue() {if(IsDue() == true) Print();}
+   void Tick(long long N = 1);
+   void PrintSummary();
+   void WriteJSON(std::string FileName, std::string Name = "");
    void ChangeLine() {*Out << std::endl;}
    void PrintLine() {*Out << std::endl;}
    void Update(double progress) {SetProgress(progress);}
    void Increment(double change = 1) {Progress = Progress + change;}
+   void AddEvents(long long N = 1) {EventCount.fetch_add(N, std::memory_order_relaxed);}
+   void AddPairs(long long N) {PairCount.fetch_add(N, std::memory_order_relaxed);}
+   void AddBytes(long long N) {ByteCount.fetch_add(N, std::memory_order_relaxed);}
 public:
    double GetMin() {return Min;}
    double GetMax() {return Max;}
@@ -37,6 +70,14 @@ public:
    int GetStyle() {return Style;}
    std::ostream *GetStream() {return Out;}
    double GetPercentage() {return (Progress - Min) / (Max - Min);}
+   double GetElapsedTime();
+   double GetEventsDone();
+   long long GetPairs() {return PairCount.load();}
+   long long GetBytesRead();
+   double GetEventRate();
+   double GetETA();
+   static long long GetResidentMemory();
+   static long long GetPeakMemory();
 public:
    void SetMin(double min) {Min = min;   SanityCheck();}
    void SetMax(double max) {Max = max;   SanityCheck();}
@@ -45,8 +86,15 @@ public:
    void SetStyle(int style) {if(style == -1) Style = rand() % 6; else Style = style;   SanityCheck();}
    void SetStream(std::ostream &out) {Out = &out;   SanityCheck();}
    void SetStream(std::ostream *out) {Out = out;   SanityCheck();}
+   void SetInterval(double seconds) {Interval = seconds;}
+   void SetTelemetry(bool show) {ShowTelemetry = show;}
+   void SetBytesRead(long long N) {ByteCount.store(N);}
 };
 
+std::string FormatProgressCount(double Value);
+std::string FormatProgressTime(double Seconds);
+std::string FormatProgressBytes(double Bytes);
+
 void ProgressBar::SanityCheck()
 {
    if(Min == Max)
@@ -232,6 +280,196 @@ void ProgressBar::Print(double progress)
    }
    if(Style == 7)
       *Out << "\033[1GCurrent progress: " << progress - Min << std::flush;
+
+   if(ShowTelemetry == true)
+      *Out << GetTelemetry() << "\033[K" << std::flush;
+}
+
+void ProgressBar::StartClock()
+{
+   StartTime = std::chrono::steady_clock::now();
+   LastPrint = -1;
+   Interval = 0.5;
+   ShowTelemetry = false;
+   EventCount = 0;
+   PairCount = 0;
+   ByteCount = 0;
+}
+
+// True for one caller per interval; safe to call from every thread on every event
+bool ProgressBar::IsDue()
+{
+   long long Now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - StartTime).count();
+   long long Last = LastPrint.load(std::memory_order_relaxed);
+   if(Last >= 0 && Now - Last < Interval * 1e9)
+      return false;
+   return LastPrint.compare_exchange_strong(Last, Now);
+}
+
+// Thread-safe replacement of Update + Print: counts N events and prints when due
+void ProgressBar::Tick(long long N)
+{
+   long long Done = EventCount.fetch_add(N, std::memory_order_relaxed) + N;
+   if(IsDue() == true)
+      Print(std::min(Min + Done, Max));
+}
+
+double ProgressBar::GetElapsedTime()
+{
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+}
+
+double ProgressBar::GetEventsDone()
+{
+   long long N = EventCount.load(std::memory_order_relaxed);
+   return (N > 0) ? N : Progress - Min;
+}
+
+long long ProgressBar::GetBytesRead()
+{
+   long long N = ByteCount.load(std::memory_order_relaxed);
+   if(N > 0)
+      return N;
+
+   std::ifstream in("/proc/self/io");
+   std::string Key;
+   long long Value;
+   while(in >> Key >> Value)
+      if(Key == "rchar:")
+         return Value;
+   return 0;
+}
+
+double ProgressBar::GetEventRate()
+{
+   double Time = GetElapsedTime();
+   return (Time > 0) ? GetEventsDone() / Time : 0;
+}
+
+// Seconds left at the average rate so far, -1 if unknown
+double ProgressBar::GetETA()
+{
+   double Rate = GetEventRate();
+   if(Rate <= 0)
+      return -1;
+   return std::max(Max - Min - GetEventsDone(), 0.0) / Rate;
+}
+
+// Bytes, 0 where /proc is not available
+long long ProgressBar::GetResidentMemory()
+{
+   std::ifstream in("/proc/self/statm");
+   long long Size = 0, Resident = 0;
+   if(!(in >> Size >> Resident))
+      return 0;
+   return Resident * sysconf(_SC_PAGESIZE);
+}
+
+long long ProgressBar::GetPeakMemory()
+{
+   struct rusage Usage;
+   if(getrusage(RUSAGE_SELF, &Usage) != 0)
+      return 0;
+   return (long long)Usage.ru_maxrss * 1024;   // kilobytes on linux
+}
+
+std::string ProgressBar::GetTelemetry()
+{
+   double Time = GetElapsedTime();
+
+   std::ostringstream Result;
+   Result << "  " << FormatProgressCount(GetEventRate()) << " evt/s";
+   long long Pairs = PairCount.load(std::memory_order_relaxed);
+   if(Pairs > 0 && Time > 0)
+      Result << "  " << FormatProgressCount(Pairs / Time) << " pair/s";
+   double ETA = GetETA();
+   Result << "  ETA " << ((ETA >= 0) ? FormatProgressTime(ETA) : "?");
+   Result << "  RSS " << FormatProgressBytes(GetResidentMemory());
+   Result << "  read " << FormatProgressBytes(GetBytesRead());
+   return Result.str();
+}
+
+void ProgressBar::PrintSummary()
+{
+   double Time = GetElapsedTime();
+   double Events = GetEventsDone();
+   long long Pairs = PairCount.load();
+
+   *Out << "[ProgressBar] " << (long long)Events << " events in " << FormatProgressTime(Time)
+      << " (" << FormatProgressCount(GetEventRate()) << " evt/s)";
+   if(Pairs > 0)
+      *Out << ", " << Pairs << " pairs (" << FormatProgressCount((Time > 0) ? Pairs / Time : 0) << " pair/s)";
+   *Out << ", peak RSS " << FormatProgressBytes(GetPeakMemory())
+      << ", read " << FormatProgressBytes(GetBytesRead()) << std::endl;
+}
+
+// One JSON object with the totals; nothing is written for an empty file name
+void ProgressBar::WriteJSON(std::string FileName, std::string Name)
+{
+   if(FileName == "")
+      return;
+
+   std::ofstream out(FileName);
+   if(!out)
+   {
+      std::cerr << "[ProgressBar] Cannot write " << FileName << std::endl;
+      return;
+   }
+
+   double Time = GetElapsedTime();
+   double Events = GetEventsDone();
+   long long Pairs = PairCount.load();
+
+   out << "{\"name\": \"" << Name << "\", \"events\": " << (long long)Events << ", \"pairs\": " << Pairs
+      << ", \"wall_s\": " << Time
+      << ", \"events_per_s\": " << ((Time > 0) ? Events / Time : 0)
+      << ", \"pairs_per_s\": " << ((Time > 0) ? Pairs / Time : 0)
+      << ", \"peak_rss_bytes\": " << GetPeakMemory()
+      << ", \"bytes_read\": " << GetBytesRead() << "}" << std::endl;
+}
+
+// 1234567 -> "1.23M"
+std::string FormatProgressCount(double Value)
+{
+   const char *Suffix[] = {"", "k", "M", "G", "T"};
+   int Index = 0;
+   while(Value >= 1000 && Index < 4)
+   {
+      Value = Value / 1000;
+      Index = Index + 1;
+   }
+   std::ostringstream Result;
+   Result << std::setprecision(3) << Value << Suffix[Index];
+   return Result.str();
+}
+
+// 3725 -> "1:02:05", 42.1 -> "42s"
+std::string FormatProgressTime(double Seconds)
+{
+   long long Total = (long long)(Seconds + 0.5);
+   std::ostringstream Result;
+   if(Total < 60)
+      Result << Total << "s";
+   else if(Total < 3600)
+      Result << Total / 60 << ":" << std::setw(2) << std::setfill('0') << Total % 60;
+   else
+      Result << Total / 3600 << ":" << std::setw(2) << std::setfill('0') << (Total / 60) % 60
+         << ":" << std::setw(2) << std::setfill('0') << Total % 60;
+   return Result.str();
+}
+
+std::string FormatProgressBytes(double Bytes)
+{
+   const char *Suffix[] = {"B", "kB", "MB", "GB", "TB"};
+   int Index = 0;
+   while(Bytes >= 1024 && Index < 4)
+   {
+      Bytes = Bytes / 1024;
+      Index = Index + 1;
+   }
+   std::ostringstream Result;
+   Result << std::setprecision(3) << Bytes << " " << Suffix[Index];
+   return Result.str();
 }
 
 
@@ -0,0 +1,185 @@
+// Lossy storage of the kinematics with a bounded error
+//    --QuantizeAngle e          angles are stored in fixed point over their range, |error| <= e (rad)
+//    --QuantizeMomentum e       momenta and energies keep only the mantissa bits needed for |error| <= e
+//                               (GeV) up to --QuantizeMomentumMax (GeV, default 100)
+//    Both default to 0, which keeps full precision.
+//
+//    The leaves become Float16_t or Double32_t, with the range in the leaf list ("Theta[N]/f[0,3.14,12]").
+//    ROOT decodes them on reading into the usual float and double buffers, so the messengers and the
+//    TTreeReaders downstream read them as before.  RoundAngle and RoundMomentum reproduce the encoding in
+//    memory, so the effect on the EECs can be checked before writing anything (HistogramFiller
+//    --ValidateQuantization).
+//    Include CommandLine.h before this file.
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "TH1D.h"
+
+class Quantization
+{
+public:
+   double AngleError;
+   double MomentumError;
+   double MomentumMax;
+public:
+   Quantization(CommandLine &CL);
+   bool IsEnabled() const;
+   int AngleBits(double Min, double Max) const;
+   int MomentumBits() const;
+   std::string Angle(char Type, double Min, double Max) const;
+   std::string Momentum(char Type) const;
+   double RoundAngle(double Value, double Min, double Max) const;
+   double RoundMomentum(double Value) const;
+   void Print(std::ostream &out) const;
+};
+
+double CompareQuantizedHistograms(TH1D &Reference, TH1D &Quantized, std::ostream &out);
+
+Quantization::Quantization(CommandLine &CL)
+{
+   AngleError    = CL.GetDouble("QuantizeAngle", 0);
+   MomentumError = CL.GetDouble("QuantizeMomentum", 0);
+   MomentumMax   = CL.GetDouble("QuantizeMomentumMax", 100);
+}
+
+bool Quantization::IsEnabled() const
+{
+   return AngleBits(0, M_PI) > 0 || MomentumBits() > 0;
+}
+
+// fixed point: the step is (Max - Min) / 2^bits and values are rounded to the nearest step
+//    0 = keep full precision
+int Quantization::AngleBits(double Min, double Max) const
+{
+   if(AngleError <= 0 || Max <= Min)
+      return 0;
+   int Bits = (int)std::ceil(std::log2((Max - Min) / (2 * AngleError)));
+   if(Bits > 32)
+      return 0;
+   return std::max(Bits, 2);
+}
+
+// truncated mantissa: the relative error is at most 2^-(bits+1); ROOT allows 2 to 14 bits
+//    0 = keep full precision
+int Quantization::MomentumBits() const
+{
+   if(MomentumError <= 0 || MomentumMax <= 0)
+      return 0;
+   int Bits = (int)std::ceil(std::log2(MomentumMax / MomentumError)) - 1;
+   if(Bits > 14)
+      return 0;
+   return std::max(Bits, 2);
+}
+
+// Type is the full-precision leaf type, 'F' or 'D'; the result goes after the '/' of the leaf list
+std::string Quantization::Angle(char Type, double Min, double Max) const
+{
+   int Bits = AngleBits(Min, Max);
+   if(Bits == 0)
+      return std::string(1, Type);
+
+   std::ostringstream Result;
+   Result << std::setprecision(10) << (char)tolower(Type) << "[" << Min << "," << Max << "," << Bits << "]";
+   return Result.str();
+}
+
+std::string Quantization::Momentum(char Type) const
+{
+   int Bits = MomentumBits();
+   if(Bits == 0)
+      return std::string(1, Type);
+   return std::string(1, (char)tolower(Type)) + "[0,0," + std::to_string(Bits) + "]";
+}
+
+// same arithmetic as TBufferFile::WriteDouble32 with a range, followed by the read back
+double Quantization::RoundAngle(double Value, double Min, double Max) const
+{
+   int Bits = AngleBits(Min, Max);
+   if(Bits == 0)
+      return Value;
+
+   double Factor = ((Bits < 32) ? (double)(1U << Bits) : (double)0xffffffffU) / (Max - Min);
+   double X = std::min(std::max(Value, Min), Max);
+   std::uint32_t Integer = (std::uint32_t)(0.5 + Factor * (X - Min));
+   return Min + Integer / Factor;
+}
+
+// same bit manipulation as TBufferFile::WriteFloat16 without a range: 8 bits of exponent,
+//    the mantissa rounded to the given number of bits, saturating instead of carrying
+double Quantization::RoundMomentum(double Value) const
+{
+   int Bits = MomentumBits();
+   if(Bits == 0)
+      return Value;
+
+   float F = Value;
+   std::uint32_t I;
+   std::memcpy(&I, &F, sizeof(I));
+
+   std::uint32_t Exponent = (I << 1) >> 24;
+   std::uint32_t Mantissa = ((1U << (Bits + 1)) - 1) & (I >> (23 - Bits - 1));
+   Mantissa = (Mantissa + 1) >> 1;
+   if(Mantissa & (1U << Bits))
+      Mantissa = (1U << Bits) - 1;
+
+   I = (Exponent << 23) | (Mantissa << (23 - Bits)) | (I & 0x80000000U);
+   std::memcpy(&F, &I, sizeof(F));
+   return F;
+}
+
+void Quantization::Print(std::ostream &out) const
+{
+   if(IsEnabled() == false)
+   {
+      out << "Quantization: off, full precision" << std::endl;
+      return;
+   }
+
+   out << "Quantization:";
+   if(AngleBits(0, M_PI) > 0)
+      out << " angles to " << AngleError << " rad (" << AngleBits(0, M_PI) << " bits over [0, pi])";
+   if(MomentumBits() > 0)
+      out << " momenta to " << MomentumError << " GeV below " << MomentumMax << " GeV (" << MomentumBits() << " mantissa bits)";
+   out << std::endl;
+}
+
+// Shift of every bin in units of the statistical error of the reference; returns the largest one
+double CompareQuantizedHistograms(TH1D &Reference, TH1D &Quantized, std::ostream &out)
+{
+   double MaxPull = 0, SumPull = 0, MaxRelative = 0;
+   int MaxBin = -1, Count = 0;
+
+   for(int i = 1; i <= Reference.GetNbinsX(); i++)
+   {
+      double R = Reference.GetBinContent(i);
+      double Error = Reference.GetBinError(i);
+      if(Error <= 0)
+         continue;
+
+      double Shift = Quantized.GetBinContent(i) - R;
+      double Pull = std::fabs(Shift) / Error;
+      SumPull = SumPull + Pull;
+      Count = Count + 1;
+      if(Pull > MaxPull)
+      {
+         MaxPull = Pull;
+         MaxBin = i;
+      }
+      if(R != 0 && std::fabs(Shift / R) > MaxRelative)
+         MaxRelative = std::fabs(Shift / R);
+   }
+
+   out << "[" << Reference.GetName() << "] " << Count << " bins, shift / stat. error: mean "
+      << ((Count > 0) ? SumPull / Count : 0) << ", max " << MaxPull << " (bin " << MaxBin
+      << "), largest relative shift " << MaxRelative << std::endl;
+
+   return MaxPull;
+}
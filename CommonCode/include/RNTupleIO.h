@@ -0,0 +1,250 @@
+// RNTuple input for the reduced format and the matching trees
+//    ReduceTree, MatchEEC and JetCluster write RNTuples with --Format RNTuple (see AsyncTreeWriter.h).
+//    Including this file lets ReducedTreeMessenger open an RNTuple where it expects the "Tree" TTree,
+//    and provides CollectionReader, which reads a counter and the double arrays it sizes from either
+//    format, for the consumers of the matched pair trees.
+//    Needs ROOT 6.36 or newer and -lROOTNTuple; with older versions TTrees still work and RNTuple
+//    inputs stop with an error.  Include Messenger.h before this file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include "TFile.h"
+#include "TKey.h"
+#include "TTree.h"
+#include "TTreeReader.h"
+#include "TTreeReaderValue.h"
+#include "TTreeReaderArray.h"
+#include "RVersion.h"
+
+#include "Timeline.h"
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+#define RNTUPLE_IO
+#include "ROOT/RNTupleReader.hxx"
+#include "ROOT/RNTupleView.hxx"
+#include "ROOT/RNTupleDescriptor.hxx"
+#endif
+
+bool IsRNTuple(TDirectory *Directory, std::string Name);
+
+#ifdef RNTUPLE_IO
+std::vector<long long> GetNTupleClusterBoundaries(ROOT::RNTupleReader &Reader);
+
+// The particle collections are std::vector fields; the messenger arrays keep their MAXPARTICLE size
+class ReducedNTupleSource : public ReducedEventSource
+{
+private:
+   std::unique_ptr<ROOT::RNTupleReader> Reader;
+   ROOT::RNTupleView<std::vector<float>> Momentum, Mass, Theta, Phi, Weight;
+   ROOT::RNTupleView<std::vector<std::int16_t>> Charge;
+   ROOT::RNTupleView<bool> PassCut;
+   std::unique_ptr<ROOT::RNTupleView<std::int32_t>> RunNo, EventNo;   // only in files that have them
+   bool Warned;
+public:
+   ReducedNTupleSource(std::unique_ptr<ROOT::RNTupleReader> reader);
+   long long GetEntries();
+   std::vector<long long> GetClusterBoundaries();
+   bool Read(long long iEntry, ReducedTreeMessenger &M);
+};
+
+ReducedEventSource *OpenReducedNTuple(TFile *File, std::string Name);
+#endif
+
+// A counter and the double arrays it sizes, from a TTree or an RNTuple with the given name
+class CollectionReader
+{
+private:
+   TFile *File;
+   std::unique_ptr<TTreeReader> TreeReader;
+   std::unique_ptr<TTreeReaderValue<int>> TreeCount;
+   std::vector<std::unique_ptr<TTreeReaderArray<double>>> TreeArrays;
+#ifdef RNTUPLE_IO
+   std::unique_ptr<ROOT::RNTupleReader> NTupleReader;
+   std::vector<std::unique_ptr<ROOT::RNTupleView<std::vector<double>>>> NTupleArrays;
+#endif
+   long long Entries;
+public:
+   int Count;
+   std::vector<std::vector<double>> Arrays;   // in the order of ArrayNames
+public:
+   CollectionReader(std::string FileName, std::string Name, std::string CountName, std::vector<std::string> ArrayNames);
+   ~CollectionReader();
+   long long GetEntries() {return Entries;}
+   bool GetEntry(long long iEntry);
+};
+
+bool IsRNTuple(TDirectory *Directory, std::string Name)
+{
+   if(Directory == nullptr)
+      return false;
+   TKey *Key = Directory->GetKey(Name.c_str());
+   return (Key != nullptr && std::string(Key->GetClassName()) == "ROOT::RNTuple");
+}
+
+#ifdef RNTUPLE_IO
+std::vector<long long> GetNTupleClusterBoundaries(ROOT::RNTupleReader &Reader)
+{
+   std::vector<long long> Boundaries;
+   for(const auto &Cluster : Reader.GetDescriptor().GetClusterIterable())
+      Boundaries.push_back(Cluster.GetFirstEntryIndex());
+   std::sort(Boundaries.begin(), Boundaries.end());
+   Boundaries.push_back(Reader.GetNEntries());
+   return Boundaries;
+}
+
+ReducedNTupleSource::ReducedNTupleSource(std::unique_ptr<ROOT::RNTupleReader> reader)
+   : Reader(std::move(reader)),
+     Momentum(Reader->GetView<std::vector<float>>("Momentum")),
+     Mass(Reader->GetView<std::vector<float>>("Mass")),
+     Theta(Reader->GetView<std::vector<float>>("Theta")),
+     Phi(Reader->GetView<std::vector<float>>("Phi")),
+     Weight(Reader->GetView<std::vector<float>>("Weight")),
+     Charge(Reader->GetView<std::vector<std::int16_t>>("Charge")),
+     PassCut(Reader->GetView<bool>("PassCut"))
+{
+   Warned = false;
+   if(Reader->GetDescriptor().FindFieldId("RunNo") != ROOT::kInvalidDescriptorId)
+      RunNo = std::make_unique<ROOT::RNTupleView<std::int32_t>>(Reader->GetView<std::int32_t>("RunNo"));
+   if(Reader->GetDescriptor().FindFieldId("EventNo") != ROOT::kInvalidDescriptorId)
+      EventNo = std::make_unique<ROOT::RNTupleView<std::int32_t>>(Reader->GetView<std::int32_t>("EventNo"));
+}
+
+long long ReducedNTupleSource::GetEntries()
+{
+   return Reader->GetNEntries();
+}
+
+std::vector<long long> ReducedNTupleSource::GetClusterBoundaries()
+{
+   return GetNTupleClusterBoundaries(*Reader);
+}
+
+bool ReducedNTupleSource::Read(long long iEntry, ReducedTreeMessenger &M)
+{
+   TIMELINE_SCOPE("GetEntry", "io");
+   const std::vector<float> &P = Momentum(iEntry);
+
+   int N = P.size();
+   if(N > MAXPARTICLE)
+   {
+      if(Warned == false)
+         std::cerr << "ReducedNTupleSource: events with more than " << MAXPARTICLE << " particles are truncated" << std::endl;
+      Warned = true;
+      N = MAXPARTICLE;
+   }
+
+   M.N = N;
+   std::copy_n(P.begin(), N, M.Momentum);
+   std::copy_n(Mass(iEntry).begin(), N, M.Mass);
+   std::copy_n(Theta(iEntry).begin(), N, M.Theta);
+   std::copy_n(Phi(iEntry).begin(), N, M.Phi);
+   std::copy_n(Weight(iEntry).begin(), N, M.Weight);
+   std::copy_n(Charge(iEntry).begin(), N, M.Charge);
+   M.PassCut = PassCut(iEntry);
+   M.RunNo = (RunNo != nullptr) ? (*RunNo)(iEntry) : -1;
+   M.EventNo = (EventNo != nullptr) ? (*EventNo)(iEntry) : -1;
+
+   return true;
+}
+
+ReducedEventSource *OpenReducedNTuple(TFile *File, std::string Name)
+{
+   return new ReducedNTupleSource(ROOT::RNTupleReader::Open(Name, File->GetName()));
+}
+
+// ReducedTreeMessenger picks this up when it finds an RNTuple
+bool ReducedNTupleRegistered = (ReducedTreeMessenger::OpenSource = OpenReducedNTuple, true);
+#endif
+
+CollectionReader::CollectionReader(std::string FileName, std::string Name, std::string CountName,
+   std::vector<std::string> ArrayNames)
+{
+   Entries = 0;
+   Count = 0;
+   Arrays.resize(ArrayNames.size());
+
+   File = TFile::Open(FileName.c_str());
+   if(File == nullptr || File->IsZombie() == true)
+   {
+      std::cerr << "CollectionReader: cannot open " << FileName << std::endl;
+      exit(1);
+   }
+
+   if(IsRNTuple(File, Name) == true)
+   {
+#ifdef RNTUPLE_IO
+      NTupleReader = ROOT::RNTupleReader::Open(Name, FileName);
+      for(std::string ArrayName : ArrayNames)
+         NTupleArrays.push_back(std::make_unique<ROOT::RNTupleView<std::vector<double>>>(
+            NTupleReader->GetView<std::vector<double>>(ArrayName)));
+      Entries = NTupleReader->GetNEntries();
+#else
+      std::cerr << "CollectionReader: " << Name << " in " << FileName << " is an RNTuple, which needs ROOT 6.36 or newer" << std::endl;
+      exit(1);
+#endif
+      return;
+   }
+
+   TTree *Tree = (TTree *)File->Get(Name.c_str());
+   if(Tree == nullptr)
+   {
+      std::cerr << "CollectionReader: no tree " << Name << " in " << FileName << std::endl;
+      exit(1);
+   }
+   TreeReader = std::make_unique<TTreeReader>(Tree);
+   TreeCount = std::make_unique<TTreeReaderValue<int>>(*TreeReader, CountName.c_str());
+   for(std::string ArrayName : ArrayNames)
+      TreeArrays.push_back(std::make_unique<TTreeReaderArray<double>>(*TreeReader, ArrayName.c_str()));
+   Entries = TreeReader->GetEntries(true);
+}
+
+CollectionReader::~CollectionReader()
+{
+   TreeArrays.clear();
+   TreeCount.reset();
+   TreeReader.reset();
+#ifdef RNTUPLE_IO
+   NTupleArrays.clear();
+   NTupleReader.reset();
+#endif
+   if(File != nullptr)
+   {
+      File->Close();
+      delete File;
+   }
+}
+
+bool CollectionReader::GetEntry(long long iEntry)
+{
+   TIMELINE_SCOPE("GetEntry", "io");
+   if(iEntry < 0 || iEntry >= Entries)
+      return false;
+
+#ifdef RNTUPLE_IO
+   if(NTupleReader != nullptr)
+   {
+      // the counter is kept in the RNTuple too, but the vector sizes carry the same information
+      for(int i = 0; i < (int)NTupleArrays.size(); i++)
+         Arrays[i] = (*NTupleArrays[i])(iEntry);
+      Count = (Arrays.size() > 0) ? Arrays[0].size() : 0;
+      return true;
+   }
+#endif
+
+   TreeReader->SetEntry(iEntry);
+   Count = **TreeCount;
+   for(int i = 0; i < (int)TreeArrays.size(); i++)
+   {
+      TTreeReaderArray<double> &Array = *TreeArrays[i];
+      Arrays[i].resize(Array.GetSize());
+      for(int j = 0; j < (int)Array.GetSize(); j++)
+         Arrays[i][j] = Array[j];
+   }
+   return true;
+}
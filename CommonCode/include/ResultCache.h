@@ -0,0 +1,246 @@
+// Content-addressed cache for expensive reference histograms
+//    The key is a hash of everything the result depends on: the identity of the input files (ROOT
+//    header UUID and size, see RunMetadata.h), the selection and the binning, each added by the caller,
+//    plus the binning of every registered histogram.  On a hit the registered histograms and values are
+//    filled from <CacheDirectory>/<Name>_<hash>.root and the loop can be skipped; on a miss the caller
+//    runs the loop and calls Store().
+//
+//    --UseCache false         always recompute and never write
+//    --RefreshCache true      recompute and overwrite the cached result
+//    --CacheDirectory d       where the results live (default "ResultCache")
+//
+//    Bump the "Version" key at the call site when the loop itself changes.
+//    Include CommandLine.h and RunMetadata.h before this file.
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TH1.h"
+#include "TAxis.h"
+#include "TNamed.h"
+#include "TParameter.h"
+#include "TSystem.h"
+
+class ResultCache
+{
+private:
+   std::string Name;
+   std::string Directory;
+   bool Enabled;
+   bool Refresh;
+   std::ostringstream Description;
+   std::vector<TH1 *> Histograms;
+   std::vector<std::pair<std::string, double *>> Values;
+   std::vector<std::pair<std::string, int *>> IntValues;
+public:
+   ResultCache(CommandLine &CL, std::string name);
+   void AddFile(std::string FileName);
+   void Add(std::string Key, std::string Value);
+   void Add(std::string Key, double Value);
+   void Add(std::string Key, const double *Array, int N);
+   void Add(std::string Key, const std::vector<double> &Array) {Add(Key, Array.data(), Array.size());}
+   void AddResult(TH1 *H);
+   void AddResult(std::string ValueName, double &X) {Values.push_back(std::make_pair(ValueName, &X));}
+   void AddResult(std::string ValueName, int &X) {IntValues.push_back(std::make_pair(ValueName, &X));}
+   std::string GetHash();
+   std::string GetFileName();
+   bool Load();
+   void Store();
+private:
+   void AddAxis(std::string Key, TAxis *Axis);
+};
+
+ResultCache::ResultCache(CommandLine &CL, std::string name)
+{
+   Name      = name;
+   Directory = CL.Get("CacheDirectory", "ResultCache");
+   Enabled   = CL.GetBool("UseCache", true);
+   Refresh   = CL.GetBool("RefreshCache", false);
+
+   Description << std::setprecision(17);
+   Description << "Name = " << Name << std::endl;
+}
+
+void ResultCache::AddFile(std::string FileName)
+{
+   Description << "File = " << GetFileFingerprint(FileName, false) << std::endl;
+}
+
+void ResultCache::Add(std::string Key, std::string Value)
+{
+   Description << Key << " = " << Value << std::endl;
+}
+
+void ResultCache::Add(std::string Key, double Value)
+{
+   Description << Key << " = " << Value << std::endl;
+}
+
+void ResultCache::Add(std::string Key, const double *Array, int N)
+{
+   Description << Key << " =";
+   for(int i = 0; i < N; i++)
+      Description << " " << Array[i];
+   Description << std::endl;
+}
+
+void ResultCache::AddAxis(std::string Key, TAxis *Axis)
+{
+   if(Axis == nullptr)
+      return;
+   if(Axis->GetXbins()->GetSize() > 0)
+      Add(Key, Axis->GetXbins()->GetArray(), Axis->GetXbins()->GetSize());
+   else
+      Add(Key, std::vector<double>{(double)Axis->GetNbins(), Axis->GetXmin(), Axis->GetXmax()});
+}
+
+void ResultCache::AddResult(TH1 *H)
+{
+   if(H == nullptr)
+      return;
+   Histograms.push_back(H);
+
+   std::string Prefix = std::string("Histogram ") + H->GetName();
+   Add(Prefix, H->ClassName());
+   AddAxis(Prefix + " X", H->GetXaxis());
+   if(H->GetDimension() > 1)
+      AddAxis(Prefix + " Y", H->GetYaxis());
+   if(H->GetDimension() > 2)
+      AddAxis(Prefix + " Z", H->GetZaxis());
+}
+
+// 64-bit FNV-1a of the description, as 16 hex digits
+std::string ResultCache::GetHash()
+{
+   std::string Text = Description.str();
+   std::uint64_t Hash = 14695981039346656037ULL;
+   for(char c : Text)
+   {
+      Hash = Hash ^ (unsigned char)c;
+      Hash = Hash * 1099511628211ULL;
+   }
+
+   std::ostringstream Result;
+   Result << std::hex << std::setw(16) << std::setfill('0') << Hash;
+   return Result.str();
+}
+
+std::string ResultCache::GetFileName()
+{
+   return Directory + "/" + Name + "_" + GetHash() + ".root";
+}
+
+// True if everything registered was filled from the cache; the histograms are untouched otherwise
+bool ResultCache::Load()
+{
+   if(Enabled == false || Refresh == true)
+      return false;
+
+   TDirectory::TContext Context;   // opening the cache must not move the current directory
+
+   std::string FileName = GetFileName();
+   if(gSystem->AccessPathName(FileName.c_str()) == true)   // true means it does not exist
+   {
+      std::cout << "ResultCache: no cached " << Name << ", computing it" << std::endl;
+      return false;
+   }
+
+   TFile File(FileName.c_str());
+   TNamed *Key = (TNamed *)File.Get("CacheKey");
+   if(File.IsZombie() == true || Key == nullptr || Description.str() != Key->GetTitle())
+   {
+      std::cerr << "ResultCache: " << FileName << " does not match the request, recomputing" << std::endl;
+      return false;
+   }
+
+   std::vector<TH1 *> Cached;
+   for(TH1 *H : Histograms)
+   {
+      TH1 *C = (TH1 *)File.Get(H->GetName());
+      if(C == nullptr || C->GetNcells() != H->GetNcells())
+      {
+         std::cerr << "ResultCache: " << H->GetName() << " missing in " << FileName << ", recomputing" << std::endl;
+         return false;
+      }
+      Cached.push_back(C);
+   }
+   std::vector<double> CachedValues, CachedIntValues;
+   for(auto &Item : Values)
+   {
+      TParameter<double> *P = (TParameter<double> *)File.Get(("Value_" + Item.first).c_str());
+      if(P == nullptr)
+         return false;
+      CachedValues.push_back(P->GetVal());
+   }
+   for(auto &Item : IntValues)
+   {
+      TParameter<double> *P = (TParameter<double> *)File.Get(("Value_" + Item.first).c_str());
+      if(P == nullptr)
+         return false;
+      CachedIntValues.push_back(P->GetVal());
+   }
+
+   for(int i = 0; i < (int)Histograms.size(); i++)
+   {
+      Histograms[i]->Reset();
+      Histograms[i]->Add(Cached[i]);
+   }
+   for(int i = 0; i < (int)Values.size(); i++)
+      *Values[i].second = CachedValues[i];
+   for(int i = 0; i < (int)IntValues.size(); i++)
+      *IntValues[i].second = (int)CachedIntValues[i];
+
+   File.Close();
+
+   std::cout << "ResultCache: " << Name << " taken from " << FileName << std::endl;
+   return true;
+}
+
+// Written to a temporary name of this process and moved into place, so neither a crash nor two jobs
+//    storing the same key at once ever leave a truncated entry; the rename is atomic, the last one wins
+void ResultCache::Store()
+{
+   if(Enabled == false)
+      return;
+
+   TDirectory::TContext Context;
+
+   gSystem->mkdir(Directory.c_str(), true);
+
+   std::string FileName = GetFileName();
+   std::string TemporaryName = FileName + ".tmp." + std::to_string(getpid());
+
+   TFile File(TemporaryName.c_str(), "RECREATE");
+   TNamed Key("CacheKey", Description.str().c_str());
+   File.WriteTObject(&Key);
+   for(TH1 *H : Histograms)
+      File.WriteTObject(H, H->GetName());
+   for(auto &Item : Values)
+   {
+      TParameter<double> P(("Value_" + Item.first).c_str(), *Item.second);
+      File.WriteTObject(&P);
+   }
+   for(auto &Item : IntValues)
+   {
+      TParameter<double> P(("Value_" + Item.first).c_str(), *Item.second);
+      File.WriteTObject(&P);
+   }
+   File.Close();
+
+   if(rename(TemporaryName.c_str(), FileName.c_str()) != 0)
+   {
+      std::cerr << "ResultCache: cannot move " << TemporaryName << " to " << FileName << std::endl;
+      remove(TemporaryName.c_str());
+   }
+   else
+      std::cout << "ResultCache: stored " << Name << " in " << FileName << std::endl;
+}
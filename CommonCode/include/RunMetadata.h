@@ -0,0 +1,265 @@
+// Normalization and provenance written next to the histograms
+//    Every histogram-producing job writes a small "Metadata" tree with one entry per job: the program,
+//    its command line, the inputs with a fingerprint each, the host, timing, and the event counts and
+//    sums of weights before and after the event selection.  hadd and HistogramMerger keep one entry per
+//    job, so downstream tools sum the entries to get the normalization without opening the input trees.
+//
+//    The fingerprint of an input is the UUID in its ROOT header plus its size, which only needs the
+//    header; --MetadataChecksum true replaces it with an MD5 of the whole file.
+//    Include CommandLine.h before this file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <ctime>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "TTree.h"
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TUUID.h"
+#include "TMD5.h"
+
+struct RunMetadata
+{
+   std::string Program;
+   std::string Options;         // command line as typed
+   std::string Inputs;          // input files, separated by ";"
+   std::string Checksums;       // fingerprint of every input, same order
+   std::string Host;
+   long long StartTime;         // unix time
+   double WallTime;             // seconds
+   double CPUTime;              // seconds
+   long long EventsProcessed;   // events read, before the event selection
+   long long EventsSelected;    // events passing the selection
+   double SumWeight;
+   double SumWeightSelected;
+   std::chrono::steady_clock::time_point Start;   // not written
+   void CountProcessed(double Weight = 1)   {EventsProcessed = EventsProcessed + 1; SumWeight = SumWeight + Weight;}
+   void CountSelected(double Weight = 1)    {EventsSelected = EventsSelected + 1; SumWeightSelected = SumWeightSelected + Weight;}
+};
+
+RunMetadata StartRunMetadata(CommandLine &CL, std::vector<std::string> Inputs);
+std::string GetFileFingerprint(std::string FileName, bool FullChecksum);
+void FinishRunMetadata(RunMetadata &Metadata);
+void WriteRunMetadata(TDirectory *Directory, RunMetadata &Metadata);
+void WriteRunMetadata(TDirectory *Directory, const std::vector<RunMetadata> &Metadata);
+std::vector<RunMetadata> ReadRunMetadata(TTree *Tree);
+std::vector<RunMetadata> ReadRunMetadata(TDirectory *Directory);
+RunMetadata SumRunMetadata(const std::vector<RunMetadata> &Metadata);
+double GetEventCount(std::string FileName, std::string FallbackTree, bool Selected = true);
+
+RunMetadata StartRunMetadata(CommandLine &CL, std::vector<std::string> Inputs)
+{
+   bool FullChecksum = CL.GetBool("MetadataChecksum", false);
+
+   RunMetadata Metadata;
+   Metadata.Program = CL.GetSelf();
+   Metadata.Options = CL.GetCommandLine();
+   Metadata.Inputs = "";
+   Metadata.Checksums = "";
+   for(int i = 0; i < (int)Inputs.size(); i++)
+   {
+      Metadata.Inputs = Metadata.Inputs + ((i > 0) ? ";" : "") + Inputs[i];
+      Metadata.Checksums = Metadata.Checksums + ((i > 0) ? ";" : "") + GetFileFingerprint(Inputs[i], FullChecksum);
+   }
+
+   char HostName[256] = "";
+   gethostname(HostName, 255);
+   Metadata.Host = HostName;
+
+   Metadata.StartTime = time(nullptr);
+   Metadata.Start = std::chrono::steady_clock::now();
+   Metadata.WallTime = 0;
+   Metadata.CPUTime = 0;
+   Metadata.EventsProcessed = 0;
+   Metadata.EventsSelected = 0;
+   Metadata.SumWeight = 0;
+   Metadata.SumWeightSelected = 0;
+
+   return Metadata;
+}
+
+std::string GetFileFingerprint(std::string FileName, bool FullChecksum)
+{
+   if(FullChecksum == true)
+   {
+      TMD5 *MD5 = TMD5::FileChecksum(FileName.c_str());
+      if(MD5 == nullptr)
+         return "missing";
+      std::string Result = std::string("md5:") + MD5->AsString();
+      delete MD5;
+      return Result;
+   }
+
+   struct stat Status;
+   if(stat(FileName.c_str(), &Status) != 0)
+      return "missing";
+   std::string Result = "size:" + std::to_string((long long)Status.st_size);
+
+   TFile *File = TFile::Open(FileName.c_str());
+   if(File != nullptr && File->IsZombie() == false)
+      Result = std::string("uuid:") + File->GetUUID().AsString() + " " + Result;
+   if(File != nullptr)
+   {
+      File->Close();
+      delete File;
+   }
+
+   return Result;
+}
+
+void FinishRunMetadata(RunMetadata &Metadata)
+{
+   Metadata.WallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - Metadata.Start).count();
+   Metadata.CPUTime = (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Finishes the timing and writes the tree
+void WriteRunMetadata(TDirectory *Directory, RunMetadata &Metadata)
+{
+   FinishRunMetadata(Metadata);
+   WriteRunMetadata(Directory, std::vector<RunMetadata>{Metadata});
+}
+
+void WriteRunMetadata(TDirectory *Directory, const std::vector<RunMetadata> &Metadata)
+{
+   if(Directory == nullptr)
+      return;
+   Directory->cd();
+
+   RunMetadata M;
+
+   TTree Tree("Metadata", "Normalization and provenance, one entry per job");
+   Tree.Branch("Program", &M.Program);
+   Tree.Branch("Options", &M.Options);
+   Tree.Branch("Inputs", &M.Inputs);
+   Tree.Branch("Checksums", &M.Checksums);
+   Tree.Branch("Host", &M.Host);
+   Tree.Branch("StartTime", &M.StartTime, "StartTime/L");
+   Tree.Branch("WallTime", &M.WallTime, "WallTime/D");
+   Tree.Branch("CPUTime", &M.CPUTime, "CPUTime/D");
+   Tree.Branch("EventsProcessed", &M.EventsProcessed, "EventsProcessed/L");
+   Tree.Branch("EventsSelected", &M.EventsSelected, "EventsSelected/L");
+   Tree.Branch("SumWeight", &M.SumWeight, "SumWeight/D");
+   Tree.Branch("SumWeightSelected", &M.SumWeightSelected, "SumWeightSelected/D");
+
+   for(const RunMetadata &Item : Metadata)
+   {
+      M = Item;
+      Tree.Fill();
+   }
+
+   Tree.Write();
+}
+
+std::vector<RunMetadata> ReadRunMetadata(TTree *Tree)
+{
+   std::vector<RunMetadata> Result;
+   if(Tree == nullptr)
+      return Result;
+
+   RunMetadata M;
+   std::string *Program = &M.Program, *Options = &M.Options, *Inputs = &M.Inputs;
+   std::string *Checksums = &M.Checksums, *Host = &M.Host;
+   Tree->SetBranchAddress("Program", &Program);
+   Tree->SetBranchAddress("Options", &Options);
+   Tree->SetBranchAddress("Inputs", &Inputs);
+   Tree->SetBranchAddress("Checksums", &Checksums);
+   Tree->SetBranchAddress("Host", &Host);
+   Tree->SetBranchAddress("StartTime", &M.StartTime);
+   Tree->SetBranchAddress("WallTime", &M.WallTime);
+   Tree->SetBranchAddress("CPUTime", &M.CPUTime);
+   Tree->SetBranchAddress("EventsProcessed", &M.EventsProcessed);
+   Tree->SetBranchAddress("EventsSelected", &M.EventsSelected);
+   Tree->SetBranchAddress("SumWeight", &M.SumWeight);
+   Tree->SetBranchAddress("SumWeightSelected", &M.SumWeightSelected);
+
+   for(long long iE = 0; iE < Tree->GetEntries(); iE++)
+   {
+      Tree->GetEntry(iE);
+      Result.push_back(M);
+   }
+
+   Tree->ResetBranchAddresses();
+   return Result;
+}
+
+// All entries of the "Metadata" tree in the directory, empty for files written before it existed
+std::vector<RunMetadata> ReadRunMetadata(TDirectory *Directory)
+{
+   if(Directory == nullptr)
+      return std::vector<RunMetadata>();
+   return ReadRunMetadata((TTree *)Directory->Get("Metadata"));
+}
+
+// Totals over jobs; the text fields are joined, the wall time is the longest job
+RunMetadata SumRunMetadata(const std::vector<RunMetadata> &Metadata)
+{
+   RunMetadata Total;
+   Total.StartTime = 0;
+   Total.WallTime = 0;
+   Total.CPUTime = 0;
+   Total.EventsProcessed = 0;
+   Total.EventsSelected = 0;
+   Total.SumWeight = 0;
+   Total.SumWeightSelected = 0;
+
+   for(const RunMetadata &M : Metadata)
+   {
+      if(Total.Program.find(M.Program) == std::string::npos)
+         Total.Program = Total.Program + ((Total.Program != "") ? ";" : "") + M.Program;
+      Total.Inputs = Total.Inputs + ((Total.Inputs != "") ? ";" : "") + M.Inputs;
+      Total.Checksums = Total.Checksums + ((Total.Checksums != "") ? ";" : "") + M.Checksums;
+      if(Total.StartTime == 0 || M.StartTime < Total.StartTime)
+         Total.StartTime = M.StartTime;
+      Total.WallTime = std::max(Total.WallTime, M.WallTime);
+      Total.CPUTime = Total.CPUTime + M.CPUTime;
+      Total.EventsProcessed = Total.EventsProcessed + M.EventsProcessed;
+      Total.EventsSelected = Total.EventsSelected + M.EventsSelected;
+      Total.SumWeight = Total.SumWeight + M.SumWeight;
+      Total.SumWeightSelected = Total.SumWeightSelected + M.SumWeightSelected;
+   }
+
+   return Total;
+}
+
+// Number of events behind the histograms in FileName.  Older files without metadata fall back to the
+//    entries of FallbackTree, which costs opening it; an empty name disables the fallback.
+double GetEventCount(std::string FileName, std::string FallbackTree, bool Selected)
+{
+   TFile *File = TFile::Open(FileName.c_str());
+   if(File == nullptr || File->IsZombie() == true)
+   {
+      std::cerr << "GetEventCount: cannot open " << FileName << std::endl;
+      exit(1);
+   }
+
+   double Count = -1;
+   std::vector<RunMetadata> Metadata = ReadRunMetadata(File);
+   if(Metadata.size() > 0)
+   {
+      RunMetadata Total = SumRunMetadata(Metadata);
+      Count = Selected ? Total.EventsSelected : Total.EventsProcessed;
+   }
+   else if(FallbackTree != "" && File->Get(FallbackTree.c_str()) != nullptr)
+   {
+      std::cerr << "GetEventCount: no metadata in " << FileName << ", counting the entries of " << FallbackTree << std::endl;
+      Count = ((TTree *)File->Get(FallbackTree.c_str()))->GetEntries();
+   }
+
+   File->Close();
+   delete File;
+
+   if(Count < 0)
+   {
+      std::cerr << "GetEventCount: no event count available in " << FileName << std::endl;
+      exit(1);
+   }
+   return Count;
+}
@@ -0,0 +1,84 @@
+#ifndef TIMELINE_H_11235
+#define TIMELINE_H_11235
+
+// Scoped stage timers and counters written as a Chrome trace-event timeline
+//    Timeline::Start("Timeline.json") switches the recording on; every TIMELINE_SCOPE then records one
+//    complete event ("ph": "X") from its construction to the end of the enclosing block, on the thread
+//    it ran on, and TIMELINE_COUNTER one counter sample.  Timeline::Finish() writes the JSON, which
+//    chrome://tracing or ui.perfetto.dev open directly, and prints the total time per stage.
+//
+//    Switched off (the default) a scope costs one load of a bool.  Each thread buffers its own events,
+//    so recording takes no lock; past MaxEvents (default 2 million) only the per-stage totals are kept.
+//    Compile with -DNO_TIMELINE to remove the scopes altogether.
+//
+//    Stage names and categories must be string literals or otherwise outlive the program: only the
+//    pointers are stored.  This header has an include guard, since the messengers, Matching.h and
+//    AsyncTreeWriter.h all include it; the implementation is in source/Timeline.cpp.
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <atomic>
+
+struct TimelineEvent
+{
+   const char *Name;
+   const char *Category;
+   long long Start;      // nanoseconds since Timeline::Start
+   long long Duration;   // nanoseconds, -1 for a counter
+   double Value;         // counter value
+   int Thread;
+};
+
+class Timeline
+{
+public:
+   static std::atomic<bool> Enabled;
+   static long long MaxEvents;
+public:
+   static void Start(std::string FileName, long long maxEvents = 2000000);
+   static void Finish(std::ostream *Summary = nullptr);
+   static long long Now();
+   static void Record(const char *Name, const char *Category, long long Start, long long Duration);
+   static void Count(const char *Name, double Value);
+   static void SetThreadName(std::string Name);
+   static void PrintSummary(std::ostream &out);
+   static bool Write(std::string FileName);
+};
+
+class ScopedTimer
+{
+private:
+   const char *Name;
+   const char *Category;
+   long long StartTime;
+   bool Active;
+public:
+   ScopedTimer(const char *name, const char *category = "")
+      : Name(name), Category(category), StartTime(0), Active(Timeline::Enabled.load(std::memory_order_relaxed))
+   {
+      if(Active == true)
+         StartTime = Timeline::Now();
+   }
+   ~ScopedTimer() {Stop();}
+   void Stop()   // ends the stage before the end of the block
+   {
+      if(Active == true)
+         Timeline::Record(Name, Category, StartTime, Timeline::Now() - StartTime);
+      Active = false;
+   }
+};
+
+#define TIMELINE_JOIN2(a, b) a##b
+#define TIMELINE_JOIN(a, b) TIMELINE_JOIN2(a, b)
+
+#ifndef NO_TIMELINE
+#define TIMELINE_SCOPE(Name, Category) ScopedTimer TIMELINE_JOIN(TimelineScope, __LINE__)(Name, Category)
+#define TIMELINE_COUNTER(Name, Value) \
+   do {if(Timeline::Enabled.load(std::memory_order_relaxed) == true) Timeline::Count(Name, Value);} while(0)
+#else
+#define TIMELINE_SCOPE(Name, Category)
+#define TIMELINE_COUNTER(Name, Value) do {} while(0)
+#endif
+
+#endif
@@ -0,0 +1,521 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+using namespace std;
+
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "TDirectory.h"
+#include "TH1.h"
+#include "TAxis.h"
+#include "TArrayD.h"
+
+#include "CommandLine.h"
+#include "EntryRange.h"
+#include "RunMetadata.h"
+#include "PrecisionTarget.h"
+
+// Histogram-only replacement for hadd.
+//    Input files are split over threads, each thread sums its share in memory, and the partial sums are
+//    combined pairwise in parallel (tree-shaped reduction).  Objects are matched by their full path, so
+//    sub-directories such as "Unfolding/" are kept.  Histograms with the same name must have the same
+//    binning, otherwise the merge stops.  Histograms listed in --Constant (by default the bin-edge
+//    bookkeeping HBinMin and HBinMax) are taken from the first file and only checked in the others.
+//    Event-count histograms (HN) are summed like everything else and their total is reported.
+//
+//    With --Watch the inputs are polled and every file whose "<file>.done" marker (written by JobDriver)
+//    appears is merged right away, so the merge runs alongside the per-file jobs.
+//
+//    "EntryRange" trees written by sharded jobs are collected and written to the output, and the merger
+//    reports whether the shards cover every input entry exactly once (--RequireCoverage makes it fatal).
+//    "Metadata" trees (RunMetadata.h) are carried over the same way, one entry per job, and the total
+//    event counts are reported.  "PrecisionTarget" trees (PrecisionTarget.h) of early-stopped jobs are
+//    kept the same way, so the merged file still has the precision reached and the entries read.
+
+struct MergeState
+{
+   map<string, TH1 *> Histograms;
+   vector<string> Order;
+   vector<EntryRange> Ranges;
+   vector<RunMetadata> Metadata;
+   vector<PrecisionTargetRecord> Precision;
+   int FileCount;
+   bool Good;
+   string Error;
+};
+
+int main(int argc, char *argv[]);
+vector<string> ExpandInputs(vector<string> Patterns);
+void AddFile(MergeState &State, string FileName, const set<string> &Constants);
+void AddDirectory(MergeState &State, TDirectory *Directory, string Prefix, string FileName, const set<string> &Constants);
+void AddHistogram(MergeState &State, TH1 *H, string Path, string FileName, const set<string> &Constants);
+void MergeInto(MergeState &A, MergeState &B, const set<string> &Constants);
+bool SameAxis(TAxis *A, TAxis *B);
+bool SameBinning(TH1 *A, TH1 *B);
+bool SameContent(TH1 *A, TH1 *B);
+MergeState MergeParallel(vector<string> Files, int Threads, const set<string> &Constants);
+bool WriteState(MergeState &State, string OutputFileName);
+bool FileExists(string Path);
+void ClearState(MergeState &State);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   vector<string> Patterns    = CL.GetStringVector("Input");
+   string OutputFileName      = CL.Get("Output");
+   int Threads                = CL.GetInt("Threads", (int)thread::hardware_concurrency());
+   vector<string> ConstantList = CL.GetStringVector("Constant", vector<string>{"HBinMin", "HBinMax"});
+   string CountHistogram      = CL.Get("Count", "HN");
+   bool Watch                 = CL.GetBool("Watch", false);
+   int Expected               = CL.GetInt("Expected", -1);
+   double PollInterval        = CL.GetDouble("Poll", 10);
+   double Timeout             = CL.GetDouble("Timeout", 86400);
+   bool RemoveInputs          = CL.GetBool("RemoveInputs", false);
+   bool RequireCoverage       = CL.GetBool("RequireCoverage", false);
+
+   if(Threads < 1)
+      Threads = 1;
+   set<string> Constants(ConstantList.begin(), ConstantList.end());
+
+   ROOT::EnableThreadSafety();
+   TH1::AddDirectory(false);
+
+   auto Start = chrono::steady_clock::now();
+
+   MergeState Total;
+   Total.FileCount = 0;
+   Total.Good = true;
+   vector<string> Merged;
+
+   if(Watch == false)
+   {
+      Merged = ExpandInputs(Patterns);
+      if(Merged.size() == 0)
+      {
+         cerr << "HistogramMerger: no input files" << endl;
+         return -1;
+      }
+      Total = MergeParallel(Merged, Threads, Constants);
+   }
+   else
+   {
+      if(Expected <= 0)
+         cerr << "HistogramMerger: watching without --Expected, will stop at the timeout" << endl;
+
+      set<string> Done;
+      while(true)
+      {
+         vector<string> Ready;
+         for(string File : ExpandInputs(Patterns))
+            if(Done.find(File) == Done.end() && FileExists(File + ".done"))
+               Ready.push_back(File);
+
+         if(Ready.size() > 0)
+         {
+            MergeState Batch = MergeParallel(Ready, Threads, Constants);
+            if(Batch.Good == false)
+            {
+               Total.Good = false;
+               Total.Error = Batch.Error;
+               ClearState(Batch);
+               break;
+            }
+            if(Total.FileCount == 0)
+               Total = Batch;
+            else
+            {
+               MergeInto(Total, Batch, Constants);
+               ClearState(Batch);
+            }
+            for(string File : Ready)
+            {
+               Done.insert(File);
+               Merged.push_back(File);
+            }
+            cout << "HistogramMerger: " << Merged.size() << " files merged so far" << endl;
+
+            // keep a readable partial result around while waiting
+            if(Total.Good == true)
+               WriteState(Total, OutputFileName);
+         }
+
+         if(Total.Good == false)
+            break;
+         if(Expected > 0 && (int)Merged.size() >= Expected)
+            break;
+         if(chrono::duration<double>(chrono::steady_clock::now() - Start).count() > Timeout)
+         {
+            cerr << "HistogramMerger: timeout after " << Merged.size() << " files" << endl;
+            Total.Good = Total.Good && (Expected <= 0);
+            break;
+         }
+
+         this_thread::sleep_for(chrono::milliseconds((long long)(PollInterval * 1000)));
+      }
+   }
+
+   if(Total.Good == false)
+   {
+      cerr << "HistogramMerger: " << Total.Error << endl;
+      cerr << "HistogramMerger: no output written" << endl;
+      remove(OutputFileName.c_str());
+      return 1;
+   }
+
+   if(Total.Ranges.size() > 0)
+   {
+      bool Covered = CheckEntryRangeCoverage(Total.Ranges, cerr);
+      cout << "HistogramMerger: " << Total.Ranges.size() << " entry ranges, "
+         << (Covered ? "inputs fully covered" : "coverage check FAILED") << endl;
+      if(Covered == false && RequireCoverage == true)
+      {
+         cerr << "HistogramMerger: no output written" << endl;
+         return 1;
+      }
+   }
+   else if(RequireCoverage == true)
+      cerr << "HistogramMerger: warning: no EntryRange records found, coverage not checked" << endl;
+
+   if(Total.Metadata.size() > 0)
+   {
+      RunMetadata Sum = SumRunMetadata(Total.Metadata);
+      cout << "HistogramMerger: " << Total.Metadata.size() << " jobs, " << Sum.EventsProcessed << " events processed, "
+         << Sum.EventsSelected << " selected (sum of weights " << Sum.SumWeightSelected << ")" << endl;
+   }
+
+   if(Total.Precision.size() > 0)
+   {
+      long long Read = 0, Available = 0;
+      int StoppedCount = 0;
+      for(PrecisionTargetRecord &R : Total.Precision)
+      {
+         Read = Read + R.EntriesRead;
+         Available = Available + R.EntriesAvailable;
+         StoppedCount = StoppedCount + (R.Stopped ? 1 : 0);
+      }
+      cout << "HistogramMerger: " << Total.Precision.size() << " precision-targeted jobs, " << StoppedCount
+         << " stopped early, " << Read << " of " << Available << " entries read" << endl;
+   }
+
+   if(WriteState(Total, OutputFileName) == false)
+      return 1;
+
+   double Time = chrono::duration<double>(chrono::steady_clock::now() - Start).count();
+   cout << "HistogramMerger: " << Total.FileCount << " files, " << Total.Order.size() << " histograms into "
+      << OutputFileName << " in " << Time << " s" << endl;
+   if(Total.Histograms.find(CountHistogram) != Total.Histograms.end())
+      cout << "HistogramMerger: total " << CountHistogram << " = " << Total.Histograms[CountHistogram]->GetBinContent(1) << endl;
+
+   if(RemoveInputs == true)
+   {
+      for(string File : Merged)
+      {
+         remove(File.c_str());
+         remove((File + ".done").c_str());
+      }
+   }
+
+   ClearState(Total);
+
+   return 0;
+}
+
+vector<string> ExpandInputs(vector<string> Patterns)
+{
+   vector<string> Result;
+   for(string Pattern : Patterns)
+   {
+      glob_t Glob;
+      if(glob(Pattern.c_str(), 0, nullptr, &Glob) == 0)
+      {
+         for(size_t i = 0; i < Glob.gl_pathc; i++)
+         {
+            string Name = Glob.gl_pathv[i];
+            if(Name.size() > 5 && Name.substr(Name.size() - 5) == ".done")
+               continue;
+            if(Name.size() > 8 && Name.substr(Name.size() - 8) == ".partial")
+               continue;
+            Result.push_back(Name);
+         }
+      }
+      globfree(&Glob);
+   }
+   return Result;
+}
+
+void AddFile(MergeState &State, string FileName, const set<string> &Constants)
+{
+   TFile File(FileName.c_str());
+   if(File.IsZombie() == true)
+   {
+      State.Good = false;
+      State.Error = "cannot open " + FileName;
+      return;
+   }
+
+   AddDirectory(State, &File, "", FileName, Constants);
+   State.FileCount = State.FileCount + 1;
+
+   File.Close();
+}
+
+void AddDirectory(MergeState &State, TDirectory *Directory, string Prefix, string FileName, const set<string> &Constants)
+{
+   set<string> Seen;   // only the highest cycle of each key
+
+   TIter Next(Directory->GetListOfKeys());
+   while(TKey *Key = (TKey *)Next())
+   {
+      if(State.Good == false)
+         return;
+
+      string Name = Key->GetName();
+      if(Seen.find(Name) != Seen.end())
+         continue;
+      Seen.insert(Name);
+
+      TClass *Class = TClass::GetClass(Key->GetClassName());
+      if(Class == nullptr)
+         continue;
+
+      if(Class->InheritsFrom(TDirectory::Class()) == true)
+      {
+         TDirectory *Sub = (TDirectory *)Key->ReadObj();
+         AddDirectory(State, Sub, Prefix + Name + "/", FileName, Constants);
+      }
+      else if(Class->InheritsFrom(TH1::Class()) == true)
+      {
+         TH1 *H = (TH1 *)Key->ReadObj();
+         AddHistogram(State, H, Prefix + Name, FileName, Constants);
+         delete H;
+      }
+      else if(Prefix == "" && Name == "EntryRange" && Class->InheritsFrom(TTree::Class()) == true)
+      {
+         TTree *Tree = (TTree *)Key->ReadObj();
+         vector<EntryRange> Ranges = ReadEntryRanges(Tree);
+         State.Ranges.insert(State.Ranges.end(), Ranges.begin(), Ranges.end());
+         delete Tree;
+      }
+      else if(Prefix == "" && Name == "Metadata" && Class->InheritsFrom(TTree::Class()) == true)
+      {
+         TTree *Tree = (TTree *)Key->ReadObj();
+         vector<RunMetadata> Metadata = ReadRunMetadata(Tree);
+         State.Metadata.insert(State.Metadata.end(), Metadata.begin(), Metadata.end());
+         delete Tree;
+      }
+      else if(Prefix == "" && Name == "PrecisionTarget" && Class->InheritsFrom(TTree::Class()) == true)
+      {
+         TTree *Tree = (TTree *)Key->ReadObj();
+         vector<PrecisionTargetRecord> Precision = ReadPrecisionTargets(Tree);
+         State.Precision.insert(State.Precision.end(), Precision.begin(), Precision.end());
+         delete Tree;
+      }
+      else if(State.FileCount == 0)
+         cerr << "HistogramMerger: skipping " << Prefix + Name << " (" << Key->GetClassName() << "), use hadd for trees" << endl;
+   }
+}
+
+void AddHistogram(MergeState &State, TH1 *H, string Path, string FileName, const set<string> &Constants)
+{
+   string Name = Path.substr(Path.rfind('/') + 1);
+
+   if(State.Histograms.find(Path) == State.Histograms.end())
+   {
+      TH1 *Clone = (TH1 *)H->Clone();
+      Clone->SetDirectory(nullptr);
+      State.Histograms[Path] = Clone;
+      State.Order.push_back(Path);
+      return;
+   }
+
+   TH1 *Sum = State.Histograms[Path];
+   if(SameBinning(Sum, H) == false)
+   {
+      State.Good = false;
+      State.Error = "binning of " + Path + " in " + FileName + " differs from the previous files";
+      return;
+   }
+
+   if(Constants.find(Name) != Constants.end())
+   {
+      if(SameContent(Sum, H) == false)
+         cerr << "HistogramMerger: warning: " << Path << " in " << FileName << " differs, keeping the first one" << endl;
+      return;
+   }
+
+   Sum->Add(H);
+}
+
+void MergeInto(MergeState &A, MergeState &B, const set<string> &Constants)
+{
+   if(A.Good == false)
+      return;
+   if(B.Good == false)
+   {
+      A.Good = false;
+      A.Error = B.Error;
+      return;
+   }
+
+   for(string Path : B.Order)
+   {
+      AddHistogram(A, B.Histograms[Path], Path, "a partial sum", Constants);
+      if(A.Good == false)
+         return;
+   }
+   A.Ranges.insert(A.Ranges.end(), B.Ranges.begin(), B.Ranges.end());
+   A.Metadata.insert(A.Metadata.end(), B.Metadata.begin(), B.Metadata.end());
+   A.Precision.insert(A.Precision.end(), B.Precision.begin(), B.Precision.end());
+   A.FileCount = A.FileCount + B.FileCount;
+}
+
+bool SameAxis(TAxis *A, TAxis *B)
+{
+   if(A->GetNbins() != B->GetNbins())
+      return false;
+   for(int i = 1; i <= A->GetNbins() + 1; i++)
+   {
+      double EdgeA = A->GetBinLowEdge(i);
+      double EdgeB = B->GetBinLowEdge(i);
+      if(fabs(EdgeA - EdgeB) > 1e-9 * max(1.0, fabs(EdgeA)))
+         return false;
+   }
+   return true;
+}
+
+bool SameBinning(TH1 *A, TH1 *B)
+{
+   if(A->GetDimension() != B->GetDimension())
+      return false;
+   if(SameAxis(A->GetXaxis(), B->GetXaxis()) == false)
+      return false;
+   if(A->GetDimension() > 1 && SameAxis(A->GetYaxis(), B->GetYaxis()) == false)
+      return false;
+   if(A->GetDimension() > 2 && SameAxis(A->GetZaxis(), B->GetZaxis()) == false)
+      return false;
+   return true;
+}
+
+bool SameContent(TH1 *A, TH1 *B)
+{
+   int N = A->GetNcells();
+   for(int i = 0; i < N; i++)
+      if(A->GetBinContent(i) != B->GetBinContent(i))
+         return false;
+   return true;
+}
+
+MergeState MergeParallel(vector<string> Files, int Threads, const set<string> &Constants)
+{
+   int N = min((int)Files.size(), Threads);
+   if(N < 1)
+      N = 1;
+
+   // each thread sums a contiguous share of the files
+   vector<MergeState> States(N);
+   vector<thread> Workers;
+   for(int iT = 0; iT < N; iT++)
+   {
+      States[iT].FileCount = 0;
+      States[iT].Good = true;
+      Workers.emplace_back([&, iT]()
+      {
+         for(int i = iT * (int)Files.size() / N; i < (iT + 1) * (int)Files.size() / N; i++)
+         {
+            AddFile(States[iT], Files[i], Constants);
+            if(States[iT].Good == false)
+               return;
+         }
+      });
+   }
+   for(thread &Worker : Workers)
+      Worker.join();
+
+   // then the partial sums are combined pairwise
+   for(int Step = 1; Step < N; Step = Step * 2)
+   {
+      vector<thread> Reducers;
+      for(int i = 0; i + Step < N; i = i + 2 * Step)
+      {
+         Reducers.emplace_back([&, i, Step]()
+         {
+            MergeInto(States[i], States[i+Step], Constants);
+            ClearState(States[i+Step]);
+         });
+      }
+      for(thread &Reducer : Reducers)
+         Reducer.join();
+   }
+
+   return States[0];
+}
+
+bool WriteState(MergeState &State, string OutputFileName)
+{
+   // written to a temporary name first, so a reader never sees a half-written file
+   string TemporaryName = OutputFileName + ".partial";
+   TFile OutputFile(TemporaryName.c_str(), "RECREATE");
+   if(OutputFile.IsZombie() == true)
+   {
+      cerr << "HistogramMerger: cannot create " << TemporaryName << endl;
+      return false;
+   }
+
+   for(string Path : State.Order)
+   {
+      TDirectory *Directory = &OutputFile;
+      size_t Slash = Path.rfind('/');
+      if(Slash != string::npos)
+      {
+         string DirectoryName = Path.substr(0, Slash);
+         Directory = OutputFile.mkdir(DirectoryName.c_str(), "", true);   // returns the existing one if present
+      }
+      Directory->cd();
+      State.Histograms[Path]->Write(Path.substr(Slash == string::npos ? 0 : Slash + 1).c_str());
+   }
+
+   if(State.Ranges.size() > 0)
+      WriteEntryRanges(&OutputFile, State.Ranges);
+   if(State.Metadata.size() > 0)
+      WriteRunMetadata(&OutputFile, State.Metadata);
+   if(State.Precision.size() > 0)
+      WritePrecisionTargets(&OutputFile, State.Precision);
+
+   OutputFile.Close();
+
+   if(rename(TemporaryName.c_str(), OutputFileName.c_str()) != 0)
+   {
+      cerr << "HistogramMerger: cannot move " << TemporaryName << " to " << OutputFileName << endl;
+      return false;
+   }
+   return true;
+}
+
+bool FileExists(string Path)
+{
+   struct stat Status;
+   return stat(Path.c_str(), &Status) == 0;
+}
+
+void ClearState(MergeState &State)
+{
+   for(auto &Item : State.Histograms)
+      delete Item.second;
+   State.Histograms.clear();
+   State.Order.clear();
+   State.Ranges.clear();
+   State.Metadata.clear();
+   State.Precision.clear();
+}
@@ -0,0 +1,345 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "CommandLine.h"
+
+// File-level job driver: runs one command per input file on the local cores, retries failures,
+//    and only merges the outputs when every input has succeeded.
+//
+//    Placeholders in --Command, --Output and --MergeCommand:
+//       {input}   full path of the input file
+//       {base}    basename of the input file
+//       {stem}    basename without the extension
+//       {index}   position of the input in the list, starting from 1, zero-padded
+//       {output}  the expanded --Output template
+//       {merged}  the --Merge target (merge command only)
+//       {outputs} all outputs separated by spaces (merge command only)
+//
+//    A job whose output and "<output>.done" marker both exist is skipped, so an interrupted
+//    campaign can be restarted with the same command.
+
+struct Job
+{
+   string Input;
+   string Output;
+   string Command;
+   string LogFile;
+   int Attempts;
+   int Status;        // exit code of the last attempt, -1 while pending
+   pid_t PID;
+   double WallTime;   // seconds, last attempt
+   chrono::steady_clock::time_point Start;
+};
+
+int main(int argc, char *argv[]);
+vector<string> ExpandInputs(vector<string> Patterns, string ListFileName);
+string Substitute(string Template, map<string, string> &Values);
+string BaseName(string Path);
+string StemName(string Path);
+long long FileSize(string Path);
+bool FileExists(string Path);
+pid_t Launch(Job &J);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   vector<string> InputPatterns = CL.GetStringVector("Input", vector<string>{});
+   string ListFileName          = CL.Get("List", "");
+   string CommandTemplate       = CL.Get("Command");
+   string OutputTemplate        = CL.Get("Output", "{base}");
+   int Concurrency              = CL.GetInt("Jobs", (int)sysconf(_SC_NPROCESSORS_ONLN));
+   int MaxRetry                 = CL.GetInt("Retry", 1);
+   string MergedFileName        = CL.Get("Merge", "");
+   string MergeTemplate         = CL.Get("MergeCommand", "hadd -f {merged} {outputs}");
+   bool Clean                   = CL.GetBool("Clean", MergedFileName != "");
+   string LogDirectory          = CL.Get("LogDirectory", "Log");
+   bool Resume                  = CL.GetBool("Resume", true);
+
+   if(Concurrency < 1)
+      Concurrency = 1;
+
+   vector<string> Inputs = ExpandInputs(InputPatterns, ListFileName);
+   if(Inputs.size() == 0)
+   {
+      cerr << "No input files given (use --Input with a comma-separated list or glob, or --List)" << endl;
+      return -1;
+   }
+
+   system(("mkdir -p " + LogDirectory).c_str());
+
+   vector<Job> Jobs(Inputs.size());
+   for(int i = 0; i < (int)Inputs.size(); i++)
+   {
+      ostringstream Index;
+      Index << setw(to_string(Inputs.size()).size()) << setfill('0') << i + 1;
+
+      map<string, string> Values;
+      Values["input"] = Inputs[i];
+      Values["base"]  = BaseName(Inputs[i]);
+      Values["stem"]  = StemName(Inputs[i]);
+      Values["index"] = Index.str();
+      Values["output"] = Substitute(OutputTemplate, Values);
+
+      Jobs[i].Input    = Inputs[i];
+      Jobs[i].Output   = Values["output"];
+      Jobs[i].Command  = Substitute(CommandTemplate, Values);
+      Jobs[i].LogFile  = LogDirectory + "/" + BaseName(Jobs[i].Output) + ".log";
+      Jobs[i].Attempts = 0;
+      Jobs[i].Status   = -1;
+      Jobs[i].PID      = -1;
+      Jobs[i].WallTime = 0;
+   }
+
+   deque<int> Pending;
+   map<pid_t, int> Running;
+   int Skipped = 0;
+   for(int i = 0; i < (int)Jobs.size(); i++)
+   {
+      if(Resume == true && FileExists(Jobs[i].Output) && FileExists(Jobs[i].Output + ".done"))
+      {
+         Jobs[i].Status = 0;
+         Skipped = Skipped + 1;
+         continue;
+      }
+      Pending.push_back(i);
+   }
+
+   cout << "JobDriver: " << Jobs.size() << " inputs, " << Skipped << " already done, running "
+      << Pending.size() << " with up to " << Concurrency << " at a time" << endl;
+
+   auto CampaignStart = chrono::steady_clock::now();
+   long long TotalBytes = 0;
+   int Finished = 0;
+
+   while(Pending.size() > 0 || Running.size() > 0)
+   {
+      while(Pending.size() > 0 && (int)Running.size() < Concurrency)
+      {
+         int i = Pending.front();
+         Pending.pop_front();
+
+         Jobs[i].Attempts = Jobs[i].Attempts + 1;
+         Jobs[i].Start = chrono::steady_clock::now();
+         Jobs[i].PID = Launch(Jobs[i]);
+         if(Jobs[i].PID < 0)
+         {
+            cerr << "Failed to start job for " << Jobs[i].Input << endl;
+            Jobs[i].Status = 127;
+            continue;
+         }
+         Running[Jobs[i].PID] = i;
+      }
+
+      int WaitStatus = 0;
+      pid_t PID = waitpid(-1, &WaitStatus, 0);
+      if(PID < 0)
+         break;
+      if(Running.find(PID) == Running.end())
+         continue;
+
+      int i = Running[PID];
+      Running.erase(PID);
+
+      Job &J = Jobs[i];
+      J.WallTime = chrono::duration<double>(chrono::steady_clock::now() - J.Start).count();
+      J.Status = WIFEXITED(WaitStatus) ? WEXITSTATUS(WaitStatus) : 128 + WTERMSIG(WaitStatus);
+      if(J.Status == 0 && FileExists(J.Output) == false)
+         J.Status = 126;   // claimed success but left no output (Launch removed any earlier one)
+
+      long long Bytes = FileSize(J.Input);
+      if(J.Status == 0)
+      {
+         Finished = Finished + 1;
+         TotalBytes = TotalBytes + Bytes;
+         ofstream Marker(J.Output + ".done");
+         Marker << J.Command << endl;
+         Marker.close();
+
+         cout << "[" << Finished + Skipped << "/" << Jobs.size() << "] " << BaseName(J.Input)
+            << " done in " << fixed << setprecision(1) << J.WallTime << " s";
+         if(J.WallTime > 0)
+            cout << " (" << setprecision(2) << Bytes / 1048576.0 / J.WallTime << " MB/s)";
+         cout << endl;
+      }
+      else if(J.Attempts <= MaxRetry)
+      {
+         cerr << BaseName(J.Input) << " failed with status " << J.Status << " after " << J.WallTime
+            << " s, retrying (" << J.Attempts << "/" << MaxRetry + 1 << "), see " << J.LogFile << endl;
+         Pending.push_back(i);
+      }
+      else
+         cerr << BaseName(J.Input) << " failed with status " << J.Status << ", giving up, see " << J.LogFile << endl;
+   }
+
+   double CampaignTime = chrono::duration<double>(chrono::steady_clock::now() - CampaignStart).count();
+
+   vector<int> Failed;
+   for(int i = 0; i < (int)Jobs.size(); i++)
+      if(Jobs[i].Status != 0)
+         Failed.push_back(i);
+
+   cout << "JobDriver: " << Finished << " jobs finished in " << fixed << setprecision(1) << CampaignTime << " s";
+   if(CampaignTime > 0)
+      cout << ", " << setprecision(2) << TotalBytes / 1048576.0 / CampaignTime << " MB/s of input";
+   cout << endl;
+
+   if(Failed.size() > 0)
+   {
+      cerr << "JobDriver: " << Failed.size() << " inputs failed, not merging:" << endl;
+      for(int i : Failed)
+         cerr << "   " << Jobs[i].Input << " (status " << Jobs[i].Status << ", log " << Jobs[i].LogFile << ")" << endl;
+      return 1;
+   }
+
+   if(MergedFileName == "")
+      return 0;
+
+   string Outputs = "";
+   for(Job &J : Jobs)
+      Outputs = Outputs + " " + J.Output;
+
+   map<string, string> Values;
+   Values["merged"] = MergedFileName;
+   Values["outputs"] = Outputs;
+   string MergeCommand = Substitute(MergeTemplate, Values);
+
+   auto MergeStart = chrono::steady_clock::now();
+   int MergeStatus = system(MergeCommand.c_str());
+   double MergeTime = chrono::duration<double>(chrono::steady_clock::now() - MergeStart).count();
+   if(MergeStatus != 0)
+   {
+      cerr << "JobDriver: merge into " << MergedFileName << " failed, keeping the per-file outputs" << endl;
+      return 1;
+   }
+   cout << "JobDriver: merged " << Jobs.size() << " outputs into " << MergedFileName
+      << " in " << setprecision(1) << MergeTime << " s" << endl;
+
+   if(Clean == true)
+   {
+      for(Job &J : Jobs)
+      {
+         remove(J.Output.c_str());
+         remove((J.Output + ".done").c_str());
+      }
+   }
+
+   return 0;
+}
+
+vector<string> ExpandInputs(vector<string> Patterns, string ListFileName)
+{
+   vector<string> Result;
+
+   if(ListFileName != "")
+   {
+      ifstream in(ListFileName.c_str());
+      string Line;
+      while(getline(in, Line))
+      {
+         if(Line.size() == 0 || Line[0] == '#')
+            continue;
+         Patterns.push_back(Line);
+      }
+   }
+
+   for(string Pattern : Patterns)
+   {
+      glob_t Glob;
+      if(glob(Pattern.c_str(), 0, nullptr, &Glob) == 0)
+      {
+         for(size_t i = 0; i < Glob.gl_pathc; i++)
+            Result.push_back(Glob.gl_pathv[i]);
+      }
+      else
+         Result.push_back(Pattern);   // let the job report a missing file
+      globfree(&Glob);
+   }
+
+   return Result;
+}
+
+string Substitute(string Template, map<string, string> &Values)
+{
+   for(auto &Item : Values)
+   {
+      string Key = "{" + Item.first + "}";
+      size_t Position = Template.find(Key);
+      while(Position != string::npos)
+      {
+         Template.replace(Position, Key.size(), Item.second);
+         Position = Template.find(Key, Position + Item.second.size());
+      }
+   }
+   return Template;
+}
+
+string BaseName(string Path)
+{
+   size_t Slash = Path.rfind('/');
+   if(Slash == string::npos)
+      return Path;
+   return Path.substr(Slash + 1);
+}
+
+string StemName(string Path)
+{
+   string Base = BaseName(Path);
+   size_t Dot = Base.rfind('.');
+   if(Dot == string::npos || Dot == 0)
+      return Base;
+   return Base.substr(0, Dot);
+}
+
+long long FileSize(string Path)
+{
+   struct stat Status;
+   if(stat(Path.c_str(), &Status) != 0)
+      return 0;
+   return Status.st_size;
+}
+
+bool FileExists(string Path)
+{
+   struct stat Status;
+   return stat(Path.c_str(), &Status) == 0;
+}
+
+// Removes what an earlier attempt or run left behind, so that an output found after the job exits
+//    can only have been written by this attempt
+pid_t Launch(Job &J)
+{
+   remove((J.Output + ".done").c_str());
+   remove(J.Output.c_str());
+
+   pid_t PID = fork();
+   if(PID != 0)
+      return PID;
+
+   // child: send everything to the per-job log and run the command through the shell
+   int Log = open(J.LogFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if(Log >= 0)
+   {
+      dup2(Log, STDOUT_FILENO);
+      dup2(Log, STDERR_FILENO);
+      close(Log);
+   }
+   execl("/bin/sh", "sh", "-c", J.Command.c_str(), (char *)nullptr);
+   _exit(127);
+}
@@ -1,11 +1,148 @@
 #include <algorithm>
 #include <vector>
 #include <iostream>
+#include <chrono>
 
+#include "TROOT.h"
 #include "TFile.h"
 #include "TTree.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include "TTreeCache.h"
+#include "TTreeCacheUnzip.h"
+#include "TFileCacheRead.h"
+#include "TKey.h"
 
 #include "Messenger.h"
+#include "Timeline.h"
+
+MessengerIO::MessengerIO()
+{
+   CachedTree = nullptr;
+   Entries = 0;
+   Reset(nullptr);
+}
+
+void MessengerIO::Reset(TTree *tree)
+{
+   CachedTree = tree;
+   Entries = (tree != nullptr) ? tree->GetEntries() : 0;
+   EntriesRead = 0;
+   BytesRead = 0;
+   ReadTime = 0;
+}
+
+long long MessengerIO::GetEntries(TTree *tree)
+{
+   if(tree == nullptr)
+      return 0;
+   if(tree != CachedTree)   // tree swapped behind our back
+   {
+      CachedTree = tree;
+      Entries = tree->GetEntries();
+   }
+   return Entries;
+}
+
+bool MessengerIO::EnableCache(TTree *tree, long long CacheSize, int LearnEntries, bool Prefetch, bool ParallelUnzip)
+{
+   if(tree == nullptr)
+      return false;
+
+   TObjArray *Branches = tree->GetListOfBranches();
+
+   // Default: enough for two clusters of the active branches (the one being read plus the prefetched one)
+   if(CacheSize < 0)
+   {
+      long long ActiveZipBytes = 0;
+      for(int i = 0; Branches != nullptr && i < Branches->GetEntries(); i++)
+      {
+         TBranch *Branch = (TBranch *)Branches->At(i);
+         if(Branch != nullptr && tree->GetBranchStatus(Branch->GetName()) == true)
+            ActiveZipBytes = ActiveZipBytes + Branch->GetZipBytes("*");
+      }
+
+      long long ClusterSize = tree->GetAutoFlush();
+      long long EntryCount = GetEntries(tree);
+      double ClusterFraction = 1;
+      if(ClusterSize > 0 && EntryCount > 0)
+         ClusterFraction = std::min(1.0, (double)ClusterSize / EntryCount);
+
+      CacheSize = (long long)(2 * ActiveZipBytes * ClusterFraction);
+      CacheSize = std::max(CacheSize, 1LL << 20);
+      CacheSize = std::min(CacheSize, 1LL << 30);
+   }
+
+   // Parallel unzipping needs the implicit multi-threading pool and has to be requested before the cache is made
+   if(ParallelUnzip == true)
+   {
+      if(ROOT::IsImplicitMTEnabled() == false)
+         ROOT::EnableImplicitMT();
+      TTreeCacheUnzip::SetParallelUnzip(TTreeCacheUnzip::kEnable);
+   }
+
+   if(tree->SetCacheSize(CacheSize) != 0)
+      return false;
+
+   for(int i = 0; Branches != nullptr && i < Branches->GetEntries(); i++)
+   {
+      TBranch *Branch = (TBranch *)Branches->At(i);
+      if(Branch != nullptr && tree->GetBranchStatus(Branch->GetName()) == true)
+         tree->AddBranchToCache(Branch, true);
+   }
+   if(LearnEntries > 0)
+      tree->SetCacheLearnEntries(LearnEntries);
+   else
+      tree->StopCacheLearningPhase();
+
+   TFile *File = tree->GetCurrentFile();
+   if(Prefetch == true && File != nullptr)
+   {
+      // background thread reads the next cluster while we process the current one
+      TFileCacheRead *Cache = File->GetCacheRead(tree);
+      if(Cache != nullptr)
+         Cache->SetEnablePrefetching(true);
+   }
+
+   return true;
+}
+
+// On the timeline GetEntry covers reading and decompressing the baskets; the file counter only moves
+//    when baskets come from disk, which separates the two
+int MessengerIO::Read(TTree *tree, long long iEntry)
+{
+   TIMELINE_SCOPE("GetEntry", "io");
+   auto Start = std::chrono::steady_clock::now();
+   int Bytes = tree->GetEntry(iEntry);
+   auto End = std::chrono::steady_clock::now();
+   if(tree->GetCurrentFile() != nullptr)
+      TIMELINE_COUNTER("FileBytesRead", tree->GetCurrentFile()->GetBytesRead());
+
+   ReadTime = ReadTime + std::chrono::duration<double>(End - Start).count();
+   EntriesRead = EntriesRead + 1;
+   if(Bytes > 0)
+      BytesRead = BytesRead + Bytes;
+
+   return Bytes;
+}
+
+long long MessengerIO::GetFileBytesRead(TTree *tree)
+{
+   if(tree == nullptr || tree->GetCurrentFile() == nullptr)
+      return 0;
+   return tree->GetCurrentFile()->GetBytesRead();
+}
+
+void MessengerIO::PrintStatistics(std::ostream &out, std::string Label)
+{
+   out << "[" << Label << "] read " << EntriesRead << " entries, "
+      << BytesRead / 1048576.0 << " MB uncompressed ("
+      << GetFileBytesRead(CachedTree) / 1048576.0 << " MB from file) in "
+      << ReadTime << " s";
+   if(ReadTime > 0)
+      out << ", " << BytesRead / 1048576.0 / ReadTime << " MB/s";
+   out << std::endl;
+}
 
 JetTreeMessenger::JetTreeMessenger()
 {
@@ -42,6 +179,8 @@ bool JetTreeMessenger::Initialize(TTree *tree)
 
 bool JetTreeMessenger::Initialize()
 {
+   IO.Reset(Tree);
+
    if(Tree == nullptr)
       return false;
 
@@ -73,7 +212,7 @@ bool JetTreeMessenger::GetEntry(int iEntry)
    if(iEntry >= GetEntries())
       return false;
 
-   Tree->GetEntry(iEntry);
+   IO.Read(Tree, iEntry);
 
    Jet.resize(nref);
    for(int i = 0; i < nref; i++)
@@ -84,9 +223,12 @@ bool JetTreeMessenger::GetEntry(int iEntry)
 
 int JetTreeMessenger::GetEntries()
 {
-   if(Tree == nullptr)
-      return 0;
-   return Tree->GetEntries();
+   return IO.GetEntries(Tree);
+}
+
+bool JetTreeMessenger::EnableCache(long long CacheSize, int LearnEntries, bool Prefetch, bool ParallelUnzip)
+{
+   return IO.EnableCache(Tree, CacheSize, LearnEntries, Prefetch, ParallelUnzip);
 }
 
 ParticleTreeMessenger::ParticleTreeMessenger()
@@ -124,6 +266,11 @@ bool ParticleTreeMessenger::Initialize(TTree *tree)
 
 bool ParticleTreeMessenger::Initialize()
 {
+   IO.Reset(Tree);
+
+   EventNo = -1;
+   RunNo = -1;
+
    if(Tree == nullptr)
       return false;
 
@@ -546,7 +693,7 @@ bool ParticleTreeMessenger::GetEntry(int iEntry)
    if(iEntry >= GetEntries())
       return false;
 
-   Tree->GetEntry(iEntry);
+   IO.Read(Tree, iEntry);
 
    P.resize(nParticle);
    for(int i = 0; i < nParticle; i++)
@@ -557,9 +704,12 @@ bool ParticleTreeMessenger::GetEntry(int iEntry)
 
 int ParticleTreeMessenger::GetEntries()
 {
-   if(Tree == nullptr)
-      return 0;
-   return Tree->GetEntries();
+   return IO.GetEntries(Tree);
+}
+
+bool ParticleTreeMessenger::EnableCache(long long CacheSize, int LearnEntries, bool Prefetch, bool ParallelUnzip)
+{
+   return IO.EnableCache(Tree, CacheSize, LearnEntries, Prefetch, ParallelUnzip);
 }
 
 bool ParticleTreeMessenger::PassBaselineCut()
@@ -576,30 +726,64 @@ bool ParticleTreeMessenger::PassBaselineCut()
    return true;
 }
 
+ReducedEventSource *(*ReducedTreeMessenger::OpenSource)(TFile *file, std::string name) = nullptr;
+
 ReducedTreeMessenger::ReducedTreeMessenger()
 {
    Tree = nullptr;
+   Source = nullptr;
    Initialize();
 }
 
 ReducedTreeMessenger::ReducedTreeMessenger(TFile &file, std::string name)
 {
-   Tree = (TTree *)file.Get(name.c_str());
-   Initialize();
+   Source = nullptr;
+   Open(&file, name);
 }
 
 ReducedTreeMessenger::ReducedTreeMessenger(TFile *file, std::string name)
 {
-   Tree = (TTree *)file->Get(name.c_str());
-   Initialize();
+   Source = nullptr;
+   Open(file, name);
 }
 
 ReducedTreeMessenger::ReducedTreeMessenger(TTree *tree)
 {
    Tree = tree;
+   Source = nullptr;
    Initialize();
 }
 
+ReducedTreeMessenger::~ReducedTreeMessenger()
+{
+   if(Source != nullptr)
+      delete Source;
+}
+
+bool ReducedTreeMessenger::Open(TFile *file, std::string name)
+{
+   Tree = nullptr;
+   if(Source != nullptr)
+      delete Source;
+   Source = nullptr;
+
+   if(file == nullptr)
+      return Initialize();
+
+   TKey *Key = file->GetKey(name.c_str());
+   if(Key != nullptr && std::string(Key->GetClassName()) == "ROOT::RNTuple")
+   {
+      if(OpenSource != nullptr)
+         Source = OpenSource(file, name);
+      else
+         std::cerr << "ReducedTreeMessenger: " << name << " is an RNTuple, include RNTupleIO.h to read it" << std::endl;
+   }
+   else
+      Tree = (TTree *)file->Get(name.c_str());
+
+   return Initialize();
+}
+
 bool ReducedTreeMessenger::Initialize(TTree *tree)
 {
    Tree = tree;
@@ -608,8 +792,13 @@ bool ReducedTreeMessenger::Initialize(TTree *tree)
 
 bool ReducedTreeMessenger::Initialize()
 {
+   IO.Reset(Tree);
+
+   RunNo = -1;
+   EventNo = -1;
+
    if(Tree == nullptr)
-      return false;
+      return (Source != nullptr);
 
    Tree->SetBranchAddress("N",        &N);
    Tree->SetBranchAddress("Momentum", &Momentum);
@@ -619,34 +808,210 @@ bool ReducedTreeMessenger::Initialize()
    Tree->SetBranchAddress("Weight",   &Weight);
    Tree->SetBranchAddress("Charge",   &Charge);
    Tree->SetBranchAddress("PassCut",  &PassCut);
+   if(Tree->GetBranch("RunNo") != nullptr)
+      Tree->SetBranchAddress("RunNo", &RunNo);
+   if(Tree->GetBranch("EventNo") != nullptr)
+      Tree->SetBranchAddress("EventNo", &EventNo);
 
    return true;
 }
 
 bool ReducedTreeMessenger::GetEntry(int iEntry)
 {
-   if(Tree == nullptr)
+   if(Tree == nullptr && Source == nullptr)
       return false;
    if(iEntry < 0)
       return false;
    if(iEntry >= GetEntries())
       return false;
 
-   Tree->GetEntry(iEntry);
+   if(Source != nullptr)
+      Source->Read(iEntry, *this);
+   else
+      IO.Read(Tree, iEntry);
 
    P.resize(N);
    for(int i = 0; i < N; i++)
       P[i].SetSizeThetaPhiMass(Momentum[i], Theta[i], Phi[i], Mass[i]);
+
+   return true;
 }
 
 int ReducedTreeMessenger::GetEntries()
 {
+   if(Source != nullptr)
+      return Source->GetEntries();
+   return IO.GetEntries(Tree);
+}
+
+// first entry of every cluster, followed by the number of entries
+std::vector<long long> ReducedTreeMessenger::GetClusterBoundaries()
+{
+   if(Source != nullptr)
+      return Source->GetClusterBoundaries();
+
+   std::vector<long long> Boundaries;
    if(Tree == nullptr)
-      return 0;
-   return Tree->GetEntries();
+      return Boundaries;
+
+   long long N = GetEntries();
+   TTree::TClusterIterator Iterator = Tree->GetClusterIterator(0);
+   long long Start = Iterator.Next();
+   while(Start < N)
+   {
+      Boundaries.push_back(Start);
+      Start = Iterator.Next();
+   }
+   Boundaries.push_back(N);
+
+   return Boundaries;
+}
+
+// an RNTuple source reads whole clusters with its own prefetching, there is nothing to configure
+bool ReducedTreeMessenger::EnableCache(long long CacheSize, int LearnEntries, bool Prefetch, bool ParallelUnzip)
+{
+   if(Source != nullptr)
+      return false;
+   return IO.EnableCache(Tree, CacheSize, LearnEntries, Prefetch, ParallelUnzip);
+}
+
+SelectionIndexMessenger::SelectionIndexMessenger()
+{
+   Tree = nullptr;
+}
+
+SelectionIndexMessenger::SelectionIndexMessenger(TFile &file, std::string name)
+{
+   Tree = (TTree *)file.Get(name.c_str());
+   Initialize();
+}
+
+SelectionIndexMessenger::SelectionIndexMessenger(TFile *file, std::string name)
+{
+   if(file == nullptr)
+   {
+      Tree = nullptr;
+      return;
+   }
+   Tree = (TTree *)file->Get(name.c_str());
+   Initialize();
+}
+
+SelectionIndexMessenger::SelectionIndexMessenger(TTree *tree)
+{
+   Tree = tree;
+   Initialize();
+}
+
+bool SelectionIndexMessenger::Initialize(TTree *tree)
+{
+   Tree = tree;
+   return Initialize();
+}
+
+bool SelectionIndexMessenger::Initialize()
+{
+   IO.Reset(Tree);
+
+   RunNo = -1;
+   EventNo = -1;
+
+   if(Tree == nullptr)
+      return false;
+
+   if(Tree->GetBranch("RunNo") != nullptr)
+      Tree->SetBranchAddress("RunNo", &RunNo);
+   if(Tree->GetBranch("EventNo") != nullptr)
+      Tree->SetBranchAddress("EventNo", &EventNo);
+   Tree->SetBranchAddress("PassBaselineCut",   &PassBaselineCut);
+   Tree->SetBranchAddress("passesLEP1TwoPC",   &passesLEP1TwoPC);
+   Tree->SetBranchAddress("passesSTheta",      &passesSTheta);
+   Tree->SetBranchAddress("passesAll",         &passesAll);
+   Tree->SetBranchAddress("STheta",            &STheta);
+   Tree->SetBranchAddress("TTheta",            &TTheta);
+   Tree->SetBranchAddress("SThetaCategory",    &SThetaCategory);
+   Tree->SetBranchAddress("TThetaCategory",    &TThetaCategory);
+   Tree->SetBranchAddress("nParticle",         &nParticle);
+   Tree->SetBranchAddress("nChargedHadronsHP", &nChargedHadronsHP);
+   Tree->SetBranchAddress("TotalE",            &TotalE);
+   Tree->SetBranchAddress("SumP",              &SumP);
+   Tree->SetBranchAddress("N5Jet",             &N5Jet);
+
+   return true;
 }
 
+bool SelectionIndexMessenger::GetEntry(int iEntry)
+{
+   if(Tree == nullptr)
+      return false;
+   if(iEntry < 0)
+      return false;
+   if(iEntry >= GetEntries())
+      return false;
 
+   IO.Read(Tree, iEntry);
+   return true;
+}
 
+int SelectionIndexMessenger::GetEntries()
+{
+   return IO.GetEntries(Tree);
+}
+
+bool SelectionIndexMessenger::EnableCache(long long CacheSize, int LearnEntries, bool Prefetch, bool ParallelUnzip)
+{
+   return IO.EnableCache(Tree, CacheSize, LearnEntries, Prefetch, ParallelUnzip);
+}
 
+bool SelectionIndexMessenger::Pass(bool CheckCut, bool CheckSphericity, bool Reject3Jet)
+{
+   if(CheckCut == true && PassBaselineCut == false)
+      return false;
+   if(CheckSphericity == true && passesSTheta == false)
+      return false;
+   if(Reject3Jet == true && N5Jet > 2)
+      return false;
+   return true;
+}
+
+// The index has to have as many entries as the particle tree, and the same run and event numbers on the
+//    first, middle and last entries; only the identifier branches are read from the particle tree
+bool SelectionIndexMessenger::IsAlignedWith(ParticleTreeMessenger &M, std::ostream &out)
+{
+   if(Tree == nullptr || M.Tree == nullptr)
+      return false;
+
+   long long N = GetEntries();
+   if(N != M.GetEntries())
+   {
+      out << "selection index has " << N << " entries, the particle tree " << M.GetEntries() << std::endl;
+      return false;
+   }
+   if(N == 0)
+      return true;
+
+   TBranch *RunBranch = M.Tree->GetBranch("RunNo");
+   TBranch *EventBranch = M.Tree->GetBranch("EventNo");
+   if(Tree->GetBranch("RunNo") == nullptr || Tree->GetBranch("EventNo") == nullptr
+      || RunBranch == nullptr || EventBranch == nullptr)
+   {
+      out << "selection index or particle tree has no run / event numbers, rebuild the index" << std::endl;
+      return false;
+   }
+
+   for(long long iE : {0LL, N / 2, N - 1})
+   {
+      Tree->GetBranch("RunNo")->GetEntry(iE, 1);
+      Tree->GetBranch("EventNo")->GetEntry(iE, 1);
+      RunBranch->GetEntry(iE, 1);   // also when the branch is disabled
+      EventBranch->GetEntry(iE, 1);
+      if(RunNo != M.RunNo || EventNo != M.EventNo)
+      {
+         out << "selection index entry " << iE << " is run " << RunNo << " event " << EventNo
+            << ", the particle tree has run " << M.RunNo << " event " << M.EventNo << std::endl;
+         return false;
+      }
+   }
+   return true;
+}
 
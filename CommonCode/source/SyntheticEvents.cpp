@@ -0,0 +1,874 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+using namespace std;
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TRandom3.h"
+#include "TMatrixDSym.h"
+#include "TMatrixDSymEigen.h"
+#include "TVectorD.h"
+
+#include "CommandLine.h"
+#include "ProgressBar.h"
+#include "TauHelperFunctions3.h"
+#include "CATree.h"
+
+#define SYNTHETICMAX 1000   // same as MAXPARTICLE and MAXJET in Messenger.h
+#define SYNTHETICMAXPW 6
+
+// Synthetic LEP1-like events in the layout of the archived ALEPH files
+//    Z -> q qbar at --Energy, with 2, 3 or 4 partons (3- and 4-jet rates of roughly 25% and 5%), each
+//    fragmented into pions, kaons, protons, photons and neutral hadrons with a limited transverse
+//    momentum, and a few neutrinos from heavy-flavour decays.  Momentum and energy are balanced at the end.
+//    The detector step drops particles outside the acceptance or below threshold, applies per-type
+//    efficiencies and smears momenta and angles with ALEPH-like resolutions.
+//
+//    tgenBefore has every generated event, t and tgen only those whose reconstructed event passes the
+//    standard selection, entry by entry.  Jets (e+e- anti-kt, E-scheme, soft drop with zcut 0.1) are
+//    written as ak<R>ESchemeJetTree and ak<R>ESchemeGenJetTree for every --JetR, R4 meaning R = 0.4.
+//    Only branches the analysis code reads are filled; the rest of the archived layout is not written.
+//
+//    ./SyntheticEvents --Output Synthetic.root --Events 10000 --Seed 42 --JetR 0.4,0.8
+
+struct Particle
+{
+   FourVector P;
+   short Charge;
+   int PID;
+   short PWFlag;      // 0 charged track, 4 photon, 5 neutral hadron
+   bool HighPurity;
+   short NTPC, NITC, NVDET;
+   float D0, Z0;
+};
+
+struct EventShape
+{
+   double Thrust, TTheta, TPhi;
+   FourVector ThrustAxis;
+   double Sphericity, Aplanarity, STheta, SPhi;
+};
+
+struct Jet
+{
+   FourVector P;
+   vector<int> Constituents;
+};
+
+class ParticleTreeWriter
+{
+public:
+   TTree *Tree;
+   int EventNo, RunNo, year, subDir, process;
+   bool isMC;
+   unsigned long long uniqueID;
+   float Energy;
+   int bFlag;
+   float particleWeight;
+   int nParticle;
+   float px[SYNTHETICMAX], py[SYNTHETICMAX], pz[SYNTHETICMAX], pt[SYNTHETICMAX], pmag[SYNTHETICMAX];
+   float rap[SYNTHETICMAX], eta[SYNTHETICMAX], theta[SYNTHETICMAX], phi[SYNTHETICMAX], mass[SYNTHETICMAX];
+   short charge[SYNTHETICMAX];
+   bool isCharged[SYNTHETICMAX];
+   short pwflag[SYNTHETICMAX];
+   int pid[SYNTHETICMAX];
+   float d0[SYNTHETICMAX], z0[SYNTHETICMAX];
+   bool highPurity[SYNTHETICMAX];
+   short ntpc[SYNTHETICMAX], nitc[SYNTHETICMAX], nvdet[SYNTHETICMAX];
+   float weight[SYNTHETICMAX];
+   float pt_wrtThr[SYNTHETICMAX], eta_wrtThr[SYNTHETICMAX], rap_wrtThr[SYNTHETICMAX];
+   float theta_wrtThr[SYNTHETICMAX], phi_wrtThr[SYNTHETICMAX];
+   bool passesNTupleAfterCut, passesTotalChgEnergyMin, passesNTrkMin, passesSTheta, passesMissP;
+   bool passesISR, passesWW, passesNeuNch, passesAll, passesLEP1TwoPC;
+   float missP, missPt, missTheta, missPhi;
+   int nChargedHadrons, nChargedHadronsHP, nChargedHadrons_GT0p4;
+   float nChargedHadronsHP_Corrected;
+   float Thrust, TTheta, TPhi;
+   float Sphericity, STheta, SPhi, Aplanarity;
+public:
+   ParticleTreeWriter(TFile &File, string Name, string Title);
+   bool Fill(int Event, double SqrtS, const vector<Particle> &Particles);
+};
+
+class JetTreeWriter
+{
+public:
+   TTree *Tree;
+   double R;
+   int nref;
+   float jtpt[SYNTHETICMAX], jteta[SYNTHETICMAX], jtphi[SYNTHETICMAX], jtm[SYNTHETICMAX];
+   int jtN[SYNTHETICMAX];
+   int jtNPW[SYNTHETICMAX][SYNTHETICMAXPW];
+   float jtptFracPW[SYNTHETICMAX][SYNTHETICMAXPW];
+   float zgJtPt_Beta0p00ZCut0p10[SYNTHETICMAX], zgJtPhi_Beta0p00ZCut0p10[SYNTHETICMAX];
+   float zgJtEta_Beta0p00ZCut0p10[SYNTHETICMAX];
+   float zg_Beta0p00ZCut0p10[SYNTHETICMAX], rg_Beta0p00ZCut0p10[SYNTHETICMAX];
+public:
+   JetTreeWriter(TFile &File, string Name, double r);
+   void Fill(const vector<Particle> &Particles);
+};
+
+vector<Particle> GenerateEvent(TRandom3 &Random, double SqrtS);
+vector<FourVector> GeneratePartons(TRandom3 &Random, double SqrtS);
+void Fragment(TRandom3 &Random, FourVector Parton, vector<Particle> &Particles);
+void BalanceEvent(vector<Particle> &Particles, double SqrtS);
+vector<Particle> Reconstruct(TRandom3 &Random, const vector<Particle> &Gen);
+double DrawPolarAngle(TRandom3 &Random);
+EventShape GetEventShape(const vector<Particle> &Particles);
+vector<Jet> ClusterJets(const vector<Particle> &Particles, double R);
+bool IsNeutrino(int PID);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   string OutputFileName  = CL.Get("Output", "Synthetic.root");
+   long long EventCount   = CL.GetInt("Events", 10000);
+   int Seed               = CL.GetInt("Seed", 42);
+   double SqrtS           = CL.GetDouble("Energy", 91.1876);
+   vector<double> JetR    = CL.GetDoubleVector("JetR", vector<double>{0.4});
+   string RecoTreeName    = CL.Get("Reco", "t");
+   string GenTreeName     = CL.Get("Gen", "tgen");
+   string GenBeforeName   = CL.Get("GenBefore", "tgenBefore");
+
+   TRandom3 Random(Seed);
+
+   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+
+   ParticleTreeWriter Reco(OutputFile, RecoTreeName, "Synthetic reconstructed particles, selected events");
+   ParticleTreeWriter Gen(OutputFile, GenTreeName, "Synthetic generated particles, selected events");
+   ParticleTreeWriter GenBefore(OutputFile, GenBeforeName, "Synthetic generated particles, all events");
+
+   vector<JetTreeWriter *> RecoJets, GenJets;
+   for(double R : JetR)
+   {
+      string Label = "akR" + to_string((int)round(R * 10));
+      RecoJets.push_back(new JetTreeWriter(OutputFile, Label + "ESchemeJetTree", R));
+      GenJets.push_back(new JetTreeWriter(OutputFile, Label + "ESchemeGenJetTree", R));
+   }
+
+   ProgressBar Bar(cout, EventCount);
+   Bar.SetStyle(-1);
+
+   long long SelectedCount = 0;
+   for(long long iE = 0; iE < EventCount; iE++)
+   {
+      Bar.Update(iE);
+      Bar.PrintIfDue();
+
+      vector<Particle> GenParticles = GenerateEvent(Random, SqrtS);
+      vector<Particle> RecoParticles = Reconstruct(Random, GenParticles);
+
+      GenBefore.Fill(iE, SqrtS, GenParticles);
+
+      // the archived t and tgen hold the events passing the selection on the reconstructed event
+      if(Reco.Fill(iE, SqrtS, RecoParticles) == false)
+         continue;
+      Gen.Fill(iE, SqrtS, GenParticles);
+      SelectedCount = SelectedCount + 1;
+
+      vector<Particle> GenVisible;
+      for(const Particle &P : GenParticles)
+         if(IsNeutrino(P.PID) == false)
+            GenVisible.push_back(P);
+      for(JetTreeWriter *Writer : RecoJets)
+         Writer->Fill(RecoParticles);
+      for(JetTreeWriter *Writer : GenJets)
+         Writer->Fill(GenVisible);
+   }
+
+   Bar.Update(EventCount);
+   Bar.Print();
+   Bar.PrintLine();
+
+   cout << "Generated " << EventCount << " events, " << SelectedCount << " pass the selection" << endl;
+
+   OutputFile.cd();
+   Reco.Tree->Write();
+   Gen.Tree->Write();
+   GenBefore.Tree->Write();
+   for(JetTreeWriter *Writer : RecoJets)
+      Writer->Tree->Write();
+   for(JetTreeWriter *Writer : GenJets)
+      Writer->Tree->Write();
+
+   for(JetTreeWriter *Writer : RecoJets)
+      delete Writer;
+   for(JetTreeWriter *Writer : GenJets)
+      delete Writer;
+
+   OutputFile.Close();
+
+   return 0;
+}
+
+ParticleTreeWriter::ParticleTreeWriter(TFile &File, string Name, string Title)
+{
+   File.cd();
+   Tree = new TTree(Name.c_str(), Title.c_str());
+
+   Tree->Branch("EventNo", &EventNo, "EventNo/I");
+   Tree->Branch("RunNo", &RunNo, "RunNo/I");
+   Tree->Branch("year", &year, "year/I");
+   Tree->Branch("subDir", &subDir, "subDir/I");
+   Tree->Branch("process", &process, "process/I");
+   Tree->Branch("isMC", &isMC, "isMC/O");
+   Tree->Branch("uniqueID", &uniqueID, "uniqueID/l");
+   Tree->Branch("Energy", &Energy, "Energy/F");
+   Tree->Branch("bFlag", &bFlag, "bFlag/I");
+   Tree->Branch("particleWeight", &particleWeight, "particleWeight/F");
+   Tree->Branch("nParticle", &nParticle, "nParticle/I");
+   Tree->Branch("px", &px, "px[nParticle]/F");
+   Tree->Branch("py", &py, "py[nParticle]/F");
+   Tree->Branch("pz", &pz, "pz[nParticle]/F");
+   Tree->Branch("pt", &pt, "pt[nParticle]/F");
+   Tree->Branch("pmag", &pmag, "pmag[nParticle]/F");
+   Tree->Branch("rap", &rap, "rap[nParticle]/F");
+   Tree->Branch("eta", &eta, "eta[nParticle]/F");
+   Tree->Branch("theta", &theta, "theta[nParticle]/F");
+   Tree->Branch("phi", &phi, "phi[nParticle]/F");
+   Tree->Branch("mass", &mass, "mass[nParticle]/F");
+   Tree->Branch("charge", &charge, "charge[nParticle]/S");
+   Tree->Branch("isCharged", &isCharged, "isCharged[nParticle]/O");
+   Tree->Branch("pwflag", &pwflag, "pwflag[nParticle]/S");
+   Tree->Branch("pid", &pid, "pid[nParticle]/I");
+   Tree->Branch("d0", &d0, "d0[nParticle]/F");
+   Tree->Branch("z0", &z0, "z0[nParticle]/F");
+   Tree->Branch("highPurity", &highPurity, "highPurity[nParticle]/O");
+   Tree->Branch("ntpc", &ntpc, "ntpc[nParticle]/S");
+   Tree->Branch("nitc", &nitc, "nitc[nParticle]/S");
+   Tree->Branch("nvdet", &nvdet, "nvdet[nParticle]/S");
+   Tree->Branch("weight", &weight, "weight[nParticle]/F");
+   Tree->Branch("pt_wrtThr", &pt_wrtThr, "pt_wrtThr[nParticle]/F");
+   Tree->Branch("eta_wrtThr", &eta_wrtThr, "eta_wrtThr[nParticle]/F");
+   Tree->Branch("rap_wrtThr", &rap_wrtThr, "rap_wrtThr[nParticle]/F");
+   Tree->Branch("theta_wrtThr", &theta_wrtThr, "theta_wrtThr[nParticle]/F");
+   Tree->Branch("phi_wrtThr", &phi_wrtThr, "phi_wrtThr[nParticle]/F");
+   Tree->Branch("passesNTupleAfterCut", &passesNTupleAfterCut, "passesNTupleAfterCut/O");
+   Tree->Branch("passesTotalChgEnergyMin", &passesTotalChgEnergyMin, "passesTotalChgEnergyMin/O");
+   Tree->Branch("passesNTrkMin", &passesNTrkMin, "passesNTrkMin/O");
+   Tree->Branch("passesSTheta", &passesSTheta, "passesSTheta/O");
+   Tree->Branch("passesMissP", &passesMissP, "passesMissP/O");
+   Tree->Branch("passesISR", &passesISR, "passesISR/O");
+   Tree->Branch("passesWW", &passesWW, "passesWW/O");
+   Tree->Branch("passesNeuNch", &passesNeuNch, "passesNeuNch/O");
+   Tree->Branch("passesAll", &passesAll, "passesAll/O");
+   Tree->Branch("passesLEP1TwoPC", &passesLEP1TwoPC, "passesLEP1TwoPC/O");
+   Tree->Branch("missP", &missP, "missP/F");
+   Tree->Branch("missPt", &missPt, "missPt/F");
+   Tree->Branch("missTheta", &missTheta, "missTheta/F");
+   Tree->Branch("missPhi", &missPhi, "missPhi/F");
+   Tree->Branch("nChargedHadrons", &nChargedHadrons, "nChargedHadrons/I");
+   Tree->Branch("nChargedHadronsHP", &nChargedHadronsHP, "nChargedHadronsHP/I");
+   Tree->Branch("nChargedHadronsHP_Corrected", &nChargedHadronsHP_Corrected, "nChargedHadronsHP_Corrected/F");
+   Tree->Branch("nChargedHadrons_GT0p4", &nChargedHadrons_GT0p4, "nChargedHadrons_GT0p4/I");
+   Tree->Branch("Thrust", &Thrust, "Thrust/F");
+   Tree->Branch("TTheta", &TTheta, "TTheta/F");
+   Tree->Branch("TPhi", &TPhi, "TPhi/F");
+   Tree->Branch("Sphericity", &Sphericity, "Sphericity/F");
+   Tree->Branch("STheta", &STheta, "STheta/F");
+   Tree->Branch("SPhi", &SPhi, "SPhi/F");
+   Tree->Branch("Aplanarity", &Aplanarity, "Aplanarity/F");
+}
+
+// Fills the tree and returns whether the event passes the standard selection
+bool ParticleTreeWriter::Fill(int Event, double SqrtS, const vector<Particle> &Particles)
+{
+   EventNo = Event;
+   RunNo = 40000 + Event / 1000;
+   year = 1994;
+   subDir = 0;
+   process = 0;
+   isMC = true;
+   uniqueID = ((unsigned long long)RunNo << 32) | (unsigned int)EventNo;
+   Energy = SqrtS;
+   bFlag = -999;
+   particleWeight = 1;
+
+   EventShape Shape = GetEventShape(Particles);
+
+   nParticle = min((int)Particles.size(), SYNTHETICMAX);
+
+   FourVector Total(0, 0, 0, 0);
+   double ChargedEnergy = 0;
+   int NeutralCount = 0;
+   nChargedHadrons = 0;
+   nChargedHadronsHP = 0;
+   nChargedHadrons_GT0p4 = 0;
+
+   for(int i = 0; i < nParticle; i++)
+   {
+      FourVector P = Particles[i].P;
+      px[i] = P[1];
+      py[i] = P[2];
+      pz[i] = P[3];
+      pt[i] = P.GetPT();
+      pmag[i] = P.GetP();
+      rap[i] = P.GetY();
+      eta[i] = P.GetEta();
+      theta[i] = P.GetTheta();
+      phi[i] = P.GetPhi();
+      mass[i] = sqrt(max(P.GetMass2(), 0.0));
+      charge[i] = Particles[i].Charge;
+      isCharged[i] = (Particles[i].Charge != 0);
+      pwflag[i] = Particles[i].PWFlag;
+      pid[i] = Particles[i].PID;
+      d0[i] = Particles[i].D0;
+      z0[i] = Particles[i].Z0;
+      highPurity[i] = Particles[i].HighPurity;
+      ntpc[i] = Particles[i].NTPC;
+      nitc[i] = Particles[i].NITC;
+      nvdet[i] = Particles[i].NVDET;
+      weight[i] = 1;
+
+      // kinematics with respect to the thrust axis
+      double PL = P.SpatialDot(Shape.ThrustAxis);
+      double PT = sqrt(max(P.GetP2() - PL * PL, 0.0));
+      FourVector Reference = (fabs(Shape.ThrustAxis[3]) < 0.9) ? FourVector(0, 0, 0, 1) : FourVector(0, 1, 0, 0);
+      FourVector U = Shape.ThrustAxis.SpatialCross(Reference).SpatialNormalize();
+      FourVector V = Shape.ThrustAxis.SpatialCross(U);
+      theta_wrtThr[i] = atan2(PT, PL);
+      phi_wrtThr[i] = atan2(P.SpatialDot(V), P.SpatialDot(U));
+      pt_wrtThr[i] = PT;
+      eta_wrtThr[i] = -log(tan(max(theta_wrtThr[i], 1e-6f) / 2));
+      rap_wrtThr[i] = 0.5 * log(max(P[0] + PL, 1e-9) / max(P[0] - PL, 1e-9));
+
+      if(IsNeutrino(pid[i]) == true)
+         continue;
+      Total = Total + P;
+      if(charge[i] != 0)
+      {
+         ChargedEnergy = ChargedEnergy + P[0];
+         nChargedHadrons = nChargedHadrons + 1;
+         if(highPurity[i] == true)
+            nChargedHadronsHP = nChargedHadronsHP + 1;
+         if(pt[i] > 0.4)
+            nChargedHadrons_GT0p4 = nChargedHadrons_GT0p4 + 1;
+      }
+      else
+         NeutralCount = NeutralCount + 1;
+   }
+   nChargedHadronsHP_Corrected = nChargedHadronsHP;
+
+   FourVector Missing = -Total;
+   missP = Missing.GetP();
+   missPt = Missing.GetPT();
+   missTheta = Missing.GetTheta();
+   missPhi = Missing.GetPhi();
+
+   Thrust = Shape.Thrust;
+   TTheta = Shape.TTheta;
+   TPhi = Shape.TPhi;
+   Sphericity = Shape.Sphericity;
+   STheta = Shape.STheta;
+   SPhi = Shape.SPhi;
+   Aplanarity = Shape.Aplanarity;
+
+   // the usual ALEPH hadronic selection
+   passesNTupleAfterCut = true;
+   passesTotalChgEnergyMin = (ChargedEnergy >= 15);
+   passesNTrkMin = (nChargedHadronsHP >= 5);
+   passesSTheta = (fabs(cos(STheta)) <= 0.82);
+   passesMissP = (missP < 20);
+   passesISR = true;
+   passesWW = true;
+   passesNeuNch = (nChargedHadronsHP + NeutralCount >= 13);
+   passesAll = passesNTupleAfterCut && passesTotalChgEnergyMin && passesNTrkMin && passesSTheta
+      && passesMissP && passesISR && passesWW && passesNeuNch;
+   passesLEP1TwoPC = passesTotalChgEnergyMin && passesNTrkMin && passesSTheta;
+
+   if(Tree != nullptr)
+      Tree->Fill();
+
+   return passesAll;
+}
+
+JetTreeWriter::JetTreeWriter(TFile &File, string Name, double r)
+{
+   R = r;
+
+   File.cd();
+   Tree = new TTree(Name.c_str(), ("Synthetic anti-kt jets, R = " + to_string(R)).c_str());
+   Tree->Branch("nref", &nref, "nref/I");
+   Tree->Branch("jtpt", &jtpt, "jtpt[nref]/F");
+   Tree->Branch("jteta", &jteta, "jteta[nref]/F");
+   Tree->Branch("jtphi", &jtphi, "jtphi[nref]/F");
+   Tree->Branch("jtm", &jtm, "jtm[nref]/F");
+   Tree->Branch("jtN", &jtN, "jtN[nref]/I");
+   Tree->Branch("jtNPW", &jtNPW, "jtNPW[nref][6]/I");
+   Tree->Branch("jtptFracPW", &jtptFracPW, "jtptFracPW[nref][6]/F");
+   Tree->Branch("zgJtPt_Beta0p00ZCut0p10", &zgJtPt_Beta0p00ZCut0p10, "zgJtPt_Beta0p00ZCut0p10[nref]/F");
+   Tree->Branch("zgJtPhi_Beta0p00ZCut0p10", &zgJtPhi_Beta0p00ZCut0p10, "zgJtPhi_Beta0p00ZCut0p10[nref]/F");
+   Tree->Branch("zgJtEta_Beta0p00ZCut0p10", &zgJtEta_Beta0p00ZCut0p10, "zgJtEta_Beta0p00ZCut0p10[nref]/F");
+   Tree->Branch("zg_Beta0p00ZCut0p10", &zg_Beta0p00ZCut0p10, "zg_Beta0p00ZCut0p10[nref]/F");
+   Tree->Branch("rg_Beta0p00ZCut0p10", &rg_Beta0p00ZCut0p10, "rg_Beta0p00ZCut0p10[nref]/F");
+}
+
+void JetTreeWriter::Fill(const vector<Particle> &Particles)
+{
+   vector<Jet> Jets = ClusterJets(Particles, R);
+
+   nref = min((int)Jets.size(), SYNTHETICMAX);
+   for(int i = 0; i < nref; i++)
+   {
+      FourVector &P = Jets[i].P;
+      jtpt[i] = P.GetPT();
+      jteta[i] = P.GetEta();
+      jtphi[i] = P.GetPhi();
+      jtm[i] = sqrt(max(P.GetMass2(), 0.0));
+      jtN[i] = Jets[i].Constituents.size();
+
+      for(int j = 0; j < SYNTHETICMAXPW; j++)
+      {
+         jtNPW[i][j] = 0;
+         jtptFracPW[i][j] = 0;
+      }
+      vector<Node *> Nodes;
+      for(int Index : Jets[i].Constituents)
+      {
+         int Flag = Particles[Index].PWFlag;
+         FourVector C = Particles[Index].P;
+         if(Flag >= 0 && Flag < SYNTHETICMAXPW)
+         {
+            jtNPW[i][Flag] = jtNPW[i][Flag] + 1;
+            jtptFracPW[i][Flag] = jtptFracPW[i][Flag] + C.GetPT() / max(jtpt[i], 1e-9f);
+         }
+         Nodes.push_back(new Node(C));
+      }
+
+      // soft drop on the C/A reclustered constituents, energy sharing as in e+e-
+      zgJtPt_Beta0p00ZCut0p10[i] = -1;
+      zgJtEta_Beta0p00ZCut0p10[i] = -999;
+      zgJtPhi_Beta0p00ZCut0p10[i] = -999;
+      zg_Beta0p00ZCut0p10[i] = -1;
+      rg_Beta0p00ZCut0p10[i] = -1;
+      BuildCATree2(Nodes);
+      Node *Groomed = (Nodes.size() > 0) ? FindSDNodeE(Nodes[0], 0.1, 0, R) : nullptr;
+      if(Groomed != nullptr)
+      {
+         zgJtPt_Beta0p00ZCut0p10[i] = Groomed->P.GetPT();
+         zgJtEta_Beta0p00ZCut0p10[i] = Groomed->P.GetEta();
+         zgJtPhi_Beta0p00ZCut0p10[i] = Groomed->P.GetPhi();
+         if(Groomed->Child1 != nullptr && Groomed->Child2 != nullptr)
+         {
+            double E1 = Groomed->Child1->P[0], E2 = Groomed->Child2->P[0];
+            zg_Beta0p00ZCut0p10[i] = min(E1, E2) / (E1 + E2);
+            rg_Beta0p00ZCut0p10[i] = GetAngle(Groomed->Child1->P, Groomed->Child2->P);
+         }
+      }
+      for(Node *N : Nodes)
+         delete N;
+   }
+
+   Tree->Fill();
+}
+
+vector<Particle> GenerateEvent(TRandom3 &Random, double SqrtS)
+{
+   vector<Particle> Particles;
+
+   for(FourVector &Parton : GeneratePartons(Random, SqrtS))
+      Fragment(Random, Parton, Particles);
+
+   BalanceEvent(Particles, SqrtS);
+
+   return Particles;
+}
+
+// Massless partons; the event axis follows 1 + cos^2 theta, the 3-jet kinematics roughly 1 / (y13 y23)
+vector<FourVector> GeneratePartons(TRandom3 &Random, double SqrtS)
+{
+   vector<FourVector> Partons;
+
+   double Type = Random.Rndm();
+   double X1 = 1, X2 = 1, X3 = 0;
+   if(Type > 0.70)
+   {
+      while(true)
+      {
+         double Y1 = exp(log(0.005) + Random.Rndm() * (log(0.5) - log(0.005)));
+         double Y2 = exp(log(0.005) + Random.Rndm() * (log(0.5) - log(0.005)));
+         X1 = 1 - Y1;
+         X2 = 1 - Y2;
+         X3 = 2 - X1 - X2;
+         if(X3 > 0 && X3 < 1 && X3 < X1 && X3 < X2)
+            break;
+      }
+   }
+
+   // partons in their plane: 1 along z, 2 at the angle fixed by massless kinematics, 3 balancing
+   double E = SqrtS / 2;
+   FourVector P1(X1 * E, 0, 0, X1 * E);
+   double Cos12 = (X3 > 0) ? 1 - 2 * (1 - X3) / (X1 * X2) : -1;
+   Cos12 = max(min(Cos12, 1.0), -1.0);
+   double Sin12 = sqrt(1 - Cos12 * Cos12);
+   FourVector P2(X2 * E, X2 * E * Sin12, 0, X2 * E * Cos12);
+   FourVector P3 = FourVector(SqrtS, 0, 0, 0) - P1 - P2;
+
+   Partons.push_back(P1);
+   Partons.push_back(P2);
+   if(X3 > 0)
+      Partons.push_back(P3);
+
+   // hard gluon splitting for the 4-parton events
+   if(X3 > 0 && Type > 0.95)
+   {
+      FourVector Gluon = Partons[2];
+      double Z = Random.Uniform(0.2, 0.5);
+      double Angle = exp(Random.Uniform(log(0.1), log(0.6)));
+      FourVector Axis = Gluon.SpatialCross(FourVector(0, 0, 1, 0)).SpatialNormalize();
+      FourVector A = Gluon.Rotate(Axis, Angle * (1 - Z)) * (1 - Z);
+      FourVector B = Gluon.Rotate(Axis, -Angle * Z) * Z;
+      Partons[2] = A;
+      Partons.push_back(B);
+   }
+
+   // random orientation: the first parton follows 1 + cos^2, the plane rotates freely around it
+   double Spin = Random.Uniform(-M_PI, M_PI);
+   double Theta = DrawPolarAngle(Random);
+   double Phi = Random.Uniform(-M_PI, M_PI);
+   for(FourVector &P : Partons)
+      P = P.RotateZ(Spin).RotateY(Theta).RotateZ(Phi);
+
+   return Partons;
+}
+
+// Longitudinal fractions from a broad Dirichlet-like draw, exponential transverse momentum around the
+//    parton, and a species mix close to the measured Z hadronic final state
+void Fragment(TRandom3 &Random, FourVector Parton, vector<Particle> &Particles)
+{
+   double E = Parton[0];
+   if(E <= 0.5)
+      return;
+
+   int N = max(1, Random.Poisson(3.4 * log(E) + 2));
+   vector<double> Weights(N);
+   double SumWeight = 0;
+   for(int i = 0; i < N; i++)
+   {
+      double X = -log(max(Random.Rndm(), 1e-12));
+      Weights[i] = X * X;
+      SumWeight = SumWeight + Weights[i];
+   }
+
+   double PartonTheta = Parton.GetTheta();
+   double PartonPhi = Parton.GetPhi();
+
+   for(int i = 0; i < N; i++)
+   {
+      Particle P;
+      P.D0 = Random.Gaus(0, 0.005);
+      P.Z0 = Random.Gaus(0, 0.01);
+      P.NTPC = 0;
+      P.NITC = 0;
+      P.NVDET = 0;
+      P.HighPurity = false;
+
+      double Mass = 0;
+      double Species = Random.Rndm();
+      if(Species < 0.58)        {P.PID = 211;  P.Charge = 1; P.PWFlag = 0; Mass = 0.13957;}
+      else if(Species < 0.66)   {P.PID = 321;  P.Charge = 1; P.PWFlag = 0; Mass = 0.49368;}
+      else if(Species < 0.69)   {P.PID = 2212; P.Charge = 1; P.PWFlag = 0; Mass = 0.93827;}
+      else if(Species < 0.95)   {P.PID = 22;   P.Charge = 0; P.PWFlag = 4; Mass = 0;}
+      else                      {P.PID = 130;  P.Charge = 0; P.PWFlag = 5; Mass = 0.49761;}
+      if(P.Charge != 0 && Random.Rndm() < 0.5)
+      {
+         P.Charge = -1;
+         P.PID = -P.PID;
+      }
+
+      double PL = Weights[i] / SumWeight * E;
+      double PT = -0.35 * log(max(Random.Rndm(), 1e-12));
+      double Azimuth = Random.Uniform(-M_PI, M_PI);
+      FourVector Local(0, PT * cos(Azimuth), PT * sin(Azimuth), PL);
+      Local[0] = sqrt(Local.GetP2() + Mass * Mass);
+      P.P = Local.RotateY(PartonTheta).RotateZ(PartonPhi);
+
+      Particles.push_back(P);
+   }
+
+   // semileptonic heavy-flavour decays leave a neutrino in a few percent of the jets
+   if(Random.Rndm() < 0.04)
+   {
+      Particle Nu;
+      Nu.PID = (Random.Rndm() < 0.5) ? 12 : 14;
+      Nu.Charge = 0;
+      Nu.PWFlag = 5;
+      Nu.HighPurity = false;
+      Nu.NTPC = 0;
+      Nu.NITC = 0;
+      Nu.NVDET = 0;
+      Nu.D0 = 0;
+      Nu.Z0 = 0;
+      double Size = Random.Uniform(1, min(10.0, E / 3));
+      FourVector Local;
+      Local.SetSizeThetaPhi(Size, fabs(Random.Gaus(0, 0.15)), Random.Uniform(-M_PI, M_PI));
+      Nu.P = Local.RotateY(PartonTheta).RotateZ(PartonPhi);
+      Particles.push_back(Nu);
+   }
+}
+
+// Removes the net momentum evenly and scales the momenta until the energies add up to SqrtS
+void BalanceEvent(vector<Particle> &Particles, double SqrtS)
+{
+   int N = Particles.size();
+   if(N < 2)
+      return;
+
+   vector<double> Mass(N);
+   FourVector Total(0, 0, 0, 0);
+   for(int i = 0; i < N; i++)
+   {
+      Mass[i] = sqrt(max(Particles[i].P.GetMass2(), 0.0));
+      Total = Total + Particles[i].P;
+   }
+
+   for(int i = 0; i < N; i++)
+      for(int j = 1; j <= 3; j++)
+         Particles[i].P[j] = Particles[i].P[j] - Total[j] / N;
+
+   double Scale = 1;
+   for(int iteration = 0; iteration < 20; iteration++)
+   {
+      double SumE = 0, Derivative = 0;
+      for(int i = 0; i < N; i++)
+      {
+         double P2 = Particles[i].P.GetP2();
+         double E = sqrt(Scale * Scale * P2 + Mass[i] * Mass[i]);
+         SumE = SumE + E;
+         Derivative = Derivative + Scale * P2 / max(E, 1e-9);
+      }
+      if(fabs(SumE - SqrtS) < 1e-6 || Derivative <= 0)
+         break;
+      Scale = max(Scale - (SumE - SqrtS) / Derivative, 0.1);
+   }
+
+   for(int i = 0; i < N; i++)
+   {
+      for(int j = 1; j <= 3; j++)
+         Particles[i].P[j] = Particles[i].P[j] * Scale;
+      Particles[i].P[0] = sqrt(Particles[i].P.GetP2() + Mass[i] * Mass[i]);
+   }
+}
+
+// Acceptance, efficiency and resolution per particle type
+vector<Particle> Reconstruct(TRandom3 &Random, const vector<Particle> &Gen)
+{
+   vector<Particle> Reco;
+
+   for(Particle P : Gen)
+   {
+      if(IsNeutrino(P.PID) == true)
+         continue;
+
+      double Size = P.P.GetP();
+      double Theta = P.P.GetTheta();
+      double Phi = P.P.GetPhi();
+      double Mass = sqrt(max(P.P.GetMass2(), 0.0));
+      double CosTheta = fabs(cos(Theta));
+
+      if(P.PWFlag == 0)
+      {
+         double PT = P.P.GetPT();
+         if(CosTheta > 0.95 || PT < 0.1 || Random.Rndm() > 0.98)
+            continue;
+         double Resolution = sqrt(pow(6e-4 * PT, 2) + 0.005 * 0.005);
+         Size = Size * max(Random.Gaus(1, Resolution), 0.5);
+         Theta = Theta + Random.Gaus(0, 0.001);
+         Phi = Phi + Random.Gaus(0, 0.001);
+         P.NTPC = min(21, max(0, (int)Random.Gaus(15, 4)));
+         P.NITC = min(8, max(0, (int)Random.Gaus(6, 2)));
+         P.NVDET = (CosTheta < 0.85) ? Random.Integer(3) : 0;
+         P.D0 = P.D0 + Random.Gaus(0, 0.003);
+         P.Z0 = P.Z0 + Random.Gaus(0, 0.006);
+         P.HighPurity = (PT >= 0.2 && CosTheta <= 0.94 && P.NTPC >= 4 && fabs(P.D0) < 2 && fabs(P.Z0) < 10);
+      }
+      else if(P.PWFlag == 4)
+      {
+         if(CosTheta > 0.98 || P.P[0] < 0.3 || Random.Rndm() > 0.95)
+            continue;
+         double Resolution = 0.18 / sqrt(P.P[0]) + 0.009;
+         Size = Size * max(Random.Gaus(1, Resolution), 0.1);
+         Theta = Theta + Random.Gaus(0, 0.002);
+         Phi = Phi + Random.Gaus(0, 0.002);
+      }
+      else
+      {
+         if(CosTheta > 0.98 || P.P[0] < 0.5 || Random.Rndm() > 0.80)
+            continue;
+         double Resolution = 0.85 / sqrt(P.P[0]);
+         Size = Size * max(Random.Gaus(1, Resolution), 0.1);
+         Theta = Theta + Random.Gaus(0, 0.015);
+         Phi = Phi + Random.Gaus(0, 0.015);
+      }
+
+      Theta = min(max(Theta, 1e-4), M_PI - 1e-4);
+      P.P.SetSizeThetaPhiMass(Size, Theta, Phi, Mass);
+      Reco.push_back(P);
+   }
+
+   return Reco;
+}
+
+double DrawPolarAngle(TRandom3 &Random)
+{
+   while(true)
+   {
+      double CosTheta = Random.Uniform(-1, 1);
+      if(Random.Uniform(0, 2) < 1 + CosTheta * CosTheta)
+         return acos(CosTheta);
+   }
+}
+
+// Thrust by iterating n -> sum sign(p.n) p from the directions of the hardest particles; sphericity
+//    from the eigenvectors of the momentum tensor.  Neutrinos are invisible to both.
+EventShape GetEventShape(const vector<Particle> &Particles)
+{
+   EventShape Shape;
+   Shape.Thrust = 0;
+   Shape.TTheta = 0;
+   Shape.TPhi = 0;
+   Shape.ThrustAxis = FourVector(0, 0, 0, 1);
+   Shape.Sphericity = 0;
+   Shape.Aplanarity = 0;
+   Shape.STheta = 0;
+   Shape.SPhi = 0;
+
+   vector<FourVector> P;
+   double SumP = 0, SumP2 = 0;
+   for(const Particle &Item : Particles)
+   {
+      if(IsNeutrino(Item.PID) == true)
+         continue;
+      P.push_back(Item.P);
+      SumP = SumP + P.back().GetP();
+      SumP2 = SumP2 + P.back().GetP2();
+   }
+   if(P.size() < 2 || SumP <= 0)
+      return Shape;
+
+   vector<int> Order(P.size());
+   for(int i = 0; i < (int)P.size(); i++)
+      Order[i] = i;
+   sort(Order.begin(), Order.end(), [&](int a, int b) {return P[a].GetP() > P[b].GetP();});
+
+   int SeedCount = min((int)P.size(), 4);
+   for(int iS = 0; iS < SeedCount; iS++)
+   {
+      FourVector Axis = P[Order[iS]];
+      Axis = Axis.SpatialNormalize();
+      for(int iteration = 0; iteration < 20; iteration++)
+      {
+         FourVector Sum(0, 0, 0, 0);
+         for(FourVector &Item : P)
+            Sum = (Item.SpatialDot(Axis) >= 0) ? Sum + Item : Sum - Item;
+         Sum[0] = 0;
+         if(Sum.GetP() <= 0)
+            break;
+         FourVector Next = Sum.SpatialNormalize();
+         bool Converged = (Next.SpatialDot(Axis) > 1 - 1e-12);
+         Axis = Next;
+         if(Converged)
+            break;
+      }
+
+      double Sum = 0;
+      for(FourVector &Item : P)
+         Sum = Sum + fabs(Item.SpatialDot(Axis));
+      if(Sum / SumP > Shape.Thrust)
+      {
+         Shape.Thrust = Sum / SumP;
+         Shape.ThrustAxis = Axis;
+      }
+   }
+   Shape.TTheta = Shape.ThrustAxis.GetTheta();
+   Shape.TPhi = Shape.ThrustAxis.GetPhi();
+
+   TMatrixDSym Tensor(3);
+   for(int a = 0; a < 3; a++)
+      for(int b = 0; b < 3; b++)
+      {
+         double Sum = 0;
+         for(FourVector &Item : P)
+            Sum = Sum + Item[a+1] * Item[b+1];
+         Tensor(a, b) = Sum / SumP2;
+      }
+   TMatrixDSymEigen Eigen(Tensor);
+   TVectorD Values = Eigen.GetEigenValues();   // descending
+   TMatrixD Vectors = Eigen.GetEigenVectors();
+   Shape.Sphericity = 1.5 * (Values[1] + Values[2]);
+   Shape.Aplanarity = 1.5 * Values[2];
+   FourVector SAxis(0, Vectors(0, 0), Vectors(1, 0), Vectors(2, 0));
+   Shape.STheta = SAxis.GetTheta();
+   Shape.SPhi = SAxis.GetPhi();
+
+   return Shape;
+}
+
+// e+e- anti-kt: d_ij = min(E_i^-2, E_j^-2) (1 - cos theta_ij) / (1 - cos R), d_iB = E_i^-2
+vector<Jet> ClusterJets(const vector<Particle> &Particles, double R)
+{
+   vector<Jet> Pseudo, Jets;
+   for(int i = 0; i < (int)Particles.size(); i++)
+   {
+      Jet J;
+      J.P = Particles[i].P;
+      J.Constituents.push_back(i);
+      Pseudo.push_back(J);
+   }
+
+   double Denominator = 1 - cos(R);
+
+   while(Pseudo.size() > 0)
+   {
+      int BestI = -1, BestJ = -1;
+      double Best = -1;
+      for(int i = 0; i < (int)Pseudo.size(); i++)
+      {
+         double Ei2 = 1 / max(Pseudo[i].P[0] * Pseudo[i].P[0], 1e-12);
+         if(Best < 0 || Ei2 < Best)
+         {
+            Best = Ei2;
+            BestI = i;
+            BestJ = -1;
+         }
+         for(int j = i + 1; j < (int)Pseudo.size(); j++)
+         {
+            double Ej2 = 1 / max(Pseudo[j].P[0] * Pseudo[j].P[0], 1e-12);
+            double Distance = min(Ei2, Ej2) * (1 - cos(GetAngle(Pseudo[i].P, Pseudo[j].P))) / Denominator;
+            if(Distance < Best)
+            {
+               Best = Distance;
+               BestI = i;
+               BestJ = j;
+            }
+         }
+      }
+
+      if(BestJ < 0)
+      {
+         Jets.push_back(Pseudo[BestI]);
+         Pseudo.erase(Pseudo.begin() + BestI);
+      }
+      else
+      {
+         Pseudo[BestI].P = Pseudo[BestI].P + Pseudo[BestJ].P;
+         Pseudo[BestI].Constituents.insert(Pseudo[BestI].Constituents.end(),
+            Pseudo[BestJ].Constituents.begin(), Pseudo[BestJ].Constituents.end());
+         Pseudo.erase(Pseudo.begin() + BestJ);
+      }
+   }
+
+   sort(Jets.begin(), Jets.end(), [](const Jet &A, const Jet &B) {return A.P[0] > B.P[0];});
+   return Jets;
+}
+
+bool IsNeutrino(int PID)
+{
+   PID = abs(PID);
+   return PID == 12 || PID == 14 || PID == 16;
+}
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+
+#include "Timeline.h"
+
+// Events of one thread; only that thread appends, Finish() reads them after the workers are done
+struct TimelineThreadBuffer
+{
+   int Thread;
+   std::string Name;
+   std::vector<TimelineEvent> Events;
+   std::map<const char *, std::pair<long long, long long>> Totals;   // calls and nanoseconds per stage
+   std::map<const char *, const char *> Categories;
+};
+
+std::atomic<bool> Timeline::Enabled(false);
+long long Timeline::MaxEvents = 2000000;
+
+static std::string TimelineFileName;
+static std::chrono::steady_clock::time_point TimelineStartTime = std::chrono::steady_clock::now();
+static std::mutex TimelineLock;
+static std::vector<std::unique_ptr<TimelineThreadBuffer>> TimelineBuffers;
+static std::atomic<long long> TimelineEventCount(0);
+static std::atomic<long long> TimelineDroppedCount(0);
+static thread_local TimelineThreadBuffer *TimelineLocalBuffer = nullptr;
+
+static TimelineThreadBuffer *GetTimelineBuffer()
+{
+   if(TimelineLocalBuffer != nullptr)
+      return TimelineLocalBuffer;
+
+   std::lock_guard<std::mutex> Guard(TimelineLock);
+   TimelineBuffers.emplace_back(new TimelineThreadBuffer);
+   TimelineLocalBuffer = TimelineBuffers.back().get();
+   TimelineLocalBuffer->Thread = TimelineBuffers.size() - 1;
+   TimelineLocalBuffer->Name = (TimelineLocalBuffer->Thread == 0) ? "main" : "worker " + std::to_string(TimelineLocalBuffer->Thread);
+   return TimelineLocalBuffer;
+}
+
+// An empty file name leaves the recording off, so callers can pass --Timeline straight through
+void Timeline::Start(std::string FileName, long long maxEvents)
+{
+   if(FileName == "")
+      return;
+
+   TimelineFileName = FileName;
+   MaxEvents = maxEvents;
+   TimelineStartTime = std::chrono::steady_clock::now();
+   GetTimelineBuffer();   // the calling thread becomes thread 0
+   Enabled = true;
+}
+
+// Stops the recording, writes the file and optionally the per-stage summary; call it once the worker
+//    threads have finished
+void Timeline::Finish(std::ostream *Summary)
+{
+   if(Enabled == false)
+      return;
+   Enabled = false;
+
+   if(Write(TimelineFileName) == true)
+      std::cout << "[Timeline] wrote " << TimelineEventCount - TimelineDroppedCount << " events to " << TimelineFileName << std::endl;
+   if(Summary != nullptr)
+      PrintSummary(*Summary);
+}
+
+long long Timeline::Now()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - TimelineStartTime).count();
+}
+
+void Timeline::Record(const char *Name, const char *Category, long long Start, long long Duration)
+{
+   TimelineThreadBuffer *Buffer = GetTimelineBuffer();
+
+   std::pair<long long, long long> &Total = Buffer->Totals[Name];
+   Total.first = Total.first + 1;
+   Total.second = Total.second + Duration;
+   if(Total.first == 1)
+      Buffer->Categories[Name] = Category;
+
+   if(TimelineEventCount.fetch_add(1, std::memory_order_relaxed) >= MaxEvents)
+   {
+      TimelineDroppedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   Buffer->Events.push_back(TimelineEvent{Name, Category, Start, Duration, 0, Buffer->Thread});
+}
+
+void Timeline::Count(const char *Name, double Value)
+{
+   TimelineThreadBuffer *Buffer = GetTimelineBuffer();
+   if(TimelineEventCount.fetch_add(1, std::memory_order_relaxed) >= MaxEvents)
+   {
+      TimelineDroppedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   Buffer->Events.push_back(TimelineEvent{Name, "counter", Now(), -1, Value, Buffer->Thread});
+}
+
+void Timeline::SetThreadName(std::string Name)
+{
+   GetTimelineBuffer()->Name = Name;
+}
+
+// Total wall time per stage summed over threads, longest first
+void Timeline::PrintSummary(std::ostream &out)
+{
+   std::map<std::string, std::pair<long long, long long>> Totals;
+   std::map<std::string, std::string> Categories;
+   {
+      std::lock_guard<std::mutex> Guard(TimelineLock);
+      for(auto &Buffer : TimelineBuffers)
+      {
+         for(auto &Item : Buffer->Totals)
+         {
+            Totals[Item.first].first = Totals[Item.first].first + Item.second.first;
+            Totals[Item.first].second = Totals[Item.first].second + Item.second.second;
+            Categories[Item.first] = Buffer->Categories[Item.first];
+         }
+      }
+   }
+
+   std::vector<std::pair<std::string, std::pair<long long, long long>>> Sorted(Totals.begin(), Totals.end());
+   std::sort(Sorted.begin(), Sorted.end(), [](const std::pair<std::string, std::pair<long long, long long>> &A,
+      const std::pair<std::string, std::pair<long long, long long>> &B) {return A.second.second > B.second.second;});
+
+   out << "[Timeline] " << std::setw(28) << std::left << "stage" << std::setw(10) << "category"
+      << std::right << std::setw(12) << "calls" << std::setw(12) << "total (s)" << std::setw(12) << "mean (us)" << std::endl;
+   for(auto &Item : Sorted)
+   {
+      long long Calls = Item.second.first;
+      double Seconds = Item.second.second * 1e-9;
+      out << "[Timeline] " << std::setw(28) << std::left << Item.first << std::setw(10) << Categories[Item.first]
+         << std::right << std::setw(12) << Calls << std::setw(12) << std::fixed << std::setprecision(3) << Seconds
+         << std::setw(12) << std::setprecision(2) << ((Calls > 0) ? Seconds / Calls * 1e6 : 0) << std::endl;
+   }
+   out << std::defaultfloat << std::setprecision(6);
+   if(TimelineDroppedCount > 0)
+      out << "[Timeline] " << TimelineDroppedCount << " events past the limit are only in the totals" << std::endl;
+}
+
+static void WriteTimelineString(std::ostream &out, const std::string &Text)
+{
+   out << '"';
+   for(char c : Text)
+   {
+      if(c == '"' || c == '\\')
+         out << '\\';
+      out << c;
+   }
+   out << '"';
+}
+
+// Trace-event format: timestamps and durations in microseconds
+bool Timeline::Write(std::string FileName)
+{
+   std::ofstream out(FileName);
+   if(!out)
+   {
+      std::cerr << "[Timeline] cannot write " << FileName << std::endl;
+      return false;
+   }
+
+   std::lock_guard<std::mutex> Guard(TimelineLock);
+
+   out << std::fixed << std::setprecision(3);
+   out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+   bool First = true;
+   for(auto &Buffer : TimelineBuffers)
+   {
+      out << (First ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << Buffer->Thread
+         << ", \"args\": {\"name\": ";
+      WriteTimelineString(out, Buffer->Name);
+      out << "}}";
+      First = false;
+
+      for(const TimelineEvent &E : Buffer->Events)
+      {
+         out << ",\n{\"name\": ";
+         WriteTimelineString(out, E.Name);
+         if(E.Duration >= 0)
+         {
+            out << ", \"cat\": ";
+            WriteTimelineString(out, E.Category);
+            out << ", \"ph\": \"X\", \"ts\": " << E.Start * 1e-3 << ", \"dur\": " << E.Duration * 1e-3
+               << ", \"pid\": 1, \"tid\": " << E.Thread << "}";
+         }
+         else
+            out << ", \"ph\": \"C\", \"ts\": " << E.Start * 1e-3 << ", \"pid\": 1, \"args\": {\"value\": " << E.Value << "}}";
+      }
+      Buffer->Events.clear();
+   }
+   out << std::endl << "]}" << std::endl;
+
+   return true;
+}
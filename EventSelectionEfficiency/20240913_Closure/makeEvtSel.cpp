@@ -20,6 +20,8 @@ using namespace std;
 #include "ProgressBar.h"
 #include "TauHelperFunctions3.h"
 #include "SetStyle.h"
+#include "RunMetadata.h"
+#include "ResultCache.h"
 
 
 
@@ -48,14 +50,16 @@ int main(int argc, char *argv[])
    string GenTreeName       = CL.Get("Gen", "tgen");
    string GenBeforeTreeName = CL.Get("GenBefore", "tgenBefore");
    TFile InputFile(InputFileName.c_str());
+   RunMetadata Metadata = StartRunMetadata(CL, {InputFileName});
    TFile InputDataFile(InputDataFileName.c_str()); 
 
    
    double TotalE = 91.1876;
 
    ParticleTreeMessenger MGen(InputFile, GenTreeName);
-   ParticleTreeMessenger MGenBefore(InputFile, GenBeforeTreeName); 
    ParticleTreeMessenger MData(InputDataFile, DataTreeName);
+   MGen.EnableCache();
+   MData.EnableCache();
 
    //------------------------------------
    // define the binning
@@ -190,6 +194,7 @@ int main(int argc, char *argv[])
    int EntryCount = MGen.GetEntries();
    for(int iE = 0; iE < EntryCount; iE++){
       MGen.GetEntry(iE);
+      Metadata.CountSelected();
 
 
       // fill the four vector
@@ -240,43 +245,70 @@ int main(int argc, char *argv[])
     // -------------------------------------
     // loop over the tree before event selections
     // -------------------------------------
-   int EntryCountBefore = MGenBefore.GetEntries();
-   for(int iE = 0; iE < EntryCountBefore; iE++){
-      MGenBefore.GetEntry(iE);
-      // fill the four vector
-      vector<FourVector> PGenBefore;
-      for(int i = 0; i < MGenBefore.nParticle; i++){
-        // charged particle selection 
-       if(MGenBefore.charge[i] == 0) continue;
-       if(MGenBefore.highPurity[i] == false) continue;
-         PGenBefore.push_back(MGenBefore.P[i]);
-      } // end loop over the particles 
-
-      // now calculate and fill the EECs
-      for(int i = 0; i < PGenBefore.size(); i++){
-        for(int j = i+1; j < PGenBefore.size();j++){
-            FourVector Gen1 = PGenBefore.at(i);
-            FourVector Gen2 = PGenBefore.at(j);
+   // the same for every run on this file, so it is kept in the result cache
+   int EntryCountBefore = 0;
+   ResultCache Cache(CL, "ClosureGenBefore");
+   Cache.AddFile(InputFileName);
+   Cache.Add("Tree", GenBeforeTreeName);
+   Cache.Add("Selection", "charge != 0 && highPurity");
+   Cache.Add("TotalE", TotalE);
+   Cache.Add("Bins", Bins, 2 * BinCount + 1);
+   Cache.Add("zBins", zBins, 2 * BinCount + 1);
+   Cache.Add("EnergyBins", EnergyBins, BinCount + 1);
+   Cache.Add("Version", "1");
+   Cache.AddResult(&h2_EvtSelBefore_Theta);
+   Cache.AddResult(&h2_EvtSelBefore_Z);
+   Cache.AddResult(&h1_EvtSelBefore_Z);
+   Cache.AddResult(&h1_EvtSelBefore_Theta);
+   Cache.AddResult("EntryCountBefore", EntryCountBefore);
+
+   if(Cache.Load() == false)
+   {
+      ParticleTreeMessenger MGenBefore(InputFile, GenBeforeTreeName); 
+      MGenBefore.EnableCache();
+      EntryCountBefore = MGenBefore.GetEntries();
+      for(int iE = 0; iE < EntryCountBefore; iE++){
+         MGenBefore.GetEntry(iE);
+         // fill the four vector
+         vector<FourVector> PGenBefore;
+         for(int i = 0; i < MGenBefore.nParticle; i++){
+           // charged particle selection 
+          if(MGenBefore.charge[i] == 0) continue;
+          if(MGenBefore.highPurity[i] == false) continue;
+            PGenBefore.push_back(MGenBefore.P[i]);
+         } // end loop over the particles 
+
+         // now calculate and fill the EECs
+         for(int i = 0; i < PGenBefore.size(); i++){
+           for(int j = i+1; j < PGenBefore.size();j++){
+               FourVector Gen1 = PGenBefore.at(i);
+               FourVector Gen2 = PGenBefore.at(j);
             
-            // get the proper bins
-            int BinThetaGenBefore  = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
-            int BinEnergyGenBefore = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), BinCount, EnergyBins);
-            double zGenBefore = (1-cos(GetAngle(Gen1, Gen2)))/2; 
-            int BinZGenBefore = FindBin(zGenBefore, 2*BinCount, zBins); 
+               // get the proper bins
+               int BinThetaGenBefore  = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
+               int BinEnergyGenBefore = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), BinCount, EnergyBins);
+               double zGenBefore = (1-cos(GetAngle(Gen1, Gen2)))/2; 
+               int BinZGenBefore = FindBin(zGenBefore, 2*BinCount, zBins); 
 
-            // calculate the EEC
-            double EEC =  Gen1[0]*Gen2[0]/(TotalE*TotalE); 
+               // calculate the EEC
+               double EEC =  Gen1[0]*Gen2[0]/(TotalE*TotalE); 
 
-            // fill the histograms
-            h2_EvtSelBefore_Theta.Fill(BinThetaGenBefore, BinEnergyGenBefore, EEC); 
-            h2_EvtSelBefore_Z.Fill(BinZGenBefore, BinEnergyGenBefore, EEC); 
-            h1_EvtSelBefore_Z.Fill(BinZGenBefore, EEC); 
-            h1_EvtSelBefore_Theta.Fill(BinThetaGenBefore, EEC);
+               // fill the histograms
+               h2_EvtSelBefore_Theta.Fill(BinThetaGenBefore, BinEnergyGenBefore, EEC); 
+               h2_EvtSelBefore_Z.Fill(BinZGenBefore, BinEnergyGenBefore, EEC); 
+               h1_EvtSelBefore_Z.Fill(BinZGenBefore, EEC); 
+               h1_EvtSelBefore_Theta.Fill(BinThetaGenBefore, EEC);
 
+            }
          }
-      }
 
-    } // end loop over the number of events
+      } // end loop over the number of events
+      Cache.Store();
+   }
+   // the tree before the selection holds every generated event; it may come from the cache, so count it here
+   Metadata.EventsProcessed = EntryCountBefore;
+   Metadata.SumWeight = EntryCountBefore;
+
    // EEC is per-event so scale by the event number
    h1_EvtSel_Z.Scale(1.0/EntryCount); 
    h1_EvtSelBefore_Z.Scale(1.0/EntryCountBefore);
@@ -383,6 +415,7 @@ int main(int argc, char *argv[])
     h1_EvtSelBefore_Z.Write(); 
     h1_EvtSelBefore_Theta.Write(); 
     h1_EvtSel_Theta.Write(); 
+    WriteRunMetadata(&OutputFile, Metadata);
 
 
 
@@ -26,6 +26,8 @@ using namespace std;
 #include "TauHelperFunctions3.h"
 #include "SetStyle.h"
 #include "EffCorrFactor.h"
+#include "RunMetadata.h"
+#include "ResultCache.h"
 
 int main(int argc, char *argv[]);
 int FindBin(double Value, int NBins, double Bins[]); 
@@ -59,7 +61,7 @@ int main(int argc, char *argv[])
    double TotalE = 91.1876;
 
    ParticleTreeMessenger MGen(InputFile, GenTreeName);
-   ParticleTreeMessenger MGenBefore(InputFile, GenBeforeTreeName); 
+   MGen.EnableCache();
 
    //------------------------------------
    // define the binning
@@ -198,42 +200,64 @@ int main(int argc, char *argv[])
    // -------------------------------------
    // loop over the tree before event selection
    // -------------------------------------
-   int EntryCountBefore = MGenBefore.GetEntries();
-   for(int iE = 0; iE < EntryCountBefore; iE++)
+   // the same for every efficiency run on this file, so it is kept in the result cache
+   int EntryCountBefore = 0;
+   ResultCache Cache(CL, "EvtSelEffGenBefore");
+   Cache.AddFile(InputFileName);
+   Cache.Add("Tree", GenBeforeTreeName);
+   Cache.Add("Selection", "charge != 0 && highPurity");
+   Cache.Add("TotalE", TotalE);
+   Cache.Add("Bins", Bins, 2 * BinCount + 1);
+   Cache.Add("zBins", zBins, 2 * BinCount + 1);
+   Cache.Add("Version", "1");
+   Cache.AddResult(&h2_EvtSelBefore_Theta);
+   Cache.AddResult(&h2_EvtSelBefore_Z);
+   Cache.AddResult(&h1_EvtSelBefore_Z);
+   Cache.AddResult(&h1_EvtSelBefore_Theta);
+   Cache.AddResult("EntryCountBefore", EntryCountBefore);
+
+   if(Cache.Load() == false)
    {
-      MGenBefore.GetEntry(iE);
-      // fill the four vector
-      vector<FourVector> PGenBefore;
-      for(int i = 0; i < MGenBefore.nParticle; i++){
-        // charged particle selection 
-       if(MGenBefore.charge[i] == 0) continue;
-       if(MGenBefore.highPurity[i] == false) continue;
-         PGenBefore.push_back(MGenBefore.P[i]);
-      } // end loop over the particles 
-
-      // now calculate and fill the EECs
-      for(int i = 0; i < PGenBefore.size(); i++){
-        for(int j = i+1; j < PGenBefore.size();j++){
-            FourVector Gen1 = PGenBefore.at(i);
-            FourVector Gen2 = PGenBefore.at(j);
-
-            // get the proper bins
-            int BinThetaGen  = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
-            // int BinEnergyGen = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), EnergyBinCount, EnergyBins);
-            double zGen = (1-cos(GetAngle(Gen1,Gen2)))/2; 
-            int BinZGen = FindBin(zGen, 2*BinCount, zBins); 
-
-            // calculate the EEC
-            double EEC =  Gen1[0]*Gen2[0]/(TotalE*TotalE); 
+      ParticleTreeMessenger MGenBefore(InputFile, GenBeforeTreeName); 
+      MGenBefore.EnableCache();
+      EntryCountBefore = MGenBefore.GetEntries();
+      for(int iE = 0; iE < EntryCountBefore; iE++)
+      {
+         MGenBefore.GetEntry(iE);
+         // fill the four vector
+         vector<FourVector> PGenBefore;
+         for(int i = 0; i < MGenBefore.nParticle; i++){
+           // charged particle selection 
+          if(MGenBefore.charge[i] == 0) continue;
+          if(MGenBefore.highPurity[i] == false) continue;
+            PGenBefore.push_back(MGenBefore.P[i]);
+         } // end loop over the particles 
+
+         // now calculate and fill the EECs
+         for(int i = 0; i < PGenBefore.size(); i++){
+           for(int j = i+1; j < PGenBefore.size();j++){
+               FourVector Gen1 = PGenBefore.at(i);
+               FourVector Gen2 = PGenBefore.at(j);
+
+               // get the proper bins
+               int BinThetaGen  = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
+               // int BinEnergyGen = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), EnergyBinCount, EnergyBins);
+               double zGen = (1-cos(GetAngle(Gen1,Gen2)))/2; 
+               int BinZGen = FindBin(zGen, 2*BinCount, zBins); 
+
+               // calculate the EEC
+               double EEC =  Gen1[0]*Gen2[0]/(TotalE*TotalE); 
             
-            // fill the histograms
-            h2_EvtSelBefore_Theta.Fill(BinThetaGen, EEC, EEC); 
-            h2_EvtSelBefore_Z.Fill(BinZGen, EEC, EEC); 
-            h1_EvtSelBefore_Z.Fill(BinZGen, EEC); 
-            h1_EvtSelBefore_Theta.Fill(BinThetaGen, EEC);
+               // fill the histograms
+               h2_EvtSelBefore_Theta.Fill(BinThetaGen, EEC, EEC); 
+               h2_EvtSelBefore_Z.Fill(BinZGen, EEC, EEC); 
+               h1_EvtSelBefore_Z.Fill(BinZGen, EEC); 
+               h1_EvtSelBefore_Theta.Fill(BinThetaGen, EEC);
+            }
          }
-      }
-   } // end loop over the number of events
+      } // end loop over the number of events
+      Cache.Store();
+   }
    // EEC is per-event so scale by the event number
    printf( "h1_EvtSel_Z.GetEntries(): %.3f, EntryCount: %d, h1_EvtSelBefore_Z.GetEntries(): %.3f, EntryCountBefore: %d\n", 
             h1_EvtSel_Z.GetEntries(), EntryCount,
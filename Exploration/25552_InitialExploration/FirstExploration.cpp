@@ -57,16 +57,15 @@ int main(int argc, char *argv[])
 
    ParticleTreeMessenger MParticle(File, ParticleTreeName.c_str());
    JetTreeMessenger      MJet(File, JetTreeName.c_str());
+   MParticle.EnableCache();
+   MJet.EnableCache();
 
    int EntryCount = MParticle.GetEntries();
    ProgressBar Bar(cout, EntryCount);
    for(int iE = 0; iE < EntryCount; iE++)
    {
-      if(EntryCount < 300 || (iE % (EntryCount / 250) == 0))
-      {
-         Bar.Update(iE);
-         Bar.Print();
-      }
+      Bar.Update(iE);
+      Bar.PrintIfDue();
 
       MParticle.GetEntry(iE);
       MJet.GetEntry(iE);
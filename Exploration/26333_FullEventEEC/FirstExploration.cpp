@@ -63,16 +63,14 @@ int main(int argc, char *argv[])
    float NEvent = 0;
 
    ParticleTreeMessenger MParticle(File, ParticleTreeName.c_str());
+   MParticle.EnableCache();
 
    int EntryCount = MParticle.GetEntries();
    ProgressBar Bar(cout, EntryCount);
    for(int iE = 0; iE < EntryCount; iE++)
    {
-      if(EntryCount < 300 || (iE % (EntryCount / 250) == 0))
-      {
-         Bar.Update(iE);
-         Bar.Print();
-      }
+      Bar.Update(iE);
+      Bar.PrintIfDue();
 
       MParticle.GetEntry(iE);
 
@@ -8,10 +8,50 @@ using namespace std;
 #include "SetStyle.h"
 #include "ProgressBar.h"
 #include "CommandLine.h"
+#include "EntryRange.h"
+#include "PrecisionTarget.h"
+#include "Checkpoint.h"
+#include "RunMetadata.h"
+#include "Timeline.h"
 #include "Messenger.h"
+#include "EECKernels.h"
+#include "BootstrapReplicas.h"
 #include "JetCorrector.h"
 #include "alephTrkEfficiency.h"
 
+// One selection of the multi-configuration fill: particle mask, weights, normalization and histograms
+//    --Configurations A,B,... runs several selections on one read of the input.  Every option below is
+//    read as --A.Option first and falls back to the global --Option, e.g.
+//       --Configurations Nominal,TightTheta,Weighted --TightTheta.MinTheta 0.5 --Weighted.DoWeight true
+//    Each configuration is written to its own directory of the output file.  Without --Configurations
+//    there is one unnamed configuration from the global options, written to the top of the file as before.
+//    The particle tree (--Particle) is shared: a selection on a different tree needs its own job.
+class EECConfiguration
+{
+public:
+   string Name;
+   double MinParticleE, MinParticlePT, MinTheta;
+   bool CheckCut, CheckSphericity, Reject3Jet;
+   bool ChargedOnly, DoEENormalize, UseFullEnergy, DoWeight;
+   float NEvent;
+   TH1D HN, HEEC2, HE2E2C, HEEC3, HEEC4, HEEC5;
+   TH1D HLinearEEC2, HLinearEEC3, HLinearEEC4, HLinearEEC5;
+   // --Bootstrap replicas of the filled histograms, nullptr when off
+   BootstrapHistogram *BN, *BEEC2, *BE2E2C, *BEEC3, *BLinearEEC2, *BLinearEEC3;
+   // state of the current event
+   bool Selected;
+   vector<double> W;   // per particle of the event, indexed like the shared particle list
+   double TotalE2, TotalE3, TotalE4, TotalE5;
+public:
+   EECConfiguration(CommandLine &CL, string name, bool IsReco, int BinCount, double LinearBins[],
+      BootstrapReplicas &Bootstrap);
+   ~EECConfiguration();
+   vector<TH1D *> EECHistograms();
+   vector<BootstrapHistogram *> BootstrapHistograms();
+   bool PassParticle(FourVector &P, bool IsCharged) const;
+   void Write(TFile &OutputFile, double Bins[], double LinearBins[]);
+};
+
 int main(int argc, char *argv[]);
 void DivideByBin(TH1D &H, double Bins[]);
 int FindBin(double Value, int NBins, double Bins[]);
@@ -26,19 +66,25 @@ int main(int argc, char *argv[])
    string InputFileName    = CL.Get("Input");
    string OutputFileName   = CL.Get("Output", "Plots.root");
    string ParticleTreeName = CL.Get("Particle", "t");
-   double MinParticleE     = CL.GetDouble("MinParticleE", 0);
-   double MinParticlePT    = CL.GetDouble("MinParticlePT", 0.2);
-   double MinTheta         = CL.GetDouble("MinTheta", 0.35);   // cos(0.35) = 0.94
    bool IsReco             = CL.GetBool("IsReco", true);
-   bool CheckCut           = CL.GetBool("CheckCut", IsReco);
-   bool CheckSphericity    = CL.GetBool("CheckSphericity", false);
-   bool ChargedOnly        = CL.GetBool("ChargedOnly", true);
-   bool DoEENormalize      = CL.GetBool("EENormalize", true);
-   bool UseFullEnergy      = CL.GetBool("UseFullEnergy", true);
-   bool DoWeight           = CL.GetBool("DoWeight", false);
    double Fraction         = CL.GetDouble("Fraction", 1.00);
-   bool Reject3Jet         = CL.GetBool("Reject3Jet", false);
-   string JetTreeName      = Reject3Jet ? CL.Get("Jet") : "akR4ESchemeJetTree";
+   vector<string> ConfigurationNames = CL.GetStringVector("Configurations", vector<string>{""});
+   string IndexFileName    = CL.Get("Index", "");
+   double CacheSize        = CL.GetDouble("CacheSize", -1);   // in MB; negative = sized from active branches, 0 = off
+   bool Prefetch           = CL.GetBool("Prefetch", true);
+   bool ParallelUnzip      = CL.GetBool("ParallelUnzip", false);
+   string ProgressJSON     = CL.Get("ProgressJSON", "");   // throughput summary, not written if empty
+   string TimelineFileName = CL.Get("Timeline", "");       // trace-event JSON of the stages, off if empty
+   KernelValidator Validator(CL);                           // --FastKernels, --Validate
+   BootstrapReplicas Bootstrap(CL, InputFileName);          // --Bootstrap, --BootstrapSeed
+
+   Timeline::Start(TimelineFileName);
+
+   if(ConfigurationNames.size() == 0 || ConfigurationNames.size() > 64)
+   {
+      cerr << "Between 1 and 64 configurations are supported, " << ConfigurationNames.size() << " given" << endl;
+      return 1;
+   }
 
    TFile OutputFile(OutputFileName.c_str(), "RECREATE");
 
@@ -56,16 +102,6 @@ int main(int argc, char *argv[])
    for(int i = 0; i <= 2 * BinCount; i++)
       LinearBins[i] = M_PI / (2 * BinCount) * i;
 
-   TH1D HN("HN", ";;", 1, 0, 1);
-   TH1D HEEC2("HEEC2", ";EEC_{2};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HE2E2C("HE2E2C", ";E^{2}E^{2}C_{2};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HEEC3("HEEC3", ";EEC_{3};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HEEC4("HEEC4", ";EEC_{4};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HEEC5("HEEC5", ";EEC_{5};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HLinearEEC2("HLinearEEC2", ";EEC_{2};", 2 * BinCount, LinearBins);
-   TH1D HLinearEEC3("HLinearEEC3", ";EEC_{3};", 2 * BinCount, LinearBins);
-   TH1D HLinearEEC4("HLinearEEC4", ";EEC_{4};", 2 * BinCount, LinearBins);
-   TH1D HLinearEEC5("HLinearEEC5", ";EEC_{5};", 2 * BinCount, LinearBins);
    TH1D HBinMin("HBinMin", ";EEC;BinMin", 2 * BinCount, 0, 2 * BinCount);
    TH1D HBinMax("HBinMax", ";EEC;BinMax", 2 * BinCount, 0, 2 * BinCount);
 
@@ -75,148 +111,443 @@ int main(int argc, char *argv[])
       HBinMax.SetBinContent(i + 1, Bins[i+1]);
    }
 
-   HEEC2.SetStats(0);
-   HE2E2C.SetStats(0);
-   HEEC3.SetStats(0);
-   HEEC4.SetStats(0);
-   HEEC5.SetStats(0);
-   HLinearEEC2.SetStats(0);
-   HLinearEEC3.SetStats(0);
-   HLinearEEC4.SetStats(0);
-   HLinearEEC5.SetStats(0);
+   vector<EECConfiguration *> Configurations;
+   bool AnyReject3Jet = false, AnyCheckCut = false, AnyWeight = false;
+   for(string Name : ConfigurationNames)
+   {
+      Configurations.push_back(new EECConfiguration(CL, Name, IsReco, BinCount, LinearBins, Bootstrap));
+      AnyReject3Jet = AnyReject3Jet || Configurations.back()->Reject3Jet;
+      AnyCheckCut = AnyCheckCut || Configurations.back()->CheckCut;
+      AnyWeight = AnyWeight || Configurations.back()->DoWeight;
+   }
+   string JetTreeName = AnyReject3Jet ? CL.Get("Jet") : "akR4ESchemeJetTree";
+
+   // the first configuration drives the precision target
+   EECConfiguration &First = *Configurations[0];
 
    TFile File(InputFileName.c_str());
 
-   float NEvent = 0;
+   RunMetadata Metadata = StartRunMetadata(CL, {InputFileName});
 
    ParticleTreeMessenger MParticle(File, ParticleTreeName.c_str());
    JetTreeMessenger MJet(File, JetTreeName.c_str());
+   if(CacheSize != 0)
+   {
+      long long CacheBytes = (CacheSize > 0) ? (long long)(CacheSize * 1048576) : -1;
+      MParticle.EnableCache(CacheBytes, 100, Prefetch, ParallelUnzip);
+      if(AnyReject3Jet == true)
+         MJet.EnableCache(CacheBytes, 100, Prefetch, ParallelUnzip);
+   }
+
+   // optional precomputed selection index (see MainAnalysis/20261019_SelectionIndex)
+   //    if present, failing events are skipped before the particle tree is read
+   TFile *IndexFile = (IndexFileName != "") ? TFile::Open(IndexFileName.c_str()) : nullptr;
+   SelectionIndexMessenger MIndex(IndexFile, ParticleTreeName + "Index");
+   bool UseIndex = (MIndex.Tree != nullptr);
+   if(IndexFileName != "" && UseIndex == false)
+      cerr << "Warning: selection index " << IndexFileName << " not usable, falling back to full reads" << endl;
+   if(UseIndex == true && MIndex.IsAlignedWith(MParticle, cerr) == false)
+   {
+      cerr << "Warning: selection index is not aligned with tree " << ParticleTreeName << ", ignoring it" << endl;
+      UseIndex = false;
+   }
 
    alephTrkEfficiency efficiencyCorrector;
 
-   int EntryCount = MParticle.GetEntries() * Fraction;
+   vector<long long> Clusters = GetClusterBoundaries(MParticle.Tree);
+   EntryRange Range = GetEntryRange(CL, Clusters, (MParticle.Tree != nullptr) ? MParticle.Tree->GetName() : "", InputFileName, Fraction);
+   PrecisionTarget Precision(CL, Clusters, Range);   // --TargetPrecision: clusters in random order, early stop
+   int EntryCount = Range.SampledSize();
+
+   // the snapshot holds the raw sums, before the division by bin width
+   Checkpoint Snapshot(CL, OutputFileName);
+   for(EECConfiguration *C : Configurations)
+   {
+      for(TH1D *H : C->EECHistograms())
+         Snapshot.Add(H, C->Name);
+      for(BootstrapHistogram *B : C->BootstrapHistograms())
+         Snapshot.Add(B->Replicas, C->Name);
+      Snapshot.Add((C->Name == "") ? "NEvent" : ("NEvent_" + C->Name), C->NEvent);
+   }
+   Snapshot.Add("EventsProcessed", Metadata.EventsProcessed);
+   Snapshot.Add("EventsSelected", Metadata.EventsSelected);
+   Snapshot.Add("SumWeight", Metadata.SumWeight);
+   Snapshot.Add("SumWeightSelected", Metadata.SumWeightSelected);
+   // the cluster order and the set of histograms must match the snapshot, or the position means another entry
+   string ConfigurationList = "";
+   for(string Name : ConfigurationNames)
+      ConfigurationList = ConfigurationList + "," + Name;
+   Snapshot.AddSetting("ShuffledClusters", Precision.IsEnabled() ? "true" : "false");
+   Snapshot.AddSetting("PrecisionSeed", to_string(Precision.Seed));
+   Snapshot.AddSetting("Configurations", ConfigurationList);
+   int StartEntry = Snapshot.Resume(Range);
+
+   // the snapshot stores the loop position as Range.Begin + position, the entries follow the cluster order
    ProgressBar Bar(cout, EntryCount);
-   for(int iE = 0; iE < EntryCount; iE++)
+   Bar.SetTelemetry(true);
+   for(int iPosition = StartEntry - Range.Begin; iPosition < EntryCount; iPosition++)
    {
-      if(EntryCount < 300 || (iE % (EntryCount / 250) == 0))
+      // the replicas of the previous event are still pending until flushed, and belong in the snapshot
+      if(Snapshot.Due(Range.Begin + iPosition) == true)
       {
-         Bar.Update(iE);
-         Bar.Print();
+         Bootstrap.Flush();
+         Snapshot.Save(Range.Begin + iPosition);
+      }
+
+      int iE = Precision.Entry(iPosition);
+
+      Bar.Update(iPosition);
+      Bar.PrintIfDue();
+
+      Metadata.CountProcessed();
+
+      bool AnySelected = false;
+      if(UseIndex == true)
+      {
+         MIndex.GetEntry(iE);
+         for(EECConfiguration *C : Configurations)
+         {
+            C->Selected = MIndex.Pass(C->CheckCut, C->CheckSphericity, C->Reject3Jet);
+            AnySelected = AnySelected || C->Selected;
+         }
+         if(AnySelected == false)
+            continue;
       }
 
       MParticle.GetEntry(iE);
-      if(Reject3Jet == true)
+      Bootstrap.Next(MParticle.RunNo, MParticle.EventNo, iE);
+      if(UseIndex == false)
       {
-         MJet.GetEntry(iE);
+         bool Has3Jet = false;
+         if(AnyReject3Jet == true)
+         {
+            MJet.GetEntry(iE);
 
-         int N5 = 0;
-         for(int i = 0; i < MJet.nref; i++)
-            if(MJet.Jet[i][0] >= 5)
-               N5 = N5 + 1;
-         if(N5 > 2)
+            int N5 = 0;
+            for(int i = 0; i < MJet.nref; i++)
+               if(MJet.Jet[i][0] >= 5)
+                  N5 = N5 + 1;
+            Has3Jet = (N5 > 2);
+         }
+         bool PassCut = (AnyCheckCut == true) ? MParticle.PassBaselineCut() : true;
+
+         for(EECConfiguration *C : Configurations)
+         {
+            C->Selected = true;
+            if(C->Reject3Jet == true && Has3Jet == true)
+               C->Selected = false;
+            if(C->CheckCut == true && PassCut == false)
+               C->Selected = false;
+            if(C->CheckSphericity == true && MParticle.passesSTheta == false)
+               C->Selected = false;
+            AnySelected = AnySelected || C->Selected;
+         }
+         if(AnySelected == false)
             continue;
       }
 
-      if(CheckCut == true && MParticle.PassBaselineCut() == false)
-         continue;
-      if(CheckSphericity == true && MParticle.passesSTheta == false)
-         continue;
+      Metadata.CountSelected();
 
-      NEvent = NEvent + 1;
-
-      // now we gather the particles
+      // now we gather the particles: the union of the selections, Masks[i] has bit s set if
+      //    particle i passes configuration s
       vector<FourVector> P;
-      vector<double> W;
-      double TotalE = 0;
+      vector<uint64_t> Masks;
+      vector<double> Efficiencies;
       for(int iP = 0; iP < MParticle.nParticle; iP++)
       {
-         if(MParticle.P[iP][0] < MinParticleE)
-            continue;
-         if(MParticle.P[iP].GetPT() < MinParticlePT)
-            continue;
-         if(ChargedOnly == true && (MParticle.charge[iP] == 0 && MParticle.isCharged[iP] == 0))
-            continue;
-         if(MParticle.P[iP].GetTheta() < MinTheta || MParticle.P[iP].GetTheta() > M_PI - MinTheta)
+         bool IsCharged = (MParticle.charge[iP] != 0 || MParticle.isCharged[iP] != 0);
+
+         uint64_t Mask = 0;
+         for(int s = 0; s < (int)Configurations.size(); s++)
+            if(Configurations[s]->Selected == true && Configurations[s]->PassParticle(MParticle.P[iP], IsCharged) == true)
+               Mask = Mask | ((uint64_t)1 << s);
+         if(Mask == 0)
             continue;
 
          FourVector &Momentum = MParticle.P[iP];
          P.push_back(Momentum);
-         
-         if(DoWeight == true)
+         Masks.push_back(Mask);
+
+         if(AnyWeight == true)
          {
             double Efficiency = efficiencyCorrector.efficiency(Momentum.GetTheta(), Momentum.GetPhi(), Momentum.GetPT(), MParticle.nChargedHadronsHP);
-            W.push_back((Efficiency > 0) ? (1 / Efficiency) : 0);
+            Efficiencies.push_back((Efficiency > 0) ? (1 / Efficiency) : 0);
          }
          else
-            W.push_back(1);
-         
-         // W.push_back(MParticle.weight[iP]);
-         
-         TotalE = TotalE + MParticle.P[iP][0];
+            Efficiencies.push_back(1);
       }
 
-      if(UseFullEnergy == true)
-         TotalE = 91.1876;
-
-      double TotalE2 = DoEENormalize ? (TotalE  * TotalE) : 1;
-      double TotalE3 = DoEENormalize ? (TotalE2 * TotalE) : 1;
-      double TotalE4 = DoEENormalize ? (TotalE3 * TotalE) : 1;
-      double TotalE5 = DoEENormalize ? (TotalE4 * TotalE) : 1;
-   
-      // Fill EECs
       int N = P.size();
-      vector<vector<double>> D(N);
-      for(int i = 0; i < N; i++)
+      for(int s = 0; s < (int)Configurations.size(); s++)
       {
-         D[i].resize(N);
-         for(int j = 0; j < N; j++)
-            D[i][j] = GetAngle(P[i], P[j]);
+         EECConfiguration &C = *Configurations[s];
+         if(C.Selected == false)
+            continue;
+         C.NEvent = C.NEvent + 1;
+         if(C.BN != nullptr)
+            C.BN->Fill(0.5);
+
+         C.W.assign(N, 0);
+         double TotalE = 0;
+         for(int i = 0; i < N; i++)
+         {
+            if((Masks[i] >> s & 1) == 0)
+               continue;
+            C.W[i] = (C.DoWeight == true) ? Efficiencies[i] : 1;
+            TotalE = TotalE + P[i][0];
+         }
+
+         if(C.UseFullEnergy == true)
+            TotalE = 91.1876;
+
+         C.TotalE2 = C.DoEENormalize ? (TotalE    * TotalE) : 1;
+         C.TotalE3 = C.DoEENormalize ? (C.TotalE2 * TotalE) : 1;
+         C.TotalE4 = C.DoEENormalize ? (C.TotalE3 * TotalE) : 1;
+         C.TotalE5 = C.DoEENormalize ? (C.TotalE4 * TotalE) : 1;
       }
 
-      for(int i1 = 0; i1 < N; i1++)
+      // a single configuration keeps the legacy / fast choice, several share one angle matrix
+      auto RunPairLoop = [&](bool Fast, auto &&Fill2, auto &&Fill3)
       {
-         for(int i2 = i1 + 1; i2 < N; i2++)
+         if(Configurations.size() == 1)
+            EECPairLoop(Fast, P, BinCount * 2, Bins,
+               [&](int i1, int i2, double Max2, int Bin2) {Fill2(0, i1, i2, Max2, Bin2);},
+               [&](int i1, int i2, int i3, double Max3, int Bin3) {Fill3(0, i1, i2, i3, Max3, Bin3);});
+         else
+            EECPairLoopShared(P, Masks, BinCount * 2, Bins, Fill2, Fill3);
+      };
+
+      // Fill EECs
+      Bar.AddPairs((long long)N * (N - 1) / 2);
+      RunPairLoop(Validator.Fast,
+         [&](int s, int i1, int i2, double Max2, int Bin2)
          {
-            double Max2 = D[i1][i2];
-            int Bin2 = FindBin(Max2, BinCount * 2, Bins);
-            HEEC2.Fill(Bin2, P[i1][0] * P[i2][0] / TotalE2 * W[i1] * W[i2]);
-            HLinearEEC2.Fill(Max2, P[i1][0] * P[i2][0] / TotalE2 * W[i1] * W[i2]);
-            HE2E2C.Fill(Bin2, P[i1][0] * P[i2][0] * P[i1][0] * P[i2][0] / TotalE4 * W[i1] * W[i2]);
+            EECConfiguration &C = *Configurations[s];
+            double EEC2 = P[i1][0] * P[i2][0] / C.TotalE2 * C.W[i1] * C.W[i2];
+            double E2E2C = P[i1][0] * P[i2][0] * P[i1][0] * P[i2][0] / C.TotalE4 * C.W[i1] * C.W[i2];
+            C.HEEC2.Fill(Bin2, EEC2);
+            C.HLinearEEC2.Fill(Max2, EEC2);
+            C.HE2E2C.Fill(Bin2, E2E2C);
+            if(C.BEEC2 != nullptr)
+            {
+               C.BEEC2->Fill(Bin2, EEC2);
+               C.BLinearEEC2->Fill(Max2, EEC2);
+               C.BE2E2C->Fill(Bin2, E2E2C);
+            }
+         },
+         [&](int s, int i1, int i2, int i3, double Max3, int Bin3)
+         {
+            EECConfiguration &C = *Configurations[s];
+            double EEC3 = P[i1][0] * P[i2][0] * P[i3][0] / C.TotalE3 * C.W[i1] * C.W[i2] * C.W[i3];
+            C.HEEC3.Fill(Bin3, EEC3);
+            C.HLinearEEC3.Fill(Max3, EEC3);
+            if(C.BEEC3 != nullptr)
+            {
+               C.BEEC3->Fill(Bin3, EEC3);
+               C.BLinearEEC3->Fill(Max3, EEC3);
+            }
 
-            for(int i3 = i2 + 1; i3 < N; i3++)
+            // EEC4 and EEC5 would need the full angle matrix D of the legacy loop
+            /*
+            for(int i4 = i3 + 1; i4 < N; i4++)
             {
-               double Max3 = GetMax({Max2, D[i1][i3], D[i2][i3]});
-               int Bin3 = FindBin(Max3, BinCount * 2, Bins);
-               HEEC3.Fill(Bin3, P[i1][0] * P[i2][0] * P[i3][0] / TotalE3 * W[i1] * W[i2] * W[i3]);
-               HLinearEEC3.Fill(Max3, P[i1][0] * P[i2][0] * P[i3][0] / TotalE3 * W[i1] * W[i2] * W[i3]);
-           
-               /*
-               for(int i4 = i3 + 1; i4 < N; i4++)
+               double Max4 = GetMax({Max3, D[i1][i4], D[i2][i4], D[i3][i4]});
+               int Bin4 = FindBin(Max4, BinCount * 2, Bins);
+               C.HEEC4.Fill(Bin4, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] / C.TotalE4 * C.W[i1] * C.W[i2] * C.W[i3] * C.W[i4]);
+               C.HLinearEEC4.Fill(Max4, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] / C.TotalE4 * C.W[i1] * C.W[i2] * C.W[i3] * C.W[i4]);
+
+               for(int i5 = i4 + 1; i5 < N; i5++)
                {
-                  double Max4 = GetMax({Max3, D[i1][i4], D[i2][i4], D[i3][i4]});
-                  int Bin4 = FindBin(Max4, BinCount * 2, Bins);
-                  HEEC4.Fill(Bin4, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] / TotalE4 * W[i1] * W[i2] * W[i3] * W[i4]);
-                  HLinearEEC4.Fill(Max4, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] / TotalE4 * W[i1] * W[i2] * W[i3] * W[i4]);
-
-                  for(int i5 = i4 + 1; i5 < N; i5++)
-                  {
-                     double Max5 = GetMax({Max4, D[i1][i5], D[i2][i5], D[i3][i5], D[i4][i5]});
-                     int Bin5 = FindBin(Max5, BinCount * 2, Bins);
-                     HEEC5.Fill(Bin5, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] * P[i5][0] / TotalE5 * W[i1] * W[i2] * W[i3] * W[i4] * W[i5]);
-                     HLinearEEC5.Fill(Max5, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] * P[i5][0] / TotalE5 * W[i1] * W[i2] * W[i3] * W[i4] * W[i5]);
-                  }
+                  double Max5 = GetMax({Max4, D[i1][i5], D[i2][i5], D[i3][i5], D[i4][i5]});
+                  int Bin5 = FindBin(Max5, BinCount * 2, Bins);
+                  C.HEEC5.Fill(Bin5, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] * P[i5][0] / C.TotalE5 * C.W[i1] * C.W[i2] * C.W[i3] * C.W[i4] * C.W[i5]);
+                  C.HLinearEEC5.Fill(Max5, P[i1][0] * P[i2][0] * P[i3][0] * P[i4][0] * P[i5][0] / C.TotalE5 * C.W[i1] * C.W[i2] * C.W[i3] * C.W[i4] * C.W[i5]);
                }
-               */
             }
-         }
+            */
+         });
+      Bootstrap.Flush();
+
+      // per-event EEC2 and EEC3 contributions by bin from both pair loops, then the angle-weighted sums,
+      //    for all configurations; the legacy side runs the original loop on each selection separately
+      if(Validator.Sample(iE) == true)
+      {
+         auto Contributions = [&](bool Fast)
+         {
+            int Size = 2 * (BinCount * 2 + 2) + 2;
+            vector<double> C(Size * Configurations.size(), 0);
+            auto Add2 = [&](int s, int i1, int i2, double Max2, int Bin2)
+            {
+               EECConfiguration &Config = *Configurations[s];
+               double *Sum = &C[Size * s];
+               double Weight = P[i1][0] * P[i2][0] / Config.TotalE2 * Config.W[i1] * Config.W[i2];
+               Sum[Bin2 + 1] = Sum[Bin2 + 1] + Weight;
+               Sum[Size - 2] = Sum[Size - 2] + Max2 * Weight;
+            };
+            auto Add3 = [&](int s, int i1, int i2, int i3, double Max3, int Bin3)
+            {
+               EECConfiguration &Config = *Configurations[s];
+               double *Sum = &C[Size * s];
+               double Weight = P[i1][0] * P[i2][0] * P[i3][0] / Config.TotalE3 * Config.W[i1] * Config.W[i2] * Config.W[i3];
+               Sum[BinCount * 2 + 2 + Bin3 + 1] = Sum[BinCount * 2 + 2 + Bin3 + 1] + Weight;
+               Sum[Size - 1] = Sum[Size - 1] + Max3 * Weight;
+            };
+
+            if(Fast == true)
+            {
+               RunPairLoop(true, Add2, Add3);
+               return C;
+            }
+            for(int s = 0; s < (int)Configurations.size(); s++)
+            {
+               vector<int> Index;
+               vector<FourVector> Subset;
+               for(int i = 0; i < N; i++)
+               {
+                  if((Masks[i] >> s & 1) == 0)
+                     continue;
+                  Index.push_back(i);
+                  Subset.push_back(P[i]);
+               }
+               EECPairLoopLegacy(Subset, BinCount * 2, Bins,
+                  [&](int j1, int j2, double Max2, int Bin2) {Add2(s, Index[j1], Index[j2], Max2, Bin2);},
+                  [&](int j1, int j2, int j3, double Max3, int Bin3) {Add3(s, Index[j1], Index[j2], Index[j3], Max3, Bin3);});
+            }
+            return C;
+         };
+         Validator.Compare("PairLoop", [&]() {return Contributions(false);}, [&]() {return Contributions(true);});
       }
+
+      if(Precision.Reached(First.HEEC2, Bins, First.NEvent, iPosition + 1) == true)
+         break;
    }
-   Bar.Update(EntryCount);
+   Bar.Update(Precision.Stopped ? Precision.EntriesRead : EntryCount);
    Bar.Print();
    Bar.PrintLine();
+   Bar.PrintSummary();
+   Bar.WriteJSON(ProgressJSON, "FirstExploration");
+   Validator.Report(cout);
+
+   MParticle.IO.PrintStatistics(cout, ParticleTreeName);
+   if(AnyReject3Jet == true)
+      MJet.IO.PrintStatistics(cout, JetTreeName);
 
+   if(IndexFile != nullptr)
+   {
+      IndexFile->Close();
+      delete IndexFile;
+   }
    File.Close();
 
+   Precision.Finish(First.HEEC2, Bins, First.NEvent);
+
+   ScopedTimer WriteTimer("Write", "output");
+   for(EECConfiguration *C : Configurations)
+      C->Write(OutputFile, Bins, LinearBins);
+
+   OutputFile.cd();
+   HBinMin.Write();
+   HBinMax.Write();
+
+   WriteEntryRanges(&OutputFile, Precision.ProcessedRanges(Range));
+   Precision.Write(&OutputFile, Range.SampledSize());
+   WriteRunMetadata(&OutputFile, Metadata);
+
+   OutputFile.Close();
+   WriteTimer.Stop();
+
+   Snapshot.Finish();
+
+   for(EECConfiguration *C : Configurations)
+      delete C;
+
+   Timeline::Finish(&cout);
+
+   return 0;
+}
+
+EECConfiguration::EECConfiguration(CommandLine &CL, string name, bool IsReco, int BinCount, double LinearBins[],
+   BootstrapReplicas &Bootstrap)
+   : Name(name), NEvent(0),
+     HN("HN", ";;", 1, 0, 1),
+     HEEC2("HEEC2", ";EEC_{2};", 2 * BinCount, 0, 2 * BinCount),
+     HE2E2C("HE2E2C", ";E^{2}E^{2}C_{2};", 2 * BinCount, 0, 2 * BinCount),
+     HEEC3("HEEC3", ";EEC_{3};", 2 * BinCount, 0, 2 * BinCount),
+     HEEC4("HEEC4", ";EEC_{4};", 2 * BinCount, 0, 2 * BinCount),
+     HEEC5("HEEC5", ";EEC_{5};", 2 * BinCount, 0, 2 * BinCount),
+     HLinearEEC2("HLinearEEC2", ";EEC_{2};", 2 * BinCount, LinearBins),
+     HLinearEEC3("HLinearEEC3", ";EEC_{3};", 2 * BinCount, LinearBins),
+     HLinearEEC4("HLinearEEC4", ";EEC_{4};", 2 * BinCount, LinearBins),
+     HLinearEEC5("HLinearEEC5", ";EEC_{5};", 2 * BinCount, LinearBins),
+     BN(nullptr), BEEC2(nullptr), BE2E2C(nullptr), BEEC3(nullptr), BLinearEEC2(nullptr), BLinearEEC3(nullptr),
+     Selected(false), TotalE2(1), TotalE3(1), TotalE4(1), TotalE5(1)
+{
+   string Prefix = (Name == "") ? "" : (Name + ".");
+   MinParticleE    = CL.GetDouble(Prefix + "MinParticleE", CL.GetDouble("MinParticleE", 0));
+   MinParticlePT   = CL.GetDouble(Prefix + "MinParticlePT", CL.GetDouble("MinParticlePT", 0.2));
+   MinTheta        = CL.GetDouble(Prefix + "MinTheta", CL.GetDouble("MinTheta", 0.35));   // cos(0.35) = 0.94
+   CheckCut        = CL.GetBool(Prefix + "CheckCut", CL.GetBool("CheckCut", IsReco));
+   CheckSphericity = CL.GetBool(Prefix + "CheckSphericity", CL.GetBool("CheckSphericity", false));
+   Reject3Jet      = CL.GetBool(Prefix + "Reject3Jet", CL.GetBool("Reject3Jet", false));
+   ChargedOnly     = CL.GetBool(Prefix + "ChargedOnly", CL.GetBool("ChargedOnly", true));
+   DoEENormalize   = CL.GetBool(Prefix + "EENormalize", CL.GetBool("EENormalize", true));
+   UseFullEnergy   = CL.GetBool(Prefix + "UseFullEnergy", CL.GetBool("UseFullEnergy", true));
+   DoWeight        = CL.GetBool(Prefix + "DoWeight", CL.GetBool("DoWeight", false));
+
+   // owned by this object, written explicitly into the configuration directory
+   HN.SetDirectory(nullptr);
+   for(TH1D *H : EECHistograms())
+   {
+      H->SetDirectory(nullptr);
+      H->SetStats(0);
+   }
+
+   // EEC4 and EEC5 are not filled, so they get no replicas
+   if(Bootstrap.IsEnabled() == true)
+   {
+      BN          = new BootstrapHistogram(Bootstrap, HN);
+      BEEC2       = new BootstrapHistogram(Bootstrap, HEEC2);
+      BE2E2C      = new BootstrapHistogram(Bootstrap, HE2E2C);
+      BEEC3       = new BootstrapHistogram(Bootstrap, HEEC3);
+      BLinearEEC2 = new BootstrapHistogram(Bootstrap, HLinearEEC2);
+      BLinearEEC3 = new BootstrapHistogram(Bootstrap, HLinearEEC3);
+   }
+}
+
+EECConfiguration::~EECConfiguration()
+{
+   for(BootstrapHistogram *B : BootstrapHistograms())
+      delete B;
+}
+
+vector<TH1D *> EECConfiguration::EECHistograms()
+{
+   return {&HEEC2, &HE2E2C, &HEEC3, &HEEC4, &HEEC5, &HLinearEEC2, &HLinearEEC3, &HLinearEEC4, &HLinearEEC5};
+}
+
+vector<BootstrapHistogram *> EECConfiguration::BootstrapHistograms()
+{
+   if(BN == nullptr)
+      return {};
+   return {BN, BEEC2, BE2E2C, BEEC3, BLinearEEC2, BLinearEEC3};
+}
+
+bool EECConfiguration::PassParticle(FourVector &P, bool IsCharged) const
+{
+   if(P[0] < MinParticleE)
+      return false;
+   if(P.GetPT() < MinParticlePT)
+      return false;
+   if(ChargedOnly == true && IsCharged == false)
+      return false;
+   if(P.GetTheta() < MinTheta || P.GetTheta() > M_PI - MinTheta)
+      return false;
+   return true;
+}
+
+// Normalizes by bin width and writes into the directory of the configuration (the top for the unnamed one)
+void EECConfiguration::Write(TFile &OutputFile, double Bins[], double LinearBins[])
+{
    HN.SetBinContent(1, NEvent);
    DivideByBin(HEEC2, Bins);
    DivideByBin(HE2E2C, Bins);
@@ -227,25 +558,22 @@ int main(int argc, char *argv[])
    DivideByBin(HLinearEEC3, LinearBins);
    DivideByBin(HLinearEEC4, LinearBins);
    DivideByBin(HLinearEEC5, LinearBins);
-  
-   OutputFile.cd();
+   if(BN != nullptr)
+   {
+      BEEC2->DivideByBin(Bins);
+      BE2E2C->DivideByBin(Bins);
+      BEEC3->DivideByBin(Bins);
+      BLinearEEC2->DivideByBin(LinearBins);
+      BLinearEEC3->DivideByBin(LinearBins);
+   }
 
+   TDirectory *Directory = (Name == "") ? (TDirectory *)&OutputFile : OutputFile.mkdir(Name.c_str());
+   Directory->cd();
    HN.Write();
-   HEEC2.Write();
-   HE2E2C.Write();
-   HEEC3.Write();
-   HEEC4.Write();
-   HEEC5.Write();
-   HLinearEEC2.Write();
-   HLinearEEC3.Write();
-   HLinearEEC4.Write();
-   HLinearEEC5.Write();
-   HBinMin.Write();
-   HBinMax.Write();
-
-   OutputFile.Close();
-
-   return 0;
+   for(TH1D *H : EECHistograms())
+      H->Write();
+   for(BootstrapHistogram *B : BootstrapHistograms())
+      B->Write(Directory);
 }
 
 void DivideByBin(TH1D &H, double Bins[])
@@ -26,6 +26,7 @@ void MakeCanvas(vector<TH1D *> Histograms, vector<string> Labels, string Output,
    bool LogX = true);
 double GetMin(TH1D *H);
 void SetPad(TPad &P);
+TDirectory *OpenInput(string Input, TFile *&File);
 
 int main(int argc, char *argv[])
 {
@@ -33,7 +34,7 @@ int main(int argc, char *argv[])
 
    CommandLine CL(argc, argv);
 
-   vector<string> DefaultFileNames{"PlotGen.root", "PlotReco.root", "PlotPythia8.root"};
+   vector<string> DefaultFileNames{"PlotGenAll.root:Gen", "PlotReco.root", "PlotPythia8.root"};
    vector<string> DefaultLabels{"Archived MC", "Archived MC + detector", "Pythia8"};
 
    vector<string> FileNames = CL.GetStringVector("Input", DefaultFileNames);
@@ -83,16 +84,23 @@ void MakePlot(vector<string> FileNames, vector<string> Labels, string Histogram,
    int N = FileNames.size();
 
    vector<TFile *> Files(N);
+   vector<TDirectory *> Directories(N);
    for(int i = 0; i < N; i++)
-      Files[i] = new TFile(FileNames[i].c_str());
+      Directories[i] = OpenInput(FileNames[i], Files[i]);
 
    bool Error = false;
 
    vector<TH1D *> Histograms(N);
    for(int i = 0; i < N; i++)
    {
-      TH1D *HN = (TH1D *)Files[i]->Get("HN");
-      TH1D *H = (TH1D *)Files[i]->Get(Histogram.c_str());
+      if(Directories[i] == nullptr)
+      {
+         Error = true;
+         break;
+      }
+
+      TH1D *HN = (TH1D *)Directories[i]->Get("HN");
+      TH1D *H = (TH1D *)Directories[i]->Get(Histogram.c_str());
 
       cout << FileNames[i] << " " << HN << " " << H << endl;
 
@@ -128,17 +136,24 @@ void MakePlot2(vector<string> FileNames, vector<string> Labels, string Histogram
    int N = FileNames.size();
 
    vector<TFile *> Files(N);
+   vector<TDirectory *> Directories(N);
    for(int i = 0; i < N; i++)
-      Files[i] = new TFile(FileNames[i].c_str());
+      Directories[i] = OpenInput(FileNames[i], Files[i]);
 
    bool Error = false;
   
    vector<TH1D *> Histograms(N);
    for(int i = 0; i < N; i++)
    {
-      TH1D *HN = (TH1D *)Files[i]->Get("HN");
-      TH1D *H1 = (TH1D *)Files[i]->Get(Histogram1.c_str());
-      TH1D *H2 = (TH1D *)Files[i]->Get(Histogram2.c_str());
+      if(Directories[i] == nullptr)
+      {
+         Error = true;
+         break;
+      }
+
+      TH1D *HN = (TH1D *)Directories[i]->Get("HN");
+      TH1D *H1 = (TH1D *)Directories[i]->Get(Histogram1.c_str());
+      TH1D *H2 = (TH1D *)Directories[i]->Get(Histogram2.c_str());
 
       if(H1 == nullptr || H2 == nullptr || HN == nullptr)
       {
@@ -495,3 +510,25 @@ void SetPad(TPad &P)
    P.Draw();
 }
 
+// "File.root" reads the histograms at the top of the file, "File.root:Name" those of configuration Name
+//    of a multi-configuration FirstExploration output
+TDirectory *OpenInput(string Input, TFile *&File)
+{
+   string FileName = Input;
+   string DirectoryName = "";
+   size_t Split = Input.rfind(".root:");
+   if(Split != string::npos)
+   {
+      FileName = Input.substr(0, Split + 5);
+      DirectoryName = Input.substr(Split + 6);
+   }
+
+   File = new TFile(FileName.c_str());
+   if(DirectoryName == "")
+      return File;
+
+   TDirectory *Directory = File->GetDirectory(DirectoryName.c_str());
+   if(Directory == nullptr)
+      cerr << "Directory " << DirectoryName << " not found in " << FileName << endl;
+   return Directory;
+}
@@ -1,25 +1,63 @@
 #!/bin/bash
 
-for i in `seq 1 40`
+# Per-file jobs run in parallel through the job driver.  The histogram mergers run in the background
+# and pick up each per-file output as soon as its job has finished, so merging overlaps with processing.
+Driver=$ProjectBase/CommonCode/bin/JobDriver
+Merger=$ProjectBase/CommonCode/bin/HistogramMerger
+Jobs=${Jobs:-`nproc`}
+MCFiles=`seq -f "$ProjectBase/Samples/ALEPHMC/LEP1MC1994_recons_aftercut-0%02g.root" -s, 1 40`
+DataFiles="$ProjectBase/Samples/ALEPH/LEP1Data1994P1_recons_aftercut-MERGED.root,$ProjectBase/Samples/ALEPH/LEP1Data1994P2_recons_aftercut-MERGED.root,$ProjectBase/Samples/ALEPH/LEP1Data1994P3_recons_aftercut-MERGED.root"
+
+# a merger that does not see all its inputs gives up at MergeTimeout seconds and leaves no output
+MergeTimeout=${MergeTimeout:-21600}
+MergerPIDs=""
+for Tag in PlotGenAll PlotReco
 do
-   j=`printf "%02d" "$i"`
-	./Execute --Input $ProjectBase/Samples/ALEPHMC/LEP1MC1994_recons_aftercut-0$j.root \
-		--Output PlotGen_$j.root \
-		--Particle tgen --IsReco false --DoEENormalize true --DoWeight false
-	./Execute --Input $ProjectBase/Samples/ALEPHMC/LEP1MC1994_recons_aftercut-0$j.root \
-		--Output PlotGenSTheta_$j.root \
-		--Particle tgen --IsReco false --DoEENormalize true --DoWeight false --CheckSphericity true
-	./Execute --Input $ProjectBase/Samples/ALEPHMC/LEP1MC1994_recons_aftercut-0$j.root \
-		--Output PlotReco_$j.root \
-		--Particle t --IsReco true --DoEENormalize true --DoWeight true
+	$Merger --Watch true --Poll 5 --Expected 40 --Threads 2 --Timeout $MergeTimeout --Input "${Tag}_*.root" --Output $Tag.root &
+	MergerPIDs="$MergerPIDs $!"
 done
+$Merger --Watch true --Poll 5 --Expected 3 --Threads 2 --Timeout $MergeTimeout --Input "PlotData_*.root" --Output PlotData.root &
+MergerPIDs="$MergerPIDs $!"
+
+# a failed job never writes its .done marker, so its merger could only wait for the timeout: stop them all
+Failed=0
+RunDriver()
+{
+	Label=$1
+	shift
+	$Driver "$@"
+	Status=$?
+	if [ $Status -ne 0 ]
+	then
+		echo "JobDriver for $Label failed with status $Status" >&2
+		Failed=1
+	fi
+}
+
+# the generator-level selections share one read of tgen, as the Gen and GenSTheta directories of PlotGenAll.root
+RunDriver PlotGenAll --Input "$MCFiles" --Jobs $Jobs --Retry 1 \
+	--Output "PlotGenAll_{index}.root" \
+	--Command "./Execute --Input {input} --Output {output} --Particle tgen --IsReco false --DoEENormalize true --DoWeight false --Configurations Gen,GenSTheta --GenSTheta.CheckSphericity true"
+RunDriver PlotReco --Input "$MCFiles" --Jobs $Jobs --Retry 1 \
+	--Output "PlotReco_{index}.root" \
+	--Command "./Execute --Input {input} --Output {output} --Particle t --IsReco true --DoEENormalize true --DoWeight true"
+RunDriver PlotData --Input "$DataFiles" --Jobs $Jobs --Retry 1 \
+	--Output "PlotData_{index}.root" \
+	--Command "./Execute --Input {input} --Output {output} --Particle t --IsReco true --DoEENormalize true --DoWeight true"
 
-./Execute --Input $ProjectBase/Samples/ALEPH/LEP1Data1994P1_recons_aftercut-MERGED.root \
-   --Output PlotData_1.root \
-   --Particle t --IsReco true --DoEENormalize true --DoWeight true
-./Execute --Input $ProjectBase/Samples/ALEPH/LEP1Data1994P2_recons_aftercut-MERGED.root \
-   --Output PlotData_2.root \
-   --Particle t --IsReco true --DoEENormalize true --DoWeight true
-./Execute --Input $ProjectBase/Samples/ALEPH/LEP1Data1994P3_recons_aftercut-MERGED.root \
-   --Output PlotData_3.root \
-   --Particle t --IsReco true --DoEENormalize true --DoWeight true
+if [ $Failed -ne 0 ]
+then
+	kill $MergerPIDs 2> /dev/null
+	wait
+	exit 1
+fi
+
+for PID in $MergerPIDs
+do
+	if ! wait $PID
+	then
+		echo "A histogram merger failed" >&2
+		Failed=1
+	fi
+done
+exit $Failed
@@ -29,6 +29,8 @@ int main(int argc, char *argv[])
 
    JetTreeMessenger MJet(File, JetTreeName);
    ParticleTreeMessenger MP(File, ParticleTreeName);
+   MJet.EnableCache();
+   MP.EnableCache();
 
    int JetCount = 0;
    int MatchedJetCount = 0;
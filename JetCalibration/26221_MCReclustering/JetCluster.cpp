@@ -12,6 +12,7 @@ using namespace fastjet;
 #include "TauHelperFunctions3.h"
 #include "CommandLine.h"
 #include "ProgressBar.h"
+#include "Timeline.h"
 
 #include "Messenger.h"
 
@@ -32,12 +33,18 @@ int main(int argc, char *argv[])
    string GenBeforeParticleTreeName = CL.Get("GenBefore", "tgenBefore");
    bool SkipNeutrino                = CL.GetBool("SkipNeutrino", false);
    bool SkipGen                     = CL.GetBool("SkipGen", false);
+   string TimelineFileName          = CL.Get("Timeline", "");   // trace-event JSON of the stages, off if empty
+
+   Timeline::Start(TimelineFileName);
 
    TFile InputFile(InputFileName.c_str());
 
    ParticleTreeMessenger MReco(InputFile, ParticleTreeName);
    ParticleTreeMessenger MGen(InputFile, GenParticleTreeName);
    ParticleTreeMessenger MGenBefore(InputFile, GenBeforeParticleTreeName);
+   MReco.EnableCache();
+   MGen.EnableCache();
+   MGenBefore.EnableCache();
 
    TFile OutputFile(OutputFileName.c_str(), "RECREATE");
 
@@ -94,11 +101,8 @@ int main(int argc, char *argv[])
    Bar.SetStyle(-1);
    for(int iE = 0; iE < EventCount; iE++)
    {
-      if(EventCount < 500 || iE % (EventCount / 250) == 0)
-      {
-         Bar.Update(iE);
-         Bar.Print();
-      }
+      Bar.Update(iE);
+      Bar.PrintIfDue();
 
       MReco.GetEntry(iE);
       if(SkipGen == false)
@@ -154,6 +158,7 @@ int main(int argc, char *argv[])
       // Now do all the clustering
       for(int iR = 0; iR < (int)JetR.size(); iR++)
       {
+         ScopedTimer ClusterTimer("FastJet", "cluster");
          JetDefinition RecoDefinition(ee_genkt_algorithm, JetR[iR], -1, RecombinationScheme(E_scheme));
          // AreaDefinition RecoAreaDefinition(AreaType(active_area), GhostedAreaSpec(5, 3, 0.01));
          // ClusterSequenceArea RecoSequence(RecoFastJetParticles, RecoDefinition, RecoAreaDefinition);
@@ -171,6 +176,7 @@ int main(int argc, char *argv[])
          // ClusterSequenceArea GenBeforeSequence(GenBeforeFastJetParticles, GenBeforeDefinition, GenBeforeAreaDefinition);
          ClusterSequence GenBeforeSequence(GenBeforeFastJetParticles, GenBeforeDefinition);
          vector<PseudoJet> GenBeforeFastJets = sorted_by_pt(GenBeforeSequence.inclusive_jets(0));
+         ClusterTimer.Stop();
 
          NRecoJet[iR] = RecoFastJets.size();
          for(int iJ = 0; iJ < (int)RecoFastJets.size(); iJ++)
@@ -208,6 +214,7 @@ int main(int argc, char *argv[])
             }
          }
 
+         TIMELINE_SCOPE("Fill", "output");
          RecoTree[iR]->Fill();
          if(SkipGen == false)
          {
@@ -221,6 +228,7 @@ int main(int argc, char *argv[])
    Bar.Print();
    Bar.PrintLine();
 
+   ScopedTimer WriteTimer("Write", "output");
    for(int iR = 0; iR < (int)JetR.size(); iR++)
    {
       RecoTree[iR]->Write();
@@ -232,9 +240,12 @@ int main(int argc, char *argv[])
    }
 
    OutputFile.Close();
+   WriteTimer.Stop();
 
    InputFile.Close();
 
+   Timeline::Finish(&cout);
+
    return 0;
 }
 
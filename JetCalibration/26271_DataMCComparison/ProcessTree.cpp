@@ -6,6 +6,7 @@ using namespace std;
 #include "TFile.h"
 
 #include "CommandLine.h"
+#include "EntryRange.h"
 #include "ProgressBar.h"
 
 #include "JetCorrector.h"
@@ -55,14 +56,14 @@ int main(int argc, char *argv[])
    OutputTree.Branch("JetE",     &JetE,     "JetE[N]/F");
    OutputTree.Branch("JetRawE",  &JetRawE,  "JetRawE[N]/F");
 
-   int EntryCount = InputTree->GetEntries();
+   EntryRange Range = GetEntryRange(CL, InputTree, InputFileName, Fraction);
+   int EntryCount = Range.Size();
    ProgressBar Bar(cout, EntryCount);
 
-   for(int iE = 0; iE < EntryCount * Fraction; iE++)
+   for(int iE = Range.First(); iE < Range.End; iE = Range.Next(iE))
    {
-      Bar.Update(iE);
-      if(EntryCount < 1000 || iE % (EntryCount / 300) == 0)
-         Bar.Print();
+      Bar.Update(iE - Range.Begin);
+      Bar.PrintIfDue();
 
       InputTree->GetEntry(iE);
 
@@ -91,6 +92,7 @@ int main(int argc, char *argv[])
    Bar.PrintLine();
 
    OutputTree.Write();
+   WriteEntryRange(&OutputFile, Range);
 
    OutputFile.Close();
    InputFile.Close();
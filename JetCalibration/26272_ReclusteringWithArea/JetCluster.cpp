@@ -10,9 +10,12 @@ using namespace fastjet;
 
 #include "TauHelperFunctions3.h"
 #include "CommandLine.h"
+#include "EntryRange.h"
 #include "ProgressBar.h"
 
 #include "Messenger.h"
+#include "AsyncTreeWriter.h"
+#include "Timeline.h"
 
 #define MAXR 20
 #define MAX 1000
@@ -35,16 +38,27 @@ int main(int argc, char *argv[])
    bool SkipGen                     = CL.GetBool("SkipGen", false);
 
    int GhostSpacing                 = CL.GetInt("GhostSpacing", 50);
+   AsyncTreeWriterOptions RecoOptions      = GetAsyncTreeWriterOptions(CL, "Reco");
+   AsyncTreeWriterOptions GenOptions       = GetAsyncTreeWriterOptions(CL, "Gen");
+   AsyncTreeWriterOptions GenBeforeOptions = GetAsyncTreeWriterOptions(CL, "GenBefore");
+   string Format                           = CL.Get("Format", "TTree");   // TTree or RNTuple
+   string TimelineFileName                 = CL.Get("Timeline", "");   // trace-event JSON of the stages, off if empty
+
+   Timeline::Start(TimelineFileName);
 
    TFile InputFile(InputFileName.c_str());
 
    ParticleTreeMessenger MReco(InputFile, ParticleTreeName);
    ParticleTreeMessenger MGen(InputFile, GenParticleTreeName);
    ParticleTreeMessenger MGenBefore(InputFile, GenBeforeParticleTreeName);
+   MReco.EnableCache();
+   MGen.EnableCache();
+   MGenBefore.EnableCache();
 
-   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+   // one writer thread per tree, all feeding the same output file
+   AsyncOutputFile OutputFile(OutputFileName, "RECREATE", Format);
 
-   vector<TTree *> RecoTree, GenTree, GenBeforeTree;
+   vector<AsyncTreeWriter *> RecoTree, GenTree, GenBeforeTree;
 
    int NRecoJet[MAXR];
    float RecoJetPT[MAXR][MAX], RecoJetEta[MAXR][MAX], RecoJetPhi[MAXR][MAX], RecoJetM[MAXR][MAX], RecoJetA[MAXR][MAX];
@@ -59,11 +73,11 @@ int main(int argc, char *argv[])
    for(int iR = 0; iR < (int)JetR.size(); iR++)
    {
       double R = JetR[iR];
-      RecoTree.push_back(     new TTree(Form("RecoR%d",      (int)(R * 10)), "Reclustered trees"));
+      RecoTree.push_back(     new AsyncTreeWriter(OutputFile, Form("RecoR%d",      (int)(R * 10)), "Reclustered trees", RecoOptions));
       if(SkipGen == false)
       {
-         GenTree.push_back(      new TTree(Form("GenR%d",       (int)(R * 10)), "Reclustered trees"));
-         GenBeforeTree.push_back(new TTree(Form("GenBeforeR%d", (int)(R * 10)), "Reclustered trees"));
+         GenTree.push_back(      new AsyncTreeWriter(OutputFile, Form("GenR%d",       (int)(R * 10)), "Reclustered trees", GenOptions));
+         GenBeforeTree.push_back(new AsyncTreeWriter(OutputFile, Form("GenBeforeR%d", (int)(R * 10)), "Reclustered trees", GenBeforeOptions));
       }
       
       RecoTree[iR]->Branch("nref",       &NRecoJet[iR],        "nref/I");
@@ -92,16 +106,14 @@ int main(int argc, char *argv[])
       }
    }
 
-   int EventCount = MReco.GetEntries();
+   EntryRange Range = GetEntryRange(CL, MReco.Tree, InputFileName);
+   int EventCount = Range.Size();
    ProgressBar Bar(cout, EventCount);
    Bar.SetStyle(-1);
-   for(int iE = 0; iE < EventCount; iE++)
+   for(int iE = Range.First(); iE < Range.End; iE = Range.Next(iE))
    {
-      if(EventCount < 500 || iE % (EventCount / 250) == 0)
-      {
-         Bar.Update(iE);
-         Bar.Print();
-      }
+      Bar.Update(iE - Range.Begin);
+      Bar.PrintIfDue();
 
       MReco.GetEntry(iE);
       if(SkipGen == false)
@@ -146,6 +158,7 @@ int main(int argc, char *argv[])
       // Now do all the clustering
       for(int iR = 0; iR < (int)JetR.size(); iR++)
       {
+         ScopedTimer ClusterTimer("FastJet", "cluster");
          JetDefinition RecoDefinition(ee_genkt_algorithm, JetR[iR], -1, RecombinationScheme(E_scheme));
          ClusterSequence RecoSequence(RecoFastJetParticles, RecoDefinition);
          vector<PseudoJet> RecoFastJets = sorted_by_pt(RecoSequence.inclusive_jets(0));
@@ -157,6 +170,7 @@ int main(int argc, char *argv[])
          JetDefinition GenBeforeDefinition(ee_genkt_algorithm, JetR[iR], -1, RecombinationScheme(E_scheme));
          ClusterSequence GenBeforeSequence(GenBeforeFastJetParticles, GenBeforeDefinition);
          vector<PseudoJet> GenBeforeFastJets = sorted_by_pt(GenBeforeSequence.inclusive_jets(0));
+         ClusterTimer.Stop();
 
          NRecoJet[iR] = RecoFastJets.size();
          for(int iJ = 0; iJ < (int)RecoFastJets.size(); iJ++)
@@ -207,20 +221,34 @@ int main(int argc, char *argv[])
    Bar.Print();
    Bar.PrintLine();
 
+   ScopedTimer WriteTimer("Write", "output");
    for(int iR = 0; iR < (int)JetR.size(); iR++)
    {
-      RecoTree[iR]->Write();
+      RecoTree[iR]->Finish();
+      RecoTree[iR]->PrintStatistics(cout);
+      delete RecoTree[iR];
       if(SkipGen == false)
       {
-         GenTree[iR]->Write();
-         GenBeforeTree[iR]->Write();
+         GenTree[iR]->Finish();
+         GenBeforeTree[iR]->Finish();
+         GenTree[iR]->PrintStatistics(cout);
+         GenBeforeTree[iR]->PrintStatistics(cout);
+         delete GenTree[iR];
+         delete GenBeforeTree[iR];
       }
    }
 
    OutputFile.Close();
+   WriteTimer.Stop();
+
+   TFile RangeFile(OutputFileName.c_str(), "UPDATE");
+   WriteEntryRange(&RangeFile, Range);
+   RangeFile.Close();
 
    InputFile.Close();
 
+   Timeline::Finish(&cout);
+
    return 0;
 }
 
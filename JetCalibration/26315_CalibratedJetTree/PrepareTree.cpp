@@ -28,6 +28,8 @@ int main(int argc, char *argv[])
 
    ParticleTreeMessenger MP(InputFile, ParticleTreeName);
    JetTreeMessenger MJ(InputFile, InputTreeName);
+   MP.EnableCache();
+   MJ.EnableCache();
 
    int EntryCount = MPReco.GetEntries();
    for(int iE = 0; iE < EntryCount; iE++)
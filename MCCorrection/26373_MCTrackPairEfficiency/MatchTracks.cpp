@@ -8,6 +8,7 @@ using namespace std;
 
 #include "Messenger.h"
 #include "CommandLine.h"
+#include "EntryRange.h"
 #include "Matching.h"
 #include "ProgressBar.h"
 #include "TauHelperFunctions3.h"
@@ -27,6 +28,7 @@ int main(int argc, char *argv[])
    string RecoTreeName   = CL.Get("Reco", "t");
    string OutputFileName = CL.Get("Output");
    double Fraction       = CL.GetDouble("Fraction", 1.00);
+   string IndexFileName  = CL.Get("Index", "");   // selection index of the reco tree (MakeSelectionIndex), optional
 
    TFile InputFile(InputFileName.c_str());
    TFile OutputFile(OutputFileName.c_str(), "RECREATE");
@@ -79,22 +81,41 @@ int main(int argc, char *argv[])
 
    ParticleTreeMessenger MGen(InputFile, GenTreeName);
    ParticleTreeMessenger MReco(InputFile, RecoTreeName);
+   MGen.EnableCache();
+   MReco.EnableCache();
+
+   // with a selection index, events failing the baseline cut are skipped before the trees are read
+   TFile *IndexFile = (IndexFileName != "") ? TFile::Open(IndexFileName.c_str()) : nullptr;
+   SelectionIndexMessenger MIndex(IndexFile, RecoTreeName + "Index");
+   bool UseIndex = (MIndex.Tree != nullptr);
+   if(IndexFileName != "" && UseIndex == false)
+      cerr << "Warning: selection index " << IndexFileName << " not usable, falling back to full reads" << endl;
+   if(UseIndex == true && MIndex.IsAlignedWith(MReco, cerr) == false)
+   {
+      cerr << "Warning: selection index is not aligned with tree " << RecoTreeName << ", ignoring it" << endl;
+      UseIndex = false;
+   }
 
-   int EntryCount = MGen.GetEntries() * Fraction;
+   EntryRange Range = GetEntryRange(CL, MGen.Tree, InputFileName, Fraction);
+   int EntryCount = Range.Size();
    ProgressBar Bar(cout, EntryCount);
    Bar.SetStyle(-1);
-   for(int iE = 0; iE < EntryCount; iE++)
+   for(int iE = Range.First(); iE < Range.End; iE = Range.Next(iE))
    {
-      if(EntryCount < 500 || iE % (EntryCount / 300) == 0)
+      Bar.Update(iE - Range.Begin);
+      Bar.PrintIfDue();
+
+      if(UseIndex == true)
       {
-         Bar.Update(iE);
-         Bar.Print();
+         MIndex.GetEntry(iE);
+         if(MIndex.Pass(true, false, false) == false)
+            continue;
       }
 
       MGen.GetEntry(iE);
       MReco.GetEntry(iE);
 
-      if(MReco.PassBaselineCut() == false)
+      if(UseIndex == false && MReco.PassBaselineCut() == false)
          continue;
 
       vector<FourVector> PGen, PReco;
@@ -192,9 +213,15 @@ int main(int argc, char *argv[])
    OutputFile.cd();
    OutputTree.Write();
    OutputPairTree.Write();
+   WriteEntryRange(&OutputFile, Range);
    OutputFile.Close();
 
    OutputFile.Close();
+   if(IndexFile != nullptr)
+   {
+      IndexFile->Close();
+      delete IndexFile;
+   }
    InputFile.Close();
 
    return 0;
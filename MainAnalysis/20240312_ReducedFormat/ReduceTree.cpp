@@ -5,7 +5,10 @@ using namespace std;
 #include "TFile.h"
 
 #include "CommandLine.h"
+#include "EntryRange.h"
 #include "Messenger.h"
+#include "AsyncTreeWriter.h"
+#include "Quantization.h"
 #include "alephTrkEfficiency.h"
 
 #define MAX 10000
@@ -20,37 +23,51 @@ int main(int argc, char *argv[])
    bool GenLevel         = CL.GetBool("GenLevel", false);
    double MinTheta       = CL.GetDouble("MinTheta", 0.35);
    double Fraction       = CL.GetDouble("Fraction", 1.00);
+   string Format         = CL.Get("Format", "TTree");   // TTree or RNTuple
+   AsyncTreeWriterOptions TreeOptions = GetAsyncTreeWriterOptions(CL, "Tree");
+   Quantization Q(CL);
+
+   Q.Print(cout);
+   if(Format == "RNTuple" && Q.IsEnabled() == true)
+      cout << "Quantization is not applied to RNTuple output, writing full precision" << endl;
 
    TFile InputFile(InputFileName.c_str());
    ParticleTreeMessenger M(InputFile, TreeName);
+   M.EnableCache();
 
    cout << M.GetEntries() << endl;
 
-   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
-   TTree OutputTree("Tree", "Reduced tree");
+   // in an RNTuple the particle arrays become variable-length collections
+   AsyncOutputFile OutputFile(OutputFileName, "RECREATE", Format);
+   AsyncTreeWriter OutputTree(OutputFile, "Tree", "Reduced tree", TreeOptions);
 
    int N;
    float Momentum[MAX], Mass[MAX], Theta[MAX], Phi[MAX], Weight[MAX];
    short Charge[MAX];
    bool PassCut;
+   int RunNo, EventNo;
    OutputTree.Branch("N", &N, "N/I");
-   OutputTree.Branch("Momentum", &Momentum, "Momentum[N]/F");
+   OutputTree.Branch("Momentum", &Momentum, ("Momentum[N]/" + Q.Momentum('F')).c_str());
    OutputTree.Branch("Mass", &Mass, "Mass[N]/F");
-   OutputTree.Branch("Theta", &Theta, "Theta[N]/F");
-   OutputTree.Branch("Phi", &Phi, "Phi[N]/F");
+   OutputTree.Branch("Theta", &Theta, ("Theta[N]/" + Q.Angle('F', 0, M_PI)).c_str());
+   OutputTree.Branch("Phi", &Phi, ("Phi[N]/" + Q.Angle('F', -M_PI, M_PI)).c_str());
    OutputTree.Branch("Weight", &Weight, "Weight[N]/F");
    OutputTree.Branch("Charge", &Charge, "Charge[N]/S");
    OutputTree.Branch("PassCut", &PassCut, "PassCut/O");
+   OutputTree.Branch("RunNo", &RunNo, "RunNo/I");
+   OutputTree.Branch("EventNo", &EventNo, "EventNo/I");
 
    alephTrkEfficiency efficiencyCorrector;
 
-   int EntryCount = M.GetEntries() * Fraction;
-   for(int iE = 0; iE < EntryCount; iE++)
+   EntryRange Range = GetEntryRange(CL, M.Tree, InputFileName, Fraction);
+   for(int iE = Range.First(); iE < Range.End; iE = Range.Next(iE))
    {
       M.GetEntry(iE);
 
       // Event selection here
       PassCut = M.PassBaselineCut();
+      RunNo = M.RunNo;
+      EventNo = M.EventNo;
 
       N = 0;
       for(int iP = 0; iP < M.nParticle; iP++)
@@ -89,10 +106,14 @@ int main(int argc, char *argv[])
       OutputTree.Fill();
    }
 
-   OutputFile.cd();
-   OutputTree.Write();
+   OutputTree.Finish();
+   OutputTree.PrintStatistics(cout);
    OutputFile.Close();
 
+   TFile RangeFile(OutputFileName.c_str(), "UPDATE");
+   WriteEntryRange(&RangeFile, Range);
+   RangeFile.Close();
+
    InputFile.Close();
 
    return 0;
@@ -1,32 +1,22 @@
 #!/bin/bash
 
-for i in Samples/ALEPHMC/*
-do
-	./Execute --Input "$i" --Output `basename "$i"`
-done
-
-hadd -f LEP1MC1994_Reco.root LEP1MC1994_recons*root
-
-for i in Samples/ALEPHMC/*
-do
-   rm `basename "$i"`
-done
-
-for i in Samples/ALEPHMC/*
-do
-	./Execute --Input "$i" --Output `basename "$i"` --GenLevel true --Tree tgen
-done
-
-hadd -f LEP1MC1994_Gen.root LEP1MC1994_recons*root
-
-for i in Samples/ALEPHMC/*
-do
-   rm `basename "$i"`
-done
-
-for i in Samples/ALEPH/*1994*
-do
-	./Execute --Input "$i" --Output `basename "$i"`
-done
+# Per-file jobs run in parallel through the job driver; the merge only happens if every file succeeded
+Driver=$ProjectBase/CommonCode/bin/JobDriver
+Jobs=${Jobs:-`nproc`}
+
+$Driver --Input "Samples/ALEPHMC/*" --Jobs $Jobs --Retry 1 \
+	--Output "Reco_{base}" \
+	--Command "./Execute --Input {input} --Output {output}" \
+	--Merge LEP1MC1994_Reco.root || exit 1
+
+$Driver --Input "Samples/ALEPHMC/*" --Jobs $Jobs --Retry 1 \
+	--Output "Gen_{base}" \
+	--Command "./Execute --Input {input} --Output {output} --GenLevel true --Tree tgen" \
+	--Merge LEP1MC1994_Gen.root || exit 1
+
+$Driver --Input "Samples/ALEPH/*1994*" --Jobs $Jobs --Retry 1 \
+	--Output "{base}" \
+	--Command "./Execute --Input {input} --Output {output}" || exit 1
+rm -f LEP1Data1994*.done
 
 mv LEP1MC1994_Reco.root LEP1MC1994_Gen.root LEP1Data1994_*root Output/
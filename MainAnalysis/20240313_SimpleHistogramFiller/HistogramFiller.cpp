@@ -8,14 +8,47 @@ using namespace std;
 #include "SetStyle.h"
 #include "ProgressBar.h"
 #include "CommandLine.h"
+#include "EntryRange.h"
+#include "PrecisionTarget.h"
 #include "Messenger.h"
+#include "RNTupleIO.h"
+#include "Quantization.h"
+#include "RunMetadata.h"
+#include "Timeline.h"
+#include "EECKernels.h"
+#include "BootstrapReplicas.h"
 #include "JetCorrector.h"
 #include "alephTrkEfficiency.h"
 
+// One selection of the multi-configuration fill: particle mask, weights, normalization and histograms
+//    --Configurations A,B,... fills several selections from one read of the reduced tree.  Every option
+//    below is read as --A.Option first and falls back to the global --Option, e.g.
+//       --Configurations Nominal,MinPT0p5 --MinPT0p5.MinParticlePT 0.5
+//    Each configuration is written to its own directory of the output file; without --Configurations
+//    there is one unnamed configuration from the global options, written to the top of the file.
+class EECConfiguration
+{
+public:
+   string Name;
+   double MinParticleE, MinParticlePT, MinTheta;
+   bool CheckCut, DoEENormalize, UseFullEnergy, DoWeight;
+   float NEvent;
+   TH1D HN, HEEC2, HEEC3, HLinearEEC2, HLinearEEC3;
+   // --Bootstrap replicas of the histograms, nullptr when off
+   BootstrapHistogram *BN, *BEEC2, *BEEC3, *BLinearEEC2, *BLinearEEC3;
+   // state of the current event
+   bool Selected;
+   vector<double> W;   // per particle of the event, indexed like the shared particle list
+   double TotalE2, TotalE3;
+public:
+   EECConfiguration(CommandLine &CL, string name, int BinCount, double LinearBins[], BootstrapReplicas &Bootstrap);
+   ~EECConfiguration();
+   bool PassParticle(FourVector &P) const;
+   void Write(TFile &OutputFile, double Bins[], double LinearBins[]);
+};
+
 int main(int argc, char *argv[]);
 void DivideByBin(TH1D &H, double Bins[]);
-int FindBin(double Value, int NBins, double Bins[]);
-double GetMax(vector<double> X);
 
 int main(int argc, char *argv[])
 {
@@ -25,15 +58,29 @@ int main(int argc, char *argv[])
 
    string InputFileName    = CL.Get("Input");
    string OutputFileName   = CL.Get("Output", "Plots.root");
-   double MinParticleE     = CL.GetDouble("MinParticleE", 0);
-   double MinParticlePT    = CL.GetDouble("MinParticlePT", 0.2);
-   double MinTheta         = CL.GetDouble("MinTheta", 0.35);   // cos(0.35) = 0.94
    bool IsReco             = CL.GetBool("IsReco", true);
-   bool DoEENormalize      = CL.GetBool("EENormalize", true);
-   bool UseFullEnergy      = CL.GetBool("UseFullEnergy", true);
-   bool DoWeight           = CL.GetBool("DoWeight", false);
    double Fraction         = CL.GetDouble("Fraction", 1.00);
-   bool CheckCut           = CL.GetBool("CheckCut", true);
+   vector<string> ConfigurationNames = CL.GetStringVector("Configurations", vector<string>{""});
+   double CacheSize        = CL.GetDouble("CacheSize", -1);   // in MB; negative = sized from active branches, 0 = off
+   bool Prefetch           = CL.GetBool("Prefetch", true);
+   bool ParallelUnzip      = CL.GetBool("ParallelUnzip", false);
+   bool ValidateQuantization = CL.GetBool("ValidateQuantization", false);   // also fill the first configuration with --Quantize* rounding applied
+   string ProgressJSON     = CL.Get("ProgressJSON", "");   // throughput summary, not written if empty
+   string TimelineFileName = CL.Get("Timeline", "");       // trace-event JSON of the stages, off if empty
+   Quantization Q(CL);
+   KernelValidator Validator(CL);   // --FastKernels, --Validate
+   BootstrapReplicas Bootstrap(CL, InputFileName);   // --Bootstrap, --BootstrapSeed
+
+   Timeline::Start(TimelineFileName);
+
+   if(ConfigurationNames.size() == 0 || ConfigurationNames.size() > 64)
+   {
+      cerr << "Between 1 and 64 configurations are supported, " << ConfigurationNames.size() << " given" << endl;
+      return 1;
+   }
+
+   if(ValidateQuantization == true)
+      Q.Print(cout);
 
    TFile OutputFile(OutputFileName.c_str(), "RECREATE");
 
@@ -51,11 +98,6 @@ int main(int argc, char *argv[])
    for(int i = 0; i <= 2 * BinCount; i++)
       LinearBins[i] = M_PI / (2 * BinCount) * i;
 
-   TH1D HN("HN", ";;", 1, 0, 1);
-   TH1D HEEC2("HEEC2", ";EEC_{2};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HEEC3("HEEC3", ";EEC_{3};", 2 * BinCount, 0, 2 * BinCount);
-   TH1D HLinearEEC2("HLinearEEC2", ";EEC_{2};", 2 * BinCount, LinearBins);
-   TH1D HLinearEEC3("HLinearEEC3", ";EEC_{3};", 2 * BinCount, LinearBins);
    TH1D HBinMin("HBinMin", ";EEC;BinMin", 2 * BinCount, 0, 2 * BinCount);
    TH1D HBinMax("HBinMax", ";EEC;BinMax", 2 * BinCount, 0, 2 * BinCount);
 
@@ -65,120 +107,353 @@ int main(int argc, char *argv[])
       HBinMax.SetBinContent(i + 1, Bins[i+1]);
    }
 
-   HEEC2.SetStats(0);
-   HEEC3.SetStats(0);
-   HLinearEEC2.SetStats(0);
-   HLinearEEC3.SetStats(0);
+   TH1D HEEC2Quantized("HEEC2Quantized", ";EEC_{2};", 2 * BinCount, 0, 2 * BinCount);
+   TH1D HEEC3Quantized("HEEC3Quantized", ";EEC_{3};", 2 * BinCount, 0, 2 * BinCount);
+
+   vector<EECConfiguration *> Configurations;
+   for(string Name : ConfigurationNames)
+      Configurations.push_back(new EECConfiguration(CL, Name, BinCount, LinearBins, Bootstrap));
+
+   // the first configuration drives the precision target and the quantization check
+   EECConfiguration &First = *Configurations[0];
 
    TFile File(InputFileName.c_str());
 
-   float NEvent = 0;
+   RunMetadata Metadata = StartRunMetadata(CL, {InputFileName});
 
    ReducedTreeMessenger M(File, "Tree");
+   if(CacheSize != 0)
+      M.EnableCache((CacheSize > 0) ? (long long)(CacheSize * 1048576) : -1, 100, Prefetch, ParallelUnzip);
 
    alephTrkEfficiency efficiencyCorrector;
 
-   int EntryCount = M.GetEntries() * Fraction;
+   vector<long long> Clusters = M.GetClusterBoundaries();
+   EntryRange Range = GetEntryRange(CL, Clusters, "Tree", InputFileName, Fraction);
+   PrecisionTarget Precision(CL, Clusters, Range);   // --TargetPrecision: clusters in random order, early stop
+   int EntryCount = Range.SampledSize();
    ProgressBar Bar(cout, EntryCount);
-   for(int iE = 0; iE < EntryCount; iE++)
+   Bar.SetTelemetry(true);
+   for(int iPosition = 0; iPosition < EntryCount; iPosition++)
    {
-      if(EntryCount < 300 || (iE % (EntryCount / 250) == 0))
-      {
-         Bar.Update(iE);
-         Bar.Print();
-      }
+      int iE = Precision.Entry(iPosition);
+
+      Bar.Update(iPosition);
+      Bar.PrintIfDue();
 
       M.GetEntry(iE);
+      Metadata.CountProcessed();
+      Bootstrap.Next(M.RunNo, M.EventNo, iE);
 
-      if(CheckCut == true && M.PassCut == false)
+      bool AnySelected = false;
+      for(EECConfiguration *C : Configurations)
+      {
+         C->Selected = (C->CheckCut == false || M.PassCut == true);
+         AnySelected = AnySelected || C->Selected;
+      }
+      if(AnySelected == false)
          continue;
 
-      NEvent = NEvent + 1;
+      Metadata.CountSelected();
 
-      // now we gather the particles
-      vector<FourVector> P;
-      vector<double> W;
-      double TotalE = 0;
+      // now we gather the particles: the union of the selections, Masks[i] has bit s set if
+      //    particle i passes configuration s
+      vector<FourVector> P, PQuantized;
+      vector<uint64_t> Masks;
+      vector<int> Index;
       for(int iP = 0; iP < M.N; iP++)
       {
-         if(M.P[iP][0] < MinParticleE)
-            continue;
-         if(M.P[iP].GetPT() < MinParticlePT)
-            continue;
-         if(M.P[iP].GetTheta() < MinTheta || M.P[iP].GetTheta() > M_PI - MinTheta)
+         uint64_t Mask = 0;
+         for(int s = 0; s < (int)Configurations.size(); s++)
+            if(Configurations[s]->Selected == true && Configurations[s]->PassParticle(M.P[iP]) == true)
+               Mask = Mask | ((uint64_t)1 << s);
+         if(Mask == 0)
             continue;
 
          FourVector &Momentum = M.P[iP];
          P.push_back(Momentum);
-         
-         if(DoWeight == true)
-            W.push_back(M.Weight[iP]);
-         else
-            W.push_back(1);
-         
-         TotalE = TotalE + M.P[iP][0];
-      }
+         Masks.push_back(Mask);
+         Index.push_back(iP);
 
-      if(UseFullEnergy == true)
-         TotalE = 91.1876;
+         if(ValidateQuantization == true)
+         {
+            FourVector Rounded;
+            Rounded.SetSizeThetaPhiMass(Q.RoundMomentum(M.Momentum[iP]),
+               Q.RoundAngle(M.Theta[iP], 0, M_PI), Q.RoundAngle(M.Phi[iP], -M_PI, M_PI), M.Mass[iP]);
+            PQuantized.push_back(Rounded);
+         }
+      }
 
-      double TotalE2 = DoEENormalize ? (TotalE  * TotalE) : 1;
-      double TotalE3 = DoEENormalize ? (TotalE2 * TotalE) : 1;
-   
-      // Fill EECs
       int N = P.size();
-      vector<vector<double>> D(N);
-      for(int i = 0; i < N; i++)
+      for(int s = 0; s < (int)Configurations.size(); s++)
       {
-         D[i].resize(N);
-         for(int j = 0; j < N; j++)
-            D[i][j] = GetAngle(P[i], P[j]);
+         EECConfiguration &C = *Configurations[s];
+         if(C.Selected == false)
+            continue;
+         C.NEvent = C.NEvent + 1;
+         if(C.BN != nullptr)
+            C.BN->Fill(0.5);
+
+         C.W.assign(N, 0);
+         double TotalE = 0;
+         for(int i = 0; i < N; i++)
+         {
+            if((Masks[i] >> s & 1) == 0)
+               continue;
+            C.W[i] = (C.DoWeight == true) ? M.Weight[Index[i]] : 1;
+            TotalE = TotalE + P[i][0];
+         }
+
+         if(C.UseFullEnergy == true)
+            TotalE = 91.1876;
+
+         C.TotalE2 = C.DoEENormalize ? (TotalE    * TotalE) : 1;
+         C.TotalE3 = C.DoEENormalize ? (C.TotalE2 * TotalE) : 1;
       }
 
-      for(int i1 = 0; i1 < N; i1++)
+      Bar.AddPairs((long long)N * (N - 1) / 2);
+
+      // a single configuration keeps the legacy / fast choice, several share one angle matrix
+      auto RunPairLoop = [&](bool Fast, auto &&Fill2, auto &&Fill3)
+      {
+         if(Configurations.size() == 1)
+            EECPairLoop(Fast, P, BinCount * 2, Bins,
+               [&](int i1, int i2, double Max2, int Bin2) {Fill2(0, i1, i2, Max2, Bin2);},
+               [&](int i1, int i2, int i3, double Max3, int Bin3) {Fill3(0, i1, i2, i3, Max3, Bin3);});
+         else
+            EECPairLoopShared(P, Masks, BinCount * 2, Bins, Fill2, Fill3);
+      };
+
+      // the per-event contributions of both pair loops: EEC2 and EEC3 by bin, then the angle-weighted sums
+      //    that go into the linear histograms, for all configurations; the legacy side runs the original
+      //    loop on each selection separately
+      if(Validator.Sample(iE) == true)
       {
-         for(int i2 = i1 + 1; i2 < N; i2++)
+         auto Contributions = [&](bool Fast)
          {
-            double Max2 = D[i1][i2];
-            int Bin2 = FindBin(Max2, BinCount * 2, Bins);
-            HEEC2.Fill(Bin2, P[i1][0] * P[i2][0] / TotalE2 * W[i1] * W[i2]);
-            HLinearEEC2.Fill(Max2, P[i1][0] * P[i2][0] / TotalE2 * W[i1] * W[i2]);
+            int Size = 2 * (BinCount * 2 + 2) + 2;
+            vector<double> C(Size * Configurations.size(), 0);
+            auto Add2 = [&](int s, int i1, int i2, double Max2, int Bin2)
+            {
+               EECConfiguration &Config = *Configurations[s];
+               double *Sum = &C[Size * s];
+               double Weight = P[i1][0] * P[i2][0] / Config.TotalE2 * Config.W[i1] * Config.W[i2];
+               Sum[Bin2 + 1] = Sum[Bin2 + 1] + Weight;
+               Sum[Size - 2] = Sum[Size - 2] + Max2 * Weight;
+            };
+            auto Add3 = [&](int s, int i1, int i2, int i3, double Max3, int Bin3)
+            {
+               EECConfiguration &Config = *Configurations[s];
+               double *Sum = &C[Size * s];
+               double Weight = P[i1][0] * P[i2][0] * P[i3][0] / Config.TotalE3 * Config.W[i1] * Config.W[i2] * Config.W[i3];
+               Sum[BinCount * 2 + 2 + Bin3 + 1] = Sum[BinCount * 2 + 2 + Bin3 + 1] + Weight;
+               Sum[Size - 1] = Sum[Size - 1] + Max3 * Weight;
+            };
+
+            if(Fast == true)
+            {
+               RunPairLoop(true, Add2, Add3);
+               return C;
+            }
+            for(int s = 0; s < (int)Configurations.size(); s++)
+            {
+               vector<int> Members;
+               vector<FourVector> Subset;
+               for(int i = 0; i < N; i++)
+               {
+                  if((Masks[i] >> s & 1) == 0)
+                     continue;
+                  Members.push_back(i);
+                  Subset.push_back(P[i]);
+               }
+               EECPairLoopLegacy(Subset, BinCount * 2, Bins,
+                  [&](int j1, int j2, double Max2, int Bin2) {Add2(s, Members[j1], Members[j2], Max2, Bin2);},
+                  [&](int j1, int j2, int j3, double Max3, int Bin3) {Add3(s, Members[j1], Members[j2], Members[j3], Max3, Bin3);});
+            }
+            return C;
+         };
+         Validator.Compare("PairLoop", [&]() {return Contributions(false);}, [&]() {return Contributions(true);});
+      }
 
-            for(int i3 = i2 + 1; i3 < N; i3++)
+      // Fill EECs
+      RunPairLoop(Validator.Fast,
+         [&](int s, int i1, int i2, double Max2, int Bin2)
+         {
+            EECConfiguration &C = *Configurations[s];
+            double EEC2 = P[i1][0] * P[i2][0] / C.TotalE2 * C.W[i1] * C.W[i2];
+            C.HEEC2.Fill(Bin2, EEC2);
+            C.HLinearEEC2.Fill(Max2, EEC2);
+            if(C.BEEC2 != nullptr)
+            {
+               C.BEEC2->Fill(Bin2, EEC2);
+               C.BLinearEEC2->Fill(Max2, EEC2);
+            }
+         },
+         [&](int s, int i1, int i2, int i3, double Max3, int Bin3)
+         {
+            EECConfiguration &C = *Configurations[s];
+            double EEC3 = P[i1][0] * P[i2][0] * P[i3][0] / C.TotalE3 * C.W[i1] * C.W[i2] * C.W[i3];
+            C.HEEC3.Fill(Bin3, EEC3);
+            C.HLinearEEC3.Fill(Max3, EEC3);
+            if(C.BEEC3 != nullptr)
             {
-               double Max3 = GetMax({Max2, D[i1][i3], D[i2][i3]});
-               int Bin3 = FindBin(Max3, BinCount * 2, Bins);
-               HEEC3.Fill(Bin3, P[i1][0] * P[i2][0] * P[i3][0] / TotalE3 * W[i1] * W[i2] * W[i3]);
-               HLinearEEC3.Fill(Max3, P[i1][0] * P[i2][0] * P[i3][0] / TotalE3 * W[i1] * W[i2] * W[i3]);
+               C.BEEC3->Fill(Bin3, EEC3);
+               C.BLinearEEC3->Fill(Max3, EEC3);
             }
+         });
+      Bootstrap.Flush();
+
+      // the particles of the first configuration again, with the stored precision emulated
+      if(ValidateQuantization == true && First.Selected == true)
+      {
+         vector<FourVector> Subset;
+         vector<double> W;
+         for(int i = 0; i < N; i++)
+         {
+            if((Masks[i] & 1) == 0)
+               continue;
+            Subset.push_back(PQuantized[i]);
+            W.push_back(First.W[i]);
          }
+         EECPairLoop(Validator.Fast, Subset, BinCount * 2, Bins,
+            [&](int i1, int i2, double Max2, int Bin2)
+            {
+               HEEC2Quantized.Fill(Bin2, Subset[i1][0] * Subset[i2][0] / First.TotalE2 * W[i1] * W[i2]);
+            },
+            [&](int i1, int i2, int i3, double Max3, int Bin3)
+            {
+               HEEC3Quantized.Fill(Bin3, Subset[i1][0] * Subset[i2][0] * Subset[i3][0] / First.TotalE3 * W[i1] * W[i2] * W[i3]);
+            });
       }
+
+      if(Precision.Reached(First.HEEC2, Bins, First.NEvent, iPosition + 1) == true)
+         break;
    }
-   Bar.Update(EntryCount);
+   Bar.Update(Precision.Stopped ? Precision.EntriesRead : EntryCount);
    Bar.Print();
    Bar.PrintLine();
+   Bar.PrintSummary();
+   Bar.WriteJSON(ProgressJSON, "HistogramFiller");
+   Validator.Report(cout);
+
+   M.IO.PrintStatistics(cout, "Tree");
 
    File.Close();
 
+   Precision.Finish(First.HEEC2, Bins, First.NEvent);
+
+   DivideByBin(HEEC2Quantized, Bins);
+   DivideByBin(HEEC3Quantized, Bins);
+
+   ScopedTimer WriteTimer("Write", "output");
+   for(EECConfiguration *C : Configurations)
+      C->Write(OutputFile, Bins, LinearBins);
+
+   OutputFile.cd();
+   HBinMin.Write();
+   HBinMax.Write();
+
+   // the same events with the stored precision emulated: the shifts should be far below the statistical errors
+   if(ValidateQuantization == true)
+   {
+      CompareQuantizedHistograms(First.HEEC2, HEEC2Quantized, cout);
+      CompareQuantizedHistograms(First.HEEC3, HEEC3Quantized, cout);
+      HEEC2Quantized.Write();
+      HEEC3Quantized.Write();
+   }
+
+   WriteEntryRanges(&OutputFile, Precision.ProcessedRanges(Range));
+   Precision.Write(&OutputFile, Range.SampledSize());
+   WriteRunMetadata(&OutputFile, Metadata);
+
+   OutputFile.Close();
+   WriteTimer.Stop();
+
+   for(EECConfiguration *C : Configurations)
+      delete C;
+
+   Timeline::Finish(&cout);
+
+   return 0;
+}
+
+EECConfiguration::EECConfiguration(CommandLine &CL, string name, int BinCount, double LinearBins[], BootstrapReplicas &Bootstrap)
+   : Name(name), NEvent(0),
+     HN("HN", ";;", 1, 0, 1),
+     HEEC2("HEEC2", ";EEC_{2};", 2 * BinCount, 0, 2 * BinCount),
+     HEEC3("HEEC3", ";EEC_{3};", 2 * BinCount, 0, 2 * BinCount),
+     HLinearEEC2("HLinearEEC2", ";EEC_{2};", 2 * BinCount, LinearBins),
+     HLinearEEC3("HLinearEEC3", ";EEC_{3};", 2 * BinCount, LinearBins),
+     BN(nullptr), BEEC2(nullptr), BEEC3(nullptr), BLinearEEC2(nullptr), BLinearEEC3(nullptr),
+     Selected(false), TotalE2(1), TotalE3(1)
+{
+   string Prefix = (Name == "") ? "" : (Name + ".");
+   MinParticleE  = CL.GetDouble(Prefix + "MinParticleE", CL.GetDouble("MinParticleE", 0));
+   MinParticlePT = CL.GetDouble(Prefix + "MinParticlePT", CL.GetDouble("MinParticlePT", 0.2));
+   MinTheta      = CL.GetDouble(Prefix + "MinTheta", CL.GetDouble("MinTheta", 0.35));   // cos(0.35) = 0.94
+   CheckCut      = CL.GetBool(Prefix + "CheckCut", CL.GetBool("CheckCut", true));
+   DoEENormalize = CL.GetBool(Prefix + "EENormalize", CL.GetBool("EENormalize", true));
+   UseFullEnergy = CL.GetBool(Prefix + "UseFullEnergy", CL.GetBool("UseFullEnergy", true));
+   DoWeight      = CL.GetBool(Prefix + "DoWeight", CL.GetBool("DoWeight", false));
+
+   // owned by this object, written explicitly into the configuration directory
+   for(TH1D *H : {&HN, &HEEC2, &HEEC3, &HLinearEEC2, &HLinearEEC3})
+      H->SetDirectory(nullptr);
+   for(TH1D *H : {&HEEC2, &HEEC3, &HLinearEEC2, &HLinearEEC3})
+      H->SetStats(0);
+
+   if(Bootstrap.IsEnabled() == true)
+   {
+      BN          = new BootstrapHistogram(Bootstrap, HN);
+      BEEC2       = new BootstrapHistogram(Bootstrap, HEEC2);
+      BEEC3       = new BootstrapHistogram(Bootstrap, HEEC3);
+      BLinearEEC2 = new BootstrapHistogram(Bootstrap, HLinearEEC2);
+      BLinearEEC3 = new BootstrapHistogram(Bootstrap, HLinearEEC3);
+   }
+}
+
+EECConfiguration::~EECConfiguration()
+{
+   for(BootstrapHistogram *B : {BN, BEEC2, BEEC3, BLinearEEC2, BLinearEEC3})
+      delete B;
+}
+
+bool EECConfiguration::PassParticle(FourVector &P) const
+{
+   if(P[0] < MinParticleE)
+      return false;
+   if(P.GetPT() < MinParticlePT)
+      return false;
+   if(P.GetTheta() < MinTheta || P.GetTheta() > M_PI - MinTheta)
+      return false;
+   return true;
+}
+
+// Normalizes by bin width and writes into the directory of the configuration (the top for the unnamed one)
+void EECConfiguration::Write(TFile &OutputFile, double Bins[], double LinearBins[])
+{
    HN.SetBinContent(1, NEvent);
    DivideByBin(HEEC2, Bins);
    DivideByBin(HEEC3, Bins);
    DivideByBin(HLinearEEC2, LinearBins);
    DivideByBin(HLinearEEC3, LinearBins);
-  
-   OutputFile.cd();
+   if(BN != nullptr)
+   {
+      BEEC2->DivideByBin(Bins);
+      BEEC3->DivideByBin(Bins);
+      BLinearEEC2->DivideByBin(LinearBins);
+      BLinearEEC3->DivideByBin(LinearBins);
+   }
 
+   TDirectory *Directory = (Name == "") ? (TDirectory *)&OutputFile : OutputFile.mkdir(Name.c_str());
+   Directory->cd();
    HN.Write();
    HEEC2.Write();
    HEEC3.Write();
    HLinearEEC2.Write();
    HLinearEEC3.Write();
-   HBinMin.Write();
-   HBinMax.Write();
-
-   OutputFile.Close();
-
-   return 0;
+   if(BN != nullptr)
+      for(BootstrapHistogram *B : {BN, BEEC2, BEEC3, BLinearEEC2, BLinearEEC3})
+         B->Write(Directory);
 }
 
 void DivideByBin(TH1D &H, double Bins[])
@@ -192,23 +467,3 @@ void DivideByBin(TH1D &H, double Bins[])
       H.SetBinError(i, H.GetBinError(i) / (R - L));
    }
 }
-
-int FindBin(double Value, int NBins, double Bins[])
-{
-   for(int i = 0; i < NBins; i++)
-      if(Value < Bins[i])
-         return i - 1;
-   return NBins;
-}
-
-double GetMax(vector<double> X)
-{
-   if(X.size() == 0)
-      return -1;
-
-   double Result = X[0];
-   for(int i = 1; i < X.size(); i++)
-      if(Result < X[i])
-         Result = X[i];
-   return Result;
-}
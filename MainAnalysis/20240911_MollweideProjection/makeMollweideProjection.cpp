@@ -38,6 +38,7 @@ int main(int argc, char *argv[])
 
 
    ParticleTreeMessenger* MGen = new ParticleTreeMessenger(InputFile, GenTreeName);
+   MGen->EnableCache();
    const int nBinsX = 200;
    const int nBinsY = 100;
    TH2D *hCMBplot = new TH2D("hCMBplot", "hCMBplotY", nBinsX, -TMath::Pi(), TMath::Pi(), nBinsY, -TMath::Pi()/2, TMath::Pi()/2);
@@ -149,6 +149,7 @@ int main(int argc, char *argv[])
 
    double TotalE = 91.1876;
    ParticleTreeMessenger MGenBefore(InputMC, GenBeforeTreeName); 
+   MGenBefore.EnableCache();
    int EntryCountBefore = MGenBefore.GetEntries();
    for(int iE = 0; iE < EntryCountBefore; iE++)
    {
@@ -27,6 +27,8 @@ using namespace std;
 #include "TauHelperFunctions3.h"
 #include "SetStyle.h"
 #include "EffCorrFactor.h"
+#include "RunMetadata.h"
+#include "ResultCache.h"
 
 int FindBin(double Value, int NBins, double Bins[]); 
 void MakeCanvasZ(vector<TH1D > Histograms, TGraphErrors DataSyst, vector<string> Labels, string Output, string X, string Y, double WorldMin, double WorldMax, bool DoRatio, bool LogX);
@@ -69,6 +71,9 @@ int main(int argc, char *argv[])
    // For tgenBefore comparison
    string InputMCPath            = CL.Get("InputMC", "../../Samples/ALEPHMC/LEP1MC1994_recons_aftercut-001.root");
    string GenBeforeTreeName      = CL.Get("GenBefore", "tgenBefore");
+   // file whose event count normalizes the data; read from its metadata, older files fall back to the tree
+   string NormalizationFileName  = CL.Get("Normalization", "/data/hbossi/PhysicsEEJetEEC/Unfolding/20240922_UnfoldingThetaZ/UnfoldingInputData_09232024.root");
+   string NormalizationTreeName  = CL.Get("NormalizationTree", "UnmatchedPairTree");
 
    TFile InputData(InputDataPath.c_str(), "READ");
    TH2D HDataBfCorr( *((TH2D*) InputData.Get(HistoName.c_str())) );
@@ -134,11 +139,8 @@ int main(int argc, char *argv[])
     
    }
 
-   // [Warning] JC: this is a quick hack to get the normalization, we would need to parse that normalization value
-  TString fnamesmeared = "/data/hbossi/PhysicsEEJetEEC/Unfolding/20240922_UnfoldingThetaZ/UnfoldingInputData_09232024.root";
-  TFile *inputsmeared =TFile::Open(fnamesmeared);
-  TTree *smeared=(TTree*)inputsmeared->Get("UnmatchedPairTree");
-  Int_t nEv=smeared->GetEntries();
+   double nEv = GetEventCount(NormalizationFileName, NormalizationTreeName);
+   printf("[INFO] normalizing to %.0f events from %s\n", nEv, NormalizationFileName.c_str());
 
    HDataBfCorr1D->Scale(1.0/nEv); 
    HDataAfCorr1D->Scale(1.0/nEv);
@@ -152,40 +154,58 @@ int main(int argc, char *argv[])
    TH1D HzMCGenBeforeRef("HzMCGenBeforeRef", "HzMCGenBeforeRef", 2 * BinCount, 0, 2 * BinCount); 
 
    double TotalE = 91.1876;
-   ParticleTreeMessenger MGenBefore(InputMC, GenBeforeTreeName); 
-   int EntryCountBefore = MGenBefore.GetEntries();
-   for(int iE = 0; iE < EntryCountBefore; iE++)
+   int EntryCountBefore = 0;
+
+   // the reference only depends on the MC file, the selection and the binning, so it is reused across runs
+   ResultCache Cache(CL, "CorrectionGenBeforeZ");
+   Cache.AddFile(InputMCPath);
+   Cache.Add("Tree", GenBeforeTreeName);
+   Cache.Add("Selection", "charge != 0 && highPurity");
+   Cache.Add("TotalE", TotalE);
+   Cache.Add("zBins", zBins, 2 * BinCount + 1);
+   Cache.Add("Version", "1");
+   Cache.AddResult(&HzMCGenBeforeRef);
+   Cache.AddResult("EntryCountBefore", EntryCountBefore);
+
+   if(Cache.Load() == false)
    {
-      MGenBefore.GetEntry(iE);
-      // fill the four vector
-      vector<FourVector> PGenBefore;
-      for(int i = 0; i < MGenBefore.nParticle; i++){
-        // charged particle selection 
-       if(MGenBefore.charge[i] == 0) continue;
-       if(MGenBefore.highPurity[i] == false) continue;
-         PGenBefore.push_back(MGenBefore.P[i]);
-      } // end loop over the particles 
-
-      // now calculate and fill the EECs
-      for(int i = 0; i < PGenBefore.size(); i++){
-        for(int j = i+1; j < PGenBefore.size();j++){
-            FourVector Gen1 = PGenBefore.at(i);
-            FourVector Gen2 = PGenBefore.at(j);
-
-            // get the proper bins
-            int BinThetaGen  = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
-            // int BinEnergyGen = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), EnergyBinCount, EnergyBins);
-            double zGen = (1-cos(GetAngle(Gen1,Gen2)))/2; 
-            int BinZGen = FindBin(zGen, 2*BinCount, zBins); 
-
-            // calculate the EEC
-            double EEC =  Gen1[0]*Gen2[0]/(TotalE*TotalE); 
+      ParticleTreeMessenger MGenBefore(InputMC, GenBeforeTreeName); 
+      MGenBefore.EnableCache();
+      EntryCountBefore = MGenBefore.GetEntries();
+      for(int iE = 0; iE < EntryCountBefore; iE++)
+      {
+         MGenBefore.GetEntry(iE);
+         // fill the four vector
+         vector<FourVector> PGenBefore;
+         for(int i = 0; i < MGenBefore.nParticle; i++){
+           // charged particle selection 
+          if(MGenBefore.charge[i] == 0) continue;
+          if(MGenBefore.highPurity[i] == false) continue;
+            PGenBefore.push_back(MGenBefore.P[i]);
+         } // end loop over the particles 
+
+         // now calculate and fill the EECs
+         for(int i = 0; i < PGenBefore.size(); i++){
+           for(int j = i+1; j < PGenBefore.size();j++){
+               FourVector Gen1 = PGenBefore.at(i);
+               FourVector Gen2 = PGenBefore.at(j);
+
+               // get the proper bins
+               int BinThetaGen  = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
+               // int BinEnergyGen = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), EnergyBinCount, EnergyBins);
+               double zGen = (1-cos(GetAngle(Gen1,Gen2)))/2; 
+               int BinZGen = FindBin(zGen, 2*BinCount, zBins); 
+
+               // calculate the EEC
+               double EEC =  Gen1[0]*Gen2[0]/(TotalE*TotalE); 
             
-            // fill the histograms
-            HzMCGenBeforeRef.Fill(BinZGen, EEC); 
+               // fill the histograms
+               HzMCGenBeforeRef.Fill(BinZGen, EEC); 
+            }
          }
-      }
-   } // end loop over the number of events
+      } // end loop over the number of events
+      Cache.Store();
+   }
    // EEC is per-event so scale by the event number
    HzMCGenBeforeRef.Scale(1.0/EntryCountBefore);
 
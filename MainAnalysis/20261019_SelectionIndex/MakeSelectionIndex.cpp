@@ -0,0 +1,174 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+using namespace std;
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "CommandLine.h"
+#include "ProgressBar.h"
+#include "Messenger.h"
+
+// Writes a compact per-event index for each particle tree, aligned 1:1 with the source entries.
+//    The index tree "<tree>Index" carries the event selection flags, the sphericity/thrust axis
+//    categories, the multiplicities, the total energy and the number of jets above 5 GeV.
+//    The run and event numbers are copied, so that readers can check that the index still belongs
+//    to the tree they attach it to.
+int main(int argc, char *argv[]);
+void EnableBranches(TTree *Tree, const vector<string> &Names);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   string InputFileName      = CL.Get("Input");
+   string OutputFileName     = CL.Get("Output", "Index.root");
+   vector<string> TreeNames  = CL.GetStringVector("Tree", vector<string>{"t", "tgen"});
+   vector<string> JetNames   = CL.GetStringVector("Jet", vector<string>{"akR4ESchemeJetTree", "akR4ESchemeGenJetTree"});
+   double MinJetE            = CL.GetDouble("MinJetE", 5);
+
+   if(JetNames.size() != TreeNames.size() && !(JetNames.size() == 1 && JetNames[0] == "None"))
+   {
+      cerr << "Error: number of jet trees (" << JetNames.size() << ") does not match number of particle trees ("
+         << TreeNames.size() << ")" << endl;
+      return -1;
+   }
+
+   TFile InputFile(InputFileName.c_str());
+   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+
+   for(int iT = 0; iT < (int)TreeNames.size(); iT++)
+   {
+      string TreeName = TreeNames[iT];
+      string JetName = (JetNames.size() == TreeNames.size()) ? JetNames[iT] : "None";
+
+      ParticleTreeMessenger MParticle(InputFile, TreeName);
+      if(MParticle.Tree == nullptr)
+      {
+         cerr << "Warning: tree " << TreeName << " not found in " << InputFileName << ", skipping" << endl;
+         continue;
+      }
+      // only decompress what the index needs
+      EnableBranches(MParticle.Tree, {"RunNo", "EventNo", "nParticle", "pmag", "pt", "eta", "phi", "mass",
+         "passesLEP1TwoPC", "passesSTheta", "passSphericity", "passesAll", "STheta", "TTheta",
+         "nChargedHadronsHP"});
+      MParticle.EnableCache();
+
+      JetTreeMessenger MJet;
+      if(JetName != "None")
+      {
+         MJet.Initialize((TTree *)InputFile.Get(JetName.c_str()));
+         if(MJet.Tree == nullptr)
+            cerr << "Warning: jet tree " << JetName << " not found, N5Jet will be set to -1" << endl;
+         else
+         {
+            EnableBranches(MJet.Tree, {"nref", "jtpt", "jteta", "jtphi", "jtm"});
+            MJet.EnableCache();
+         }
+      }
+
+      OutputFile.cd();
+      TTree IndexTree((TreeName + "Index").c_str(), ("Selection index for " + TreeName).c_str());
+
+      int RunNo, EventNo;
+      bool PassBaselineCut, passesLEP1TwoPC, passesSTheta, passesAll;
+      float STheta, TTheta, TotalE, SumP;
+      short SThetaCategory, TThetaCategory;
+      int nParticle, nChargedHadronsHP, N5Jet;
+      IndexTree.Branch("RunNo", &RunNo, "RunNo/I");
+      IndexTree.Branch("EventNo", &EventNo, "EventNo/I");
+      IndexTree.Branch("PassBaselineCut", &PassBaselineCut, "PassBaselineCut/O");
+      IndexTree.Branch("passesLEP1TwoPC", &passesLEP1TwoPC, "passesLEP1TwoPC/O");
+      IndexTree.Branch("passesSTheta", &passesSTheta, "passesSTheta/O");
+      IndexTree.Branch("passesAll", &passesAll, "passesAll/O");
+      IndexTree.Branch("STheta", &STheta, "STheta/F");
+      IndexTree.Branch("TTheta", &TTheta, "TTheta/F");
+      IndexTree.Branch("SThetaCategory", &SThetaCategory, "SThetaCategory/S");
+      IndexTree.Branch("TThetaCategory", &TThetaCategory, "TThetaCategory/S");
+      IndexTree.Branch("nParticle", &nParticle, "nParticle/I");
+      IndexTree.Branch("nChargedHadronsHP", &nChargedHadronsHP, "nChargedHadronsHP/I");
+      IndexTree.Branch("TotalE", &TotalE, "TotalE/F");
+      IndexTree.Branch("SumP", &SumP, "SumP/F");
+      IndexTree.Branch("N5Jet", &N5Jet, "N5Jet/I");
+
+      int EntryCount = MParticle.GetEntries();
+      long long BaselineCount = 0, SThetaCount = 0;
+      ProgressBar Bar(cout, EntryCount);
+      Bar.SetStyle(-1);
+
+      for(int iE = 0; iE < EntryCount; iE++)
+      {
+         Bar.Update(iE);
+         Bar.PrintIfDue();
+
+         MParticle.GetEntry(iE);
+
+         RunNo             = MParticle.RunNo;
+         EventNo           = MParticle.EventNo;
+         PassBaselineCut   = MParticle.PassBaselineCut();
+         passesLEP1TwoPC   = MParticle.passesLEP1TwoPC;
+         passesSTheta      = MParticle.passesSTheta;
+         passesAll         = MParticle.passesAll;
+         STheta            = MParticle.STheta;
+         TTheta            = MParticle.TTheta;
+         SThetaCategory    = (short)floor(STheta / (M_PI / 36));
+         TThetaCategory    = (short)floor(TTheta / (M_PI / 36));
+         nParticle         = MParticle.nParticle;
+         nChargedHadronsHP = MParticle.nChargedHadronsHP;
+
+         TotalE = 0;
+         SumP = 0;
+         for(int i = 0; i < MParticle.nParticle; i++)
+         {
+            TotalE = TotalE + MParticle.P[i][0];
+            SumP = SumP + MParticle.pmag[i];
+         }
+
+         N5Jet = -1;
+         if(MJet.Tree != nullptr)
+         {
+            MJet.GetEntry(iE);
+            N5Jet = 0;
+            for(int i = 0; i < MJet.nref; i++)
+               if(MJet.Jet[i][0] >= MinJetE)
+                  N5Jet = N5Jet + 1;
+         }
+
+         IndexTree.Fill();
+
+         if(PassBaselineCut == true)
+            BaselineCount = BaselineCount + 1;
+         if(PassBaselineCut == true && passesSTheta == true)
+            SThetaCount = SThetaCount + 1;
+      }
+
+      Bar.Update(EntryCount);
+      Bar.Print();
+      Bar.PrintLine();
+
+      cout << TreeName << ": " << EntryCount << " entries, " << BaselineCount << " pass baseline cut, "
+         << SThetaCount << " pass STheta" << endl;
+
+      MParticle.IO.PrintStatistics(cout, TreeName);
+
+      OutputFile.cd();
+      IndexTree.Write();
+   }
+
+   OutputFile.Close();
+   InputFile.Close();
+
+   return 0;
+}
+
+void EnableBranches(TTree *Tree, const vector<string> &Names)
+{
+   if(Tree == nullptr)
+      return;
+
+   Tree->SetBranchStatus("*", 0);
+   for(string Name : Names)
+      if(Tree->GetBranch(Name.c_str()) != nullptr)
+         Tree->SetBranchStatus(Name.c_str(), 1);
+}
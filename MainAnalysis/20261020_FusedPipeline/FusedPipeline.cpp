@@ -0,0 +1,537 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+using namespace std;
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TCanvas.h"
+#include "TEllipse.h"
+#include "TStyle.h"
+#include "TMath.h"
+#include "TVector3.h"
+
+#include "CommandLine.h"
+#include "ProgressBar.h"
+#include "Messenger.h"
+#include "EntryRange.h"
+#include "EECKernels.h"
+#include "EventPipeline.h"
+#include "RunMetadata.h"
+
+// Runs the per-file event loops of several analyses on one read of the input (see EventPipeline.h)
+//    --Modules GenZ,EvtSel,EEC,Mollweide     modules to run, in this order
+//    GenZ       the z EEC of HistogramFillerGen on --GenZ.Tree (tgen), written to --GenZ.Output
+//    EvtSel     the selected-event EEC histograms of makeEvtSel (Closure) on --EvtSel.Tree (tgen),
+//               before normalization, written to --EvtSel.Output; the plots stay in makeEvtSel
+//    EEC        the EEC2 / EEC3 of HistogramFiller straight from --EEC.Tree (t) with the cuts and weights
+//               of ReduceTree, written to --EEC.Output.  The reduced tree stores floats, so the sums
+//               agree with the two-step chain to float precision
+//    Mollweide  the thrust-frame energy map of makeMollweideProjection, drawn to a pdf
+//    Every ROOT output carries its own Metadata tree (RunMetadata.h) with the events its module saw.
+//    MatchEEC reads the same t and tgen entries but keeps its own loop for now; the pipeline can hold
+//    both trees, so it can be added as a module.
+class GenZModule : public PipelineModule
+{
+public:
+   string OutputFileName, TreeName;
+   bool IsSherpa;
+   ParticleSelection Selection;
+   double zBins[201];
+   TH1D HN, genUnmatched_z;
+   int nAcceptedEvents;
+   RunMetadata Metadata;
+   EventPipeline *Pipeline;
+public:
+   GenZModule(CommandLine &CL);
+   string Name() const {return "GenZ";}
+   void Begin(EventPipeline &pipeline);
+   void Event(PipelineEvent &Event);
+   void End();
+};
+
+class EvtSelModule : public PipelineModule
+{
+public:
+   string OutputFileName, TreeName;
+   ParticleSelection Selection;
+   double Bins[201], zBins[201], EnergyBins[101];
+   TH2D *h2_EvtSel_Theta, *h2_EvtSel_Z;
+   TH1D h1_EvtSel_Z, h1_EvtSel_Theta, HN, HNSTheta;
+   vector<int> lowerSThetaBounds, upperSThetaBounds;
+   vector<TH1D *> vec_h1_EvtSel_Z;
+   vector<int> nEventsMC;
+   RunMetadata Metadata;
+public:
+   EvtSelModule(CommandLine &CL);
+   ~EvtSelModule();
+   string Name() const {return "EvtSel";}
+   void Begin(EventPipeline &Pipeline);
+   void Event(PipelineEvent &Event);
+   void End();
+};
+
+class EECModule : public PipelineModule
+{
+public:
+   string OutputFileName, TreeName;
+   bool CheckCut, DoEENormalize, UseFullEnergy, Fast;
+   ParticleSelection Selection;
+   double Bins[201], LinearBins[201];
+   TH1D HN, HEEC2, HEEC3, HLinearEEC2, HLinearEEC3, HBinMin, HBinMax;
+   float NEvent;
+   RunMetadata Metadata;
+   EventPipeline *Pipeline;
+public:
+   EECModule(CommandLine &CL);
+   string Name() const {return "EEC";}
+   void Begin(EventPipeline &pipeline);
+   void Event(PipelineEvent &Event);
+   void End();
+};
+
+class MollweideModule : public PipelineModule
+{
+public:
+   string TreeName;
+   bool isLEP1;
+   ParticleSelection Selection;
+   TH2D hCMBplot;
+public:
+   MollweideModule(CommandLine &CL);
+   string Name() const {return "Mollweide";}
+   void Begin(EventPipeline &Pipeline);
+   void Event(PipelineEvent &Event);
+   void End();
+};
+
+int main(int argc, char *argv[]);
+void DivideByBin(TH1D &H, double Bins[]);
+void FillThetaBins(double Bins[], int BinCount);
+void FillZBins(double zBins[], int BinCount);
+double mollweideX(double lambda, double theta);
+double mollweideY(double theta);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   vector<string> ModuleNames = CL.GetStringVector("Modules", vector<string>{"GenZ", "EvtSel", "EEC", "Mollweide"});
+
+   vector<PipelineModule *> Modules;
+   for(string Name : ModuleNames)
+   {
+      if(Name == "GenZ")             Modules.push_back(new GenZModule(CL));
+      else if(Name == "EvtSel")      Modules.push_back(new EvtSelModule(CL));
+      else if(Name == "EEC")         Modules.push_back(new EECModule(CL));
+      else if(Name == "Mollweide")   Modules.push_back(new MollweideModule(CL));
+      else
+      {
+         cerr << "Unknown module " << Name << endl;
+         return -1;
+      }
+   }
+
+   EventPipeline Pipeline(CL);
+   for(PipelineModule *Module : Modules)
+      Pipeline.Add(Module);
+   bool Success = Pipeline.Run();
+
+   for(PipelineModule *Module : Modules)
+      delete Module;
+
+   return Success ? 0 : -1;
+}
+
+GenZModule::GenZModule(CommandLine &CL)
+   : HN("HN", ";;", 1, 0, 1), genUnmatched_z("genUnmatched_z", "genUnmatched_z", 200, 0, 200),
+     nAcceptedEvents(0), Pipeline(nullptr)
+{
+   OutputFileName = CL.Get("GenZ.Output", "GenZ.root");
+   TreeName       = CL.Get("GenZ.Tree", "tgen");
+   IsSherpa       = CL.GetBool("GenZ.IsSherpa", false);
+   Metadata       = StartRunMetadata(CL, {CL.Get("Input")});
+
+   // charged particle selection
+   Selection.Name = IsSherpa ? "Charge" : "ChargedFlag";
+   Selection.Charge = IsSherpa ? ParticleSelection::NonzeroCharge : ParticleSelection::ChargedFlag;
+
+   FillZBins(zBins, 100);
+   HN.SetDirectory(nullptr);
+   genUnmatched_z.SetDirectory(nullptr);
+}
+
+void GenZModule::Begin(EventPipeline &pipeline)
+{
+   Pipeline = &pipeline;
+   Pipeline->UseTree(TreeName);
+}
+
+void GenZModule::Event(PipelineEvent &Event)
+{
+   const double TotalE = 91.1876;   // GeV
+   nAcceptedEvents++;
+   Metadata.CountProcessed();
+   Metadata.CountSelected();
+
+   PipelineParticles &PGen = Event.Particles(TreeName, Selection);
+   for(int i = 0; i < PGen.N(); i++)
+   {
+      for(int j = i + 1; j < PGen.N(); j++)
+      {
+         // z histograms
+         double zGenUnmatched = (1 - cos(PGen.Angle(i, j))) / 2;
+         int BinZGen = FindBinLinear(zGenUnmatched, 200, zBins);
+         genUnmatched_z.Fill(BinZGen, PGen.P[i][0] * PGen.P[j][0] / (TotalE * TotalE));
+      }
+   }
+}
+
+void GenZModule::End()
+{
+   cout << "[GenZ] The number of accepted events is " << nAcceptedEvents << endl;
+   HN.SetBinContent(1, nAcceptedEvents);
+
+   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+   genUnmatched_z.Write();
+   HN.Write();
+   WriteEntryRange(&OutputFile, Pipeline->Range);
+   WriteRunMetadata(&OutputFile, Metadata);
+   OutputFile.Close();
+}
+
+EvtSelModule::EvtSelModule(CommandLine &CL)
+   : h1_EvtSel_Z("h1_EvtSel_Z", "h2_EvtSel_Z", 200, 0, 200),
+     h1_EvtSel_Theta("h1_EvtSel_Theta", "h2_EvtSel_Theta", 200, 0, 200),
+     HN("HN", ";;", 1, 0, 1),
+     HNSTheta("HNSTheta", ";S_{#theta} bin;pairs", 6, 0, 6),
+     lowerSThetaBounds{7, 11, 15, 19, 21, 25}, upperSThetaBounds{11, 15, 19, 21, 25, 29}
+{
+   OutputFileName = CL.Get("EvtSel.Output", "EvtSel.root");
+   TreeName       = CL.Get("EvtSel.Tree", "tgen");
+   Metadata       = StartRunMetadata(CL, {CL.Get("Input")});
+
+   // charged particle selection
+   Selection.Name = "ChargedHighPurity";
+   Selection.Charge = ParticleSelection::NonzeroCharge;
+   Selection.HighPurity = true;
+
+   const int BinCount = 100;
+   FillThetaBins(Bins, BinCount);
+   FillZBins(zBins, BinCount);
+   double logMin = std::log10(4e-6);
+   double logMax = std::log10(0.2);
+   double logStep = (logMax - logMin) / (BinCount);
+   for(int i = 0; i <= BinCount; i++)
+      EnergyBins[i] = std::pow(10, logMin + i * logStep);
+   h2_EvtSel_Theta = new TH2D("h2_EvtSel_Theta", "h2_EvtSel_Theta", 2 * BinCount, 0, 2 * BinCount, BinCount, EnergyBins);
+   h2_EvtSel_Z = new TH2D("h2_EvtSel_Z", "h2_EvtSel_Z", 2 * BinCount, 0, 2 * BinCount, BinCount, EnergyBins);
+
+   for(int j = 0; j < (int)lowerSThetaBounds.size(); j++)
+   {
+      vec_h1_EvtSel_Z.push_back(new TH1D(Form("h1_EvtSel_Z_%d", j), Form("h1_EvtSel_Z_%d", j), 2 * BinCount, 0, 2 * BinCount));
+      nEventsMC.push_back(0);
+   }
+
+   for(TH1 *H : {(TH1 *)h2_EvtSel_Theta, (TH1 *)h2_EvtSel_Z, (TH1 *)&h1_EvtSel_Z, (TH1 *)&h1_EvtSel_Theta, (TH1 *)&HN, (TH1 *)&HNSTheta})
+      H->SetDirectory(nullptr);
+   for(TH1D *H : vec_h1_EvtSel_Z)
+      H->SetDirectory(nullptr);
+}
+
+EvtSelModule::~EvtSelModule()
+{
+   delete h2_EvtSel_Theta;
+   delete h2_EvtSel_Z;
+   for(TH1D *H : vec_h1_EvtSel_Z)
+      delete H;
+}
+
+void EvtSelModule::Begin(EventPipeline &Pipeline)
+{
+   Pipeline.UseTree(TreeName);
+}
+
+void EvtSelModule::Event(PipelineEvent &Event)
+{
+   const int BinCount = 100;
+   const double TotalE = 91.1876;
+
+   ParticleTreeMessenger &MGen = Event.Tree(TreeName);
+   PipelineParticles &PGen = Event.Particles(TreeName, Selection);
+   HN.Fill(0.5);
+   Metadata.CountProcessed();
+   Metadata.CountSelected();
+
+   // now calculate and fill the EECs
+   for(int i = 0; i < PGen.N(); i++)
+   {
+      for(int j = i + 1; j < PGen.N(); j++)
+      {
+         FourVector &Gen1 = PGen.P[i];
+         FourVector &Gen2 = PGen.P[j];
+         double Angle = PGen.Angle(i, j);
+
+         // get the proper bins
+         int BinThetaGen  = FindBinLinear(Angle, 2 * BinCount, Bins);
+         int BinEnergyGen = FindBinLinear(Gen1[0] * Gen2[0] / (TotalE * TotalE), BinCount, EnergyBins);
+         double zGen = (1 - cos(Angle)) / 2;
+         int BinZGen = FindBinLinear(zGen, 2 * BinCount, zBins);
+
+         // calculate the EEC
+         double EEC = Gen1[0] * Gen2[0] / (TotalE * TotalE);
+
+         // fill the histograms
+         h2_EvtSel_Theta->Fill(BinThetaGen, BinEnergyGen, EEC);
+         h2_EvtSel_Z->Fill(BinZGen, BinEnergyGen, EEC);
+         h1_EvtSel_Z.Fill(BinZGen, EEC);
+         h1_EvtSel_Theta.Fill(BinThetaGen, EEC);
+
+         // the sphericity-binned copies; the counters go up per pair, as in makeEvtSel
+         for(int k = 0; k < (int)lowerSThetaBounds.size(); k++)
+         {
+            if(MGen.STheta >= (lowerSThetaBounds[k] * M_PI) / 36 && MGen.STheta <= (upperSThetaBounds[k] * M_PI) / 36)
+            {
+               vec_h1_EvtSel_Z[k]->Fill(BinZGen, EEC);
+               nEventsMC[k] = nEventsMC[k] + 1;
+            }
+         }
+      }
+   }
+}
+
+void EvtSelModule::End()
+{
+   for(int k = 0; k < (int)nEventsMC.size(); k++)
+      HNSTheta.SetBinContent(k + 1, nEventsMC[k]);
+
+   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+   h2_EvtSel_Theta->Write();
+   h2_EvtSel_Z->Write();
+   h1_EvtSel_Z.Write();
+   h1_EvtSel_Theta.Write();
+   for(TH1D *H : vec_h1_EvtSel_Z)
+      H->Write();
+   HN.Write();
+   HNSTheta.Write();
+   WriteRunMetadata(&OutputFile, Metadata);
+   OutputFile.Close();
+}
+
+EECModule::EECModule(CommandLine &CL)
+   : HN("HN", ";;", 1, 0, 1),
+     HEEC2("HEEC2", ";EEC_{2};", 200, 0, 200),
+     HEEC3("HEEC3", ";EEC_{3};", 200, 0, 200),
+     HLinearEEC2("HLinearEEC2", ";EEC_{2};", 200, 0, 200),
+     HLinearEEC3("HLinearEEC3", ";EEC_{3};", 200, 0, 200),
+     HBinMin("HBinMin", ";EEC;BinMin", 200, 0, 200),
+     HBinMax("HBinMax", ";EEC;BinMax", 200, 0, 200),
+     NEvent(0), Pipeline(nullptr)
+{
+   OutputFileName = CL.Get("EEC.Output", "EEC.root");
+   TreeName       = CL.Get("EEC.Tree", "t");
+   CheckCut       = CL.GetBool("EEC.CheckCut", true);
+   DoEENormalize  = CL.GetBool("EEC.EENormalize", true);
+   UseFullEnergy  = CL.GetBool("EEC.UseFullEnergy", true);
+   Fast           = CL.GetBool("FastKernels", false);
+   Metadata       = StartRunMetadata(CL, {CL.Get("Input")});
+
+   // ReduceTree keeps high-purity charged tracks inside MinTheta, HistogramFiller cuts on E and pT
+   Selection.Name = "EEC";
+   Selection.Charge = ParticleSelection::NonzeroCharge;
+   Selection.HighPurity = true;
+   Selection.MinTheta = CL.GetDouble("EEC.MinTheta", 0.35);   // cos(0.35) = 0.94
+   Selection.MinE = CL.GetDouble("EEC.MinParticleE", 0);
+   Selection.MinPT = CL.GetDouble("EEC.MinParticlePT", 0.2);
+   Selection.EfficiencyWeight = CL.GetBool("EEC.DoWeight", false);
+
+   const int BinCount = 100;
+   FillThetaBins(Bins, BinCount);
+   for(int i = 0; i <= 2 * BinCount; i++)
+      LinearBins[i] = M_PI / (2 * BinCount) * i;
+   HLinearEEC2.SetBins(2 * BinCount, LinearBins);
+   HLinearEEC3.SetBins(2 * BinCount, LinearBins);
+
+   for(int i = 0; i < 2 * BinCount; i++)
+   {
+      HBinMin.SetBinContent(i + 1, Bins[i]);
+      HBinMax.SetBinContent(i + 1, Bins[i+1]);
+   }
+
+   for(TH1D *H : {&HN, &HEEC2, &HEEC3, &HLinearEEC2, &HLinearEEC3, &HBinMin, &HBinMax})
+      H->SetDirectory(nullptr);
+   for(TH1D *H : {&HEEC2, &HEEC3, &HLinearEEC2, &HLinearEEC3})
+      H->SetStats(0);
+}
+
+void EECModule::Begin(EventPipeline &pipeline)
+{
+   Pipeline = &pipeline;
+   Pipeline->UseTree(TreeName);
+}
+
+void EECModule::Event(PipelineEvent &Event)
+{
+   const int BinCount = 100;
+
+   Metadata.CountProcessed();
+   if(CheckCut == true && Event.Tree(TreeName).PassBaselineCut() == false)
+      return;
+   NEvent = NEvent + 1;
+   Metadata.CountSelected();
+
+   PipelineParticles &Particles = Event.Particles(TreeName, Selection);
+   vector<FourVector> &P = Particles.P;
+   vector<double> &W = Particles.Weight;
+
+   double TotalE = 0;
+   for(int i = 0; i < Particles.N(); i++)
+      TotalE = TotalE + P[i][0];
+   if(UseFullEnergy == true)
+      TotalE = 91.1876;
+
+   double TotalE2 = DoEENormalize ? (TotalE  * TotalE) : 1;
+   double TotalE3 = DoEENormalize ? (TotalE2 * TotalE) : 1;
+
+   EECPairLoop(Fast, P, BinCount * 2, Bins,
+      [&](int i1, int i2, double Max2, int Bin2)
+      {
+         HEEC2.Fill(Bin2, P[i1][0] * P[i2][0] / TotalE2 * W[i1] * W[i2]);
+         HLinearEEC2.Fill(Max2, P[i1][0] * P[i2][0] / TotalE2 * W[i1] * W[i2]);
+      },
+      [&](int i1, int i2, int i3, double Max3, int Bin3)
+      {
+         HEEC3.Fill(Bin3, P[i1][0] * P[i2][0] * P[i3][0] / TotalE3 * W[i1] * W[i2] * W[i3]);
+         HLinearEEC3.Fill(Max3, P[i1][0] * P[i2][0] * P[i3][0] / TotalE3 * W[i1] * W[i2] * W[i3]);
+      });
+}
+
+void EECModule::End()
+{
+   HN.SetBinContent(1, NEvent);
+   DivideByBin(HEEC2, Bins);
+   DivideByBin(HEEC3, Bins);
+   DivideByBin(HLinearEEC2, LinearBins);
+   DivideByBin(HLinearEEC3, LinearBins);
+
+   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+   HN.Write();
+   HEEC2.Write();
+   HEEC3.Write();
+   HLinearEEC2.Write();
+   HLinearEEC3.Write();
+   HBinMin.Write();
+   HBinMax.Write();
+   WriteEntryRange(&OutputFile, Pipeline->Range);
+   WriteRunMetadata(&OutputFile, Metadata);
+   OutputFile.Close();
+}
+
+MollweideModule::MollweideModule(CommandLine &CL)
+   : hCMBplot("hCMBplot", "hCMBplotY", 200, -TMath::Pi(), TMath::Pi(), 100, -TMath::Pi()/2, TMath::Pi()/2)
+{
+   TreeName = CL.Get("Mollweide.Tree", "tgen");
+   isLEP1   = CL.GetBool("Mollweide.DoLEP1", true);
+
+   // charged particle selection
+   Selection.Name = "ChargedHighPurity";
+   Selection.Charge = ParticleSelection::NonzeroCharge;
+   Selection.HighPurity = true;
+
+   hCMBplot.SetDirectory(nullptr);
+}
+
+void MollweideModule::Begin(EventPipeline &Pipeline)
+{
+   Pipeline.UseTree(TreeName);
+}
+
+void MollweideModule::Event(PipelineEvent &Event)
+{
+   ParticleTreeMessenger &MGen = Event.Tree(TreeName);
+   PipelineParticles &PGen = Event.Particles(TreeName, Selection);
+   for(int iP = 0; iP < PGen.N(); iP++)
+   {
+      int i = PGen.Index[iP];
+      TVector3 thrustVec;
+      thrustVec.SetPtEtaPhi(MGen.pt_wrtThrMissP[i], MGen.eta_wrtThrMissP[i], MGen.phi_wrtThrMissP[i]);
+      double px = thrustVec.Px();
+      double py = thrustVec.Py();
+      double pz = thrustVec.Pz();
+      double lambda = TMath::ATan2(py, px);   // Azimuthal angle (longitude)
+      double r = TMath::Sqrt(px * px + py * py + pz * pz);
+      double theta = TMath::ASin(pz / r);     // latitude
+      hCMBplot.Fill(mollweideX(lambda, theta), mollweideY(theta), PGen.P[iP][0]);   // Using energy as the weight
+   }
+}
+
+void MollweideModule::End()
+{
+   gStyle->SetOptStat(0);
+   gStyle->SetPalette(kTemperatureMap);
+
+   TCanvas Canvas("canvas", "CMB Mollweide Plot", 1000, 500);
+   Canvas.SetFillColor(1);
+   Canvas.SetLogz();
+
+   // Draw the histogram with the Mollweide projection
+   hCMBplot.GetZaxis()->SetLabelColor(kWhite);
+   hCMBplot.Draw("COLZ");
+
+   // Create an ellipse to outline the Mollweide projection
+   TEllipse Ellipse(0, 0, TMath::Pi(), TMath::Pi()/2);
+   Ellipse.SetFillStyle(0);
+   Ellipse.SetLineColor(kWhite);
+   Ellipse.SetLineWidth(2);
+   Ellipse.Draw();
+
+   Canvas.SaveAs(isLEP1 ? "EEC_MollweidePlot_LEP1.pdf" : "EEC_MollweidePlot_LEP2.pdf");
+}
+
+void DivideByBin(TH1D &H, double Bins[])
+{
+   int N = H.GetNbinsX();
+   for(int i = 1; i <= N; i++)
+   {
+      double L = Bins[i-1];
+      double R = Bins[i];
+      H.SetBinContent(i, H.GetBinContent(i) / (R - L));
+      H.SetBinError(i, H.GetBinError(i) / (R - L));
+   }
+}
+
+// theta double log binning
+void FillThetaBins(double Bins[], int BinCount)
+{
+   double BinMin = 0.002;
+   double BinMax = M_PI / 2;
+   for(int i = 0; i <= BinCount; i++)
+   {
+      Bins[i] = exp(log(BinMin) + (log(BinMax) - log(BinMin)) / BinCount * i);
+      Bins[2*BinCount-i] = BinMax * 2 - exp(log(BinMin) + (log(BinMax) - log(BinMin)) / BinCount * i);
+   }
+}
+
+// z double log binning
+void FillZBins(double zBins[], int BinCount)
+{
+   double zBinMin = (1 - cos(0.002)) / 2;
+   double zBinMax = 0.5;
+   for(int i = 0; i <= BinCount; i++)
+   {
+      zBins[i] = exp(log(zBinMin) + (log(zBinMax) - log(zBinMin)) / BinCount * i);
+      zBins[2*BinCount-i] = zBinMax * 2 - exp(log(zBinMin) + (log(zBinMax) - log(zBinMin)) / BinCount * i);
+   }
+}
+
+double mollweideX(double lambda, double theta)
+{
+   return 2 * sqrt(2) * lambda * TMath::Cos(theta) / (TMath::Pi());
+}
+
+double mollweideY(double theta)
+{
+   return sqrt(2) * TMath::Sin(theta);
+}
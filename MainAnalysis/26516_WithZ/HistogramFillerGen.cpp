@@ -8,8 +8,10 @@ using namespace std;
 
 #include "Messenger.h"
 #include "CommandLine.h"
+#include "EntryRange.h"
 #include "Matching.h"
 #include "ProgressBar.h"
+#include "RunMetadata.h"
 #include "TauHelperFunctions3.h"
 #include "alephTrkEfficiency.h"
 
@@ -38,6 +40,8 @@ int main(int argc, char *argv[])
    TFile* InputFile  = new TFile(InputFileName.c_str());
    TFile* OutputFile = new TFile(OutputFileName.c_str(), "RECREATE");
 
+   RunMetadata Metadata = StartRunMetadata(CL, {InputFileName});
+
  
 
    // z binning
@@ -56,20 +60,24 @@ int main(int argc, char *argv[])
    // double log binning
    TH1D* genUnmatched_z = new TH1D("genUnmatched_z", "genUnmatched_z", 2 * BinCount, 0, 2 * BinCount);
    ParticleTreeMessenger* MGen = new ParticleTreeMessenger(InputFile, GenTreeName);
+   MGen->EnableCache();
    TH1D HN("HN", ";;", 1, 0, 1);
 
-   int EntryCount = MGen->GetEntries() * Fraction;
+   EntryRange Range = GetEntryRange(CL, MGen->Tree, InputFileName, Fraction);
+   int EntryCount = Range.Size();
    ProgressBar Bar(cout, EntryCount);
    Bar.SetStyle(-1); 
    int nAcceptedEvents = 0; 
    double TotalE = 91.1876; // GeV
-   for(int iE = 0; iE < EntryCount; iE++) 
+   for(int iE = Range.First(); iE < Range.End; iE = Range.Next(iE)) 
    {
 
       MGen->GetEntry(iE);
+      Metadata.CountProcessed();
 
 
       nAcceptedEvents++; 
+      Metadata.CountSelected();
 
       vector<FourVector> PGen;
       for(int i = 0; i < MGen->nParticle; i++){
@@ -104,6 +112,8 @@ int main(int argc, char *argv[])
    OutputFile->cd();
    genUnmatched_z->Write();
    HN.Write(); 
+   WriteEntryRange(OutputFile, Range);
+   WriteRunMetadata(OutputFile, Metadata);
    OutputFile->Close();
    InputFile->Close();
 
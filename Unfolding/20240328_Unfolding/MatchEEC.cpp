@@ -14,37 +14,178 @@ using namespace std;
 
 #include "Messenger.h"
 #include "CommandLine.h"
+#include "EntryRange.h"
+#include "Checkpoint.h"
+#include "RunMetadata.h"
 #include "Matching.h"
 #include "ProgressBar.h"
+#include "Timeline.h"
 #include "TauHelperFunctions3.h"
 #include "alephTrkEfficiency.h"
+#include "AsyncTreeWriter.h"
+#include "Quantization.h"
+#include "EECKernels.h"
 
 #include "TCanvas.h"
 #include "TH1D.h"
+#include "TH2D.h"
 #include "TF1.h"
 #include "TLatex.h"
 
 #define MAX 1000
 #define MAXPAIR 10000
 
+// Measured / truth / response / fake / miss histograms for one unfolding observable,
+// plus the split-MC copies: half A fills measured and truth, half B fills response, fakes and misses.
+// Measured and truth hold the matched entries only, like the response, so that they can be unfolded
+// with it directly; the fakes and misses are kept apart in Fake and Miss
+class ResponseHistograms
+{
+public:
+   TH1D Smeared, Gen, Fake, Miss;
+   TH2D Resp;
+   TH1D Smeared_SplitMC, Gen_SplitMC, Fake_SplitMC, Miss_SplitMC;
+   TH2D Resp_SplitMC;
+public:
+   ResponseHistograms(string Prefix, const vector<double> &RecoBins, const vector<double> &GenBins);
+   vector<TH1 *> AllHistograms();
+   void FillMatched(double Reco, double Gen, bool HalfA);
+   void FillFake(double Reco, bool HalfA);
+   void FillMiss(double Gen, bool HalfA);
+   void Write(TDirectory *Directory);
+};
+
+// Single-track resolution histograms and matching efficiency / fake rate counters,
+// accumulated in the matching loop; the fits and plots are done in Write
+class MatchingPerformanceHistograms
+{
+public:
+   TH1D trkChi2Tot, trkChiTheta, trkChiPhi, trkChiE;
+   TH1D trkDeltaTheta[5], trkDeltaPhi[5], trkDeltaE[5], trkDeltaP[5];   // inclusive, then reco energy categories
+   TH2D trkDeltaThetaVsMult, trkDeltaPhiVsMult, trkDeltaEOverEVsMult;
+   TH2D trkDeltaThetaVsTheta, trkDeltaPhiVsTheta, trkDeltaEOverEVsTheta;
+   int nGenTracks, nRecoTracks;
+   int nMatchedTracks[5], nUnmatchedTracks[5];   // no cutoff, then distance cutoff 1.0, 0.4, 0.2, 0.1
+   int nMatchedTracksInOneEvent[5];
+public:
+   MatchingPerformanceHistograms();
+   vector<TH1 *> AllHistograms();
+   void FillTracks(int schemeChoice, const map<int, int> &Matching, const vector<FourVector> &PGen,
+      const vector<FourVector> &PReco, int Multiplicity);
+   template <class Scheme> void FillTracks(const map<int, int> &Matching, const vector<FourVector> &PGen,
+      const vector<FourVector> &PReco, int Multiplicity);
+   template <class Scheme> void FillTrack(FourVector &Gen, FourVector &Reco, int Multiplicity);
+   void EndEvent(int nGenHP, int nRecoHP);
+   void Write(string matchedRstRootName, string rstDirName);
+};
+
+// Everything that depends on the matching scheme, one output file per scheme
+struct MatchingOutput
+{
+   int Scheme;
+   string DirName;
+   string FileName;
+   AsyncOutputFile *Output;
+   AsyncTreeWriter *MatchedTree, *PairTree, *UnmatchedTree;
+   TH1D *recoMatched, *genMatched, *recoMatched_z, *genMatched_z, *e1e2RecoMatched, *e1e2GenMatched;
+   ResponseHistograms *hTrackPt, *hDeltaR, *hE1E2;
+   MatchingPerformanceHistograms *Performance;
+};
+
+// Matching schemes as compile-time policies, each providing the chi(theta, phi, E) assignment
+//    1: 10% energy as resolution, flat theta and phi resolutions
+//    2: resolutions are cast according to ALEPH tracker performance (energy-dependent description)
+//    3: scale btw the importance of angular-match versus energy-match ( 5x)
+//    4: scale btw the importance of angular-match versus energy-match (15x)
+struct MatchingSchemeFlat
+{
+   static void Chi(double deltaTheta, double deltaPhi, double deltaE, double meanE,
+      double &chiTheta, double &chiPhi, double &chiE)
+   {
+      double phiRes  = 0.002; // somewhere in the ballpark of 0.002-0.005
+      double Eres    = 0.1*meanE; // use 10% energy resolution //0.85/sqrt(meanE); // take energy resolution based on the mean energy
+      double AngleRes= (0.01*0.01); // take angular resolution based on the detector resolution
+      chiTheta       = deltaTheta/AngleRes;
+      chiPhi         = deltaPhi  /phiRes;
+      chiE           = deltaE    /Eres;
+   }
+};
+
+template <int scaleFactorE>
+struct MatchingSchemeALEPH
+{
+   static void Chi(double deltaTheta, double deltaPhi, double deltaE, double meanE,
+      double &chiTheta, double &chiPhi, double &chiE)
+   {
+      double scaleFactorTheta = 2.8; // sigma(rz)   = 28 µm
+      double scaleFactorPhi   = 2.3; // sigma(rphi) = 23 µm
+      double sigmaDelta = 25e-6 + 95e-6 / meanE;
+      double sigmaTheta = sigmaDelta / 6e-2     // inner vertex detector radius
+                        * scaleFactorTheta;     // considering the projection (average) of minimal distance to the r-z
+      double sigmaPhi   = sigmaDelta / 6e-2     // inner vertex detector radius 
+                        * scaleFactorPhi;       // considering the projection (average) of minimal distance to the r-z
+      double sigmaE = TMath::Sqrt( (6e-4*meanE)*(6e-4*meanE) + 0.005 * 0.005 ) * meanE 
+                        * scaleFactorE;
+      chiTheta       = deltaTheta/sigmaTheta;
+      chiPhi         = deltaPhi  /sigmaPhi;
+      chiE           = deltaE    /sigmaE;
+   }
+};
+
+typedef MatchingSchemeFlat      MatchingScheme1;
+typedef MatchingSchemeALEPH<1>  MatchingScheme2;
+typedef MatchingSchemeALEPH<5>  MatchingScheme3;
+typedef MatchingSchemeALEPH<15> MatchingScheme4;
+
+// the matching metric for a given scheme, passed by value to the matching so it can be inlined
+//    Chi2 gives the components as well, for the single-track resolution histograms
+template <class Scheme>
+struct MatchingMetric
+{
+   static double Chi2(double deltaTheta, double deltaPhi, double deltaE, double meanE,
+      double &chiTheta, double &chiPhi, double &chiE)
+   {
+      Scheme::Chi(deltaTheta, deltaPhi, deltaE, meanE, chiTheta, chiPhi, chiE);
+      return chiTheta*chiTheta + chiPhi*chiPhi + chiE*chiE;
+   }
+   double operator()(const FourVector &A, const FourVector &B) const
+   {
+      double Angle = GetAngle(A,B);
+      double dPhi = GetDPhi(A,B); 
+      double Ediff = (A[0] - B[0]);
+      double meanE = (A[0] + B[0])/2;  
+
+      double chiTheta, chiPhi, chiE;
+      return Chi2(Angle, dPhi, Ediff, meanE, chiTheta, chiPhi, chiE);
+   }
+};
+
+// the same metric from the cached sizes and azimuths, for --FastKernels
+template <class Scheme>
+struct FastMatchingMetric
+{
+   double operator()(const MatchingTrack &A, const MatchingTrack &B) const
+   {
+      double Angle = PairAngle(A.X * B.X + A.Y * B.Y + A.Z * B.Z, A.P, B.P);
+      double dPhi = A.Phi - B.Phi;
+      if(dPhi > M_PI)
+         dPhi = 2 * M_PI - dPhi;
+      if(dPhi < -M_PI)
+         dPhi = dPhi + 2 * M_PI;
+      double Ediff = (A.E - B.E);
+      double meanE = (A.E + B.E)/2;
+
+      double chiTheta, chiPhi, chiE;
+      Scheme::Chi(Angle, dPhi, Ediff, meanE, chiTheta, chiPhi, chiE);
+      return chiTheta*chiTheta + chiPhi*chiPhi + chiE*chiE;
+   }
+};
+
 int main(int argc, char *argv[]);
 double MetricAngle(FourVector A, FourVector B);
-
-// [Warning] A global variable used in *this* cpp script! //
-int MatchingSchemeChoice = 2;
-double MatchingMetricCore( double deltaTheta, double deltaPhi, double deltaE,
-                           double meanE,     // the average btw the GenE and RecoE,
-                                             // this would be used to model the energy-dependency in the resolution assignment
-                           int schemeChoice, // 1: 10% energy as resolution, flat theta and phi resolutions
-                                             // 2: resolutions are cast according to ALEPH tracker performance (energy-dependent description)
-                                             // 3: scale btw the importance of angular-match versus energy-match ( 5x)
-                                             // 4: scale btw the importance of angular-match versus energy-match (15x)
-                           double& chiTheta, double& chiPhi, double& chiE);
-double MatchingMetric(FourVector A, FourVector B);
-int FindBin(double Value, int NBins, double Bins[]); 
-void MatchingPerformance(string& matchedRstRoot, string& rstDirName,
-                         ParticleTreeMessenger& MGen,
-                         ParticleTreeMessenger& MReco);
+map<int, int> MatchWithScheme(int schemeChoice, const vector<FourVector> &PGen, const vector<FourVector> &PReco);
+map<int, int> MatchWithSchemeFast(int schemeChoice, const vector<MatchingTrack> &PGen, const vector<MatchingTrack> &PReco);
+bool IsSplitHalfA(int RunNo, int EventNo);
 
 int main(int argc, char *argv[])
 {
@@ -55,8 +196,17 @@ int main(int argc, char *argv[])
    string RecoTreeName   = CL.Get("Reco", "t");
    string OutputFileName = CL.Get("Output");
    double Fraction       = CL.GetDouble("Fraction", 1.00);
-   // [Warning] A global variable used in *this* cpp script! //
-   MatchingSchemeChoice  = CL.GetInt("MatchingSchemeChoice", 2);
+   bool FillResponse     = CL.GetBool("FillResponse", false);
+   int MatchingSchemeChoice = CL.GetInt("MatchingSchemeChoice", 2);
+   bool AllSchemes       = CL.GetBool("AllSchemes", false);   // match with all four schemes in one pass
+   AsyncTreeWriterOptions MatchedTreeOptions   = GetAsyncTreeWriterOptions(CL, "MatchedTree");
+   AsyncTreeWriterOptions PairTreeOptions      = GetAsyncTreeWriterOptions(CL, "PairTree");
+   AsyncTreeWriterOptions UnmatchedTreeOptions = GetAsyncTreeWriterOptions(CL, "UnmatchedTree");
+   string Format         = CL.Get("Format", "TTree");   // TTree or RNTuple
+   string ProgressJSON   = CL.Get("ProgressJSON", "");   // throughput summary, not written if empty
+   string TimelineFileName = CL.Get("Timeline", "");     // trace-event JSON of the stages, off if empty
+   Quantization Q(CL);   // momenta only: the angles of unmatched entries are NaN, which fixed point cannot hold
+   KernelValidator Validator(CL);   // --FastKernels, --Validate
 
    if (MatchingSchemeChoice!=1 &&
        MatchingSchemeChoice!=2 &&
@@ -66,14 +216,26 @@ int main(int argc, char *argv[])
       printf("MatchingSchemeChoice %d not supported. Exiting\n", MatchingSchemeChoice);
       exit(1);
    }
-   string rstDirName     = (MatchingSchemeChoice==1)? "matchingScheme1/":
-                           (MatchingSchemeChoice==2)? "matchingScheme2/":
-                           (MatchingSchemeChoice==3)? "matchingScheme3/": "matchingScheme4/";
-   system(("mkdir -p "+rstDirName).c_str());
-   OutputFileName = rstDirName + OutputFileName;
+
+   Timeline::Start(TimelineFileName);
+
+   vector<int> Schemes;
+   if(AllSchemes == true)
+      Schemes = {1, 2, 3, 4};
+   else
+      Schemes = {MatchingSchemeChoice};
 
    TFile InputFile(InputFileName.c_str());
-   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+
+   // one output file per scheme, in matchingSchemeN/
+   vector<MatchingOutput> Outputs(Schemes.size());
+   for(int iS = 0; iS < (int)Schemes.size(); iS++)
+   {
+      Outputs[iS].Scheme = Schemes[iS];
+      Outputs[iS].DirName = "matchingScheme" + to_string(Schemes[iS]) + "/";
+      Outputs[iS].FileName = Outputs[iS].DirName + OutputFileName;
+      system(("mkdir -p " + Outputs[iS].DirName).c_str());
+   }
 
    //------------------------------------
    // define the binning
@@ -112,17 +274,6 @@ int main(int argc, char *argv[])
       //std::cout << "Adding energy bin " << EnergyBins[i] << std::endl;
    }
 
-   //------------------------------------
-   // define the trees
-   //------------------------------------
-
-   // tree for single track matching
-   TTree OutputTree("MatchedTree", "");
-   // tree for matched pairs
-   TTree OutputPairTree("PairTree", "");
-   // tree that just takes pairs, not matching taken into account
-   TTree OutputUnmatchedTree("UnmatchedPairTree", ""); 
-
    //------------------------------------
    // define the histograms
    //------------------------------------
@@ -131,23 +282,31 @@ int main(int argc, char *argv[])
    // as a function of theta
    TH1D recoUnmatched("recoUnmatched", "recoUnmatched", 2 * BinCount, 0, 2 * BinCount);
    TH1D genUnmatched("genUnmatched", "genUnmatched", 2 * BinCount, 0, 2 * BinCount);
-   TH1D recoMatched("recoMatched", "recoMatched", 2 * BinCount, 0, 2 * BinCount);
-   TH1D genMatched("genMatched", "genMatched", 2 * BinCount, 0, 2 * BinCount);
 
    // as a function of z
    TH1D recoUnmatched_z("recoUnmatched_z", "recoUnmatched_z", 2 * BinCount, 0, 2 * BinCount);
    TH1D genUnmatched_z("genUnmatched_z", "genUnmatched_z", 2 * BinCount, 0, 2 * BinCount);
-   TH1D recoMatched_z("recoMatched_z", "recoMatched_z", 2 * BinCount, 0, 2 * BinCount);
-   TH1D genMatched_z("genMatched_z", "genMatched_z", 2 * BinCount, 0, 2 * BinCount);
 
    // as a function of e1e2   
    TH1D e1e2RecoUnmatched("e1e2RecoUnmatched", "e1e2RecoUnmatched", BinCount, EnergyBins); 
-   TH1D e1e2RecoMatched("e1e2RecoMatched", "e1e2RecoMatched", BinCount, EnergyBins); 
    TH1D e1e2GenUnmatched("e1e2GenUnmatched", "e1e2GenUnmatched", BinCount, EnergyBins); 
-   TH1D e1e2GenMatched("e1e2GenMatched", "e1e2GenMatched", BinCount, EnergyBins); 
+
+   // the scheme-independent histograms are written into every output file
+   for(TH1D *H : {&recoUnmatched, &genUnmatched, &recoUnmatched_z, &genUnmatched_z, &e1e2RecoUnmatched, &e1e2GenUnmatched})
+      H->SetDirectory(nullptr);
+
+   // unfolding inputs, same binning as createUnfoldingHistograms.C
+   vector<double> trackPtBinsReco = {0.2, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 16, 18, 20, 25, 30, 40};
+   vector<double> trackPtBinsGen = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 16, 18, 20, 25, 30, 40, 50};
+   vector<double> deltaRBinsReco = {0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1, 1.1, 1.2, 1.3, 1.4, 1.5,1.6, 1.7, 1.8, 1.9, 2.0, 2.1, 2.2, 2.3, 2.4, 2.5, 2.6, 2.7, 2.8, 2.9};
+   vector<double> deltaRBinsGen = {0.0, 0.1,0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1, 1.1, 1.2, 1.3, 1.4, 1.5,1.6, 1.7, 1.8, 1.9, 2.0, 2.1, 2.2, 2.3, 2.4, 2.5, 2.6, 2.7, 2.8, 2.9, 3.0, 3.1};
+   vector<double> e1e2BinsReco = {1.0,10.0, 20.0, 50, 100,  200, 300, 500};
+   vector<double> e1e2BinsGen = {0.1,1.0,10.0, 20.0, 50, 100, 200, 300, 500, 700};
 
 
    alephTrkEfficiency efficiencyCorrector;
+   EfficiencyTable FastEfficiency(efficiencyCorrector._heff);
+   auto FindBin = Validator.Fast ? FindBinSorted : FindBinLinear;   // the binning of all the histograms below
    // variables for the matched tree
    int NParticle, eventID; 
    double GenE[MAX], GenX[MAX], GenY[MAX], GenZ[MAX];
@@ -157,31 +316,6 @@ int main(int argc, char *argv[])
    int RecoPWFlag[MAX];
    double GenEta[MAX], GenPhi[MAX], GenTheta[MAX], GenRapidity[MAX];
    double RecoEfficiency[MAX];
-   OutputTree.Branch("EventID", &eventID, "EventID/I");
-   OutputTree.Branch("NParticle", &NParticle, "NParticle/I"); 
-   OutputTree.Branch("GenE", &GenE, "GenE[NParticle]/D");
-   OutputTree.Branch("GenX", &GenX, "GenX[NParticle]/D");
-   OutputTree.Branch("GenY", &GenY, "GenY[NParticle]/D");
-   OutputTree.Branch("GenZ", &GenZ, "GenZ[NParticle]/D");
-   OutputTree.Branch("RecoE", &RecoE, "RecoE[NParticle]/D");
-   OutputTree.Branch("RecoX", &RecoX, "RecoX[NParticle]/D");
-   OutputTree.Branch("RecoY", &RecoY, "RecoY[NParticle]/D");
-   OutputTree.Branch("RecoZ", &RecoZ, "RecoZ[NParticle]/D");
-   OutputTree.Branch("Distance", &Distance, "Distance[NParticle]/D");
-   OutputTree.Branch("DeltaPhi", &DeltaPhi, "DeltaPhi[NParticle]/D");
-   OutputTree.Branch("DeltaTheta", &DeltaTheta, "DeltaTheta[NParticle]/D"); 
-   OutputTree.Branch("DeltaE", &DeltaE, "DeltaE[NParticle]/D");
-   OutputTree.Branch("Metric", &Metric, "Metric[NParticle]/D");
-   OutputTree.Branch("RecoEta", &RecoEta, "RecoEta[NParticle]/D");
-   OutputTree.Branch("RecoPhi", &RecoPhi, "RecoPhi[NParticle]/D");
-   OutputTree.Branch("RecoTheta", &RecoTheta, "RecoTheta[NParticle]/D");
-   OutputTree.Branch("GenEta", &GenEta, "GenEta[NParticle]/D");
-   OutputTree.Branch("GenPhi", &GenPhi, "GenPhi[NParticle]/D");
-   OutputTree.Branch("GenTheta", &GenTheta, "GenTheta[NParticle]/D");
-   OutputTree.Branch("RecoRapidity", &RecoRapidity, "RecoRapidity[NParticle]/D");
-   OutputTree.Branch("GenRapidity", &GenRapidity, "GenRapidity[NParticle]/D");
-   OutputTree.Branch("RecoPwFlag", &RecoPWFlag, "RecoPWFlag[NParticle]/I");
-   OutputTree.Branch("RecoEfficiency", &RecoEfficiency, "RecoEfficiency[NParticle]/D");
 
    // valiables for the pair tree
    int NPair;
@@ -192,31 +326,6 @@ int main(int argc, char *argv[])
    double DistanceGen[MAXPAIR], DistanceReco[MAXPAIR], Distance1[MAXPAIR], Distance2[MAXPAIR];
    double E1E2Gen[MAXPAIR], E1E2Reco[MAXPAIR];
    double RecoEfficiency1[MAXPAIR], RecoEfficiency2[MAXPAIR];
-   OutputPairTree.Branch("NPair", &NPair);
-   OutputPairTree.Branch("GenE1", &GenE1, "GenE1[NPair]/D");
-   OutputPairTree.Branch("GenX1", &GenX1, "GenX1[NPair]/D");
-   OutputPairTree.Branch("GenY1", &GenY1, "GenY1[NPair]/D");
-   OutputPairTree.Branch("GenZ1", &GenZ1, "GenZ1[NPair]/D");
-   OutputPairTree.Branch("GenE2", &GenE2, "GenE2[NPair]/D");
-   OutputPairTree.Branch("GenX2", &GenX2, "GenX2[NPair]/D");
-   OutputPairTree.Branch("GenY2", &GenY2, "GenY2[NPair]/D");
-   OutputPairTree.Branch("GenZ2", &GenZ2, "GenZ2[NPair]/D");
-   OutputPairTree.Branch("RecoE1", &RecoE1, "RecoE1[NPair]/D");
-   OutputPairTree.Branch("RecoX1", &RecoX1, "RecoX1[NPair]/D");
-   OutputPairTree.Branch("RecoY1", &RecoY1, "RecoY1[NPair]/D");
-   OutputPairTree.Branch("RecoZ1", &RecoZ1, "RecoZ1[NPair]/D");
-   OutputPairTree.Branch("RecoE2", &RecoE2, "RecoE2[NPair]/D");
-   OutputPairTree.Branch("RecoX2", &RecoX2, "RecoX2[NPair]/D");
-   OutputPairTree.Branch("RecoY2", &RecoY2, "RecoY2[NPair]/D");
-   OutputPairTree.Branch("RecoZ2", &RecoZ2, "RecoZ2[NPair]/D");
-   OutputPairTree.Branch("DistanceGen", &DistanceGen, "DistanceGen[NPair]/D");
-   OutputPairTree.Branch("DistanceReco", &DistanceReco, "DistanceReco[NPair]/D");
-   OutputPairTree.Branch("Distance1", &Distance1, "Distance1[NPair]/D");
-   OutputPairTree.Branch("Distance2", &Distance2, "Distance2[NPair]/D");
-   OutputPairTree.Branch("E1E2Gen", &E1E2Gen, "E1E2Gen[NPair]/D");
-   OutputPairTree.Branch("E1E2Reco", &E1E2Reco, "E1E2Reco[NPair]/D");
-   OutputPairTree.Branch("RecoEfficiency1", &RecoEfficiency1, "RecoEfficiency1[NPair]/D");
-   OutputPairTree.Branch("RecoEfficiency2", &RecoEfficiency2, "RecoEfficiency2[NPair]/D");
 
    // variables for the unmatched pair tree
    int NUnmatchedPair;
@@ -226,34 +335,198 @@ int main(int argc, char *argv[])
    double RecoE2Unmatched[MAXPAIR], RecoX2Unmatched[MAXPAIR], RecoY2Unmatched[MAXPAIR], RecoZ2Unmatched[MAXPAIR];
    double DistanceUnmatchedGen[MAXPAIR], DistanceUnmatchedReco[MAXPAIR], DeltaPhiUnmatchedGen[MAXPAIR], DeltaPhiUnmatchedReco[MAXPAIR], DeltaEUnmatchedReco[MAXPAIR], DeltaEUnmatchedGen[MAXPAIR], DeltaThetaUnmatchedGen[MAXPAIR], DeltaThetaUnmatchedReco[MAXPAIR]; 
    double E1E2GenUnmatched[MAXPAIR], E1E2RecoUnmatched[MAXPAIR];
-   OutputUnmatchedTree.Branch("NUnmatchedPair", &NUnmatchedPair);
-   OutputUnmatchedTree.Branch("GenE1Unmatched", &GenE1Unmatched, "GenE1Unmatched[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("GenE2Unmatched", &GenE2Unmatched, "GenE2Unmatched[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("RecoE1Unmatched", &RecoE1Unmatched, "RecoE1Unmatched[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("RecoE2Unmatched", &RecoE2Unmatched, "RecoE2Unmatched[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DistanceUnmatchedGen", &DistanceUnmatchedGen, "DistanceUnmatchedGen[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DistanceUnmatchedReco", &DistanceUnmatchedReco, "DistanceUnmatchedReco[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DeltaPhiUnmatchedGen", &DeltaPhiUnmatchedGen, "DeltaPhiUnmatchedGen[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DeltaPhiUnmatchedReco", &DeltaPhiUnmatchedReco, "DeltaPhiUnmatchedReco[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DeltaEUnmatchedGen", &DeltaEUnmatchedGen, "DeltaEUnmatchedGen[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DeltaEUnmatchedReco", &DeltaEUnmatchedReco, "DeltaEUnmatchedReco[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DeltaThetaUnmatchedGen", &DeltaThetaUnmatchedGen, "DeltaThetaUnmatchedGen[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("DeltaThetaUnmatchedReco", &DeltaThetaUnmatchedReco, "DeltaThetaUnmatchedReco[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("E1E2GenUnmatched", &E1E2GenUnmatched, "E1E2GenUnmatched[NUnmatchedPair]/D");
-   OutputUnmatchedTree.Branch("E1E2RecoUnmatched", &E1E2RecoUnmatched, "E1E2RecoUnmatched[NUnmatchedPair]/D");
+
+   // the trees are filled and compressed on background threads, all feeding the same output file;
+   //    they share the branch buffers above.  Mode is "UPDATE" when continuing a file written earlier.
+   auto OpenTrees = [&](MatchingOutput &O, string Mode)
+   {
+      O.Output = new AsyncOutputFile(O.FileName, Mode, Format);
+
+      // tree for single track matching
+      O.MatchedTree = new AsyncTreeWriter(*O.Output, "MatchedTree", "", MatchedTreeOptions);
+      // tree for matched pairs
+      O.PairTree = new AsyncTreeWriter(*O.Output, "PairTree", "", PairTreeOptions);
+      // tree that just takes pairs, not matching taken into account
+      O.UnmatchedTree = new AsyncTreeWriter(*O.Output, "UnmatchedPairTree", "", UnmatchedTreeOptions);
+
+      O.MatchedTree->Branch("EventID", &eventID, "EventID/I");
+      O.MatchedTree->Branch("NParticle", &NParticle, "NParticle/I");
+      O.MatchedTree->Branch("GenE", &GenE, ("GenE[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("GenX", &GenX, ("GenX[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("GenY", &GenY, ("GenY[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("GenZ", &GenZ, ("GenZ[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("RecoE", &RecoE, ("RecoE[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("RecoX", &RecoX, ("RecoX[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("RecoY", &RecoY, ("RecoY[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("RecoZ", &RecoZ, ("RecoZ[NParticle]/" + Q.Momentum('D')).c_str());
+      O.MatchedTree->Branch("Distance", &Distance, "Distance[NParticle]/D");
+      O.MatchedTree->Branch("DeltaPhi", &DeltaPhi, "DeltaPhi[NParticle]/D");
+      O.MatchedTree->Branch("DeltaTheta", &DeltaTheta, "DeltaTheta[NParticle]/D");
+      O.MatchedTree->Branch("DeltaE", &DeltaE, "DeltaE[NParticle]/D");
+      O.MatchedTree->Branch("Metric", &Metric, "Metric[NParticle]/D");
+      O.MatchedTree->Branch("RecoEta", &RecoEta, "RecoEta[NParticle]/D");
+      O.MatchedTree->Branch("RecoPhi", &RecoPhi, "RecoPhi[NParticle]/D");
+      O.MatchedTree->Branch("RecoTheta", &RecoTheta, "RecoTheta[NParticle]/D");
+      O.MatchedTree->Branch("GenEta", &GenEta, "GenEta[NParticle]/D");
+      O.MatchedTree->Branch("GenPhi", &GenPhi, "GenPhi[NParticle]/D");
+      O.MatchedTree->Branch("GenTheta", &GenTheta, "GenTheta[NParticle]/D");
+      O.MatchedTree->Branch("RecoRapidity", &RecoRapidity, "RecoRapidity[NParticle]/D");
+      O.MatchedTree->Branch("GenRapidity", &GenRapidity, "GenRapidity[NParticle]/D");
+      O.MatchedTree->Branch("RecoPwFlag", &RecoPWFlag, "RecoPWFlag[NParticle]/I");
+      O.MatchedTree->Branch("RecoEfficiency", &RecoEfficiency, "RecoEfficiency[NParticle]/D");
+
+      O.PairTree->Branch("NPair", &NPair, "NPair/I");
+      O.PairTree->Branch("GenE1", &GenE1, ("GenE1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenX1", &GenX1, ("GenX1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenY1", &GenY1, ("GenY1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenZ1", &GenZ1, ("GenZ1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenE2", &GenE2, ("GenE2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenX2", &GenX2, ("GenX2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenY2", &GenY2, ("GenY2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("GenZ2", &GenZ2, ("GenZ2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoE1", &RecoE1, ("RecoE1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoX1", &RecoX1, ("RecoX1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoY1", &RecoY1, ("RecoY1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoZ1", &RecoZ1, ("RecoZ1[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoE2", &RecoE2, ("RecoE2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoX2", &RecoX2, ("RecoX2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoY2", &RecoY2, ("RecoY2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("RecoZ2", &RecoZ2, ("RecoZ2[NPair]/" + Q.Momentum('D')).c_str());
+      O.PairTree->Branch("DistanceGen", &DistanceGen, "DistanceGen[NPair]/D");
+      O.PairTree->Branch("DistanceReco", &DistanceReco, "DistanceReco[NPair]/D");
+      O.PairTree->Branch("Distance1", &Distance1, "Distance1[NPair]/D");
+      O.PairTree->Branch("Distance2", &Distance2, "Distance2[NPair]/D");
+      O.PairTree->Branch("E1E2Gen", &E1E2Gen, "E1E2Gen[NPair]/D");
+      O.PairTree->Branch("E1E2Reco", &E1E2Reco, "E1E2Reco[NPair]/D");
+      O.PairTree->Branch("RecoEfficiency1", &RecoEfficiency1, "RecoEfficiency1[NPair]/D");
+      O.PairTree->Branch("RecoEfficiency2", &RecoEfficiency2, "RecoEfficiency2[NPair]/D");
+
+      O.UnmatchedTree->Branch("NUnmatchedPair", &NUnmatchedPair, "NUnmatchedPair/I");
+      O.UnmatchedTree->Branch("GenE1Unmatched", &GenE1Unmatched, ("GenE1Unmatched[NUnmatchedPair]/" + Q.Momentum('D')).c_str());
+      O.UnmatchedTree->Branch("GenE2Unmatched", &GenE2Unmatched, ("GenE2Unmatched[NUnmatchedPair]/" + Q.Momentum('D')).c_str());
+      O.UnmatchedTree->Branch("RecoE1Unmatched", &RecoE1Unmatched, ("RecoE1Unmatched[NUnmatchedPair]/" + Q.Momentum('D')).c_str());
+      O.UnmatchedTree->Branch("RecoE2Unmatched", &RecoE2Unmatched, ("RecoE2Unmatched[NUnmatchedPair]/" + Q.Momentum('D')).c_str());
+      O.UnmatchedTree->Branch("DistanceUnmatchedGen", &DistanceUnmatchedGen, "DistanceUnmatchedGen[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DistanceUnmatchedReco", &DistanceUnmatchedReco, "DistanceUnmatchedReco[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DeltaPhiUnmatchedGen", &DeltaPhiUnmatchedGen, "DeltaPhiUnmatchedGen[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DeltaPhiUnmatchedReco", &DeltaPhiUnmatchedReco, "DeltaPhiUnmatchedReco[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DeltaEUnmatchedGen", &DeltaEUnmatchedGen, "DeltaEUnmatchedGen[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DeltaEUnmatchedReco", &DeltaEUnmatchedReco, "DeltaEUnmatchedReco[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DeltaThetaUnmatchedGen", &DeltaThetaUnmatchedGen, "DeltaThetaUnmatchedGen[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("DeltaThetaUnmatchedReco", &DeltaThetaUnmatchedReco, "DeltaThetaUnmatchedReco[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("E1E2GenUnmatched", &E1E2GenUnmatched, "E1E2GenUnmatched[NUnmatchedPair]/D");
+      O.UnmatchedTree->Branch("E1E2RecoUnmatched", &E1E2RecoUnmatched, "E1E2RecoUnmatched[NUnmatchedPair]/D");
+   };
+
+   // drains the writer queues; the trees are in the file once the merger is gone
+   auto CloseTrees = [&](MatchingOutput &O, bool Print)
+   {
+      O.MatchedTree->Finish();
+      O.PairTree->Finish();
+      O.UnmatchedTree->Finish();
+      if(Print == true)
+      {
+         O.MatchedTree->PrintStatistics(cout);
+         O.PairTree->PrintStatistics(cout);
+         O.UnmatchedTree->PrintStatistics(cout);
+      }
+      delete O.MatchedTree;
+      delete O.PairTree;
+      delete O.UnmatchedTree;
+      delete O.Output;
+   };
+
+   // histograms for each scheme
+   for(MatchingOutput &O : Outputs)
+   {
+      O.recoMatched = new TH1D("recoMatched", "recoMatched", 2 * BinCount, 0, 2 * BinCount);
+      O.genMatched = new TH1D("genMatched", "genMatched", 2 * BinCount, 0, 2 * BinCount);
+      O.recoMatched_z = new TH1D("recoMatched_z", "recoMatched_z", 2 * BinCount, 0, 2 * BinCount);
+      O.genMatched_z = new TH1D("genMatched_z", "genMatched_z", 2 * BinCount, 0, 2 * BinCount);
+      O.e1e2RecoMatched = new TH1D("e1e2RecoMatched", "e1e2RecoMatched", BinCount, EnergyBins);
+      O.e1e2GenMatched = new TH1D("e1e2GenMatched", "e1e2GenMatched", BinCount, EnergyBins);
+
+      O.hTrackPt = new ResponseHistograms("hTrackPt", trackPtBinsReco, trackPtBinsGen);
+      O.hDeltaR = new ResponseHistograms("hDeltaR", deltaRBinsReco, deltaRBinsGen);
+      O.hE1E2 = new ResponseHistograms("hE1E2", e1e2BinsReco, e1e2BinsGen);
+      O.Performance = new MatchingPerformanceHistograms();
+
+      for(TH1D *H : {O.recoMatched, O.genMatched, O.recoMatched_z, O.genMatched_z, O.e1e2RecoMatched, O.e1e2GenMatched})
+         H->SetDirectory(nullptr);
+   }
 
    ParticleTreeMessenger MGen(InputFile, GenTreeName);
    ParticleTreeMessenger MReco(InputFile, RecoTreeName);
+   MGen.EnableCache();
+   MReco.EnableCache();
 
-   int EntryCount = MReco.GetEntries() * Fraction;
+   EntryRange Range = GetEntryRange(CL, MReco.Tree, InputFileName, Fraction);
+   int EntryCount = Range.Size();
    int nAcceptedEvents = 0; 
+
+   // snapshots of the histograms, the counters and the tree files written so far
+   Checkpoint Snapshot(CL, OutputFileName);
+   Snapshot.Add("nAcceptedEvents", nAcceptedEvents);
+   for(TH1D *H : {&recoUnmatched, &genUnmatched, &recoUnmatched_z, &genUnmatched_z, &e1e2RecoUnmatched, &e1e2GenUnmatched})
+      Snapshot.Add(H);
+   for(MatchingOutput &O : Outputs)
+   {
+      string Directory = "matchingScheme" + to_string(O.Scheme);
+      for(TH1D *H : {O.recoMatched, O.genMatched, O.recoMatched_z, O.genMatched_z, O.e1e2RecoMatched, O.e1e2GenMatched})
+         Snapshot.Add(H, Directory);
+      for(ResponseHistograms *R : {O.hTrackPt, O.hDeltaR, O.hE1E2})
+         for(TH1 *H : R->AllHistograms())
+            Snapshot.Add(H, Directory);
+      for(TH1 *H : O.Performance->AllHistograms())
+         Snapshot.Add(H, Directory);
+      Snapshot.Add(Directory + "_nGenTracks", O.Performance->nGenTracks);
+      Snapshot.Add(Directory + "_nRecoTracks", O.Performance->nRecoTracks);
+      for(int i = 0; i < 5; i++)
+      {
+         Snapshot.Add(Directory + "_nMatchedTracks" + to_string(i), O.Performance->nMatchedTracks[i]);
+         Snapshot.Add(Directory + "_nUnmatchedTracks" + to_string(i), O.Performance->nUnmatchedTracks[i]);
+      }
+      Snapshot.AddFile(O.FileName);
+   }
+   // an RNTuple cannot be continued after the file is closed, so it is written in one go
+   if(Format == "RNTuple" && Snapshot.IsEnabled() == true)
+   {
+      cerr << "Checkpointing needs --Format TTree" << endl;
+      return 1;
+   }
+   // every event fills all three trees, so the trees have one entry per counted event
+   RunMetadata Metadata = StartRunMetadata(CL, {InputFileName});
+   Snapshot.Add("EventsProcessed", Metadata.EventsProcessed);
+   Snapshot.Add("EventsSelected", Metadata.EventsSelected);
+   Snapshot.Add("SumWeight", Metadata.SumWeight);
+   Snapshot.Add("SumWeightSelected", Metadata.SumWeightSelected);
+   int StartEntry = Snapshot.Resume(Range);
+
+   for(MatchingOutput &O : Outputs)
+      OpenTrees(O, (StartEntry > Range.Begin) ? "UPDATE" : "RECREATE");
+
    ProgressBar Bar(cout, EntryCount);
    Bar.SetStyle(-1); 
-   for(int iE = 0; iE < EntryCount; iE++) 
+   Bar.SetTelemetry(true);
+   for(int iE = Range.Next(StartEntry - 1); iE < Range.End; iE = Range.Next(iE))
    {
+      // the tree files are closed for the snapshot and then appended to
+      if(Snapshot.Due(iE) == true)
+      {
+         for(MatchingOutput &O : Outputs)
+            CloseTrees(O, false);
+         Snapshot.Save(iE);
+         for(MatchingOutput &O : Outputs)
+            OpenTrees(O, "UPDATE");
+      }
+
+      Bar.Update(iE - Range.Begin);
+      Bar.PrintIfDue();
 
       MGen.GetEntry(iE);
       MReco.GetEntry(iE);
+      Metadata.CountProcessed();
+      Metadata.CountSelected();
 
       // event selection (not applied for the moment as this is assumed to be applied to the tree)
       /*
@@ -284,12 +557,14 @@ int main(int argc, char *argv[])
          if(MReco.P[i][0] < 0.2) continue;        
          PReco.push_back(MReco.P[i]);
       }
+      Bar.AddPairs((long long)PReco.size() * (PReco.size() - 1) / 2 + (long long)PGen.size() * (PGen.size() - 1) / 2);
 
 
       // now fill the unmatched tree
       int index_counter = 0;
       double TotalE = 91.1876;
       int NunmatchedRecoPairs = 0; 
+      ScopedTimer UnmatchedTimer("UnmatchedPairs", "pairs");
       for(int i = 0; i < PReco.size(); i++){
          for(int j = i+1; j < PReco.size();j++){
             if(i == j) continue; // don't match particles with themselves
@@ -355,169 +630,429 @@ int main(int argc, char *argv[])
          }
       }
 
+      UnmatchedTimer.Stop();
+
+      // the sizes and azimuths are cached once per event for the fast matching
+      vector<MatchingTrack> TGen, TReco;
+      if(Validator.Fast == true || Validator.Sample(iE) == true)
+      {
+         TGen.assign(PGen.begin(), PGen.end());
+         TReco.assign(PReco.begin(), PReco.end());
+      }
+
+      // the binning of the unmatched reco pairs and the efficiencies of the reco tracks, both ways
+      if(Validator.Sample(iE) == true)
+      {
+         vector<double> Angles, Zs, E1E2s;
+         for(int i = 0; i < (int)PReco.size(); i++)
+         {
+            for(int j = i + 1; j < (int)PReco.size(); j++)
+            {
+               Angles.push_back(GetAngle(PReco[i], PReco[j]));
+               Zs.push_back((1 - cos(Angles.back())) / 2);
+               E1E2s.push_back(PReco[i][0] * PReco[j][0] / (TotalE * TotalE));
+            }
+         }
+         auto Binning = [&](int (*Find)(double, int, const double[]))
+         {
+            vector<double> Result;
+            Result.reserve(3 * Angles.size());
+            for(int i = 0; i < (int)Angles.size(); i++)
+            {
+               Result.push_back(Find(Angles[i], 2 * BinCount, Bins));
+               Result.push_back(Find(Zs[i], 2 * BinCount, zBins));
+               Result.push_back(Find(E1E2s[i], BinCount, EnergyBins));
+            }
+            return Result;
+         };
+         Validator.Compare("FindBin", [&]() {return Binning(FindBinLinear);}, [&]() {return Binning(FindBinSorted);});
+
+         Validator.Compare("Efficiency",
+            [&]()
+            {
+               vector<double> Result;
+               for(FourVector &Reco : PReco)
+                  if(Reco.GetPT() >= 0.2)
+                     Result.push_back(efficiencyCorrector.efficiency(Reco.GetTheta(), Reco.GetPhi(), Reco.GetPT(), MReco.nChargedHadronsHP));
+               return Result;
+            },
+            [&]()
+            {
+               vector<double> Result;
+               for(FourVector &Reco : PReco)
+                  if(Reco.GetPT() >= 0.2)
+                     Result.push_back(FastEfficiency.Efficiency(Reco.GetTheta(), Reco.GetPhi(), Reco.GetPT(), MReco.nChargedHadronsHP));
+               return Result;
+            });
+
+         for(MatchingOutput &O : Outputs)
+            Validator.Compare("Matching", [&]() {return MatchWithScheme(O.Scheme, PGen, PReco);},
+               [&]() {return MatchWithSchemeFast(O.Scheme, TGen, TReco);});
+      }
+
       if(index_gen > index_counter)NUnmatchedPair = index_gen;
       else NUnmatchedPair = index_counter;
 
 
       nAcceptedEvents++; 
-      OutputUnmatchedTree.Fill();
-
-      // perform the matching
-      map<int, int> Matching = MatchJetsHungarian(MatchingMetric, PGen, PReco);
-      int Count = 0;
-      NParticle = Matching.size();
-      eventID = MGen.EventNo;
-      for(auto iter : Matching)
+      for(MatchingOutput &O : Outputs)
+         O.UnmatchedTree->Fill();
+
+      for(MatchingOutput &O : Outputs)
       {
-         FourVector Gen = iter.first >= 0 ? PGen[iter.first] : FourVector(-1, 0, 0, 0);
-         FourVector Reco = iter.second >= 0 ? PReco[iter.second] : FourVector(-1, 0, 0, 0);
-         // if(GetAngle(Gen, Reco) > 1.0) {
-         //    Gen = FourVector(-1, 0, 0, 0); 
-         //    Reco = FourVector(-1, 0, 0, 0); 
-         // }
-         GenE[Count] = Gen[0];
-         GenX[Count] = Gen[1];
-         GenY[Count] = Gen[2];
-         GenZ[Count] = Gen[3];
-         GenEta[Count] = Gen.GetEta();
-         GenRapidity[Count] = Gen.GetRapidity();
-         GenPhi[Count] = Gen.GetPhi();
-         GenTheta[Count] = Gen.GetTheta();
-         RecoE[Count] = Reco[0];
-         RecoX[Count] = Reco[1];
-         RecoY[Count] = Reco[2];
-         RecoZ[Count] = Reco[3];
-         RecoRapidity[Count] = Reco.GetRapidity();
-         RecoEta[Count] = Reco.GetEta();
-         RecoPhi[Count] = Reco.GetPhi();
-         RecoTheta[Count] = Reco.GetTheta();
-         Distance[Count] = GetAngle(Gen, Reco);
-         DeltaPhi[Count] = GetDPhi(Gen,Reco); 
-         DeltaE[Count] = Gen[0] - Reco[0]; 
-         DeltaTheta[Count] = Gen.GetTheta() - Reco.GetTheta(); 
-         double Efficiency; 
-         if (Reco.GetPT() <  0.2) Efficiency = 1;
-         else Efficiency = efficiencyCorrector.efficiency(Reco.GetTheta(), Reco.GetPhi(), Reco.GetPT(), MReco.nChargedHadronsHP);
-         RecoEfficiency[Count] = 1/Efficiency;
-         Count = Count + 1;
-      }
+         // perform the matching
+         ScopedTimer MatchTimer("Match", "match");
+         map<int, int> Matching = (Validator.Fast == true) ? MatchWithSchemeFast(O.Scheme, TGen, TReco)
+            : MatchWithScheme(O.Scheme, PGen, PReco);
+         MatchTimer.Stop();
+         int Count = 0;
+         NParticle = Matching.size();
+         eventID = MGen.EventNo;
+         for(auto iter : Matching)
+         {
+            FourVector Gen = iter.first >= 0 ? PGen[iter.first] : FourVector(-1, 0, 0, 0);
+            FourVector Reco = iter.second >= 0 ? PReco[iter.second] : FourVector(-1, 0, 0, 0);
+            // if(GetAngle(Gen, Reco) > 1.0) {
+            //    Gen = FourVector(-1, 0, 0, 0); 
+            //    Reco = FourVector(-1, 0, 0, 0); 
+            // }
+            GenE[Count] = Gen[0];
+            GenX[Count] = Gen[1];
+            GenY[Count] = Gen[2];
+            GenZ[Count] = Gen[3];
+            GenEta[Count] = Gen.GetEta();
+            GenRapidity[Count] = Gen.GetRapidity();
+            GenPhi[Count] = Gen.GetPhi();
+            GenTheta[Count] = Gen.GetTheta();
+            RecoE[Count] = Reco[0];
+            RecoX[Count] = Reco[1];
+            RecoY[Count] = Reco[2];
+            RecoZ[Count] = Reco[3];
+            RecoRapidity[Count] = Reco.GetRapidity();
+            RecoEta[Count] = Reco.GetEta();
+            RecoPhi[Count] = Reco.GetPhi();
+            RecoTheta[Count] = Reco.GetTheta();
+            Distance[Count] = GetAngle(Gen, Reco);
+            DeltaPhi[Count] = GetDPhi(Gen,Reco); 
+            DeltaE[Count] = Gen[0] - Reco[0]; 
+            DeltaTheta[Count] = Gen.GetTheta() - Reco.GetTheta(); 
+            double Efficiency; 
+            if (Reco.GetPT() <  0.2) Efficiency = 1;
+            else if (Validator.Fast == true) Efficiency = FastEfficiency.Efficiency(Reco.GetTheta(), Reco.GetPhi(), Reco.GetPT(), MReco.nChargedHadronsHP);
+            else Efficiency = efficiencyCorrector.efficiency(Reco.GetTheta(), Reco.GetPhi(), Reco.GetPT(), MReco.nChargedHadronsHP);
+            RecoEfficiency[Count] = 1/Efficiency;
+            Count = Count + 1;
+         }
+         O.Performance->FillTracks(O.Scheme, Matching, PGen, PReco, MReco.nChargedHadronsHP);
+         O.Performance->EndEvent(MGen.nChargedHadronsHP, MReco.nChargedHadronsHP);
  
-      OutputTree.Fill(); // fill the tree
+         O.MatchedTree->Fill(); // fill the tree
 
-      // now fill the tree for the matched pairs
-      NPair = 0; 
-      int NMatchedPairs = 0; 
-      for(int i = 0; i < NParticle; i++)
-      {
-         for(int j = i + 1; j < NParticle; j++)
+         // now fill the tree for the matched pairs
+         ScopedTimer MatchedPairTimer("MatchedPairs", "pairs");
+         NPair = 0; 
+         int NMatchedPairs = 0; 
+         for(int i = 0; i < NParticle; i++)
          {
-            GenE1[NPair] = GenE[i];
-            GenX1[NPair] = GenX[i];
-            GenY1[NPair] = GenY[i];
-            GenZ1[NPair] = GenZ[i];
-            GenE2[NPair] = GenE[j];
-            GenX2[NPair] = GenX[j];
-            GenY2[NPair] = GenY[j];
-            GenZ2[NPair] = GenZ[j];
-            RecoE1[NPair] = RecoE[i];
-            RecoX1[NPair] = RecoX[i];
-            RecoY1[NPair] = RecoY[i];
-            RecoZ1[NPair] = RecoZ[i];
-            RecoE2[NPair] = RecoE[j];
-            RecoX2[NPair] = RecoX[j];
-            RecoY2[NPair] = RecoY[j];
-            RecoZ2[NPair] = RecoZ[j];
-            RecoEfficiency1[NPair] = RecoEfficiency[i];
-            RecoEfficiency2[NPair] = RecoEfficiency[j];
-
-            Distance1[NPair] = Distance[i];
-            Distance2[NPair] = Distance[j];
-
-            FourVector Gen1(GenE[i], GenX[i], GenY[i], GenZ[i]);
-            FourVector Gen2(GenE[j], GenX[j], GenY[j], GenZ[j]);
-            FourVector Reco1(RecoE[i], RecoX[i], RecoY[i], RecoZ[i]);
-            FourVector Reco2(RecoE[j], RecoX[j], RecoY[j], RecoZ[j]);
-
-            DistanceGen[NPair] = GetAngle(Gen1, Gen2);
-            DistanceReco[NPair] = GetAngle(Reco1, Reco2);
-
-            E1E2Gen[NPair] = (GenE[i]*GenE[j])/(TotalE*TotalE);
-            E1E2Reco[NPair] = (RecoE[i]*RecoE[j])/(TotalE*TotalE);
-
-            if(RecoE[i] > 0 && RecoE[j] > 0 && GenE[i] > 0 && GenE[j] > 0){
-               // theta histograms
-               int BinThetaMeasuredMC = FindBin(GetAngle(Reco1,Reco2), 2 * BinCount, Bins);
-               recoMatched.Fill(BinThetaMeasuredMC,Reco1[0]*Reco2[0]/(TotalE*TotalE));
-               int BinThetaGenMC = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
-               genMatched.Fill(BinThetaGenMC,Gen1[0]*Gen2[0]/(TotalE*TotalE));
+            for(int j = i + 1; j < NParticle; j++)
+            {
+               GenE1[NPair] = GenE[i];
+               GenX1[NPair] = GenX[i];
+               GenY1[NPair] = GenY[i];
+               GenZ1[NPair] = GenZ[i];
+               GenE2[NPair] = GenE[j];
+               GenX2[NPair] = GenX[j];
+               GenY2[NPair] = GenY[j];
+               GenZ2[NPair] = GenZ[j];
+               RecoE1[NPair] = RecoE[i];
+               RecoX1[NPair] = RecoX[i];
+               RecoY1[NPair] = RecoY[i];
+               RecoZ1[NPair] = RecoZ[i];
+               RecoE2[NPair] = RecoE[j];
+               RecoX2[NPair] = RecoX[j];
+               RecoY2[NPair] = RecoY[j];
+               RecoZ2[NPair] = RecoZ[j];
+               RecoEfficiency1[NPair] = RecoEfficiency[i];
+               RecoEfficiency2[NPair] = RecoEfficiency[j];
+
+               Distance1[NPair] = Distance[i];
+               Distance2[NPair] = Distance[j];
+
+               FourVector Gen1(GenE[i], GenX[i], GenY[i], GenZ[i]);
+               FourVector Gen2(GenE[j], GenX[j], GenY[j], GenZ[j]);
+               FourVector Reco1(RecoE[i], RecoX[i], RecoY[i], RecoZ[i]);
+               FourVector Reco2(RecoE[j], RecoX[j], RecoY[j], RecoZ[j]);
+
+               DistanceGen[NPair] = GetAngle(Gen1, Gen2);
+               DistanceReco[NPair] = GetAngle(Reco1, Reco2);
+
+               E1E2Gen[NPair] = (GenE[i]*GenE[j])/(TotalE*TotalE);
+               E1E2Reco[NPair] = (RecoE[i]*RecoE[j])/(TotalE*TotalE);
+
+               if(RecoE[i] > 0 && RecoE[j] > 0 && GenE[i] > 0 && GenE[j] > 0){
+                  // theta histograms
+                  int BinThetaMeasuredMC = FindBin(GetAngle(Reco1,Reco2), 2 * BinCount, Bins);
+                  O.recoMatched->Fill(BinThetaMeasuredMC,Reco1[0]*Reco2[0]/(TotalE*TotalE));
+                  int BinThetaGenMC = FindBin(GetAngle(Gen1,Gen2), 2 * BinCount, Bins);
+                  O.genMatched->Fill(BinThetaGenMC,Gen1[0]*Gen2[0]/(TotalE*TotalE));
             
-               // energy histograms
-               int BinEnergyMeasured = FindBin(Reco1[0]*Reco2[0]/(TotalE*TotalE), BinCount, EnergyBins);
-               e1e2RecoMatched.Fill(Reco1[0]*Reco2[0]/(TotalE*TotalE));
-               int BinEnergyGen = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), BinCount, EnergyBins);
-               e1e2GenMatched.Fill(Gen1[0]*Gen2[0]/(TotalE*TotalE));
-
-               // z histograms
-               double zRecoMatched = (1-cos(GetAngle(Reco1, Reco2)))/2; 
-               int BinZMeasured = FindBin(zRecoMatched, 2*BinCount, zBins);
-               recoMatched_z.Fill(BinZMeasured, Reco1[0]*Reco2[0]/(TotalE*TotalE));
-
-               double zGenMatched = (1-cos(GetAngle(Gen1, Gen2)))/2; 
-               int BinZMC = FindBin(zGenMatched, 2*BinCount, zBins); 
-               genMatched_z.Fill(BinZMC, Gen1[0]*Gen2[0]/(TotalE*TotalE));
-
-               // increment the number of matched pairs
-               NMatchedPairs++; 
-            }
+                  // energy histograms
+                  int BinEnergyMeasured = FindBin(Reco1[0]*Reco2[0]/(TotalE*TotalE), BinCount, EnergyBins);
+                  O.e1e2RecoMatched->Fill(Reco1[0]*Reco2[0]/(TotalE*TotalE));
+                  int BinEnergyGen = FindBin(Gen1[0]*Gen2[0]/(TotalE*TotalE), BinCount, EnergyBins);
+                  O.e1e2GenMatched->Fill(Gen1[0]*Gen2[0]/(TotalE*TotalE));
+
+                  // z histograms
+                  double zRecoMatched = (1-cos(GetAngle(Reco1, Reco2)))/2; 
+                  int BinZMeasured = FindBin(zRecoMatched, 2*BinCount, zBins);
+                  O.recoMatched_z->Fill(BinZMeasured, Reco1[0]*Reco2[0]/(TotalE*TotalE));
+
+                  double zGenMatched = (1-cos(GetAngle(Gen1, Gen2)))/2; 
+                  int BinZMC = FindBin(zGenMatched, 2*BinCount, zBins); 
+                  O.genMatched_z->Fill(BinZMC, Gen1[0]*Gen2[0]/(TotalE*TotalE));
+
+                  // increment the number of matched pairs
+                  NMatchedPairs++; 
+               }
    
-            NPair = NPair + 1;
+               NPair = NPair + 1;
+            }
          }
-      }
 
-      OutputPairTree.Fill();
+         MatchedPairTimer.Stop();
+
+         O.PairTree->Fill();
+
+         if(FillResponse == true)
+         {
+            TIMELINE_SCOPE("FillResponse", "fill");
+
+            // the split-MC half is decided per event, so the two halves are statistically independent
+            bool HalfA = IsSplitHalfA(MGen.RunNo, MGen.EventNo);
+
+            vector<int> GenToReco(PGen.size(), -1);
+            vector<bool> RecoIsMatched(PReco.size(), false);
+            for(auto iter : Matching)
+            {
+               if(iter.first < 0 || iter.second < 0)
+                  continue;
+               GenToReco[iter.first] = iter.second;
+               RecoIsMatched[iter.second] = true;
+            }
+
+            // single track momentum
+            for(int i = 0; i < (int)PGen.size(); i++)
+            {
+               if(GenToReco[i] >= 0)
+                  O.hTrackPt->FillMatched(PReco[GenToReco[i]].GetP(), PGen[i].GetP(), HalfA);
+               else
+                  O.hTrackPt->FillMiss(PGen[i].GetP(), HalfA);
+            }
+            for(int i = 0; i < (int)PReco.size(); i++)
+               if(RecoIsMatched[i] == false)
+                  O.hTrackPt->FillFake(PReco[i].GetP(), HalfA);
+
+            // gen pairs: matched if both legs are matched, otherwise missed
+            for(int i = 0; i < (int)PGen.size(); i++)
+            {
+               for(int j = i + 1; j < (int)PGen.size(); j++)
+               {
+                  double DistanceGenPair = GetAngle(PGen[i], PGen[j]);
+                  double E1E2GenPair = PGen[i][0] * PGen[j][0] / (TotalE * TotalE);
+                  if(GenToReco[i] < 0 || GenToReco[j] < 0)
+                  {
+                     O.hDeltaR->FillMiss(DistanceGenPair, HalfA);
+                     O.hE1E2->FillMiss(E1E2GenPair, HalfA);
+                     continue;
+                  }
+
+                  const FourVector &Reco1 = PReco[GenToReco[i]];
+                  const FourVector &Reco2 = PReco[GenToReco[j]];
+                  O.hDeltaR->FillMatched(GetAngle(Reco1, Reco2), DistanceGenPair, HalfA);
+                  O.hE1E2->FillMatched(Reco1[0] * Reco2[0] / (TotalE * TotalE), E1E2GenPair, HalfA);
+               }
+            }
+
+            // reco pairs with at least one unmatched leg are fakes
+            for(int i = 0; i < (int)PReco.size(); i++)
+            {
+               for(int j = i + 1; j < (int)PReco.size(); j++)
+               {
+                  if(RecoIsMatched[i] == true && RecoIsMatched[j] == true)
+                     continue;
+                  O.hDeltaR->FillFake(GetAngle(PReco[i], PReco[j]), HalfA);
+                  O.hE1E2->FillFake(PReco[i][0] * PReco[j][0] / (TotalE * TotalE), HalfA);
+               }
+            }
+         }
+      }
    }
    std::cout << "Number of accepted events is " << nAcceptedEvents << std::endl;
    Bar.Update(EntryCount);
    Bar.Print();
    Bar.PrintLine();
+   Bar.PrintSummary();
+   Bar.WriteJSON(ProgressJSON, "MatchEEC");
+   Validator.Report(cout);
+
+   bool TreesComplete = true;
+   for(MatchingOutput &O : Outputs)
+   {
+      TIMELINE_SCOPE("Write", "output");
+
+      CloseTrees(O, true);
 
-   OutputFile.cd();
-
-   // write the trees to the output file
-   OutputTree.Write();
-   OutputPairTree.Write();
-   OutputUnmatchedTree.Write(); 
-
-   // -------------------------------------------------------------------
-   // histograms for the matching efficiency and fake fraction
-   // -------------------------------------------------------------------
-
-   //function of theta
-   recoUnmatched.Write(); 
-   recoMatched.Write(); 
-   genUnmatched.Write(); 
-   genMatched.Write(); 
-
-   // function of z
-   recoUnmatched_z.Write(); 
-   recoMatched_z.Write(); 
-   genUnmatched_z.Write(); 
-   genMatched_z.Write(); 
-
-   // function of energy
-   e1e2GenMatched.Write(); 
-   e1e2RecoMatched.Write(); 
-   e1e2GenUnmatched.Write(); 
-   e1e2RecoUnmatched.Write(); 
-   // -------------------------------------------------------------------
-
-   // write the output files
-   OutputFile.Close();
-   MatchingPerformance(OutputFileName, rstDirName, MGen, MReco);
+      TFile *File = new TFile(O.FileName.c_str(), "UPDATE");
+
+      // every counted event filled each tree once, also across snapshots and resumes, where the merger
+      //    appends to the tree already in the file; a tree that was written again as a new cycle shows up
+      //    here with too few entries
+      for(string TreeName : {"MatchedTree", "PairTree", "UnmatchedPairTree"})
+      {
+         TTree *Tree = (Format == "TTree") ? (TTree *)File->Get(TreeName.c_str()) : nullptr;
+         if(Tree != nullptr && Tree->GetEntries() != nAcceptedEvents)
+         {
+            cerr << "Error: " << O.FileName << ":" << TreeName << " has " << Tree->GetEntries()
+               << " entries for " << nAcceptedEvents << " events" << endl;
+            TreesComplete = false;
+         }
+      }
+
+      WriteEntryRange(File, Range);
+      WriteRunMetadata(File, Metadata);
+      File->cd();
+
+      // -------------------------------------------------------------------
+      // histograms for the matching efficiency and fake fraction
+      // -------------------------------------------------------------------
+
+      //function of theta
+      recoUnmatched.Write(); 
+      O.recoMatched->Write(); 
+      genUnmatched.Write(); 
+      O.genMatched->Write(); 
+
+      // function of z
+      recoUnmatched_z.Write(); 
+      O.recoMatched_z->Write(); 
+      genUnmatched_z.Write(); 
+      O.genMatched_z->Write(); 
+
+      // function of energy
+      O.e1e2GenMatched->Write(); 
+      O.e1e2RecoMatched->Write(); 
+      e1e2GenUnmatched.Write(); 
+      e1e2RecoUnmatched.Write(); 
+      // -------------------------------------------------------------------
+
+      if(FillResponse == true)
+      {
+         TDirectory *UnfoldingDirectory = File->mkdir("Unfolding");
+         O.hTrackPt->Write(UnfoldingDirectory);
+         O.hDeltaR->Write(UnfoldingDirectory);
+         O.hE1E2->Write(UnfoldingDirectory);
+      }
+
+      // write the output files
+      File->Close();
+      O.Performance->Write(O.FileName, O.DirName);
+
+      delete File;
+      delete O.recoMatched;
+      delete O.genMatched;
+      delete O.recoMatched_z;
+      delete O.genMatched_z;
+      delete O.e1e2RecoMatched;
+      delete O.e1e2GenMatched;
+      delete O.hTrackPt;
+      delete O.hDeltaR;
+      delete O.hE1E2;
+      delete O.Performance;
+   }
    InputFile.Close();
 
+   Snapshot.Finish();
+
+   Timeline::Finish(&cout);
+
+   return (TreesComplete == true) ? 0 : 1;
+}
+
+ResponseHistograms::ResponseHistograms(string Prefix, const vector<double> &RecoBins, const vector<double> &GenBins)
+   : Smeared((Prefix + "Smeared").c_str(), "", RecoBins.size() - 1, RecoBins.data()),
+     Gen((Prefix + "Gen").c_str(), "", GenBins.size() - 1, GenBins.data()),
+     Fake((Prefix + "Fake").c_str(), "", RecoBins.size() - 1, RecoBins.data()),
+     Miss((Prefix + "Miss").c_str(), "", GenBins.size() - 1, GenBins.data()),
+     Resp((Prefix + "Resp").c_str(), "", RecoBins.size() - 1, RecoBins.data(), GenBins.size() - 1, GenBins.data()),
+     Smeared_SplitMC((Prefix + "Smeared_SplitMC").c_str(), "", RecoBins.size() - 1, RecoBins.data()),
+     Gen_SplitMC((Prefix + "Gen_SplitMC").c_str(), "", GenBins.size() - 1, GenBins.data()),
+     Fake_SplitMC((Prefix + "Fake_SplitMC").c_str(), "", RecoBins.size() - 1, RecoBins.data()),
+     Miss_SplitMC((Prefix + "Miss_SplitMC").c_str(), "", GenBins.size() - 1, GenBins.data()),
+     Resp_SplitMC((Prefix + "Resp_SplitMC").c_str(), "", RecoBins.size() - 1, RecoBins.data(), GenBins.size() - 1, GenBins.data())
+{
+   // owned by this object, written explicitly into the output directory
+   for(TH1 *H : {(TH1 *)&Smeared, (TH1 *)&Gen, (TH1 *)&Fake, (TH1 *)&Miss, (TH1 *)&Resp,
+      (TH1 *)&Smeared_SplitMC, (TH1 *)&Gen_SplitMC, (TH1 *)&Fake_SplitMC, (TH1 *)&Miss_SplitMC, (TH1 *)&Resp_SplitMC})
+      H->SetDirectory(nullptr);
+}
+
+void ResponseHistograms::FillMatched(double Reco, double Gen, bool HalfA)
+{
+   Smeared.Fill(Reco);
+   this->Gen.Fill(Gen);
+   Resp.Fill(Reco, Gen);
+   if(HalfA == true)
+   {
+      Smeared_SplitMC.Fill(Reco);
+      Gen_SplitMC.Fill(Gen);
+   }
+   else
+      Resp_SplitMC.Fill(Reco, Gen);
+}
+
+void ResponseHistograms::FillFake(double Reco, bool HalfA)
+{
+   Fake.Fill(Reco);
+   if(HalfA == false)
+      Fake_SplitMC.Fill(Reco);
+}
+
+void ResponseHistograms::FillMiss(double Gen, bool HalfA)
+{
+   Miss.Fill(Gen);
+   if(HalfA == false)
+      Miss_SplitMC.Fill(Gen);
+}
+
+vector<TH1 *> ResponseHistograms::AllHistograms()
+{
+   return {&Smeared, &Gen, &Fake, &Miss, &Resp, &Smeared_SplitMC, &Gen_SplitMC, &Fake_SplitMC, &Miss_SplitMC, &Resp_SplitMC};
+}
 
-   return 0;
+void ResponseHistograms::Write(TDirectory *Directory)
+{
+   Directory->cd();
+   Smeared.Write();
+   Gen.Write();
+   Fake.Write();
+   Miss.Write();
+   Resp.Write();
+   Smeared_SplitMC.Write();
+   Gen_SplitMC.Write();
+   Fake_SplitMC.Write();
+   Miss_SplitMC.Write();
+   Resp_SplitMC.Write();
+}
+
+// deterministic 50/50 split of the MC sample, based on the event identity only
+bool IsSplitHalfA(int RunNo, int EventNo)
+{
+   unsigned long long Hash = ((unsigned long long)(unsigned int)RunNo << 32) | (unsigned int)EventNo;
+   Hash = Hash + 0x9E3779B97F4A7C15ULL;
+   Hash = (Hash ^ (Hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   Hash = (Hash ^ (Hash >> 27)) * 0x94D049BB133111EBULL;
+   Hash = Hash ^ (Hash >> 31);
+   return (Hash & 1) == 0;
 }
 
 // metric angle used as the first guess of the matching metric
@@ -527,283 +1062,199 @@ double MetricAngle(FourVector A, FourVector B)
    return Angle; 
 }
 
-// core function to calculate the chisquare(theta,phi,E) based on different assignments of resolutions
-double MatchingMetricCore( double deltaTheta, double deltaPhi, double deltaE,
-                           double meanE,     // the average btw the GenE and RecoE,
-                                             // this would be used to model the energy-dependency in the resolution assignment
-                           int schemeChoice, // 1: 10% energy as resolution, flat theta and phi resolutions
-                                             // 2: resolutions are cast according to ALEPH tracker performance (energy-dependent description)
-                                             // 3: scale btw the importance of angular-match versus energy-match ( 5x)
-                                             // 4: scale btw the importance of angular-match versus energy-match (15x)
-                           double& chiTheta, double& chiPhi, double& chiE)
+// the scheme is chosen once per event, the metric itself is inlined into the Hungarian matching
+map<int, int> MatchWithScheme(int schemeChoice, const vector<FourVector> &PGen, const vector<FourVector> &PReco)
 {
    if (schemeChoice==1)
+      return MatchJetsHungarian(MatchingMetric<MatchingScheme1>(), PGen, PReco);
+   if (schemeChoice==2)
+      return MatchJetsHungarian(MatchingMetric<MatchingScheme2>(), PGen, PReco);
+   if (schemeChoice==3)
+      return MatchJetsHungarian(MatchingMetric<MatchingScheme3>(), PGen, PReco);
+   if (schemeChoice==4)
+      return MatchJetsHungarian(MatchingMetric<MatchingScheme4>(), PGen, PReco);
+
+   printf("[Error] schemeChoice %d is not supported in MatchWithScheme. Please choose a number btw 1-4. Exiting...\n", schemeChoice);
+   exit(1);
+}
+
+map<int, int> MatchWithSchemeFast(int schemeChoice, const vector<MatchingTrack> &PGen, const vector<MatchingTrack> &PReco)
+{
+   if (schemeChoice==1)
+      return MatchJetsHungarian(FastMatchingMetric<MatchingScheme1>(), PGen, PReco);
+   if (schemeChoice==2)
+      return MatchJetsHungarian(FastMatchingMetric<MatchingScheme2>(), PGen, PReco);
+   if (schemeChoice==3)
+      return MatchJetsHungarian(FastMatchingMetric<MatchingScheme3>(), PGen, PReco);
+   if (schemeChoice==4)
+      return MatchJetsHungarian(FastMatchingMetric<MatchingScheme4>(), PGen, PReco);
+
+   printf("[Error] schemeChoice %d is not supported in MatchWithSchemeFast. Please choose a number btw 1-4. Exiting...\n", schemeChoice);
+   exit(1);
+}
+
+MatchingPerformanceHistograms::MatchingPerformanceHistograms()
+   : trkChi2Tot    ("trkChi2Tot",    "trkChi2Tot",  50, -5, 5),
+     trkChiTheta   ("trkChiTheta",  "trkChiTheta",50, -5, 5),
+     trkChiPhi     ("trkChiPhi",    "trkChiPhi",  50, -5, 5),
+     trkChiE       ("trkChiE",      "trkChiE",    50, -5, 5),
+     trkDeltaThetaVsMult ("trkDeltaThetaVsMult", ";N_{ch,HP}^{reco};#Delta#theta", 60, 0, 60, 100, -0.1, 0.1),
+     trkDeltaPhiVsMult   ("trkDeltaPhiVsMult",   ";N_{ch,HP}^{reco};#Delta#phi",   60, 0, 60, 100, -0.1, 0.1),
+     trkDeltaEOverEVsMult("trkDeltaEOverEVsMult", ";N_{ch,HP}^{reco};#DeltaE/E",   60, 0, 60, 100, -1, 1),
+     trkDeltaThetaVsTheta ("trkDeltaThetaVsTheta", ";#theta^{gen};#Delta#theta", 40, 0, M_PI, 100, -0.1, 0.1),
+     trkDeltaPhiVsTheta   ("trkDeltaPhiVsTheta",   ";#theta^{gen};#Delta#phi",   40, 0, M_PI, 100, -0.1, 0.1),
+     trkDeltaEOverEVsTheta("trkDeltaEOverEVsTheta", ";#theta^{gen};#DeltaE/E",   40, 0, M_PI, 100, -1, 1)
+{
+   // the energy categories are, in order, E>5, 2<E<5, 1<E<2 and E<1 GeV (reco energy)
+   string Suffix[5] = {"", "_ge5", "_2to5", "_1to2", "_le1"};
+   string Label[5]  = {"", " (E>5GeV)", " (2<E<5GeV)", " (1<E<2GeV)", " (E<1GeV)"};
+   for(int i = 0; i < 5; i++)
    {
-      double phiRes  = 0.002; // somewhere in the ballpark of 0.002-0.005
-      double Eres    = 0.1*meanE; // use 10% energy resolution //0.85/sqrt(meanE); // take energy resolution based on the mean energy
-      double AngleRes= (0.01*0.01); // take angular resolution based on the detector resolution
-      chiTheta       = deltaTheta/AngleRes;
-      chiPhi         = deltaPhi  /phiRes;
-      chiE           = deltaE    /Eres;
+      trkDeltaTheta[i] = TH1D(("trkDeltaTheta" + Suffix[i]).c_str(), ("trkDeltaTheta" + Label[i]).c_str(), 50, -4, 4);
+      trkDeltaPhi[i]   = TH1D(("trkDeltaPhi" + Suffix[i]).c_str(),   ("trkDeltaPhi" + Label[i]).c_str(),   50, -4, 4);
+      trkDeltaE[i]     = TH1D(("trkDeltaE" + Suffix[i]).c_str(),     ("trkDeltaE" + Label[i]).c_str(),     50, -10, 10);
+      trkDeltaP[i]     = TH1D(("trkDeltaP" + Suffix[i]).c_str(),     ("trkDeltaP" + Label[i]).c_str(),     50, -10, 10);
    }
-   else if (schemeChoice==2 || schemeChoice==3 || schemeChoice==4)
+
+   for(TH1 *H : AllHistograms())
+      H->SetDirectory(nullptr);
+
+   nGenTracks = 0;
+   nRecoTracks = 0;
+   for(int i = 0; i < 5; i++)
    {
-      double scaleFactorTheta = 2.8; // sigma(rz)   = 28 µm
-      double scaleFactorPhi   = 2.3; // sigma(rphi) = 23 µm
-      double scaleFactorE     = (schemeChoice==2)? 1: 
-                                (schemeChoice==3)? 5: 15;
-      double sigmaDelta = 25e-6 + 95e-6 / meanE;
-      double sigmaTheta = sigmaDelta / 6e-2     // inner vertex detector radius
-                        * scaleFactorTheta;     // considering the projection (average) of minimal distance to the r-z
-      double sigmaPhi   = sigmaDelta / 6e-2     // inner vertex detector radius 
-                        * scaleFactorPhi;       // considering the projection (average) of minimal distance to the r-z
-      double sigmaE = TMath::Sqrt( (6e-4*meanE)*(6e-4*meanE) + 0.005 * 0.005 ) * meanE 
-                        * scaleFactorE;
-      chiTheta       = deltaTheta/sigmaTheta;
-      chiPhi         = deltaPhi  /sigmaPhi;
-      chiE           = deltaE    /sigmaE;
+      nMatchedTracks[i] = 0;
+      nUnmatchedTracks[i] = 0;
+      nMatchedTracksInOneEvent[i] = 0;
+   }
+}
+
+vector<TH1 *> MatchingPerformanceHistograms::AllHistograms()
+{
+   vector<TH1 *> Result = {&trkChi2Tot, &trkChiTheta, &trkChiPhi, &trkChiE};
+   for(int i = 0; i < 5; i++)
+   {
+      Result.push_back(&trkDeltaTheta[i]);
+      Result.push_back(&trkDeltaPhi[i]);
+      Result.push_back(&trkDeltaE[i]);
+      Result.push_back(&trkDeltaP[i]);
    }
+   for(TH2D *H : {&trkDeltaThetaVsMult, &trkDeltaPhiVsMult, &trkDeltaEOverEVsMult,
+      &trkDeltaThetaVsTheta, &trkDeltaPhiVsTheta, &trkDeltaEOverEVsTheta})
+      Result.push_back(H);
+   return Result;
+}
+
+// the scheme is chosen once per event, as for the matching itself
+void MatchingPerformanceHistograms::FillTracks(int schemeChoice, const map<int, int> &Matching,
+   const vector<FourVector> &PGen, const vector<FourVector> &PReco, int Multiplicity)
+{
+   if (schemeChoice==1)
+      FillTracks<MatchingScheme1>(Matching, PGen, PReco, Multiplicity);
+   else if (schemeChoice==2)
+      FillTracks<MatchingScheme2>(Matching, PGen, PReco, Multiplicity);
+   else if (schemeChoice==3)
+      FillTracks<MatchingScheme3>(Matching, PGen, PReco, Multiplicity);
+   else if (schemeChoice==4)
+      FillTracks<MatchingScheme4>(Matching, PGen, PReco, Multiplicity);
    else
    {
-      printf("[Error] schemeChoice %d is not supported in MatchingMetricCore. Please choose a number btw 1-4. Exiting...\n", schemeChoice);
+      printf("[Error] schemeChoice %d is not supported in FillTracks. Please choose a number btw 1-4. Exiting...\n", schemeChoice);
       exit(1);
    }
-   
-   double chi2metric = chiTheta*chiTheta + chiPhi*chiPhi + chiE*chiE;
-   return (chi2metric);
 }
 
-double MatchingMetric(FourVector A, FourVector B){
-   double Angle = GetAngle(A,B);
-   double dPhi = GetDPhi(A,B); 
-   double Ediff = (A[0] - B[0]);
-   double meanE = (A[0] + B[0])/2;  
-
-   double _chiTheta, _chiPhi, _chiE;
-   double chi2metric = MatchingMetricCore( Angle, dPhi, Ediff,
-                                           meanE, MatchingSchemeChoice,
-                                           _chiTheta, _chiPhi, _chiE);
-   return chi2metric; 
+template <class Scheme>
+void MatchingPerformanceHistograms::FillTracks(const map<int, int> &Matching, const vector<FourVector> &PGen,
+   const vector<FourVector> &PReco, int Multiplicity)
+{
+   for(auto iter : Matching)
+   {
+      FourVector Gen = iter.first >= 0 ? PGen[iter.first] : FourVector(-1, 0, 0, 0);
+      FourVector Reco = iter.second >= 0 ? PReco[iter.second] : FourVector(-1, 0, 0, 0);
+      FillTrack<Scheme>(Gen, Reco, Multiplicity);
+   }
 }
 
-// function for filling the histograms
-int FindBin(double Value, int NBins, double Bins[])
+template <class Scheme>
+void MatchingPerformanceHistograms::FillTrack(FourVector &Gen, FourVector &Reco, int Multiplicity)
 {
-   for(int i = 0; i < NBins; i++)
-      if(Value < Bins[i])
-         return i - 1;
-   return NBins;
-}
+   if(Reco[0] < 0 || Gen[0] < 0)   // remove non-matched tracks
+      return;
+
+   double deltaTheta = Reco.GetTheta() - Gen.GetTheta();
+   double deltaPhi   = Reco.GetPhi() - Gen.GetPhi();
+   double deltaE     = Reco[0] - Gen[0];
+   double deltaP     = Reco.GetP() - Gen.GetP();
+   double distance   = GetAngle(Gen, Reco);
 
-// can we put this in the CommonCode/ ?
-void FillChain(TChain &chain, const vector<string> &files) {
-  for (auto file : files) {
-    chain.Add(file.c_str());
-  }
+   trkChi2Tot.Fill(distance);
+
+   int Category = (Reco[0] >= 5) ? 1 : ((Reco[0] >= 2) ? 2 : ((Reco[0] >= 1) ? 3 : 4));
+   for(int i : {0, Category})
+   {
+      trkDeltaTheta[i].Fill(deltaTheta);
+      trkDeltaPhi[i].Fill(deltaPhi);
+      trkDeltaE[i].Fill(deltaE);
+      trkDeltaP[i].Fill(deltaP);
+   }
+
+   trkDeltaThetaVsMult.Fill(Multiplicity, deltaTheta);
+   trkDeltaPhiVsMult.Fill(Multiplicity, deltaPhi);
+   trkDeltaEOverEVsMult.Fill(Multiplicity, deltaE / Gen[0]);
+   trkDeltaThetaVsTheta.Fill(Gen.GetTheta(), deltaTheta);
+   trkDeltaPhiVsTheta.Fill(Gen.GetTheta(), deltaPhi);
+   trkDeltaEOverEVsTheta.Fill(Gen.GetTheta(), deltaE / Gen[0]);
+
+   double meanE = (Reco[0] + Gen[0]) / 2;
+   double chiTheta, chiPhi, chiE;
+   MatchingMetric<Scheme>::Chi2(deltaTheta, deltaPhi, deltaE, meanE, chiTheta, chiPhi, chiE);
+
+   trkChiTheta.Fill(chiTheta);
+   trkChiPhi.Fill(chiPhi);
+   trkChiE.Fill(chiE);
+
+   // counting with distance cutoffs: none, 1.0, 0.4, 0.2, 0.1
+   double Cutoff[5] = {-1, 1.0, 0.4, 0.2, 0.1};
+   for(int i = 0; i < 5; i++)
+      if(Cutoff[i] < 0 || distance <= Cutoff[i])
+         nMatchedTracksInOneEvent[i]++;
 }
 
-// Matching criteria performance check
-void MatchingPerformance(string& matchedRstRootName, string& rstDirName,
-                         ParticleTreeMessenger& MGen,
-                         ParticleTreeMessenger& MReco)
+void MatchingPerformanceHistograms::EndEvent(int nGenHP, int nRecoHP)
 {
-   //------------------------------------
-   // Single-track level
-   //------------------------------------
-   TChain particleChain("MatchedTree");
-   FillChain(particleChain, {matchedRstRootName});
-   TTreeReader particleReader(&particleChain);
-
-   TTreeReaderValue<int> nParticles(   particleReader, "NParticle");
-   TTreeReaderArray<double> GenE(      particleReader, "GenE");
-   TTreeReaderArray<double> GenX(      particleReader, "GenX");
-   TTreeReaderArray<double> GenY(      particleReader, "GenY");
-   TTreeReaderArray<double> GenZ(      particleReader, "GenZ");
-   TTreeReaderArray<double> GenTheta(  particleReader, "GenTheta");
-   TTreeReaderArray<double> GenPhi(    particleReader, "GenPhi");
-   TTreeReaderArray<double> RecoE(     particleReader, "RecoE");
-   TTreeReaderArray<double> RecoX(     particleReader, "RecoX");
-   TTreeReaderArray<double> RecoY(     particleReader, "RecoY");
-   TTreeReaderArray<double> RecoZ(     particleReader, "RecoZ");
-   TTreeReaderArray<double> RecoTheta( particleReader, "RecoTheta");
-   TTreeReaderArray<double> RecoPhi(   particleReader, "RecoPhi");
-   TTreeReaderArray<double> Distance(  particleReader, "Distance");
+   nGenTracks  += nGenHP;
+   nRecoTracks += nRecoHP;
+   for(int i = 0; i < 5; i++)
+   {
+      nMatchedTracks[i]   += nMatchedTracksInOneEvent[i];
+      nUnmatchedTracks[i] += (nRecoHP - nMatchedTracksInOneEvent[i]);
+      nMatchedTracksInOneEvent[i] = 0;
+   }
+}
 
-   //------------------------------------
-   // define the histograms
-   //------------------------------------
+// Matching criteria performance check, on the histograms accumulated in the matching loop
+void MatchingPerformanceHistograms::Write(string matchedRstRootName, string rstDirName)
+{
    string PerformanceFileName(matchedRstRootName);
    PerformanceFileName.replace(PerformanceFileName.find(".root"), 5, "_performance.root");
    TFile PerformanceFile(PerformanceFileName.c_str(), "RECREATE");
    
    PerformanceFile.cd();
 
-   TH1D trkChi2Tot    ("trkChi2Tot",    "trkChi2Tot",  50, -5, 5);
-   TH1D trkChiTheta   ("trkChiTheta",  "trkChiTheta",50, -5, 5);
-   TH1D trkChiPhi     ("trkChiPhi",    "trkChiPhi",  50, -5, 5);
-   TH1D trkChiE       ("trkChiE",      "trkChiE",    50, -5, 5);
-   TH1D trkDeltaTheta ("trkDeltaTheta",  "trkDeltaTheta",50, -4, 4);
-   TH1D trkDeltaPhi   ("trkDeltaPhi",    "trkDeltaPhi",  50, -4, 4);
-   TH1D trkDeltaE     ("trkDeltaE",      "trkDeltaE",    50, -10, 10);
-   TH1D trkDeltaP     ("trkDeltaP",      "trkDeltaP",    50, -10, 10);
-   TH1D trkDeltaTheta_ge5 ("trkDeltaTheta_ge5",  "trkDeltaTheta (E>5GeV)",50, -4, 4);
-   TH1D trkDeltaPhi_ge5   ("trkDeltaPhi_ge5",    "trkDeltaPhi (E>5GeV)",  50, -4, 4);
-   TH1D trkDeltaE_ge5     ("trkDeltaE_ge5",      "trkDeltaE (E>5GeV)",    50, -10, 10);
-   TH1D trkDeltaP_ge5     ("trkDeltaP_ge5",      "trkDeltaP (E>5GeV)",    50, -10, 10);
-   TH1D trkDeltaTheta_2to5 ("trkDeltaTheta_2to5",  "trkDeltaTheta (2<E<5GeV)",50, -4, 4);
-   TH1D trkDeltaPhi_2to5   ("trkDeltaPhi_2to5",    "trkDeltaPhi (2<E<5GeV)",  50, -4, 4);
-   TH1D trkDeltaE_2to5     ("trkDeltaE_2to5",      "trkDeltaE (2<E<5GeV)",    50, -10, 10);
-   TH1D trkDeltaP_2to5     ("trkDeltaP_2to5",      "trkDeltaP (2<E<5GeV)",    50, -10, 10);
-   TH1D trkDeltaTheta_1to2 ("trkDeltaTheta_1to2",  "trkDeltaTheta (1<E<2GeV)",50, -4, 4);
-   TH1D trkDeltaPhi_1to2   ("trkDeltaPhi_1to2",    "trkDeltaPhi (1<E<2GeV)",  50, -4, 4);
-   TH1D trkDeltaE_1to2     ("trkDeltaE_1to2",      "trkDeltaE (1<E<2GeV)",    50, -10, 10);
-   TH1D trkDeltaP_1to2     ("trkDeltaP_1to2",      "trkDeltaP (1<E<2GeV)",    50, -10, 10);
-   TH1D trkDeltaTheta_le1 ("trkDeltaTheta_le1",  "trkDeltaTheta (E<1GeV)",50, -4, 4);
-   TH1D trkDeltaPhi_le1   ("trkDeltaPhi_le1",    "trkDeltaPhi (E<1GeV)",  50, -4, 4);
-   TH1D trkDeltaE_le1     ("trkDeltaE_le1",      "trkDeltaE (E<1GeV)",    50, -10, 10);
-   TH1D trkDeltaP_le1     ("trkDeltaP_le1",      "trkDeltaP (E<1GeV)",    50, -10, 10);
-
-   int nGenTracks       = 0;
-   int nRecoTracks      = 0;
-   int nMatchedTracks   = 0;
-   int nUnmatchedTracks = 0;
-   int nMatchedTracks_1p0   = 0;
-   int nUnmatchedTracks_1p0 = 0;
-   int nMatchedTracks_0p4   = 0;
-   int nUnmatchedTracks_0p4 = 0;
-   int nMatchedTracks_0p2   = 0;
-   int nUnmatchedTracks_0p2 = 0;
-   int nMatchedTracks_0p1   = 0;
-   int nUnmatchedTracks_0p1 = 0;
-   Long64_t totEvents = particleReader.GetEntries(true);
-   for (Long64_t iEvent = 0; iEvent < totEvents; iEvent++) 
-   {
-      particleReader.Next();
-
-      int nMatchedTracksInOneEvent = 0;
-      int nMatchedTracksInOneEvent_1p0 = 0;
-      int nMatchedTracksInOneEvent_0p4 = 0;
-      int nMatchedTracksInOneEvent_0p2 = 0;
-      int nMatchedTracksInOneEvent_0p1 = 0;
-      for (int iParticle = 0; iParticle < *nParticles; iParticle++) 
-      {
-         if (RecoE[iParticle]<0 || GenE[iParticle]<0) continue; // remove non-matched pairs
-
-         double deltaTheta = RecoTheta[iParticle]-GenTheta[iParticle];
-         double deltaPhi   = RecoPhi[iParticle]-GenPhi[iParticle];
-         double deltaE     = RecoE[iParticle]-GenE[iParticle];
-         double deltaP     = TMath::Sqrt(RecoX[iParticle]*RecoX[iParticle]+RecoY[iParticle]*RecoY[iParticle]+RecoZ[iParticle]*RecoZ[iParticle])-
-                             TMath::Sqrt(GenX[iParticle]*GenX[iParticle]+GenY[iParticle]*GenY[iParticle]+GenZ[iParticle]*GenZ[iParticle]);
-
-         trkChi2Tot.Fill(Distance[iParticle]);
-         trkDeltaTheta.Fill(deltaTheta);
-         trkDeltaPhi.Fill(deltaPhi);
-         trkDeltaE.Fill(deltaE);
-         trkDeltaP.Fill(deltaP);
-
-         if (RecoE[iParticle] >= 5) 
-         {
-            trkDeltaTheta_ge5.Fill(deltaTheta);
-            trkDeltaPhi_ge5.Fill(deltaPhi);
-            trkDeltaE_ge5.Fill(deltaE);
-            trkDeltaP_ge5.Fill(deltaP);
-         } 
-         else if (2 <= RecoE[iParticle] && RecoE[iParticle] < 5) 
-         {
-            trkDeltaTheta_2to5.Fill(deltaTheta);
-            trkDeltaPhi_2to5.Fill(deltaPhi);
-            trkDeltaE_2to5.Fill(deltaE);
-            trkDeltaP_2to5.Fill(deltaP);
-         }
-         else if (1 <= RecoE[iParticle] && RecoE[iParticle] < 2) 
-         {
-            trkDeltaTheta_1to2.Fill(deltaTheta);
-            trkDeltaPhi_1to2.Fill(deltaPhi);
-            trkDeltaE_1to2.Fill(deltaE);
-            trkDeltaP_1to2.Fill(deltaP);
-         }
-         else // recoE < 1
-         {
-            trkDeltaTheta_le1.Fill(deltaTheta);
-            trkDeltaPhi_le1.Fill(deltaPhi);
-            trkDeltaE_le1.Fill(deltaE);
-            trkDeltaP_le1.Fill(deltaP);
-         }
-
-         double meanE = (RecoE[iParticle] + GenE[iParticle])/2;  
-         
-         double chiTheta, chiPhi, chiE;
-         double chi2metric = MatchingMetricCore( deltaTheta, deltaPhi, deltaE,
-                                                 meanE, MatchingSchemeChoice,
-                                                 chiTheta, chiPhi, chiE);
-
-         trkChiTheta.Fill(chiTheta);
-         trkChiPhi.Fill(chiPhi);
-         trkChiE.Fill(chiE);
-
-         nMatchedTracksInOneEvent++;
-         if (Distance[iParticle]<=1.0) nMatchedTracksInOneEvent_1p0++;
-         if (Distance[iParticle]<=0.4) nMatchedTracksInOneEvent_0p4++;
-         if (Distance[iParticle]<=0.2) nMatchedTracksInOneEvent_0p2++;
-         if (Distance[iParticle]<=0.1) nMatchedTracksInOneEvent_0p1++;
-      }
-
-      MGen.GetEntry(iEvent);
-      MReco.GetEntry(iEvent);
-
-      // printf("%d %d %d %d %d %d\n", MGen.nParticle, MGen.nChargedHadronsHP, MReco.nParticle, MReco.nChargedHadronsHP, (*nParticles), nMatchedTracksInOneEvent);
-      nGenTracks       += MGen.nChargedHadronsHP;
-      nRecoTracks      += MReco.nChargedHadronsHP;
-      nMatchedTracks   += nMatchedTracksInOneEvent;
-      nUnmatchedTracks += (MReco.nChargedHadronsHP-nMatchedTracksInOneEvent);
-      nMatchedTracks_1p0   += nMatchedTracksInOneEvent_1p0;
-      nUnmatchedTracks_1p0 += (MReco.nChargedHadronsHP-nMatchedTracksInOneEvent_1p0);
-      nMatchedTracks_0p4   += nMatchedTracksInOneEvent_0p4;
-      nUnmatchedTracks_0p4 += (MReco.nChargedHadronsHP-nMatchedTracksInOneEvent_0p4);
-      nMatchedTracks_0p2   += nMatchedTracksInOneEvent_0p2;
-      nUnmatchedTracks_0p2 += (MReco.nChargedHadronsHP-nMatchedTracksInOneEvent_0p2);
-      nMatchedTracks_0p1   += nMatchedTracksInOneEvent_0p1;
-      nUnmatchedTracks_0p1 += (MReco.nChargedHadronsHP-nMatchedTracksInOneEvent_0p1);
-
-   } // end loop over the number of events
-
    printf("Summary >>>>>>>>>>>>>>>>>>>>>>>>>>>>>\n");
-   printf("Efficiency = %d/%d = %.3f\n", nMatchedTracks, nGenTracks, nMatchedTracks/((double) nGenTracks));
-   printf("Fake rate  = %d/%d = %.3f\n", nUnmatchedTracks, nRecoTracks, nUnmatchedTracks/((double) nRecoTracks));
-   printf("Efficiency = %d/%d = %.3f | cutoff = 1.0\n", nMatchedTracks_1p0, nGenTracks, nMatchedTracks_1p0/((double) nGenTracks));
-   printf("Fake rate  = %d/%d = %.3f | cutoff = 1.0\n", nUnmatchedTracks_1p0, nRecoTracks, nUnmatchedTracks_1p0/((double) nRecoTracks));
-   printf("Efficiency = %d/%d = %.3f | cutoff = 0.4\n", nMatchedTracks_0p4, nGenTracks, nMatchedTracks_0p4/((double) nGenTracks));
-   printf("Fake rate  = %d/%d = %.3f | cutoff = 0.4\n", nUnmatchedTracks_0p4, nRecoTracks, nUnmatchedTracks_0p4/((double) nRecoTracks));
-   printf("Efficiency = %d/%d = %.3f | cutoff = 0.2\n", nMatchedTracks_0p2, nGenTracks, nMatchedTracks_0p2/((double) nGenTracks));
-   printf("Fake rate  = %d/%d = %.3f | cutoff = 0.2\n", nUnmatchedTracks_0p2, nRecoTracks, nUnmatchedTracks_0p2/((double) nRecoTracks));
-   printf("Efficiency = %d/%d = %.3f | cutoff = 0.1\n", nMatchedTracks_0p1, nGenTracks, nMatchedTracks_0p1/((double) nGenTracks));
-   printf("Fake rate  = %d/%d = %.3f | cutoff = 0.1\n", nUnmatchedTracks_0p1, nRecoTracks, nUnmatchedTracks_0p1/((double) nRecoTracks));
+   printf("Efficiency = %d/%d = %.3f\n", nMatchedTracks[0], nGenTracks, nMatchedTracks[0]/((double) nGenTracks));
+   printf("Fake rate  = %d/%d = %.3f\n", nUnmatchedTracks[0], nRecoTracks, nUnmatchedTracks[0]/((double) nRecoTracks));
+   string CutoffLabel[5] = {"", "1.0", "0.4", "0.2", "0.1"};
+   for(int i = 1; i < 5; i++)
+   {
+      printf("Efficiency = %d/%d = %.3f | cutoff = %s\n", nMatchedTracks[i], nGenTracks, nMatchedTracks[i]/((double) nGenTracks), CutoffLabel[i].c_str());
+      printf("Fake rate  = %d/%d = %.3f | cutoff = %s\n", nUnmatchedTracks[i], nRecoTracks, nUnmatchedTracks[i]/((double) nRecoTracks), CutoffLabel[i].c_str());
+   }
    printf("End Summary <<<<<<<<<<<<<<<<<<<<<<<<<\n");
 
-   trkChi2Tot.Write();
-   trkChiTheta.Write();
-   trkChiPhi.Write();
-   trkChiE.Write();
-   trkDeltaTheta.Write();
-   trkDeltaPhi.Write();
-   trkDeltaE.Write();
-   trkDeltaP.Write();
-   trkDeltaTheta_ge5.Write();
-   trkDeltaPhi_ge5.Write();
-   trkDeltaE_ge5.Write();
-   trkDeltaP_ge5.Write();
-   trkDeltaTheta_2to5.Write();
-   trkDeltaPhi_2to5.Write();
-   trkDeltaE_2to5.Write();
-   trkDeltaP_2to5.Write();
-   trkDeltaTheta_1to2.Write();
-   trkDeltaPhi_1to2.Write();
-   trkDeltaE_1to2.Write();
-   trkDeltaP_1to2.Write();
-   trkDeltaTheta_le1.Write();
-   trkDeltaPhi_le1.Write();
-   trkDeltaE_le1.Write();
-   trkDeltaP_le1.Write();
+   for(TH1 *H : AllHistograms())
+      H->Write();
 
    auto plotResolution = [](TH1D& h, string rstDirName, 
                             bool doFit=true, bool logy=false)
@@ -876,30 +1327,13 @@ void MatchingPerformance(string& matchedRstRootName, string& rstDirName,
    plotResolution(trkChiPhi, rstDirName);
    plotResolution(trkChiE, rstDirName);
 
-   plotResolution(trkDeltaTheta, rstDirName, false, true);
-   plotResolution(trkDeltaPhi, rstDirName, false, true);
-   plotResolution(trkDeltaE, rstDirName, false, true);
-   plotResolution(trkDeltaP, rstDirName, false, true);
-
-   plotResolution(trkDeltaTheta_ge5, rstDirName, false, true);
-   plotResolution(trkDeltaPhi_ge5, rstDirName, false, true);
-   plotResolution(trkDeltaE_ge5, rstDirName, false, true);
-   plotResolution(trkDeltaP_ge5, rstDirName, false, true);
-
-   plotResolution(trkDeltaTheta_2to5, rstDirName, false, true);
-   plotResolution(trkDeltaPhi_2to5, rstDirName, false, true);
-   plotResolution(trkDeltaE_2to5, rstDirName, false, true);
-   plotResolution(trkDeltaP_2to5, rstDirName, false, true);
-
-   plotResolution(trkDeltaTheta_1to2, rstDirName, false, true);
-   plotResolution(trkDeltaPhi_1to2, rstDirName, false, true);
-   plotResolution(trkDeltaE_1to2, rstDirName, false, true);
-   plotResolution(trkDeltaP_1to2, rstDirName, false, true);
-
-   plotResolution(trkDeltaTheta_le1, rstDirName, false, true);
-   plotResolution(trkDeltaPhi_le1, rstDirName, false, true);
-   plotResolution(trkDeltaE_le1, rstDirName, false, true);
-   plotResolution(trkDeltaP_le1, rstDirName, false, true);
+   for(int i = 0; i < 5; i++)
+   {
+      plotResolution(trkDeltaTheta[i], rstDirName, false, true);
+      plotResolution(trkDeltaPhi[i], rstDirName, false, true);
+      plotResolution(trkDeltaE[i], rstDirName, false, true);
+      plotResolution(trkDeltaP[i], rstDirName, false, true);
+   }
 
    PerformanceFile.Close();
 }
@@ -0,0 +1,371 @@
+// ./ExeUnfoldingToys --Input matchingScheme2/unfoldingHistograms.root --Output matchingScheme2/UnfoldingToys_E1E2.root \
+//                    --Prefix hE1E2 --Toys 500 --Iterations 4 --Threads 8 --Seed 42
+// The response only holds matched entries, so the measured spectrum has to be free of fakes.  The default
+// <Prefix>Smeared is matched-only and is unfolded as it is; for a spectrum that includes fakes (data, or
+// the full reco-level MC) give --Fake <Prefix>Fake, and every measured bin is scaled by the MC purity
+// matched / (matched + fake) before unfolding, in the nominal result and in every toy
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+#include "TRandom3.h"
+#include "TFile.h"
+#include "TH1D.h"
+#include "TH2D.h"
+
+#include "CommandLine.h"
+#include "ProgressBar.h"
+
+// One non-empty bin of the response matrix.  The structure (which bins are filled) is fixed,
+// only Value is fluctuated toy by toy, so the unfolding loops never touch empty bins
+struct ResponseEntry
+{
+   int Reco;
+   int Gen;
+   double Value;
+   double Error;
+};
+
+struct UnfoldingInput
+{
+   int NReco;
+   int NGen;
+   vector<ResponseEntry> Response;
+   vector<double> Measured;        // reco-level spectrum to be unfolded
+   vector<double> MeasuredError;
+   vector<double> Purity;          // matched / (matched + fake) per reco bin, 1 without --Fake
+   vector<double> Truth;           // gen-level spectrum of the MC used to build the response
+   vector<double> Miss;            // Truth minus what is already in the response (fixed in the toys)
+};
+
+int main(int argc, char *argv[]);
+UnfoldingInput ReadUnfoldingInput(TFile &File, string MeasuredName, string ResponseName, string TruthName,
+   string FakeName);
+unsigned int ToySeed(unsigned int Seed, int iT);
+vector<double> RemoveFakes(const UnfoldingInput &Input, const vector<double> &Measured);
+double PoissonFluctuate(TRandom3 &Random, double Content, double Error);
+vector<double> UnfoldBayes(const UnfoldingInput &Input, const vector<ResponseEntry> &Response,
+   const vector<double> &Measured, int Iterations);
+void RunToy(const UnfoldingInput &Input, int Iterations, unsigned int Seed,
+   vector<double> &ResultStat, vector<double> &ResultResponse, vector<double> &ResultTotal);
+TH2D *MakeCovariance(string Name, const vector<vector<double>> &Results, TH1D &Binning);
+TH1D *MakeSpectrum(string Name, const vector<double> &Values, TH1D &Binning);
+
+int main(int argc, char *argv[])
+{
+   CommandLine CL(argc, argv);
+
+   string InputFileName  = CL.Get("Input");
+   string OutputFileName = CL.Get("Output", "UnfoldingToys.root");
+   string Prefix         = CL.Get("Prefix", "hE1E2");
+   string MeasuredName   = CL.Get("Measured", Prefix + "Smeared");
+   string ResponseName   = CL.Get("Response", Prefix + "Resp");
+   string TruthName      = CL.Get("Truth", Prefix + "Gen");
+   string FakeName       = CL.Get("Fake", "");   // off: the measured spectrum is already free of fakes
+   int Iterations        = CL.GetInt("Iterations", 4);
+   int ToyCount          = CL.GetInt("Toys", 500);
+   int ThreadCount       = max(1, CL.GetInt("Threads", (int)thread::hardware_concurrency()));
+   unsigned int Seed     = CL.GetInt("Seed", 42);
+
+   TFile InputFile(InputFileName.c_str());
+   UnfoldingInput Input = ReadUnfoldingInput(InputFile, MeasuredName, ResponseName, TruthName, FakeName);
+
+   TH1D *HTruth = (TH1D *)InputFile.Get(TruthName.c_str());
+   TH1D HBinning(*HTruth);
+   HBinning.SetDirectory(nullptr);
+   HBinning.Reset();
+
+   cout << "Response " << ResponseName << ": " << Input.NReco << " x " << Input.NGen
+      << " bins, " << Input.Response.size() << " non-empty" << endl;
+
+   vector<double> Nominal = UnfoldBayes(Input, Input.Response, RemoveFakes(Input, Input.Measured), Iterations);
+
+   // every toy writes into its own slot, so the covariance does not depend on the thread scheduling
+   vector<vector<double>> ResultStat(ToyCount), ResultResponse(ToyCount), ResultTotal(ToyCount);
+
+   atomic<int> NextToy(0);
+   atomic<int> DoneToy(0);
+   auto Worker = [&]()
+   {
+      while(true)
+      {
+         int iT = NextToy++;
+         if(iT >= ToyCount)
+            break;
+         RunToy(Input, Iterations, ToySeed(Seed, iT), ResultStat[iT], ResultResponse[iT], ResultTotal[iT]);
+         DoneToy++;
+      }
+   };
+
+   auto StartTime = chrono::steady_clock::now();
+
+   vector<thread> Threads;
+   for(int i = 0; i < ThreadCount; i++)
+      Threads.emplace_back(Worker);
+
+   ProgressBar Bar(cout, ToyCount);
+   Bar.SetStyle(-1);
+   while(DoneToy < ToyCount)
+   {
+      Bar.Update(DoneToy);
+      Bar.Print();
+      this_thread::sleep_for(chrono::milliseconds(250));
+   }
+   for(thread &T : Threads)
+      T.join();
+   Bar.Update(ToyCount);
+   Bar.Print();
+   Bar.PrintLine();
+
+   double Seconds = chrono::duration<double>(chrono::steady_clock::now() - StartTime).count();
+   cout << ToyCount << " toys x 3 unfoldings on " << ThreadCount << " threads in " << Seconds << " s" << endl;
+
+   TFile OutputFile(OutputFileName.c_str(), "RECREATE");
+
+   MakeSpectrum(Prefix + "Unfolded", Nominal, HBinning)->Write();
+   MakeCovariance(Prefix + "CovarianceStat", ResultStat, HBinning)->Write();
+   MakeCovariance(Prefix + "CovarianceResponse", ResultResponse, HBinning)->Write();
+   MakeCovariance(Prefix + "CovarianceTotal", ResultTotal, HBinning)->Write();
+
+   OutputFile.Close();
+   InputFile.Close();
+
+   return 0;
+}
+
+UnfoldingInput ReadUnfoldingInput(TFile &File, string MeasuredName, string ResponseName, string TruthName,
+   string FakeName)
+{
+   TH1D *HMeasured = (TH1D *)File.Get(MeasuredName.c_str());
+   TH2D *HResponse = (TH2D *)File.Get(ResponseName.c_str());
+   TH1D *HTruth    = (TH1D *)File.Get(TruthName.c_str());
+
+   if(HMeasured == nullptr || HResponse == nullptr || HTruth == nullptr)
+   {
+      cerr << "Missing unfolding inputs " << MeasuredName << ", " << ResponseName << ", " << TruthName << endl;
+      exit(1);
+   }
+
+   UnfoldingInput Input;
+
+   // response is (reco, gen) as written by createUnfoldingHistograms.C
+   Input.NReco = HResponse->GetNbinsX();
+   Input.NGen  = HResponse->GetNbinsY();
+
+   if(HMeasured->GetNbinsX() != Input.NReco || HTruth->GetNbinsX() != Input.NGen)
+   {
+      cerr << "Binning of " << MeasuredName << " / " << TruthName << " does not match " << ResponseName << endl;
+      exit(1);
+   }
+
+   vector<double> ColumnSum(Input.NGen, 0);
+   for(int iG = 0; iG < Input.NGen; iG++)
+   {
+      for(int iR = 0; iR < Input.NReco; iR++)
+      {
+         double Value = HResponse->GetBinContent(iR + 1, iG + 1);
+         if(Value <= 0)
+            continue;
+         Input.Response.push_back(ResponseEntry{iR, iG, Value, HResponse->GetBinError(iR + 1, iG + 1)});
+         ColumnSum[iG] = ColumnSum[iG] + Value;
+      }
+   }
+
+   Input.Measured.resize(Input.NReco);
+   Input.MeasuredError.resize(Input.NReco);
+   for(int iR = 0; iR < Input.NReco; iR++)
+   {
+      Input.Measured[iR] = HMeasured->GetBinContent(iR + 1);
+      Input.MeasuredError[iR] = HMeasured->GetBinError(iR + 1);
+   }
+
+   // purity from the reco-level projection of the response and the fakes of the same MC
+   Input.Purity.assign(Input.NReco, 1);
+   if(FakeName != "")
+   {
+      TH1D *HFake = (TH1D *)File.Get(FakeName.c_str());
+      if(HFake == nullptr || HFake->GetNbinsX() != Input.NReco)
+      {
+         cerr << "Fake spectrum " << FakeName << " missing or not binned like " << MeasuredName << endl;
+         exit(1);
+      }
+      vector<double> Matched(Input.NReco, 0);
+      for(const ResponseEntry &E : Input.Response)
+         Matched[E.Reco] = Matched[E.Reco] + E.Value;
+      for(int iR = 0; iR < Input.NReco; iR++)
+      {
+         double Total = Matched[iR] + HFake->GetBinContent(iR + 1);
+         Input.Purity[iR] = (Total > 0) ? Matched[iR] / Total : 0;
+      }
+   }
+
+   Input.Truth.resize(Input.NGen);
+   Input.Miss.resize(Input.NGen);
+   for(int iG = 0; iG < Input.NGen; iG++)
+   {
+      Input.Truth[iG] = max(HTruth->GetBinContent(iG + 1), ColumnSum[iG]);
+      Input.Miss[iG] = Input.Truth[iG] - ColumnSum[iG];
+   }
+
+   return Input;
+}
+
+// splitmix64 of the job seed and the toy index; TRandom3 seeds from the clock on 0, so 0 is never returned
+unsigned int ToySeed(unsigned int Seed, int iT)
+{
+   uint64_t X = ((uint64_t)Seed << 32) + (uint64_t)iT + 0x9E3779B97F4A7C15ULL;
+   X = (X ^ (X >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   X = (X ^ (X >> 27)) * 0x94D049BB133111EBULL;
+   X = X ^ (X >> 31);
+   unsigned int Result = (unsigned int)(X >> 32);
+   return (Result == 0) ? 1 : Result;
+}
+
+vector<double> RemoveFakes(const UnfoldingInput &Input, const vector<double> &Measured)
+{
+   vector<double> Result(Measured);
+   for(int iR = 0; iR < Input.NReco; iR++)
+      Result[iR] = Result[iR] * Input.Purity[iR];
+   return Result;
+}
+
+double PoissonFluctuate(TRandom3 &Random, double Content, double Error)
+{
+   if(Content <= 0)
+      return 0;
+
+   // weighted bins: fluctuate the effective number of entries and scale back
+   if(Error <= 0)
+      return Random.Poisson(Content);
+   double NEffective = Content * Content / (Error * Error);
+   return Random.Poisson(NEffective) * Content / NEffective;
+}
+
+vector<double> UnfoldBayes(const UnfoldingInput &Input, const vector<ResponseEntry> &Response,
+   const vector<double> &Measured, int Iterations)
+{
+   int NReco = Input.NReco;
+   int NGen = Input.NGen;
+
+   // truth of this (possibly fluctuated) response: filled part plus the fixed misses
+   vector<double> Truth(Input.Miss);
+   for(const ResponseEntry &E : Response)
+      Truth[E.Gen] = Truth[E.Gen] + E.Value;
+
+   vector<double> Efficiency(NGen, 0);
+   for(const ResponseEntry &E : Response)
+      Efficiency[E.Gen] = Efficiency[E.Gen] + E.Value;
+   for(int iG = 0; iG < NGen; iG++)
+      Efficiency[iG] = (Truth[iG] > 0) ? Efficiency[iG] / Truth[iG] : 0;
+
+   double TruthSum = 0;
+   for(int iG = 0; iG < NGen; iG++)
+      TruthSum = TruthSum + Truth[iG];
+
+   vector<double> Prior(NGen, 0);
+   for(int iG = 0; iG < NGen; iG++)
+      Prior[iG] = (TruthSum > 0) ? Truth[iG] / TruthSum : 0;
+
+   vector<double> Folded(NReco);
+   vector<double> Unfolded(NGen);
+
+   for(int iI = 0; iI < Iterations; iI++)
+   {
+      // P(r) = sum_g P(r|g) P(g), with P(r|g) = R(r,g) / Truth(g)
+      fill(Folded.begin(), Folded.end(), 0);
+      for(const ResponseEntry &E : Response)
+         Folded[E.Reco] = Folded[E.Reco] + E.Value / Truth[E.Gen] * Prior[E.Gen];
+
+      fill(Unfolded.begin(), Unfolded.end(), 0);
+      for(const ResponseEntry &E : Response)
+      {
+         if(Folded[E.Reco] <= 0)
+            continue;
+         double Posterior = E.Value / Truth[E.Gen] * Prior[E.Gen] / Folded[E.Reco];
+         Unfolded[E.Gen] = Unfolded[E.Gen] + Posterior * Measured[E.Reco];
+      }
+
+      double Sum = 0;
+      for(int iG = 0; iG < NGen; iG++)
+      {
+         Unfolded[iG] = (Efficiency[iG] > 0) ? Unfolded[iG] / Efficiency[iG] : 0;
+         Sum = Sum + Unfolded[iG];
+      }
+      for(int iG = 0; iG < NGen; iG++)
+         Prior[iG] = (Sum > 0) ? Unfolded[iG] / Sum : 0;
+   }
+
+   return Unfolded;
+}
+
+void RunToy(const UnfoldingInput &Input, int Iterations, unsigned int Seed,
+   vector<double> &ResultStat, vector<double> &ResultResponse, vector<double> &ResultTotal)
+{
+   // each toy owns its random stream: the results do not depend on which thread picked it up
+   TRandom3 Random(Seed);
+
+   // the raw measured spectrum is fluctuated, the fakes are removed afterwards with the fixed MC purity
+   vector<double> Measured(Input.NReco);
+   for(int iR = 0; iR < Input.NReco; iR++)
+      Measured[iR] = PoissonFluctuate(Random, Input.Measured[iR], Input.MeasuredError[iR]);
+   Measured = RemoveFakes(Input, Measured);
+   vector<double> NominalMeasured = RemoveFakes(Input, Input.Measured);
+
+   vector<ResponseEntry> Response(Input.Response);
+   for(ResponseEntry &E : Response)
+      E.Value = PoissonFluctuate(Random, E.Value, E.Error);
+
+   ResultStat     = UnfoldBayes(Input, Input.Response, Measured, Iterations);
+   ResultResponse = UnfoldBayes(Input, Response, NominalMeasured, Iterations);
+   ResultTotal    = UnfoldBayes(Input, Response, Measured, Iterations);
+}
+
+TH2D *MakeCovariance(string Name, const vector<vector<double>> &Results, TH1D &Binning)
+{
+   int N = Binning.GetNbinsX();
+   int ToyCount = Results.size();
+
+   vector<double> Mean(N, 0);
+   for(int iT = 0; iT < ToyCount; iT++)
+      for(int i = 0; i < N; i++)
+         Mean[i] = Mean[i] + Results[iT][i] / ToyCount;
+
+   TH2D *H = nullptr;
+   const TArrayD *Edges = Binning.GetXaxis()->GetXbins();
+   if(Edges->GetSize() > 0)
+      H = new TH2D(Name.c_str(), ";Gen bin;Gen bin", N, Edges->GetArray(), N, Edges->GetArray());
+   else
+      H = new TH2D(Name.c_str(), ";Gen bin;Gen bin",
+         N, Binning.GetXaxis()->GetXmin(), Binning.GetXaxis()->GetXmax(),
+         N, Binning.GetXaxis()->GetXmin(), Binning.GetXaxis()->GetXmax());
+
+   if(ToyCount < 2)
+      return H;
+
+   for(int i = 0; i < N; i++)
+   {
+      for(int j = 0; j < N; j++)
+      {
+         double Sum = 0;
+         for(int iT = 0; iT < ToyCount; iT++)
+            Sum = Sum + (Results[iT][i] - Mean[i]) * (Results[iT][j] - Mean[j]);
+         H->SetBinContent(i + 1, j + 1, Sum / (ToyCount - 1));
+      }
+   }
+
+   return H;
+}
+
+TH1D *MakeSpectrum(string Name, const vector<double> &Values, TH1D &Binning)
+{
+   TH1D *H = (TH1D *)Binning.Clone(Name.c_str());
+   for(int i = 0; i < (int)Values.size(); i++)
+      H->SetBinContent(i + 1, Values[i]);
+   return H;
+}
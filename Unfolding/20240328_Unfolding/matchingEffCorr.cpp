@@ -21,6 +21,7 @@ using namespace std;
 #include "TLegend.h"
 
 #include "Messenger.h"
+#include "RNTupleIO.h"
 #include "CommandLine.h"
 #include "Matching.h"
 #include "ProgressBar.h"
@@ -35,13 +36,6 @@ void MakeCanvas(vector<TH1D>& Histograms, vector<string> Labels, string Output,
 void SetPad(TPad &P); 
 void DivideByBin(TH1D &H, double Bins[]); 
 
-// can we put this in the CommonCode/ ?
-void FillChain(TChain &chain, const vector<string> &files) {
-  for (auto file : files) {
-    chain.Add(file.c_str());
-  }
-}
-
 int main(int argc, char *argv[])
 {
    CommandLine CL(argc, argv);
@@ -59,32 +53,14 @@ int main(int argc, char *argv[])
 
    double TotalE = 91.1876;
 
-   TChain MatchedTreeChain(MatchedTreeName.c_str());
-   FillChain(MatchedTreeChain, {InputFileName});
-   TTreeReader MatchedReader(&MatchedTreeChain);
-
-   TTreeReaderValue<int> Matched_NPair(   MatchedReader, "NPair");
-   // TTreeReaderArray<double> Matched_GenE1(      MatchedReader, "GenE1");
-   // TTreeReaderArray<double> Matched_GenX1(      MatchedReader, "GenX1");
-   // TTreeReaderArray<double> Matched_GenY1(      MatchedReader, "GenY1");
-   // TTreeReaderArray<double> Matched_GenZ1(      MatchedReader, "GenZ1");
-   // TTreeReaderArray<double> Matched_GenE2(      MatchedReader, "GenE2");
-   // TTreeReaderArray<double> Matched_GenX2(      MatchedReader, "GenX2");
-   // TTreeReaderArray<double> Matched_GenY2(      MatchedReader, "GenY2");
-   // TTreeReaderArray<double> Matched_GenZ2(      MatchedReader, "GenZ2");
-   // TTreeReaderArray<double> Matched_Distance1(  MatchedReader, "Distance1");
-   // TTreeReaderArray<double> Matched_Distance2(  MatchedReader, "Distance2");
-   TTreeReaderArray<double> Matched_DistanceGen(MatchedReader, "DistanceGen");
-   TTreeReaderArray<double> Matched_E1E2Gen(    MatchedReader, "E1E2Gen");
-
-
-   TChain UnmatchedTreeChain(UnmatchedTreeName.c_str());
-   FillChain(UnmatchedTreeChain, {InputFileName});
-   TTreeReader UnmatchedReader(&UnmatchedTreeChain);
-
-   TTreeReaderValue<int> NUnmatchedPair(          UnmatchedReader, "NUnmatchedPair");
-   TTreeReaderArray<double> DistanceUnmatchedGen( UnmatchedReader, "DistanceUnmatchedGen");
-   TTreeReaderArray<double> E1E2GenUnmatched(     UnmatchedReader, "E1E2GenUnmatched");
+   // the pair trees can be TTrees or RNTuples, CollectionReader handles both
+   CollectionReader MatchedReader(InputFileName, MatchedTreeName, "NPair", {"DistanceGen", "E1E2Gen"});
+   vector<double> &Matched_DistanceGen = MatchedReader.Arrays[0];
+   vector<double> &Matched_E1E2Gen     = MatchedReader.Arrays[1];
+
+   CollectionReader UnmatchedReader(InputFileName, UnmatchedTreeName, "NUnmatchedPair", {"DistanceUnmatchedGen", "E1E2GenUnmatched"});
+   vector<double> &DistanceUnmatchedGen = UnmatchedReader.Arrays[0];
+   vector<double> &E1E2GenUnmatched     = UnmatchedReader.Arrays[1];
 
    //------------------------------------
    // define the binning
@@ -169,13 +145,13 @@ int main(int argc, char *argv[])
    // -------------------------------------
    // loop over the tree after gen-matching
    // -------------------------------------
-   int EntryCount = MatchedReader.GetEntries(true);
+   int EntryCount = MatchedReader.GetEntries();
    for(int iE = 0; iE < EntryCount; iE++)
    {
-      MatchedReader.Next();
+      MatchedReader.GetEntry(iE);
 
       // calculate and fill the EECs
-      for (int iPair = 0; iPair < *Matched_NPair; iPair++) 
+      for (int iPair = 0; iPair < MatchedReader.Count; iPair++) 
       {
          // get the proper bins
          int BinThetaGen  = FindBin(Matched_DistanceGen[iPair], 2 * BinCount, Bins);
@@ -206,13 +182,13 @@ int main(int argc, char *argv[])
    // -------------------------------------
    // loop over the tree before gen-matching
    // -------------------------------------
-   int EntryCountBefore = UnmatchedReader.GetEntries(true);
+   int EntryCountBefore = UnmatchedReader.GetEntries();
    for(int iE = 0; iE < EntryCountBefore; iE++)
    {
-      UnmatchedReader.Next();
+      UnmatchedReader.GetEntry(iE);
 
       // calculate and fill the EECs
-      for (int iPair = 0; iPair < *NUnmatchedPair; iPair++) 
+      for (int iPair = 0; iPair < UnmatchedReader.Count; iPair++) 
       {
          // get the proper bins
          int BinThetaGen  = FindBin(DistanceUnmatchedGen[iPair], 2 * BinCount, Bins);
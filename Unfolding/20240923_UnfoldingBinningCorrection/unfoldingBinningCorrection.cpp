@@ -26,6 +26,7 @@ using namespace std;
 #include "TauHelperFunctions3.h"
 #include "SetStyle.h"
 #include "EffCorrFactor.h"
+#include "RunMetadata.h"
 
 int main(int argc, char *argv[]);
 int FindBin(double Value, int NBins, double Bins[]); 
@@ -52,6 +53,9 @@ int main(int argc, char *argv[])
    string UnfoldingBinCorrFileName     = CL.Get("UnfoldingBinCorrName", "UnfoldingBinCorr.root");
    string UnfoldingBinCorrArgName      = CL.Get("UnfoldingBinCorrArgName", "z"); // theta
    bool MakeUnfoldingBinCorrFactor     = CL.GetBool("MakeUnfoldingBinCorrFactor", false);
+   // matched MC file whose event count normalizes the histograms; read from its metadata when present
+   string NormalizationFileName        = CL.Get("Normalization", "/data/janicechen/PhysicsEEJetEEC/Unfolding/20240328_Unfolding/v2/LEP1MC1994_recons_aftercut-001_Matched.root");
+   string NormalizationTreeName        = CL.Get("NormalizationTree", "PairTree");
    TFile InputFile(InputFileName.c_str());
 
    string Projected2DUnfoldingName     =  (UnfoldingBinCorrArgName=="theta")? "h1True_Theta_ProjectionX":
@@ -124,10 +128,8 @@ int main(int argc, char *argv[])
     
    }
 
-  TString fnamemc = "/data/janicechen/PhysicsEEJetEEC/Unfolding/20240328_Unfolding/v2/LEP1MC1994_recons_aftercut-001_Matched.root";
-  TFile *inputmc =TFile::Open(fnamemc);
-  TTree *mc=(TTree*)inputmc->Get("PairTree"); 
-  double nEv2=mc->GetEntries();
+   double nEv2 = GetEventCount(NormalizationFileName, NormalizationTreeName);
+   printf("[INFO] normalizing to %.0f events from %s\n", nEv2, NormalizationFileName.c_str());
 
    h1_Projected2DUnfolding_Z.Scale(1.0/nEv2); 
    h1_MCGen1D_Z.Scale(1.0/nEv2);